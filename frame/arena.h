@@ -0,0 +1,312 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <new>
+#include <thread>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <cstddef>
+#include <stdint.h>
+
+namespace inf {
+namespace frame {
+
+const int64_t DEFAULT_ARENA_BLOCK_SIZE = 4096;
+const int64_t MAX_POOLED_ARENA_NUM = 4;
+const int64_t ARENA_SHRINK_RATIO = 4;
+
+/**
+ * @class Arena.
+ * request scoped monotonic allocator. memory is only given back by reset(),
+ * all at once, destructors of the objects created by create() run there in
+ * reverse order.
+ * reset keeps one block sized to the high-water mark of the previous round,
+ * so a steady request needs no malloc at all, a block far larger than needed
+ * is given back.
+ * allocation is guarded by a spin lock, the parallel tasks of one request may share it.
+ * e.g.:
+ * auto arena = ArenaPool::acquire();
+ * Item *item = arena->create<Item>(args...);
+ * ArenaAllocator<Item> allocator(arena.get());
+ * std::vector<Item, ArenaAllocator<Item>> items(allocator);
+ **/
+class Arena {
+public:
+    /**
+    * ctor.
+    * @param initial_size size of the first block
+    */
+    explicit Arena(const int64_t initial_size = DEFAULT_ARENA_BLOCK_SIZE)
+        : _initial_size(std::max<int64_t>(initial_size, DEFAULT_ARENA_BLOCK_SIZE)) {};
+
+    /* dtor. */
+    virtual ~Arena() {
+        destroy_objects();
+        free_blocks();
+    }
+
+    /**
+    * allocate raw memory.
+    * @param size bytes
+    * @param align alignment, power of 2
+    * @return memory, never nullptr, throws std::bad_alloc like new
+    */
+    void* allocate(const size_t size, const size_t align = alignof(std::max_align_t)) {
+        SpinGuard guard(_spin_lock);
+        return allocate_locked(size, align);
+    }
+
+    /**
+    * construct an object in the arena, its destructor runs at reset().
+    * @param args ctor args
+    * @return object
+    */
+    template <typename DataType, typename ...Args>
+    DataType* create(Args&& ...args) {
+        SpinGuard guard(_spin_lock);
+        void *memory = allocate_locked(sizeof(DataType), alignof(DataType));
+        DataType *object = new (memory) DataType(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<DataType>::value) {
+            DestructorNode *node = static_cast<DestructorNode*>(
+                    allocate_locked(sizeof(DestructorNode), alignof(DestructorNode)));
+            node->_destroy = &destroy_object<DataType>;
+            node->_object = object;
+            node->_next = _destructor_head;
+            _destructor_head = node;
+        }
+        return object;
+    }
+
+    /**
+    * destroy every object and release the memory at once.
+    * the next round starts with one block of the high-water size.
+    */
+    void reset() {
+        SpinGuard guard(_spin_lock);
+        destroy_objects();
+        _high_water_bytes = _used_bytes;
+        int64_t expected_size = std::max(DEFAULT_ARENA_BLOCK_SIZE, round_up(_high_water_bytes));
+        int64_t block_size = _blocks.empty() ? 0 : _blocks[0]._size;
+        if (_blocks.size() > 1 || block_size < expected_size || 
+                block_size > expected_size * ARENA_SHRINK_RATIO) {
+            free_blocks();
+            _initial_size = expected_size;
+        }
+        _block_offset = 0;
+        _used_bytes = 0;
+    }
+
+    /* bytes allocated in this round. */
+    int64_t get_used_bytes() const {
+        return _used_bytes;
+    }
+
+    /* bytes used by the previous round. */
+    int64_t get_high_water_bytes() const {
+        return _high_water_bytes;
+    }
+
+    /* malloc'ed block num. */
+    int64_t get_block_num() const {
+        return _blocks.size();
+    }
+
+private:
+    /* memory block. */
+    struct Block {
+        char        *_data;
+        size_t      _size;
+    };
+
+    /* destructor list, in arena memory. */
+    struct DestructorNode {
+        void            (*_destroy)(void*);
+        void            *_object;
+        DestructorNode  *_next;
+    };
+
+    /* uncontended most of the time. */
+    class SpinGuard {
+    public:
+        explicit SpinGuard(std::atomic_flag &flag) : _flag(flag) {
+            while (_flag.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+        ~SpinGuard() {
+            _flag.clear(std::memory_order_release);
+        }
+    private:
+        std::atomic_flag &_flag;
+    };
+
+    /* none copy. */
+    Arena(const Arena &rhs) = delete;
+    Arena &operator=(const Arena &rhs) = delete;
+
+    template <typename DataType>
+    static void destroy_object(void *object) {
+        static_cast<DataType*>(object)->~DataType();
+    }
+
+    static int64_t round_up(const int64_t size) {
+        return (size + DEFAULT_ARENA_BLOCK_SIZE - 1) / DEFAULT_ARENA_BLOCK_SIZE * DEFAULT_ARENA_BLOCK_SIZE;
+    }
+
+    void* allocate_locked(const size_t size, const size_t align) {
+        if (!_blocks.empty()) {
+            Block &block = _blocks.back();
+            uintptr_t base = reinterpret_cast<uintptr_t>(block._data);
+            size_t offset = ((base + _block_offset + align - 1) & ~(align - 1)) - base;
+            if (offset + size <= block._size) {
+                _used_bytes += offset + size - _block_offset;
+                _block_offset = offset + size;
+                return block._data + offset;
+            }
+        }
+        //new block, doubled each time, large allocation gets its own
+        size_t block_size = _blocks.empty() ? _initial_size : _blocks.back()._size * 2;
+        block_size = std::max(block_size, size + align);
+        char *data = static_cast<char*>(::operator new(block_size));
+        _blocks.push_back(Block{data, block_size});
+        size_t offset = (reinterpret_cast<uintptr_t>(data) + align - 1) & ~(align - 1);
+        offset -= reinterpret_cast<uintptr_t>(data);
+        _block_offset = offset + size;
+        _used_bytes += _block_offset;
+        return data + offset;
+    }
+
+    void destroy_objects() {
+        for (DestructorNode *node = _destructor_head; node != nullptr; node = node->_next) {
+            node->_destroy(node->_object);
+        }
+        _destructor_head = nullptr;
+    }
+
+    void free_blocks() {
+        for (auto &block : _blocks) {
+            ::operator delete(block._data);
+        }
+        _blocks.clear();
+    }
+
+    /* blocks, the last one is in use. */
+    std::vector<Block>      _blocks;
+    /* offset in the last block. */
+    size_t                  _block_offset{0};
+    /* size of the first block. */
+    int64_t                 _initial_size;
+    /* bytes of this round. */
+    int64_t                 _used_bytes{0};
+    /* bytes of the previous round. */
+    int64_t                 _high_water_bytes{0};
+    /* objects to destroy, the latest first. */
+    DestructorNode          *_destructor_head{nullptr};
+    /* guard allocation. */
+    std::atomic_flag        _spin_lock = ATOMIC_FLAG_INIT;
+};
+
+/**
+ * @class ArenaAllocator.
+ * stl allocator on an Arena, deallocate does nothing.
+ **/
+template <typename DataType>
+class ArenaAllocator {
+public:
+    using value_type = DataType;
+
+    /* ctor. */
+    explicit ArenaAllocator(Arena *arena) : _arena(arena) {};
+
+    template <typename OtherType>
+    ArenaAllocator(const ArenaAllocator<OtherType> &rhs) : _arena(rhs.get_arena()) {};
+
+    DataType* allocate(const size_t num) {
+        return static_cast<DataType*>(_arena->allocate(num * sizeof(DataType), alignof(DataType)));
+    }
+
+    /* memory goes back with the arena. */
+    void deallocate(DataType *, const size_t) {
+    }
+
+    Arena* get_arena() const {
+        return _arena;
+    }
+
+    template <typename OtherType>
+    bool operator==(const ArenaAllocator<OtherType> &rhs) const {
+        return _arena == rhs.get_arena();
+    }
+
+    template <typename OtherType>
+    bool operator!=(const ArenaAllocator<OtherType> &rhs) const {
+        return _arena != rhs.get_arena();
+    }
+
+private:
+    Arena *_arena;
+};
+
+/**
+ * @class ArenaPool.
+ * recycled arenas of the calling thread, no lock.
+ * an arena released on another thread goes to the pool of that thread.
+ * new arenas are sized to the high-water mark of the last one released here.
+ **/
+class ArenaPool {
+public:
+    /* give the arena back to the pool of the current thread. */
+    struct ArenaReleaser {
+        void operator()(Arena *arena) const {
+            ArenaPool::release(arena);
+        }
+    };
+    using ArenaPtr = std::unique_ptr<Arena, ArenaReleaser>;
+
+    /**
+    * get an arena of the current thread.
+    * @return arena, returned to the pool when destroyed
+    */
+    static ArenaPtr acquire() {
+        LocalPool &pool = local_pool();
+        if (pool._arenas.empty()) {
+            return ArenaPtr(new Arena(pool._high_water_bytes));
+        }
+        Arena *arena = pool._arenas.back().release();
+        pool._arenas.pop_back();
+        return ArenaPtr(arena);
+    }
+
+    /* pooled arena num of the current thread. */
+    static int64_t get_pooled_num() {
+        return local_pool()._arenas.size();
+    }
+
+private:
+    /* per thread pool. */
+    struct LocalPool {
+        std::vector<std::unique_ptr<Arena>> _arenas;
+        int64_t                             _high_water_bytes{DEFAULT_ARENA_BLOCK_SIZE};
+    };
+
+    static LocalPool& local_pool() {
+        thread_local LocalPool pool;
+        return pool;
+    }
+
+    static void release(Arena *arena) {
+        LocalPool &pool = local_pool();
+        arena->reset();
+        pool._high_water_bytes = arena->get_high_water_bytes();
+        if (static_cast<int64_t>(pool._arenas.size()) >= MAX_POOLED_ARENA_NUM) {
+            delete arena;
+            return;
+        }
+        pool._arenas.emplace_back(arena);
+    }
+};
+
+} // end namespace frame
+} // end namespace inf
@@ -1,34 +1,37 @@
 #pragma once
 
+#include "mpmc_queue.h"
 #include <iostream>
-#include <queue>
 #include <vector>
-#include <mutex>
-#include <condition_variable>
 #include <atomic>
 
 namespace inf {
 namespace frame { 
 /** 
  * @class BlockingQueue.
- * thread safe queue, when there is no Data left the thread will be sleep
+ * thread safe bounded queue, when there is no Data left the thread will be sleep,
+ * when the queue is full the producer will be blocked.
+ * backed by the lock-free MpmcQueue.
  **/
 template <typename DataType>
 class BlockingQueue {
 public:
+    /**
+    * ctor.
+    * @param max_size max data num in the queue, rounded up to power of 2
+    */
+    explicit BlockingQueue(const int64_t max_size = DEFAULT_QUEUE_CAPACITY)
+        : _task_queue(max_size), _max_size(_task_queue.capacity()) {};
+
     /**
     * put task in the queue.
     * if there is thread waiting for the task, will wake up one thread.
+    * blocked while the queue is full.
     * @param data
     * @return 0 if ok, other wise -1
     */
     int enqueue(const DataType& data) {
-        std::unique_lock<std::mutex> lock(_lock);
-        //if the queue if full 
-        _cond.wait(lock, [this](){_task_queue.size() > _max_size});
-        _task_queue.push(data);
-        _cond.notify_one();
-        return true;
+        return _task_queue.enqueue(data) ? 0 : -1;
     }
 
     /**
@@ -37,45 +40,60 @@ public:
     * @param data
     * @return 0 if ok, other wise -1
     */
-    int enqueue(const DataType&& data) {
-        std::unique_lock<std::mutex> lock(_lock);
-        //if the queue if full 
-        _cond.wait(lock, [this](){_task_queue.size() > _max_size});
-        _task_queue.emplace(std::move(data));
-        _cond.notify_one();
-        return true;
+    int enqueue(DataType&& data) {
+        return _task_queue.enqueue(std::move(data)) ? 0 : -1;
     } 
 
+    /**
+    * put task in the queue without blocking.
+    * @param data
+    * @return true if ok, false if the queue is full
+    */
+    bool try_enqueue(DataType&& data) {
+        return _task_queue.try_enqueue(std::move(data));
+    }
+
     /**
     * get data from the queue. if the queue is empty, the thread will blocking(sleep) till one task occured.
-    * @return data. 
+    * @return data. default DataType if the queue is closed.
     */
     DataType get_data() {
-        std::unique_lock<std::mutex> lock(_lock);
-        if (_task_queue.empty()) {
-            _cond.wait();
-        }
-        auto result = _task_queue.front();
-        _task_queue.pop();
+        DataType result{};
+        _task_queue.dequeue(result);
         return result;
     }
 
+    /**
+    * get data from the queue without blocking.
+    * @param data output
+    * @return true if got one.
+    */
+    bool try_get_data(DataType &data) {
+        return _task_queue.try_dequeue(data);
+    }
+
+    /* close the queue, wake up all the blocked threads. */
+    void close() {
+        _task_queue.close();
+    }
+
+    /* approximate data num. */
+    int64_t size() const {
+        return _task_queue.size();
+    }
+
+    /* max data num. */
+    int64_t get_max_size() const {
+        return _max_size;
+    }
+
    
 private:
     /* task queue. */
-    std::queue<DataType>                _task_queue;
+    MpmcQueue<DataType>                 _task_queue;
 
-    /* lock. */
-    std::mutex                          _lock;
-    
     /* queue size. */
     int64_t                             _max_size;
-
-    /* conditional variable. */
-    std::condition_variable             _cond;
-
-    /* atomic task. */
-    std::atomic<int64_t>                _task_cnt;
 };
 } // end namespace frame
-} // end namespace inf 
\ No newline at end of file
+} // end namespace inf 
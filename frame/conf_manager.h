@@ -0,0 +1,460 @@
+#pragma once
+#include "double_buffer.h"
+#include "utils/common_log.h"
+#include "yaml-cpp/yaml.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdexcept>
+#include <type_traits>
+#include <typeindex>
+#include <sys/stat.h>
+
+namespace inf {
+namespace utils {
+
+template <typename ConfType>
+class ConfSchema;
+
+/* whether ConfType declares a schema: static void declare(ConfSchema<ConfType> &schema). */
+template <typename ConfType, typename = void>
+struct has_conf_schema : std::false_type {};
+
+template <typename ConfType>
+struct has_conf_schema<ConfType, decltype(ConfType::declare(std::declval<ConfSchema<ConfType>&>()))>
+        : std::true_type {};
+
+/**
+ * @class ConfSchema.
+ * fields of a conf struct, how each one is read from yaml and what values are valid.
+ * declared once by the struct, then every load compiles a yaml map into the struct,
+ * so a lookup on the request path is a member read instead of a yaml walk.
+ * a missing required field, a wrong type, a failed check or an unknown key rejects the file.
+ * a field whose type declares a schema itself is compiled as a nested struct,
+ * other types are converted by yaml-cpp, e.g. std::vector<std::string>.
+ * e.g.:
+ * struct RankConf {
+ *     int64_t     top_k{100};
+ *     std::string model_path;
+ *     static void declare(ConfSchema<RankConf> &schema) {
+ *         schema.field("top_k", &RankConf::top_k).range(1, 1000);
+ *         schema.field("model_path", &RankConf::model_path).required();
+ *     }
+ * };
+ **/
+template <typename ConfType>
+class ConfSchema {
+public:
+    using ConfCheck = std::function<bool(const ConfType &conf, std::string *error)>;
+
+    /* one field, compiles its yaml value into the member. */
+    class FieldBase {
+    public:
+        explicit FieldBase(const std::string &name) : _name(name) {};
+        virtual ~FieldBase() = default;
+
+        const std::string& get_name() const {
+            return _name;
+        }
+
+        /**
+        * compile the value of the field.
+        * @param node the value, undefined if the key is missing
+        * @param conf output
+        * @param error reason if failed
+        * @return false if the value is missing or invalid
+        */
+        virtual bool compile(const YAML::Node &node, ConfType *conf, std::string *error) const = 0;
+
+    protected:
+        std::string _name;
+    };
+
+    template <typename FieldType>
+    class Field : public FieldBase {
+    public:
+        using FieldCheck = std::function<bool(const FieldType &value)>;
+
+        Field(const std::string &name, FieldType ConfType::*member) : FieldBase(name), _member(member) {};
+
+        /* the key must be present. */
+        Field& required() {
+            _required = true;
+            return *this;
+        }
+
+        /* value used when the key is missing, instead of the member initializer. */
+        Field& default_value(const FieldType &value) {
+            _default_value.reset(new FieldType(value));
+            return *this;
+        }
+
+        /* min <= value <= max, arithmetic fields only. */
+        Field& range(const FieldType &min, const FieldType &max) {
+            static_assert(std::is_arithmetic<FieldType>::value, "range needs an arithmetic field");
+            return check([min, max](const FieldType &value) { return value >= min && value <= max; },
+                    "out of range");
+        }
+
+        /* any other check of the value. */
+        Field& check(FieldCheck field_check, const std::string &message) {
+            _checks.emplace_back(std::move(field_check), message);
+            return *this;
+        }
+
+        bool compile(const YAML::Node &node, ConfType *conf, std::string *error) const override {
+            FieldType &value = conf->*_member;
+            if (!node.IsDefined()) {
+                if (_required) {
+                    *error = "missing field : " + this->_name;
+                    return false;
+                }
+                if (_default_value) {
+                    value = *_default_value;
+                }
+                return true;
+            }
+            if (!parse(node, &value, error)) {
+                *error = "field " + this->_name + " : " + *error;
+                return false;
+            }
+            for (auto &field_check : _checks) {
+                if (!field_check.first(value)) {
+                    *error = "field " + this->_name + " : " + field_check.second;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        template <typename ValueType>
+        static typename std::enable_if<has_conf_schema<ValueType>::value, bool>::type
+        parse(const YAML::Node &node, ValueType *value, std::string *error) {
+            return ConfSchema<ValueType>::instance().compile(node, value, error);
+        }
+
+        template <typename ValueType>
+        static typename std::enable_if<!has_conf_schema<ValueType>::value, bool>::type
+        parse(const YAML::Node &node, ValueType *value, std::string *error) {
+            try {
+                *value = node.as<ValueType>();
+                return true;
+            } catch (const YAML::Exception &e) {
+                *error = "invalid value, " + std::string(e.what());
+                return false;
+            }
+        }
+
+        FieldType ConfType::*                               _member;
+        bool                                                _required{false};
+        std::unique_ptr<FieldType>                          _default_value;
+        std::vector<std::pair<FieldCheck, std::string>>     _checks;
+    };
+
+    /* schema declared by ConfType::declare, built once. */
+    static const ConfSchema& instance() {
+        static_assert(has_conf_schema<ConfType>::value, "ConfType must declare its schema");
+        static const ConfSchema schema = []() {
+            ConfSchema schema;
+            ConfType::declare(schema);
+            return schema;
+        }();
+        return schema;
+    }
+
+    /**
+    * declare a field.
+    * @param name yaml key
+    * @param member where the value goes
+    * @return the field, to chain required(), default_value(), range() and check()
+    */
+    template <typename FieldType>
+    Field<FieldType>& field(const std::string &name, FieldType ConfType::*member) {
+        Field<FieldType> *field = new Field<FieldType>(name, member);
+        _fields.emplace_back(field);
+        return *field;
+    }
+
+    /**
+    * a check across fields, run after every field is compiled.
+    * @param conf_check returns false and sets the error if invalid
+    */
+    void check(ConfCheck conf_check) {
+        _checks.push_back(std::move(conf_check));
+    }
+
+    /**
+    * compile a yaml map into conf.
+    * @param node
+    * @param conf output, default constructed
+    * @param error reason if failed
+    * @return false if invalid
+    */
+    bool compile(const YAML::Node &node, ConfType *conf, std::string *error) const {
+        if (!node.IsMap()) {
+            *error = "not a map";
+            return false;
+        }
+        std::unordered_set<std::string> names;
+        for (auto &field : _fields) {
+            names.insert(field->get_name());
+            if (!field->compile(node[field->get_name()], conf, error)) {
+                return false;
+            }
+        }
+        //a typo must not silently fall back to the default
+        for (auto iter = node.begin(); iter != node.end(); ++iter) {
+            std::string key = iter->first.as<std::string>();
+            if (names.find(key) == names.end()) {
+                *error = "unknown field : " + key;
+                return false;
+            }
+        }
+        for (auto &conf_check : _checks) {
+            if (!conf_check(*conf, error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    ConfSchema() = default;
+    ConfSchema(ConfSchema &&rhs) = default;
+
+private:
+    /* none copy. */
+    ConfSchema(const ConfSchema &rhs) = delete;
+    ConfSchema &operator=(const ConfSchema &rhs) = delete;
+
+    std::vector<std::unique_ptr<FieldBase>> _fields;
+    std::vector<ConfCheck>                  _checks;
+};
+
+/**
+ * @class TypedConfLoader.
+ * Loader of DoubleData<ConfType, TypedConfLoader<ConfType>>, compiles a yaml file by
+ * the schema of ConfType, throws if invalid so the current conf is kept.
+ **/
+template <typename ConfType>
+class TypedConfLoader {
+public:
+    /* ctor. */
+    TypedConfLoader() = default;
+    virtual ~TypedConfLoader() = default;
+
+    /* bind the loader to a conf file. */
+    bool init(const std::string &file_name) {
+        _file_name = file_name;
+        struct stat file_stat;
+        return !file_name.empty() && stat(file_name.c_str(), &file_stat) == 0;
+    }
+
+    /* conf file. */
+    std::string get_load_file_name() const {
+        return _file_name;
+    }
+
+    /* parse and compile the latest file. */
+    ConfType load() {
+        ConfType conf;
+        std::string error;
+        if (!ConfSchema<ConfType>::instance().compile(YAML::LoadFile(_file_name), &conf, &error)) {
+            throw std::runtime_error("invalid conf : " + _file_name + ", " + error);
+        }
+        return conf;
+    }
+
+private:
+    TypedConfLoader(const TypedConfLoader &rhs) = delete;
+    TypedConfLoader &operator=(const TypedConfLoader &rhs) = delete;
+
+    std::string _file_name;
+};
+
+/**
+ * @class ConfHandle.
+ * typed handle of a conf added to ConfManager, cheap to copy, keep it instead of
+ * looking the conf up by name per request.
+ * read() pins the current conf lock free, a field is then a member read.
+ * e.g.:
+ * static ConfHandle<RankConf> rank_conf = ConfManager::get_instance().get<RankConf>("rank");
+ * auto conf = rank_conf.read();
+ * int64_t top_k = conf->top_k;
+ **/
+template <typename ConfType>
+class ConfHandle {
+public:
+    using ConfData = DoubleData<ConfType, TypedConfLoader<ConfType>>;
+    using ConfGuard = typename ConfData::ReadGuard;
+
+    ConfHandle() = default;
+    explicit ConfHandle(ConfData *data) : _data(data) {};
+
+    /* pin the current conf, do not hold it across a reload on the same thread. */
+    ConfGuard read() const {
+        return _data == nullptr ? ConfGuard() : _data->read();
+    }
+
+    /* shared pin, for a request finishing on another thread. */
+    std::shared_ptr<const ConfType> get() const {
+        return _data == nullptr ? nullptr : _data->get_current();
+    }
+
+    explicit operator bool() const {
+        return _data != nullptr;
+    }
+
+private:
+    ConfData    *_data{nullptr};
+};
+
+/**
+ * @class ConfManager.
+ * typed conf files by name, each one loaded by its own DoubleData and compiled by the
+ * schema of its struct. a changed file is reloaded in the background, an invalid one is
+ * rejected and the last valid conf stays live, see get_reload_stats().
+ * add and look up the confs at startup, use the ConfHandle on the request path.
+ * e.g.:
+ * ConfHandle<RankConf> rank_conf = ConfManager::get_instance().add<RankConf>("rank", "conf/rank.yaml");
+ * if (!rank_conf) { //missing or invalid file }
+ **/
+class ConfManager {
+public:
+    ConfManager() = default;
+    virtual ~ConfManager() = default;
+
+    static ConfManager& get_instance() {
+        static ConfManager instance;
+        return instance;
+    }
+
+    /**
+    * load a conf file, compiled by the schema of ConfType.
+    * @param name unique name of the conf
+    * @param file_name yaml file
+    * @param is_watch reload when the file changes
+    * @return handle, empty if the name is used, or the file is missing or invalid
+    */
+    template <typename ConfType>
+    ConfHandle<ConfType> add(const std::string &name, const std::string &file_name, const bool is_watch = true) {
+        using Entry = ConfEntry<ConfType>;
+        //reserve the name before anything is loaded or watched
+        {
+        std::lock_guard<std::mutex> lock(_conf_lock);
+        if (_conf_table.find(name) != _conf_table.end() || !_adding_names.insert(name).second) {
+            ERR_LOG << "duplicated conf name : " << name << std::endl;
+            return ConfHandle<ConfType>();
+        }
+        }
+        std::unique_ptr<Entry> entry;
+        std::unique_ptr<TypedConfLoader<ConfType>> loader(new TypedConfLoader<ConfType>);
+        if (!loader->init(file_name)) {
+            ERR_LOG << "conf not exist : " << name << ", " << file_name << std::endl;
+        } else {
+            entry.reset(new Entry(std::move(loader), is_watch));
+            if (entry->_data.init() != 0) {
+                ERR_LOG << "conf init failed : " << name << ", " << entry->_data.get_reload_stats()._last_error
+                        << std::endl;
+                entry.reset();
+            }
+        }
+        std::lock_guard<std::mutex> lock(_conf_lock);
+        _adding_names.erase(name);
+        if (!entry) {
+            return ConfHandle<ConfType>();
+        }
+        ConfHandle<ConfType> handle(&entry->_data);
+        _conf_table.emplace(name, std::move(entry));
+        return handle;
+    }
+
+    /**
+    * handle of an added conf.
+    * @param name
+    * @return handle, empty if not added or added as another type
+    */
+    template <typename ConfType>
+    ConfHandle<ConfType> get(const std::string &name) const {
+        std::lock_guard<std::mutex> lock(_conf_lock);
+        auto iter = _conf_table.find(name);
+        if (iter == _conf_table.end() || iter->second->_type != std::type_index(typeid(ConfType))) {
+            return ConfHandle<ConfType>();
+        }
+        return ConfHandle<ConfType>(&static_cast<ConfEntry<ConfType>*>(iter->second.get())->_data);
+    }
+
+    /**
+    * reload a conf now, on the calling thread.
+    * @param name
+    * @return false if not added or the file is invalid, the current conf is kept
+    */
+    bool reload(const std::string &name) {
+        ConfEntryBase *entry = find(name);
+        return entry != nullptr && entry->reload();
+    }
+
+    /* reload outcomes of a conf, empty if not added. */
+    ReloadStats get_reload_stats(const std::string &name) const {
+        ConfEntryBase *entry = find(name);
+        return entry == nullptr ? ReloadStats() : entry->get_reload_stats();
+    }
+
+    /* names of the added confs. */
+    std::vector<std::string> get_conf_names() const {
+        std::lock_guard<std::mutex> lock(_conf_lock);
+        std::vector<std::string> names;
+        for (auto &conf : _conf_table) {
+            names.push_back(conf.first);
+        }
+        return names;
+    }
+
+private:
+    /* type erased conf, never removed, so the handles stay valid. */
+    struct ConfEntryBase {
+        explicit ConfEntryBase(const std::type_index &type) : _type(type) {};
+        virtual ~ConfEntryBase() = default;
+        virtual bool reload() = 0;
+        virtual ReloadStats get_reload_stats() const = 0;
+
+        std::type_index _type;
+    };
+
+    template <typename ConfType>
+    struct ConfEntry : public ConfEntryBase {
+        ConfEntry(std::unique_ptr<TypedConfLoader<ConfType>> loader, const bool is_watch)
+            : ConfEntryBase(std::type_index(typeid(ConfType))), _data(std::move(loader), DEFAULT_INTERVAL, is_watch) {};
+
+        bool reload() override {
+            return _data.swap_data();
+        }
+
+        ReloadStats get_reload_stats() const override {
+            return _data.get_reload_stats();
+        }
+
+        typename ConfHandle<ConfType>::ConfData _data;
+    };
+
+    ConfManager(const ConfManager &rhs) = delete;
+    ConfManager &operator=(const ConfManager &rhs) = delete;
+
+    ConfEntryBase* find(const std::string &name) const {
+        std::lock_guard<std::mutex> lock(_conf_lock);
+        auto iter = _conf_table.find(name);
+        return iter == _conf_table.end() ? nullptr : iter->second.get();
+    }
+
+    mutable std::mutex                                                  _conf_lock;
+    std::unordered_map<std::string, std::unique_ptr<ConfEntryBase>>     _conf_table;
+    /* names being loaded by add, not in _conf_table yet. */
+    std::unordered_set<std::string>                                     _adding_names;
+};
+
+} // end namespace utils
+} // end namespace inf
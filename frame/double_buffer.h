@@ -1,5 +1,6 @@
 #pragma once
 #include "yaml-cpp/yaml.h"
+#include "file_watcher.h"
 #include <string>
 #include <vector>
 #include <memory>
@@ -14,11 +15,398 @@
 #include <iostream>
 #include <pthread.h>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <algorithm>
 
 namespace inf {
 namespace utils {
 
 const int64_t DEFAULT_INTERVAL = 3;
+const int64_t DEFAULT_EPOCH_SPIN_NUM = 64;
+const int64_t DEFAULT_EPOCH_SLEEP_US = 50;
+/* retirer checks the pending generations at least every RETIRE_CHECK_INTERVAL_MS. */
+const int64_t RETIRE_CHECK_INTERVAL_MS = 1;
+/* swap_data waits at most DEFAULT_GENERATION_WAIT_MS for a generation to retire. */
+const int64_t DEFAULT_GENERATION_WAIT_MS = 5000;
+/* live generations of a DoubleData, current included, 0 means no cap. */
+const int64_t DEFAULT_MAX_GENERATION_NUM = 0;
+/* threads of ReloadExecutor, reloads of different buffers run in parallel up to it. */
+const int64_t DEFAULT_RELOAD_THREAD_NUM = 2;
+const int64_t INVALID_RELOAD_ID = -1;
+/* get_buffer_bytes of a BufferType without an overload, not counted. */
+const int64_t UNKNOWN_BUFFER_BYTES = -1;
+
+/** 
+ * @class EpochReclaimer.
+ * epoch based reclamation, shared by all the DoubleData of the process.
+ * a reader writes the global epoch into its own slot before loading a buffer
+ * pointer, and clears the slot when done.
+ * a writer publishes the new pointer, moves the epoch forward, then waits until
+ * no slot holds an older epoch. after that nobody can still see the old pointer.
+ * reading never locks and never touches a shared counter, nested reads are allowed.
+ * note: DO NOT call synchronize while holding a read, it will wait for itself.
+ * BufferRetirer uses advance() and is_drained() instead, it never waits.
+ **/
+class EpochReclaimer {
+public:
+    /* per thread reader slot, one cache line each, never freed but reused after thread exit. */
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t>   _epoch{0};      //epoch when the read began, 0 if not reading
+        int64_t                 _depth{0};      //nested read num, only touched by the owner
+        std::atomic<bool>       _in_use{false}; //owned by a living thread
+        ReaderSlot*             _next{nullptr}; //slot list
+    };
+
+    /* singleton. */
+    static EpochReclaimer& instance() {
+        static EpochReclaimer instance;
+        return instance;
+    }
+
+    /**
+    * begin a read on the calling thread.
+    * @return the slot, pass it to leave()
+    */
+    ReaderSlot* enter() {
+        ReaderSlot *slot = local_slot();
+        if (slot->_depth++ == 0) {
+            //the slot store must be visible before the buffer pointer is loaded
+            slot->_epoch.store(_epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+        }
+        return slot;
+    }
+
+    /**
+    * end a read, on the thread which began it.
+    * @param slot
+    */
+    void leave(ReaderSlot *slot) {
+        if (--slot->_depth == 0) {
+            slot->_epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    /**
+    * wait until every read began before this call has ended.
+    * call it after a new pointer is published, then the old one can be freed.
+    */
+    void synchronize() {
+        uint64_t target = advance();
+        int64_t spin = 0;
+        while (!is_drained(target)) {
+            if (++spin < DEFAULT_EPOCH_SPIN_NUM) {
+                std::this_thread::yield();
+            } else {
+                usleep(DEFAULT_EPOCH_SLEEP_US);
+            }
+        }
+    }
+
+    /**
+    * move the epoch forward, call it after a new pointer is published.
+    * @return target epoch, pass it to is_drained()
+    */
+    uint64_t advance() {
+        return _epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    }
+
+    /**
+    * whether every read began before advance() returned target has ended, never waits.
+    * @param target
+    */
+    bool is_drained(const uint64_t target) const {
+        for (ReaderSlot *slot = _slot_head.load(std::memory_order_acquire); slot != nullptr; 
+                slot = slot->_next) {
+            uint64_t epoch = slot->_epoch.load(std::memory_order_seq_cst);
+            if (epoch != 0 && epoch < target) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* current epoch, for test. */
+    uint64_t get_epoch() const {
+        return _epoch.load();
+    }
+
+private:
+    /* give the slot back when the thread exits. */
+    struct SlotHolder {
+        ReaderSlot *_slot{nullptr};
+        ~SlotHolder() {
+            if (_slot != nullptr) {
+                _slot->_epoch.store(0, std::memory_order_release);
+                _slot->_in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    /* ctor. */
+    EpochReclaimer() = default;
+    /* slots are leaked on purpose, thread_local holders may release them after exit. */
+    ~EpochReclaimer() = default;
+
+    /* none copy. */
+    EpochReclaimer(const EpochReclaimer &rhs) = delete;
+    EpochReclaimer &operator=(const EpochReclaimer &rhs) = delete;
+
+    /* slot of the calling thread, reuse a free one or append a new one. */
+    ReaderSlot* local_slot() {
+        thread_local SlotHolder holder;
+        if (holder._slot != nullptr) {
+            return holder._slot;
+        }
+        for (ReaderSlot *slot = _slot_head.load(std::memory_order_acquire); slot != nullptr; 
+                slot = slot->_next) {
+            bool in_use = false;
+            if (!slot->_in_use.load(std::memory_order_relaxed) &&
+                    slot->_in_use.compare_exchange_strong(in_use, true)) {
+                holder._slot = slot;
+                return slot;
+            }
+        }
+        ReaderSlot *slot = new ReaderSlot();
+        slot->_in_use.store(true, std::memory_order_relaxed);
+        slot->_next = _slot_head.load(std::memory_order_relaxed);
+        while (!_slot_head.compare_exchange_weak(slot->_next, slot, std::memory_order_release,
+                std::memory_order_relaxed)) {
+        }
+        holder._slot = slot;
+        return slot;
+    }
+
+    /* global epoch, 0 is reserved for idle slots. */
+    alignas(64) std::atomic<uint64_t>   _epoch{1};
+    /* slot list head. */
+    alignas(64) std::atomic<ReaderSlot*> _slot_head{nullptr};
+};
+
+/**
+ * @class BufferRetirer.
+ * destroys the retired generations of every DoubleData on one background thread.
+ * a generation is handed over when its last shared_ptr is released, it is destroyed
+ * once every lock free read began before that has ended, so neither the swapping
+ * thread nor a request thread ever waits for readers or pays for a large destructor.
+ **/
+class BufferRetirer {
+public:
+    /* singleton, never destroyed, buffers may be released during static destruction. */
+    static BufferRetirer& instance() {
+        static BufferRetirer *instance = new BufferRetirer();
+        return *instance;
+    }
+
+    /**
+    * destroy later, after the current lock free readers are done.
+    * @param destroy called on the retirer thread
+    */
+    void retire(std::function<void()> destroy) {
+        std::lock_guard<std::mutex> lock(_lock);
+        //advanced under the lock, so the targets of _pending are increasing
+        _pending.emplace_back(EpochReclaimer::instance().advance(), std::move(destroy));
+        _cond.notify_one();
+    }
+
+    /* wake the retirer up, for a writer waiting on a generation cap. */
+    void notify() {
+        std::lock_guard<std::mutex> lock(_lock);
+        _cond.notify_one();
+    }
+
+    /* generations waiting for their readers. */
+    int64_t get_pending_num() const {
+        std::lock_guard<std::mutex> lock(_lock);
+        return _pending.size() + _destroying_num;
+    }
+
+private:
+    typedef std::pair<uint64_t, std::function<void()>> Retired;
+
+    /* ctor. */
+    BufferRetirer() {
+        std::thread([this]() { run(); }).detach();
+    }
+
+    /* none copy. */
+    BufferRetirer(const BufferRetirer &rhs) = delete;
+    BufferRetirer &operator=(const BufferRetirer &rhs) = delete;
+
+    /* retirer thread, a destroy may retire more, so it runs without the lock. */
+    void run() {
+        std::unique_lock<std::mutex> lock(_lock);
+        std::vector<Retired> drained;
+        while (true) {
+            if (_pending.empty()) {
+                _cond.wait(lock);
+            } else {
+                _cond.wait_for(lock, std::chrono::milliseconds(RETIRE_CHECK_INTERVAL_MS));
+            }
+            //targets are increasing, stop at the first one still read
+            size_t drained_num = 0;
+            while (drained_num < _pending.size() &&
+                    EpochReclaimer::instance().is_drained(_pending[drained_num].first)) {
+                ++drained_num;
+            }
+            if (drained_num == 0) {
+                continue;
+            }
+            drained.assign(std::make_move_iterator(_pending.begin()),
+                    std::make_move_iterator(_pending.begin() + drained_num));
+            _pending.erase(_pending.begin(), _pending.begin() + drained_num);
+            _destroying_num = drained.size();
+            lock.unlock();
+            for (auto &retired : drained) {
+                retired.second();
+            }
+            drained.clear();
+            lock.lock();
+            _destroying_num = 0;
+        }
+    }
+
+    mutable std::mutex          _lock;
+    std::condition_variable     _cond;
+    std::deque<Retired>         _pending;
+    size_t                      _destroying_num{0};
+};
+
+/**
+ * @class ReloadExecutor.
+ * runs the background reloads of every DoubleData and FrameSnapshotManager on a
+ * few shared threads, instead of one sleeping thread per buffer.
+ * a reload is registered once, then requested any number of times: requests while
+ * it is queued are merged, a request while it runs queues it once more, so reloads
+ * of one buffer never run at the same time and the last change is always loaded.
+ **/
+class ReloadExecutor {
+public:
+    using ReloadFunc = std::function<void()>;
+
+    /* singleton, never destroyed, DoubleData may remove its reload during static destruction. */
+    static ReloadExecutor& instance() {
+        static ReloadExecutor *instance = new ReloadExecutor();
+        return *instance;
+    }
+
+    /**
+    * register a reload, start the threads at the first call.
+    * @param func called on an executor thread for each request
+    * @return reload id
+    */
+    int64_t add(ReloadFunc func) {
+        std::lock_guard<std::mutex> lock(_lock);
+        if (_threads.empty()) {
+            for (int64_t i = 0; i < DEFAULT_RELOAD_THREAD_NUM; ++i) {
+                _threads.emplace_back([this]() { run(); });
+                _thread_ids.push_back(_threads.back().get_id());
+            }
+        }
+        int64_t reload_id = ++_reload_id;
+        _jobs[reload_id]._func = std::move(func);
+        return reload_id;
+    }
+
+    /**
+    * unregister a reload. when it returns, the reload is not running and will
+    * never run again, unless called from the reload itself.
+    * @param reload_id
+    */
+    void remove(const int64_t reload_id) {
+        std::unique_lock<std::mutex> lock(_lock);
+        bool is_executor = std::find(_thread_ids.begin(), _thread_ids.end(),
+                std::this_thread::get_id()) != _thread_ids.end();
+        if (!is_executor) {
+            _done_cond.wait(lock, [this, reload_id]() {
+                auto iter = _jobs.find(reload_id);
+                return iter == _jobs.end() || !iter->second._running;
+            });
+        }
+        _jobs.erase(reload_id);
+    }
+
+    /**
+    * run the reload on an executor thread, returns at once.
+    * @param reload_id
+    */
+    void request(const int64_t reload_id) {
+        std::lock_guard<std::mutex> lock(_lock);
+        auto iter = _jobs.find(reload_id);
+        if (iter == _jobs.end()) {
+            return;
+        }
+        Job &job = iter->second;
+        if (job._running) {
+            job._rerun = true;
+        } else if (!job._queued) {
+            job._queued = true;
+            _queue.push_back(reload_id);
+            _cond.notify_one();
+        }
+    }
+
+private:
+    /* one registered reload. */
+    struct Job {
+        ReloadFunc  _func;
+        bool        _queued{false};     //in _queue
+        bool        _running{false};
+        bool        _rerun{false};      //requested while running
+    };
+
+    /* ctor. */
+    ReloadExecutor() = default;
+
+    /* none copy. */
+    ReloadExecutor(const ReloadExecutor &rhs) = delete;
+    ReloadExecutor &operator=(const ReloadExecutor &rhs) = delete;
+
+    /* executor thread, the reload runs without the lock. */
+    void run() {
+        std::unique_lock<std::mutex> lock(_lock);
+        while (true) {
+            _cond.wait(lock, [this]() { return !_queue.empty(); });
+            int64_t reload_id = _queue.front();
+            _queue.pop_front();
+            auto iter = _jobs.find(reload_id);
+            if (iter == _jobs.end()) {
+                continue;
+            }
+            iter->second._queued = false;
+            iter->second._running = true;
+            ReloadFunc func = iter->second._func;
+            lock.unlock();
+            func();
+            lock.lock();
+            //removed by the reload itself
+            iter = _jobs.find(reload_id);
+            if (iter != _jobs.end()) {
+                iter->second._running = false;
+                if (iter->second._rerun) {
+                    iter->second._rerun = false;
+                    iter->second._queued = true;
+                    _queue.push_back(reload_id);
+                    _cond.notify_one();
+                }
+            }
+            _done_cond.notify_all();
+        }
+    }
+
+    std::mutex                                  _lock;
+    std::condition_variable                     _cond;
+    /* remove waits here for the running reload. */
+    std::condition_variable                     _done_cond;
+    std::unordered_map<int64_t, Job>            _jobs;
+    std::deque<int64_t>                         _queue;
+    int64_t                                     _reload_id{0};
+    /* never joined, the executor is never destroyed. */
+    std::vector<std::thread>                    _threads;
+    std::vector<std::thread::id>                _thread_ids;
+};
 
 /** 
  * @class SwitchMonitor.
@@ -103,10 +491,102 @@ private:
     std::unordered_map<std::string, time_t> _file_status_table; 
 };
 
+/* reload outcomes of a DoubleData, a copy taken by get_reload_stats(). */
+struct ReloadStats {
+    int64_t     _success_num{0};        //published loads, init included
+    int64_t     _failure_num{0};        //thrown or invalid loads, the last known good was kept
+    int64_t     _last_load_us{0};       //cost of the last load, success or not
+    int64_t     _last_success_time{0};  //unix seconds
+    int64_t     _last_failure_time{0};  //unix seconds
+    std::string _last_error;
+};
+
+/* generations of a DoubleData, a copy taken by get_generation_stats(). */
+struct GenerationStats {
+    int64_t     _live_num{0};           //not destroyed yet, current included
+    int64_t     _retired_num{0};        //replaced, waiting for readers or shared_ptr holders
+    int64_t     _retired_bytes{0};      //get_buffer_bytes of the retired ones, UNKNOWN_BUFFER_BYTES if any is unknown
+    int64_t     _destroyed_num{0};
+};
+
+/**
+ * bytes held by a buffer, counted for the retired generations.
+ * UNKNOWN_BUFFER_BYTES by default, a shallow size would be wrong for any buffer
+ * owning memory, overload it in the namespace of a BufferType.
+ */
+template <typename BufferType>
+int64_t get_buffer_bytes(const BufferType &) {
+    return UNKNOWN_BUFFER_BYTES;
+}
+
+/* nodes and scalars of a yaml tree, an aliased node is counted at every reference. */
+inline int64_t get_buffer_bytes(const YAML::Node &node) {
+    int64_t bytes = sizeof(YAML::Node);
+    if (node.IsScalar()) {
+        bytes += node.Scalar().size();
+    } else if (node.IsSequence()) {
+        for (auto iter = node.begin(); iter != node.end(); ++iter) {
+            bytes += get_buffer_bytes(static_cast<const YAML::Node&>(*iter));
+        }
+    } else if (node.IsMap()) {
+        for (auto iter = node.begin(); iter != node.end(); ++iter) {
+            bytes += get_buffer_bytes(iter->first) + get_buffer_bytes(iter->second);
+        }
+    }
+    return bytes;
+}
+
+template <typename DataType>
+int64_t get_buffer_bytes(const std::shared_ptr<DataType> &buffer) {
+    return buffer ? get_buffer_bytes(*buffer) : 0;
+}
+
+template <typename DataType, typename Deleter>
+int64_t get_buffer_bytes(const std::unique_ptr<DataType, Deleter> &buffer) {
+    return buffer ? get_buffer_bytes(*buffer) : 0;
+}
+
+/**
+ * whether a loaded buffer may be published, a null pointer never is.
+ * overload it in the namespace of a BufferType to reject partial loads.
+ */
+template <typename BufferType>
+bool is_valid_buffer(const BufferType &) {
+    return true;
+}
+
+template <typename DataType>
+bool is_valid_buffer(const std::shared_ptr<DataType> &buffer) {
+    return buffer != nullptr;
+}
+
+template <typename DataType, typename Deleter>
+bool is_valid_buffer(const std::unique_ptr<DataType, Deleter> &buffer) {
+    return buffer != nullptr;
+}
+
 /** 
  * @class DoubleData.
  * double data has the BuferType and it's own loader
  * Loader must implement realod() function to do specific things.
+ * 2 ways to read:
+ * //1.lock free, hot path. the buffer stays alive until the guard is destroyed
+ * auto guard = double_data.read();
+ * if (guard) { guard->... }
+ * //2.shared_ptr copy, keep it for long-lived holders
+ * auto buffer = double_data.get_current();
+ * swap_data loads without any lock the readers take, then publishes the new buffer
+ * with one pointer store and returns. the previous generation is destroyed by
+ * BufferRetirer once its last get_current holder and every read began before the
+ * swap are done. set_max_generation_num caps the live generations: a swap waits for
+ * a retired one to drain before loading, and fails if it does not in time, so rapid
+ * reloads of a large buffer can not pile up. a load which throws or returns an invalid
+ * buffer (see is_valid_buffer) is dropped and the last known good one stays live,
+ * outcomes are counted in get_reload_stats().
+ * with is_monitor, the file of the loader is watched by FileWatcher, a change requests
+ * a reload on the shared ReloadExecutor which runs within milliseconds, so a slow load
+ * never blocks the watcher and no thread sleeps per buffer. only if inotify is not
+ * available, a thread of this DoubleData polls the file mtime every interval seconds.
  **/
 template <typename BufferType, typename Loader>
 class DoubleData {
@@ -114,82 +594,217 @@ public:
     typedef std::shared_ptr<BufferType> BufferPtr;
     typedef std::unique_ptr<Loader>     LoaderPtr;
     typedef std::unique_ptr<std::thread> ThreadPtr;
+
+    /** 
+     * @class ReadGuard.
+     * pins the buffer published when the read began, move only.
+     * must be destroyed by the thread which created it.
+     **/
+    class ReadGuard {
+    public:
+        /* ctor. */
+        ReadGuard() = default;
+        ReadGuard(const BufferType *data, EpochReclaimer::ReaderSlot *slot) 
+            : _data(data), _slot(slot) {};
+
+        /* move. */
+        ReadGuard(ReadGuard &&rhs) noexcept : _data(rhs._data), _slot(rhs._slot) {
+            rhs._data = nullptr;
+            rhs._slot = nullptr;
+        }
+
+        ReadGuard &operator=(ReadGuard &&rhs) noexcept {
+            if (this != &rhs) {
+                release();
+                _data = rhs._data;
+                _slot = rhs._slot;
+                rhs._data = nullptr;
+                rhs._slot = nullptr;
+            }
+            return *this;
+        }
+
+        /* dtor. */
+        ~ReadGuard() {
+            release();
+        }
+
+        /* pinned buffer, nullptr if not inited. */
+        const BufferType* get() const {
+            return _data;
+        }
+
+        const BufferType* operator->() const {
+            return _data;
+        }
+
+        const BufferType& operator*() const {
+            return *_data;
+        }
+
+        explicit operator bool() const {
+            return _data != nullptr;
+        }
+
+    private:
+        /* none copy. */
+        ReadGuard(const ReadGuard &rhs) = delete;
+        ReadGuard &operator=(const ReadGuard &rhs) = delete;
+
+        /* end the read. */
+        void release() {
+            if (_slot != nullptr) {
+                EpochReclaimer::instance().leave(_slot);
+                _slot = nullptr;
+            }
+            _data = nullptr;
+        }
+
+        const BufferType                *_data{nullptr};
+        EpochReclaimer::ReaderSlot      *_slot{nullptr};
+    };
+
     /* ctor. */
     DoubleData(LoaderPtr loader, int64_t interval = DEFAULT_INTERVAL, bool is_monitor = false) 
-        : _loader(std::move(loader)), _interval(interval), _is_monitor(is_monitor) {
+        : _loader(std::move(loader)), _is_monitor(is_monitor), _interval(interval) {
         
     };
 
     /* dtor. */
     virtual ~DoubleData() {
-        if (_is_monitor && _monitor_thread && _monitor_thread->joinable()) {
-                _monitor_thread->join();
+        if (_watch_id != INVALID_WATCH_ID) {
+            FileWatcher::instance().unwatch(_watch_id);
+        }
+        if (_reload_id != INVALID_RELOAD_ID) {
+            ReloadExecutor::instance().remove(_reload_id);
+        }
+        {
+        std::lock_guard<std::mutex> lock(_monitor_lock);
+        _is_monitor = false;
+        _monitor_cond.notify_all();
+        }
+        if (_monitor_thread && _monitor_thread->joinable()) {
+            _monitor_thread->join();
         }
     }
     
     /**
     * init the double buffer, using Loader to load the buffer.
-    * @return 0:ok, -1:failed.
+    * with is_monitor the file is watched before the load, so a change during it is reloaded.
+    * @return 0:ok, -1:failed, the reason is in get_reload_stats().
     */
     int init() {
-        std::lock_guard<std::mutex> lock(_lock);
-        _current = std::make_shared<BufferType>();
-        _backup  = std::make_shared<BufferType>();
-        *_current = _loader->load();
-        *_backup = *_current;
-
-        _monitor.init(_loader->get_load_file_name());
-        if (_is_monitor) {
-            _monitor_thread.reset(new std::thread(&DoubleData::run, this));
+        if (_is_monitor && _reload_id == INVALID_RELOAD_ID) {
+            _reload_id = ReloadExecutor::instance().add([this]() { reload(); });
+            _watch_id = FileWatcher::instance().watch(_loader->get_load_file_name(),
+                    [this](const std::string &) { request_reload(); });
+            if (_watch_id == INVALID_WATCH_ID) {
+                _monitor.init(_loader->get_load_file_name());
+                _monitor_thread.reset(new std::thread(&DoubleData::run, this));
+            }
         }
-      
 
+        std::lock_guard<std::mutex> swap_lock(_swap_lock);
+        BufferPtr buffer = load_buffer();
+        if (!buffer) {
+            return -1;
+        }
+        publish(std::move(buffer));
         return 0;
     }
 
+    /* poll thread, only if FileWatcher failed, reloads when the file mtime changed. */
     void run () {
-        //detect file per interval
+        std::unique_lock<std::mutex> lock(_monitor_lock);
         while (_is_monitor) {
-            auto update_files = _monitor.get_need_switch_file();
-            if (!update_files.empty()){
-                swap_data();
+            _monitor_cond.wait_for(lock, std::chrono::seconds(_interval));
+            if (_is_monitor && !_monitor.get_need_switch_file().empty()) {
+                request_reload();
             }
-            sleep(_interval);
         }
     } 
 
+    /* reload on the ReloadExecutor, returns at once. needs is_monitor, swap by hand without it. */
+    void request_reload() {
+        if (_reload_id != INVALID_RELOAD_ID) {
+            ReloadExecutor::instance().request(_reload_id);
+        }
+    }
+
     /**
-    * change the backup and front data
-    * @return 
+    * load a new buffer and publish it, readers are never blocked.
+    * waits only when the generation cap is reached, never for its own reads.
+    * @return false if the load failed or the cap was not freed in time,
+    *         the last known good buffer stays live
     */
     bool swap_data() {
         //only one thread can manipulate
-        std::lock_guard<std::mutex> lock(_lock);
-        //make sure the backup data has no user.
-        // if (_backup.use_count() > 1) {
-        //     return false;
-        // }
-        *_backup = _loader->load();
-        _current.swap(_backup);
+        std::lock_guard<std::mutex> swap_lock(_swap_lock);
+        if (!wait_generation()) {
+            return false;
+        }
+        BufferPtr new_buffer = load_buffer();
+        if (!new_buffer) {
+            return false;
+        }
+        publish(std::move(new_buffer));
         return true;
-        
     }
 
+    /* swap on file change, a broken file keeps the current data. */
+    void reload() {
+        swap_data();
+    }
+
+    /* reload outcomes. */
+    ReloadStats get_reload_stats() const {
+        std::lock_guard<std::mutex> lock(_stats_lock);
+        return _stats;
+    }
+
+    /* live and retired generations. */
+    GenerationStats get_generation_stats() const {
+        GenerationStats stats;
+        stats._live_num = _counter->_live_num.load(std::memory_order_acquire);
+        stats._retired_num = std::max<int64_t>(stats._live_num - (_current_raw.load() != nullptr), 0);
+        int64_t current_bytes = _current_bytes.load(std::memory_order_acquire);
+        int64_t retired_unknown_num = _counter->_unknown_num.load(std::memory_order_acquire) -
+                (current_bytes == UNKNOWN_BUFFER_BYTES);
+        stats._retired_bytes = retired_unknown_num > 0 ? UNKNOWN_BUFFER_BYTES :
+                std::max<int64_t>(_counter->_live_bytes.load(std::memory_order_acquire) -
+                std::max<int64_t>(current_bytes, 0), 0);
+        stats._destroyed_num = _counter->_destroyed_num.load(std::memory_order_acquire);
+        return stats;
+    }
+
+    /**
+    * cap of the live generations, current included.
+    * @param max_generation_num 0 means no cap, otherwise at least 2
+    * @param wait_ms how long a swap waits for a retired generation to drain
+    */
+    void set_max_generation_num(const int64_t max_generation_num, 
+            const int64_t wait_ms = DEFAULT_GENERATION_WAIT_MS) {
+        _max_generation_num.store(max_generation_num <= 0 ? 0 : std::max<int64_t>(max_generation_num, 2));
+        _generation_wait_ms.store(wait_ms);
+    }
+
+    /**
+    * lock free read of the current data, no lock and no refcount.
+    * @return ReadGuard, empty if not inited
+    */
+    ReadGuard read() const {
+        EpochReclaimer::ReaderSlot *slot = EpochReclaimer::instance().enter();
+        return ReadGuard(_current_raw.load(std::memory_order_seq_cst), slot);
+    }
 
     /**
     * get current data ptr, using this data on front.
     * @return std::shared_ptr<BufferType> 
     */
-    BufferPtr get_current() {
-        std::lock_guard<std::mutex> lock(_lock);
-        return _current;
+    BufferPtr get_current() const {
+        return std::atomic_load(&_current);
     }
 
-    /* get backup data. this interface is only use for test, 
-       DO NOT USE IT IN BUSSINESS!!!*/
-    BufferPtr get_backup() {
-        return _backup;
-    }
 
     
 
@@ -199,12 +814,128 @@ private:
     DoubleData(const DoubleData &rhs)  = delete;
     DoubleData &operator=(const DoubleData &rhs) = delete;
 
-    /* front data ptr, always using this ptr. */
+    /* live generations, shared with the deleters, which may run after the DoubleData is gone. */
+    struct GenerationCounter {
+        std::atomic<int64_t>    _live_num{0};
+        std::atomic<int64_t>    _live_bytes{0};
+        std::atomic<int64_t>    _unknown_num{0};    //live ones of UNKNOWN_BUFFER_BYTES
+        std::atomic<int64_t>    _destroyed_num{0};
+    };
+    typedef std::shared_ptr<GenerationCounter> GenerationCounterPtr;
+
+    /* the last release of a generation hands it to the retirer instead of deleting it. */
+    struct GenerationDeleter {
+        GenerationCounterPtr    _counter;
+        int64_t                 _bytes;
+
+        void operator()(BufferType *buffer) const {
+            GenerationCounterPtr counter = _counter;
+            int64_t bytes = _bytes;
+            BufferRetirer::instance().retire([buffer, counter, bytes]() {
+                delete buffer;
+                if (bytes == UNKNOWN_BUFFER_BYTES) {
+                    counter->_unknown_num.fetch_sub(1, std::memory_order_acq_rel);
+                } else {
+                    counter->_live_bytes.fetch_sub(bytes, std::memory_order_acq_rel);
+                }
+                counter->_destroyed_num.fetch_add(1, std::memory_order_acq_rel);
+                counter->_live_num.fetch_sub(1, std::memory_order_acq_rel);
+            });
+        }
+    };
+
+    /**
+    * run the loader outside of any reader visible lock, under _swap_lock.
+    * @return new buffer, nullptr if the load threw or is invalid
+    */
+    BufferPtr load_buffer() {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        BufferPtr buffer;
+        std::string error;
+        try {
+            BufferType loaded = _loader->load();
+            if (is_valid_buffer(loaded)) {
+                int64_t bytes = std::max<int64_t>(get_buffer_bytes(loaded), UNKNOWN_BUFFER_BYTES);
+                _counter->_live_num.fetch_add(1, std::memory_order_acq_rel);
+                if (bytes == UNKNOWN_BUFFER_BYTES) {
+                    _counter->_unknown_num.fetch_add(1, std::memory_order_acq_rel);
+                } else {
+                    _counter->_live_bytes.fetch_add(bytes, std::memory_order_acq_rel);
+                }
+                buffer = BufferPtr(new BufferType(std::move(loaded)), GenerationDeleter{_counter, bytes});
+            } else {
+                error = "invalid buffer";
+            }
+        } catch (const std::exception &e) {
+            error = e.what();
+        } catch (...) {
+            error = "unknown exception";
+        }
+        record_load(buffer != nullptr, error, begin);
+        return buffer;
+    }
+
+    /* publish with one pointer store, the old generation retires when its last holder is gone. */
+    void publish(BufferPtr buffer) {
+        _current_bytes.store(std::get_deleter<GenerationDeleter>(buffer)->_bytes, std::memory_order_release);
+        BufferType *raw = buffer.get();
+        buffer = std::atomic_exchange(&_current, std::move(buffer));
+        _current_raw.store(raw, std::memory_order_seq_cst);
+    }
+
+    /**
+    * wait until a generation can be added under the cap.
+    * @return false if the retired ones are still held after the wait
+    */
+    bool wait_generation() {
+        int64_t max_generation_num = _max_generation_num.load();
+        if (max_generation_num <= 0) {
+            return true;
+        }
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point deadline = begin + std::chrono::milliseconds(_generation_wait_ms.load());
+        while (_counter->_live_num.load(std::memory_order_acquire) >= max_generation_num) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                record_load(false, "too many live generations : " + 
+                        std::to_string(_counter->_live_num.load()), begin);
+                return false;
+            }
+            BufferRetirer::instance().notify();
+            std::this_thread::sleep_for(std::chrono::milliseconds(RETIRE_CHECK_INTERVAL_MS));
+        }
+        return true;
+    }
+
+    void record_load(const bool ok, const std::string &error, const std::chrono::steady_clock::time_point &begin) {
+        int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        std::lock_guard<std::mutex> lock(_stats_lock);
+        _stats._last_load_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - begin).count();
+        if (ok) {
+            ++_stats._success_num;
+            _stats._last_success_time = now;
+        } else {
+            ++_stats._failure_num;
+            _stats._last_failure_time = now;
+            _stats._last_error = error;
+            ERR_LOG << "reload failed, keep the current data : " << _loader->get_load_file_name()
+                    << ", " << error << std::endl;
+        }
+    }
+
+    /* front data ptr, always using this ptr, accessed by atomic_load/atomic_store. */
     BufferPtr           _current;
-    /* backup data ptr, update this data. */
-    BufferPtr           _backup;
-    /* swap front and backup data lock. */
-    std::mutex          _lock;
+    /* get_buffer_bytes of _current, UNKNOWN_BUFFER_BYTES if not counted. */
+    std::atomic<int64_t> _current_bytes{0};
+    /* live generations. */
+    GenerationCounterPtr _counter{std::make_shared<GenerationCounter>()};
+    std::atomic<int64_t> _max_generation_num{DEFAULT_MAX_GENERATION_NUM};
+    std::atomic<int64_t> _generation_wait_ms{DEFAULT_GENERATION_WAIT_MS};
+    /* raw ptr of _current, published for the lock free readers. */
+    std::atomic<BufferType*> _current_raw{nullptr};
+    /* only one load and swap at a time. */
+    std::mutex          _swap_lock;
     /* data loader. Loader must implement load() and return std::shared_ptr<BufferType> */
     LoaderPtr           _loader;
     /* whether use auto update. */
@@ -213,8 +944,18 @@ private:
     int64_t             _interval{60};
     /* file SwitchMonitor. need to be init afer DoubleBuffer init()*/
     SwitchMonitor       _monitor;
-    /* thread ptr. monitor the conf file. */
+    /* thread ptr. polls the conf file, only if FileWatcher failed. */
     ThreadPtr           _monitor_thread;    
+    /* wake up the poll thread when destroyed. */
+    std::mutex          _monitor_lock;
+    std::condition_variable _monitor_cond;
+    /* ReloadExecutor reload id, with is_monitor. */
+    int64_t             _reload_id{INVALID_RELOAD_ID};
+    /* reload outcomes. */
+    mutable std::mutex  _stats_lock;
+    ReloadStats         _stats;
+    /* FileWatcher watch id. */
+    int64_t             _watch_id{INVALID_WATCH_ID};
 };
 
 
@@ -264,49 +1005,6 @@ private:
 };
 
 
-//not implement now
-class ConfManager {
-public:
-    ConfManager() = default;
-    virtual ~ConfManager() = default;
-
-    static ConfManager& get_instance() {
-        static ConfManager instance;
-        return instance;
-    }
-
-    /**
-     * init conf file by file name
-     * not implement now.
-     * @param std::vector<std::string> file_names
-     * @return -1:Failed, 0:OK
-     */
-    int init(const std::string& file_names) {
-        if (file_names.empty()) {
-            return -1;
-        }
-        
-        return 0;
-    }
-    
-
-private:
-    typedef std::unordered_map<std::string, std::string>    ConfMap;
-    typedef std::unique_ptr<ConfMap>                        ConfMapPtr;
-    typedef std::unordered_map<std::string, ConfMapPtr>     ConfTable;
-    typedef std::unique_ptr<std::thread>                    ThreadPtr;
-    
-    ConfManager(const ConfManager &rhs) = delete;
-    ConfManager &operator=(const ConfManager &rhs) = delete;
-
-    std::string             _file_name;
-    ConfTable               _conf_file_table;
-    static std::mutex       _file_lock;
-    ThreadPtr               _monitor_thread;
-
-};
-
-
 //rw lock implement
 class RW_LOCK {
 private:
@@ -18,7 +18,8 @@ template <typename CreatorType,
 class Factory {
 private:
     using CreatorPtr = std::unique_ptr<CreatorType>;
-    using ProductPtr = std::unique_ptr<ProductType>;
+    /* shared, products such as tasks may be reused across reloads. */
+    using ProductPtr = std::shared_ptr<ProductType>;
     using CreatorTable = std::unordered_map<KeyType, CreatorPtr>;
 
 public:
@@ -0,0 +1,480 @@
+#pragma once
+#include "utils/common_log.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <condition_variable>
+#include <unordered_map>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <stdint.h>
+
+namespace inf {
+namespace utils {
+
+const int64_t DEFAULT_DEBOUNCE_MS = 50;
+const int64_t INVALID_WATCH_ID = -1;
+const int64_t INVALID_CONTENT_HASH = 0;
+/* larger files are compared by size, mtime and inode instead of the content hash. */
+const int64_t DEFAULT_MAX_HASH_SIZE = 8 * 1024 * 1024;
+/* every watched file is checked this often, in case an event was lost. */
+const int64_t DEFAULT_RECHECK_MS = 10000;
+
+/**
+ * @class FileWatcher.
+ * one inotify + epoll thread serves every watched file of the process.
+ * the parent directory is watched, so both in place writes and
+ * rename-into-place deploys are caught. for a watched symlink any event of the
+ * directory is checked, so swapping a link it points through (e.g. ..data of a
+ * kubernetes configmap) is caught too. a queue overflow checks every file, and
+ * every file is checked each recheck_ms anyway, so a lost event delays a reload
+ * instead of dropping it.
+ * events of a file are debounced by debounce_ms, then the file is compared with
+ * the last check: by the content hash up to max_hash_size, so a touched but
+ * unchanged file does not trigger the callback, by size, mtime and inode above it,
+ * so a large dictionary is never read on the watcher thread. files are never
+ * read under the lock.
+ * callbacks run on the watcher thread one by one, keep them short.
+ * e.g.:
+ * int64_t watch_id = FileWatcher::instance().watch("conf/task.yaml",
+ *         [](const std::string &file_name) { reload(file_name); });
+ * FileWatcher::instance().unwatch(watch_id);
+ **/
+class FileWatcher {
+public:
+    using WatchCallback = std::function<void(const std::string &file_name)>;
+
+    /* singleton, never destroyed, DoubleData may unwatch during static destruction. */
+    static FileWatcher& instance() {
+        static FileWatcher *instance = new FileWatcher();
+        return *instance;
+    }
+
+    /**
+    * watch a file, start the watcher thread at the first call.
+    * @param file_name file to watch, it must exist
+    * @param callback called with file_name when the content changed
+    * @return watch id, INVALID_WATCH_ID if failed
+    */
+    int64_t watch(const std::string &file_name, WatchCallback callback) {
+        if (file_name.empty() || !callback) {
+            return INVALID_WATCH_ID;
+        }
+        FileSignature signature = get_signature(file_name, _max_hash_size);
+        struct stat link_stat;
+        bool is_link = lstat(file_name.c_str(), &link_stat) == 0 && S_ISLNK(link_stat.st_mode);
+        std::lock_guard<std::mutex> lock(_lock);
+        if (!start()) {
+            return INVALID_WATCH_ID;
+        }
+        std::string dir_name = get_dir_name(file_name);
+        int wd = inotify_add_watch(_inotify_fd, dir_name.c_str(),
+                IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0) {
+            ERR_LOG << "inotify_add_watch failed : " << dir_name << std::endl;
+            return INVALID_WATCH_ID;
+        }
+
+        int64_t watch_id = ++_watch_id;
+        Watch &entry = _watch_table[watch_id];
+        entry._wd = wd;
+        entry._file_name = file_name;
+        entry._base_name = get_base_name(file_name);
+        entry._signature = signature;
+        entry._is_link = is_link;
+        entry._callback = std::move(callback);
+        return watch_id;
+    }
+
+    /**
+    * stop watching. when it returns, the callback is not running and will
+    * never run again, unless called from the callback itself.
+    * @param watch_id
+    * @return true if ok, false if not found
+    */
+    bool unwatch(const int64_t watch_id) {
+        std::unique_lock<std::mutex> lock(_lock);
+        auto iter = _watch_table.find(watch_id);
+        if (iter == _watch_table.end()) {
+            return false;
+        }
+        int wd = iter->second._wd;
+        _watch_table.erase(iter);
+        bool dir_in_use = std::any_of(_watch_table.begin(), _watch_table.end(),
+                [wd](const std::pair<const int64_t, Watch> &item) { return item.second._wd == wd; });
+        if (!dir_in_use) {
+            inotify_rm_watch(_inotify_fd, wd);
+        }
+
+        if (std::this_thread::get_id() != _thread_id) {
+            _dispatch_cond.wait(lock, [this, watch_id]() { return _dispatching_id != watch_id; });
+        }
+        return true;
+    }
+
+    /**
+    * events of a file within debounce_ms are merged into one check.
+    * @param debounce_ms
+    */
+    void set_debounce_ms(const int64_t debounce_ms) {
+        _debounce_ms = debounce_ms;
+    }
+
+    /**
+    * files up to max_hash_size are compared by content, larger ones by size, mtime and inode.
+    * @param max_hash_size
+    */
+    void set_max_hash_size(const int64_t max_hash_size) {
+        _max_hash_size = max_hash_size;
+    }
+
+    /**
+    * how often every file is checked without an event, applied after the next check.
+    * @param recheck_ms <= 0 disables it
+    */
+    void set_recheck_ms(const int64_t recheck_ms) {
+        _recheck_ms = recheck_ms;
+    }
+
+    /* num of the callbacks triggered. */
+    int64_t get_changed_num() const {
+        return _changed_num;
+    }
+
+    /* num of the checks skipped because the file did not change. */
+    int64_t get_unchanged_num() const {
+        return _unchanged_num;
+    }
+
+    /**
+    * content hash of a file, FNV-1a.
+    * @param file_name
+    * @return hash, INVALID_CONTENT_HASH if the file can not be read
+    */
+    static uint64_t hash_file(const std::string &file_name) {
+        std::ifstream input(file_name, std::ios::binary);
+        if (!input) {
+            return INVALID_CONTENT_HASH;
+        }
+        uint64_t hash = 14695981039346656037ULL;
+        char buffer[4096];
+        while (input.read(buffer, sizeof(buffer)) || input.gcount() > 0) {
+            for (std::streamsize i = 0; i < input.gcount(); ++i) {
+                hash ^= static_cast<unsigned char>(buffer[i]);
+                hash *= 1099511628211ULL;
+            }
+        }
+        return hash == INVALID_CONTENT_HASH ? 1 : hash;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /* what a check compares, _content_hash is INVALID_CONTENT_HASH above max_hash_size. */
+    struct FileSignature {
+        bool                    _exist{false};
+        int64_t                 _size{0};
+        int64_t                 _mtime_ns{0};
+        uint64_t                _inode{0};
+        uint64_t                _content_hash{INVALID_CONTENT_HASH};
+
+        bool is_same(const FileSignature &rhs) const {
+            if (_exist != rhs._exist || _size != rhs._size) {
+                return false;
+            }
+            if (_content_hash != INVALID_CONTENT_HASH && rhs._content_hash != INVALID_CONTENT_HASH) {
+                return _content_hash == rhs._content_hash;
+            }
+            return _mtime_ns == rhs._mtime_ns && _inode == rhs._inode;
+        }
+    };
+
+    /* one watched file. */
+    struct Watch {
+        int                     _wd{-1};            //watch descriptor of the parent dir
+        std::string             _file_name;
+        std::string             _base_name;
+        FileSignature           _signature;
+        bool                    _is_link{false};    //any event of the dir may change its target
+        bool                    _pending{false};    //events arrived, wait for the debounce
+        Clock::time_point       _check_time;        //when to check the content
+        WatchCallback           _callback;
+    };
+
+    /* ctor. */
+    FileWatcher() = default;
+    ~FileWatcher() = default;
+
+    /* none copy. */
+    FileWatcher(const FileWatcher &rhs) = delete;
+    FileWatcher &operator=(const FileWatcher &rhs) = delete;
+
+    /* create the fds and the thread, under _lock. */
+    bool start() {
+        if (_thread) {
+            return true;
+        }
+        _inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (_inotify_fd < 0 || _epoll_fd < 0) {
+            ERR_LOG << "create inotify/epoll fd failed" << std::endl;
+            close_fds();
+            return false;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = _inotify_fd;
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _inotify_fd, &event) != 0) {
+            ERR_LOG << "epoll_ctl failed" << std::endl;
+            close_fds();
+            return false;
+        }
+
+        _recheck_time = Clock::now() + std::chrono::milliseconds(_recheck_ms);
+        _thread.reset(new std::thread(&FileWatcher::run, this));
+        _thread_id = _thread->get_id();
+        return true;
+    }
+
+    void close_fds() {
+        for (int *fd : {&_inotify_fd, &_epoll_fd}) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+    }
+
+    /* watcher thread. */
+    void run() {
+        struct epoll_event event;
+        while (true) {
+            //new watches need no wake up, they have nothing pending
+            if (epoll_wait(_epoll_fd, &event, 1, get_wait_ms()) > 0) {
+                read_events();
+            }
+            recheck();
+            dispatch();
+        }
+    }
+
+    /* ms until the earliest pending check or the recheck, -1 if nothing to wait for. */
+    int get_wait_ms() {
+        std::lock_guard<std::mutex> lock(_lock);
+        int64_t wait_ms = -1;
+        Clock::time_point now = Clock::now();
+        auto wait_until = [&wait_ms, &now](const Clock::time_point &time) {
+            int64_t left_ms = std::chrono::duration_cast<std::chrono::milliseconds>(time - now).count() + 1;
+            left_ms = std::max<int64_t>(left_ms, 0);
+            wait_ms = wait_ms < 0 ? left_ms : std::min(wait_ms, left_ms);
+        };
+        for (auto &item : _watch_table) {
+            if (item.second._pending) {
+                wait_until(item.second._check_time);
+            }
+        }
+        if (_recheck_ms > 0 && !_watch_table.empty()) {
+            wait_until(_recheck_time);
+        }
+        return static_cast<int>(wait_ms);
+    }
+
+    /* mark every file pending, under _lock, the ones already pending keep their time. */
+    void mark_all_pending(const Clock::time_point &check_time) {
+        for (auto &item : _watch_table) {
+            if (!item.second._pending) {
+                item.second._pending = true;
+                item.second._check_time = check_time;
+            }
+        }
+    }
+
+    /* safety net for lost events, every file is checked each recheck_ms. */
+    void recheck() {
+        std::lock_guard<std::mutex> lock(_lock);
+        Clock::time_point now = Clock::now();
+        if (_recheck_ms <= 0 || now < _recheck_time) {
+            return;
+        }
+        mark_all_pending(now);
+        _recheck_time = now + std::chrono::milliseconds(_recheck_ms);
+    }
+
+    /* read the inotify events, mark the files pending. */
+    void read_events() {
+        alignas(struct inotify_event) char buffer[4096];
+        while (true) {
+            ssize_t length = read(_inotify_fd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(_lock);
+            Clock::time_point check_time = Clock::now() + std::chrono::milliseconds(_debounce_ms);
+            for (char *ptr = buffer; ptr < buffer + length; ) {
+                struct inotify_event *event = reinterpret_cast<struct inotify_event*>(ptr);
+                ptr += sizeof(struct inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    ERR_LOG << "inotify queue overflow, check every watched file" << std::endl;
+                    mark_all_pending(check_time);
+                    continue;
+                }
+                if (event->len == 0) {
+                    continue;
+                }
+                for (auto &item : _watch_table) {
+                    Watch &entry = item.second;
+                    if (entry._wd == event->wd && (entry._is_link || entry._base_name == event->name)) {
+                        //every new event pushes the check back
+                        entry._pending = true;
+                        entry._check_time = check_time;
+                    }
+                }
+            }
+        }
+    }
+
+    /* check the due files, call back the changed ones. */
+    void dispatch() {
+        std::vector<int64_t> due_ids;
+        {
+        std::lock_guard<std::mutex> lock(_lock);
+        Clock::time_point now = Clock::now();
+        for (auto &item : _watch_table) {
+            if (item.second._pending && item.second._check_time <= now) {
+                item.second._pending = false;
+                due_ids.push_back(item.first);
+            }
+        }
+        }
+
+        for (int64_t watch_id : due_ids) {
+            std::string file_name;
+            FileSignature last_signature;
+            {
+            std::lock_guard<std::mutex> lock(_lock);
+            auto iter = _watch_table.find(watch_id);
+            if (iter == _watch_table.end()) {
+                continue;
+            }
+            file_name = iter->second._file_name;
+            last_signature = iter->second._signature;
+            }
+
+            //missing while being replaced, the next event brings it back
+            FileSignature signature = get_signature(file_name, _max_hash_size);
+            if (!signature._exist || signature.is_same(last_signature)) {
+                ++_unchanged_num;
+                continue;
+            }
+
+            WatchCallback callback;
+            {
+            std::lock_guard<std::mutex> lock(_lock);
+            auto iter = _watch_table.find(watch_id);
+            if (iter == _watch_table.end()) {
+                continue;
+            }
+            iter->second._signature = signature;
+            callback = iter->second._callback;
+            _dispatching_id = watch_id;
+            }
+
+            ++_changed_num;
+            callback(file_name);
+
+            std::lock_guard<std::mutex> lock(_lock);
+            _dispatching_id = INVALID_WATCH_ID;
+            _dispatch_cond.notify_all();
+        }
+    }
+
+    /**
+    * stat the file, and hash it if not larger than max_hash_size.
+    * @param file_name
+    * @param max_hash_size
+    * @return signature, _exist is false if the file can not be read
+    */
+    static FileSignature get_signature(const std::string &file_name, const int64_t max_hash_size) {
+        FileSignature signature;
+        struct stat file_stat;
+        if (stat(file_name.c_str(), &file_stat) != 0) {
+            return signature;
+        }
+        signature._size = file_stat.st_size;
+        signature._mtime_ns = static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000LL +
+                file_stat.st_mtim.tv_nsec;
+        signature._inode = file_stat.st_ino;
+        if (signature._size <= max_hash_size) {
+            signature._content_hash = hash_file(file_name);
+            if (signature._content_hash == INVALID_CONTENT_HASH) {
+                return FileSignature();
+            }
+        }
+        signature._exist = true;
+        return signature;
+    }
+
+    /* parent dir of the file. */
+    static std::string get_dir_name(const std::string &file_name) {
+        size_t pos = file_name.find_last_of('/');
+        if (pos == std::string::npos) {
+            return ".";
+        }
+        return pos == 0 ? "/" : file_name.substr(0, pos);
+    }
+
+    /* file name without dir. */
+    static std::string get_base_name(const std::string &file_name) {
+        size_t pos = file_name.find_last_of('/');
+        return pos == std::string::npos ? file_name : file_name.substr(pos + 1);
+    }
+
+    /* guard the tables. */
+    std::mutex                                  _lock;
+
+    /* unwatch waits here for the running callback. */
+    std::condition_variable                     _dispatch_cond;
+
+    /* watch id of the running callback. */
+    int64_t                                     _dispatching_id{INVALID_WATCH_ID};
+
+    /* watched files. */
+    std::unordered_map<int64_t, Watch>          _watch_table;
+
+    /* last watch id. */
+    int64_t                                     _watch_id{0};
+
+    /* fds. */
+    int                                         _inotify_fd{-1};
+    int                                         _epoll_fd{-1};
+
+    /* watcher thread, never joined. */
+    std::unique_ptr<std::thread>                _thread;
+    std::thread::id                             _thread_id;
+
+    /* debounce ms. */
+    std::atomic<int64_t>                        _debounce_ms{DEFAULT_DEBOUNCE_MS};
+
+    /* larger files are not hashed. */
+    std::atomic<int64_t>                        _max_hash_size{DEFAULT_MAX_HASH_SIZE};
+
+    /* check every file without an event, the next one at _recheck_time, under _lock. */
+    std::atomic<int64_t>                        _recheck_ms{DEFAULT_RECHECK_MS};
+    Clock::time_point                           _recheck_time;
+
+    /* counters. */
+    std::atomic<int64_t>                        _changed_num{0};
+    std::atomic<int64_t>                        _unchanged_num{0};
+};
+
+} // end namespace utils
+} // end namespace inf
@@ -0,0 +1,426 @@
+#pragma once
+#include "utils/common_log.h"
+#include "yaml-cpp/yaml.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <stdint.h>
+
+namespace inf {
+namespace frame {
+
+/* traffic of a layer is split into FLOW_BUCKET_NUM buckets. */
+const int64_t FLOW_BUCKET_NUM = 10000;
+/* max layers of a scene, a route keeps one flow per layer. */
+const int64_t MAX_FLOW_LAYER_NUM = 16;
+/* no flow of the layer is hit. */
+const int64_t INVALID_FLOW_ID = -1;
+
+/* bucket by the hash of guid and the layer seed. */
+const std::string RANDOM_DIVIDER = "random";
+/* bucket by the last 4 digits of guid, flows may pick tails by the last digit. */
+const std::string TAIL_DIVIDER = "tail";
+/* white list only. */
+const std::string SET_DIVIDER = "set";
+
+/**
+ * @class FlowRoute.
+ * result of FlowRouter::route, filled without allocation.
+ **/
+struct FlowRoute {
+    /* layers of the scene. */
+    int64_t             _layer_num{0};
+    /* hit flow of each layer, INVALID_FLOW_ID if none. */
+    int64_t             _flow_ids[MAX_FLOW_LAYER_NUM];
+    /* scheduler of the request, owned by the router. */
+    const std::string   *_scheduler_name{nullptr};
+};
+
+/**
+ * @class FlowRouter.
+ * routes a request by flow.yaml: platform -> scene -> a flow in every layer -> scheduler.
+ * layers are orthogonal: each layer hashes guid with its own seed, flows of one
+ * layer are exclusive. the bucket -> flow array of every layer is built at load,
+ * a white list is a hash set checked before the buckets.
+ * the scheduler is the one of the first layer whose hit flow has scheduler_name,
+ * the scheduler_name of the scene otherwise.
+ * e.g. flow.yaml:
+ * - platform: rec_for_video
+ *   scenes:
+ *     - scene_name: feed
+ *       scheduler_name: rec_for_video_base
+ *       layers:
+ *         - layer_name: rank
+ *           divider_type: random           # random | tail | set
+ *           seed: 17                       # optional, hash of layer_name by default
+ *           flows:
+ *             - flow_id: 124
+ *               scheduler_name: rec_for_video_exp1
+ *               buckets: [[0, 100], [5000, 5100]]  # [begin, end) of 10000
+ *               white_list: [guid_1, guid_2]
+ *             - flow_id: 125
+ *               tails: [7]                 # tail divider only
+ * FlowRoute route;
+ * router.route("rec_for_video", "feed", guid, &route);
+ **/
+class FlowRouter {
+public:
+    /* ctor. */
+    FlowRouter() = default;
+
+    /**
+    * build the router from flow.yaml.
+    * @param conf root node, a list of platforms
+    * @return false if the conf is invalid, such as overlapped buckets in a layer
+    */
+    bool init(const YAML::Node &conf) {
+        try {
+            for (const auto &platform_conf : conf) {
+                std::string platform = platform_conf["platform"].as<std::string>();
+                auto &scene_table = _platform_table[platform];
+                for (const auto &scene_conf : platform_conf["scenes"]) {
+                    std::string scene_name = scene_conf["scene_name"].as<std::string>();
+                    if (scene_table.find(scene_name) != scene_table.end()) {
+                        ERR_LOG << "duplicated scene : " << platform << "." << scene_name << std::endl;
+                        return false;
+                    }
+                    if (!init_scene(scene_conf, &scene_table[scene_name])) {
+                        ERR_LOG << "invalid scene : " << platform << "." << scene_name << std::endl;
+                        return false;
+                    }
+                }
+            }
+        } catch (const std::exception &e) {
+            ERR_LOG << "invalid flow conf : " << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+    * route a request, no allocation.
+    * @param platform
+    * @param scene
+    * @param guid user id the traffic is split by
+    * @param route hit flow of every layer and the scheduler, valid while the router lives
+    * @return false if the scene is not found
+    */
+    bool route(const std::string &platform, const std::string &scene, const std::string &guid,
+            FlowRoute *route) const {
+        auto platform_iter = _platform_table.find(platform);
+        if (platform_iter == _platform_table.end()) {
+            return false;
+        }
+        auto scene_iter = platform_iter->second.find(scene);
+        if (scene_iter == platform_iter->second.end()) {
+            return false;
+        }
+        const Scene &flow_scene = scene_iter->second;
+        uint64_t guid_hash = hash_guid(guid);
+        route->_layer_num = flow_scene._layers.size();
+        route->_scheduler_name = nullptr;
+        for (size_t i = 0; i < flow_scene._layers.size(); ++i) {
+            const Layer &layer = flow_scene._layers[i];
+            int32_t flow_index = route_layer(layer, guid, guid_hash);
+            if (flow_index < 0) {
+                route->_flow_ids[i] = INVALID_FLOW_ID;
+                continue;
+            }
+            const Flow &flow = layer._flows[flow_index];
+            route->_flow_ids[i] = flow._flow_id;
+            if (route->_scheduler_name == nullptr && !flow._scheduler_name.empty()) {
+                route->_scheduler_name = &flow._scheduler_name;
+            }
+        }
+        if (route->_scheduler_name == nullptr) {
+            route->_scheduler_name = &flow_scene._scheduler_name;
+        }
+        return true;
+    }
+
+    /* every scheduler the flows refer to, for validation. */
+    std::vector<std::string> get_scheduler_names() const {
+        std::vector<std::string> scheduler_names;
+        for (auto &platform : _platform_table) {
+            for (auto &scene : platform.second) {
+                scheduler_names.push_back(scene.second._scheduler_name);
+                for (auto &layer : scene.second._layers) {
+                    for (auto &flow : layer._flows) {
+                        if (!flow._scheduler_name.empty()) {
+                            scheduler_names.push_back(flow._scheduler_name);
+                        }
+                    }
+                }
+            }
+        }
+        return scheduler_names;
+    }
+
+    /* fnv-1a of guid, hashed once per request and mixed with each layer seed. */
+    static uint64_t hash_guid(const std::string &guid) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (char c : guid) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    /* bucket of a hashed guid in a random layer. */
+    static int64_t get_random_bucket(const uint64_t guid_hash, const uint64_t seed) {
+        uint64_t hash = guid_hash ^ (seed * 0x9E3779B97F4A7C15ULL);
+        hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+        hash ^= hash >> 31;
+        return static_cast<int64_t>(hash % FLOW_BUCKET_NUM);
+    }
+
+    /* bucket of a guid in a tail layer, the last 4 digits, random if it does not end with a digit. */
+    static int64_t get_tail_bucket(const std::string &guid, const uint64_t guid_hash, const uint64_t seed) {
+        int64_t bucket = 0;
+        int64_t scale = 1;
+        for (size_t i = guid.size(); i > 0 && scale < FLOW_BUCKET_NUM; --i) {
+            char c = guid[i - 1];
+            if (c < '0' || c > '9') {
+                break;
+            }
+            bucket += (c - '0') * scale;
+            scale *= 10;
+        }
+        return scale == 1 ? get_random_bucket(guid_hash, seed) : bucket;
+    }
+
+private:
+    /* divider of a layer. */
+    enum DividerType {
+        RANDOM_DIVIDER_TYPE = 0,
+        TAIL_DIVIDER_TYPE   = 1,
+        SET_DIVIDER_TYPE    = 2,
+    };
+
+    struct Flow {
+        int64_t     _flow_id{INVALID_FLOW_ID};
+        std::string _scheduler_name;
+    };
+
+    /* guid of the white list and its flow, the guid is compared on a hash hit. */
+    struct WhiteListEntry {
+        std::string _guid;
+        int32_t     _flow_index{-1};
+    };
+
+    struct Layer {
+        std::string                                     _layer_name;
+        DividerType                                     _divider_type{RANDOM_DIVIDER_TYPE};
+        uint64_t                                        _seed{0};
+        std::vector<Flow>                               _flows;
+        /* bucket -> flow index, -1 if none, empty for set layers. */
+        std::vector<int32_t>                            _bucket_table;
+        /* guid hash -> white list entry. */
+        std::unordered_map<uint64_t, WhiteListEntry>    _white_list;
+    };
+
+    struct Scene {
+        std::string         _scheduler_name;
+        std::vector<Layer>  _layers;
+    };
+
+    /* none copy. */
+    FlowRouter(const FlowRouter &rhs) = delete;
+    FlowRouter &operator=(const FlowRouter &rhs) = delete;
+
+    static int32_t route_layer(const Layer &layer, const std::string &guid, const uint64_t guid_hash) {
+        if (!layer._white_list.empty()) {
+            auto iter = layer._white_list.find(guid_hash);
+            if (iter != layer._white_list.end() && iter->second._guid == guid) {
+                return iter->second._flow_index;
+            }
+        }
+        switch (layer._divider_type) {
+        case RANDOM_DIVIDER_TYPE:
+            return layer._bucket_table[get_random_bucket(guid_hash, layer._seed)];
+        case TAIL_DIVIDER_TYPE:
+            return layer._bucket_table[get_tail_bucket(guid, guid_hash, layer._seed)];
+        default:
+            return -1;
+        }
+    }
+
+    bool init_scene(const YAML::Node &conf, Scene *scene) {
+        scene->_scheduler_name = conf["scheduler_name"].as<std::string>();
+        if (!conf["layers"].IsDefined()) {
+            return true;
+        }
+        if (static_cast<int64_t>(conf["layers"].size()) > MAX_FLOW_LAYER_NUM) {
+            ERR_LOG << "too many layers, max : " << MAX_FLOW_LAYER_NUM << std::endl;
+            return false;
+        }
+        for (const auto &layer_conf : conf["layers"]) {
+            scene->_layers.emplace_back();
+            if (!init_layer(layer_conf, &scene->_layers.back())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool init_layer(const YAML::Node &conf, Layer *layer) {
+        layer->_layer_name = conf["layer_name"].as<std::string>();
+        layer->_seed = conf["seed"].IsDefined() ? conf["seed"].as<uint64_t>() : hash_guid(layer->_layer_name);
+        std::string divider = conf["divider_type"].IsDefined() ?
+                conf["divider_type"].as<std::string>() : RANDOM_DIVIDER;
+        if (divider == RANDOM_DIVIDER) {
+            layer->_divider_type = RANDOM_DIVIDER_TYPE;
+        } else if (divider == TAIL_DIVIDER) {
+            layer->_divider_type = TAIL_DIVIDER_TYPE;
+        } else if (divider == SET_DIVIDER) {
+            layer->_divider_type = SET_DIVIDER_TYPE;
+        } else {
+            ERR_LOG << "unknown divider_type : " << divider << ", layer : " << layer->_layer_name << std::endl;
+            return false;
+        }
+        if (layer->_divider_type != SET_DIVIDER_TYPE) {
+            layer->_bucket_table.assign(FLOW_BUCKET_NUM, -1);
+        }
+
+        for (const auto &flow_conf : conf["flows"]) {
+            Flow flow;
+            flow._flow_id = flow_conf["flow_id"].as<int64_t>();
+            if (flow_conf["scheduler_name"].IsDefined()) {
+                flow._scheduler_name = flow_conf["scheduler_name"].as<std::string>();
+            }
+            int32_t flow_index = layer->_flows.size();
+            layer->_flows.push_back(flow);
+            if (!add_buckets(flow_conf, flow_index, layer) || !add_white_list(flow_conf, flow_index, layer)) {
+                ERR_LOG << "invalid flow : " << flow._flow_id << ", layer : " << layer->_layer_name << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* fill the bucket table, flows of one layer must not overlap. */
+    static bool add_buckets(const YAML::Node &conf, const int32_t flow_index, Layer *layer) {
+        std::vector<std::pair<int64_t, int64_t>> ranges;
+        if (conf["buckets"].IsDefined()) {
+            const YAML::Node &buckets = conf["buckets"];
+            if (buckets.size() > 0 && buckets[0].IsScalar()) {
+                ranges.emplace_back(buckets[0].as<int64_t>(), buckets[1].as<int64_t>());
+            } else {
+                for (const auto &range : buckets) {
+                    ranges.emplace_back(range[0].as<int64_t>(), range[1].as<int64_t>());
+                }
+            }
+        }
+        std::vector<int64_t> tails;
+        if (conf["tails"].IsDefined()) {
+            tails = conf["tails"].as<std::vector<int64_t>>();
+        }
+        if ((!ranges.empty() || !tails.empty()) && layer->_divider_type == SET_DIVIDER_TYPE) {
+            ERR_LOG << "set divider takes white_list only" << std::endl;
+            return false;
+        }
+        if (!tails.empty() && layer->_divider_type != TAIL_DIVIDER_TYPE) {
+            ERR_LOG << "tails of a non tail divider" << std::endl;
+            return false;
+        }
+        for (auto &range : ranges) {
+            if (range.first < 0 || range.first > range.second || range.second > FLOW_BUCKET_NUM) {
+                ERR_LOG << "invalid buckets : [" << range.first << ", " << range.second << ")" << std::endl;
+                return false;
+            }
+            for (int64_t bucket = range.first; bucket < range.second; ++bucket) {
+                if (!set_bucket(bucket, flow_index, layer)) {
+                    return false;
+                }
+            }
+        }
+        for (auto tail : tails) {
+            if (tail < 0 || tail > 9) {
+                ERR_LOG << "invalid tail : " << tail << std::endl;
+                return false;
+            }
+            for (int64_t bucket = tail; bucket < FLOW_BUCKET_NUM; bucket += 10) {
+                if (!set_bucket(bucket, flow_index, layer)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static bool set_bucket(const int64_t bucket, const int32_t flow_index, Layer *layer) {
+        int32_t &slot = layer->_bucket_table[bucket];
+        if (slot >= 0 && slot != flow_index) {
+            ERR_LOG << "bucket " << bucket << " is taken by flow : " << layer->_flows[slot]._flow_id << std::endl;
+            return false;
+        }
+        slot = flow_index;
+        return true;
+    }
+
+    static bool add_white_list(const YAML::Node &conf, const int32_t flow_index, Layer *layer) {
+        if (!conf["white_list"].IsDefined()) {
+            return true;
+        }
+        for (const auto &guid_conf : conf["white_list"]) {
+            std::string guid = guid_conf.as<std::string>();
+            uint64_t guid_hash = hash_guid(guid);
+            auto iter = layer->_white_list.find(guid_hash);
+            if (iter != layer->_white_list.end()) {
+                if (iter->second._flow_index == flow_index && iter->second._guid == guid) {
+                    continue;
+                }
+                ERR_LOG << "guid in two flows or hash collision : " << guid << std::endl;
+                return false;
+            }
+            layer->_white_list.emplace(guid_hash, WhiteListEntry{guid, flow_index});
+        }
+        return true;
+    }
+
+    /* platform -> scene name -> scene. */
+    std::unordered_map<std::string, std::unordered_map<std::string, Scene>> _platform_table;
+};
+using FlowRouterPtr = std::unique_ptr<FlowRouter>;
+
+/**
+ * @class FlowLoader.
+ * loads flow.yaml for DoubleData<FlowRouterPtr, FlowLoader>, throws if the
+ * conf is invalid so the current router is kept.
+ **/
+class FlowLoader {
+public:
+    /* ctor. */
+    FlowLoader() = default;
+    virtual ~FlowLoader() = default;
+
+    /* bind the loader to flow.yaml. */
+    bool init(const std::string &file_name) {
+        _file_name = file_name;
+        struct stat file_stat;
+        return !file_name.empty() && stat(file_name.c_str(), &file_stat) == 0;
+    }
+
+    /* flow.yaml. */
+    std::string get_load_file_name() const {
+        return _file_name;
+    }
+
+    /* load and build the router. */
+    FlowRouterPtr load() {
+        FlowRouterPtr router(new FlowRouter());
+        if (!router->init(YAML::LoadFile(_file_name))) {
+            throw std::runtime_error("invalid flow conf : " + _file_name);
+        }
+        return router;
+    }
+
+private:
+    std::string _file_name;
+};
+
+} // end namespace frame
+} // end namespace inf
@@ -0,0 +1,426 @@
+#pragma once
+#include "task.h"
+#include "task_scheduler.h"
+#include "double_buffer.h"
+#include "file_watcher.h"
+#include "flow_router.h"
+#include "utils/common_log.h"
+#include "yaml-cpp/yaml.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+#include <stdint.h>
+#include <sys/stat.h>
+
+namespace inf {
+namespace frame {
+
+/**
+ * @class FrameSnapshot.
+ * one consistent generation of task.yaml, scheduler.yaml and flow.yaml:
+ * the task map, the schedulers, the flow router, and the plan of every scheduler
+ * built against this task map.
+ * it is validated as a whole before published, so a scheduler never refers to
+ * an alias missing from the tasks it runs with, and a flow never refers to a
+ * missing scheduler.
+ **/
+template <typename UnitTaskCreator>
+class FrameSnapshot {
+public:
+    using Scheduler = TaskScheduler<UnitTaskCreator>;
+    using SchedulerTablePtr = typename TaskSchedulerManager<UnitTaskCreator>::HashTaskSchedulerPtrPtr;
+
+    /* ctor. */
+    FrameSnapshot(TaskMapPtr task_map, SchedulerTablePtr scheduler_table,
+            FlowRouterPtr flow_router, const uint64_t version) :
+            _task_map(std::move(task_map)), _scheduler_table(std::move(scheduler_table)),
+            _flow_router(std::move(flow_router)), _version(version) {};
+
+    /**
+    * check the parts against each other, build the plans of every scheduler.
+    * @return false if a scheduler refers to a missing task, or a flow to a missing scheduler
+    */
+    bool validate() const {
+        if (!_task_map || !_scheduler_table) {
+            return false;
+        }
+        for (auto &scheduler : *_scheduler_table) {
+            if (!scheduler.second->prepare(*_task_map)) {
+                return false;
+            }
+        }
+        if (_flow_router) {
+            for (auto &scheduler_name : _flow_router->get_scheduler_names()) {
+                if (get_scheduler(scheduler_name) == nullptr) {
+                    ERR_LOG << "flow refers to a missing scheduler : " << scheduler_name << std::endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /* tasks of this generation. */
+    const TaskMap& get_task_map() const {
+        return *_task_map;
+    }
+
+    /**
+    * scheduler of this generation.
+    * @param scheduler_name
+    * @return scheduler, nullptr if not found
+    */
+    const Scheduler* get_scheduler(const std::string &scheduler_name) const {
+        auto iter = _scheduler_table->find(scheduler_name);
+        if (iter == _scheduler_table->end()) {
+            return nullptr;
+        }
+        return iter->second.get();
+    }
+
+    /* flow router, nullptr if no flow file. */
+    const FlowRouter* get_flow_router() const {
+        return _flow_router.get();
+    }
+
+    /* published version, increased by every successful load. */
+    uint64_t get_version() const {
+        return _version;
+    }
+
+private:
+    /* none copy. */
+    FrameSnapshot(const FrameSnapshot &rhs) = delete;
+    FrameSnapshot &operator=(const FrameSnapshot &rhs) = delete;
+
+    TaskMapPtr          _task_map;
+    SchedulerTablePtr   _scheduler_table;
+    FlowRouterPtr       _flow_router;
+    uint64_t            _version{0};
+};
+
+/**
+ * @class FrameSnapshotLoader.
+ * loads the three files into one snapshot, throws if it is invalid,
+ * so DoubleData keeps the current one.
+ **/
+template <typename UnitTaskCreator>
+class FrameSnapshotLoader {
+public:
+    using Snapshot = FrameSnapshot<UnitTaskCreator>;
+    using SnapshotPtr = std::unique_ptr<Snapshot>;
+
+    /* ctor. */
+    FrameSnapshotLoader(const std::string &task_conf, const std::string &scheduler_conf,
+            const std::string &flow_conf) : _task_conf(task_conf),
+            _scheduler_conf(scheduler_conf), _flow_conf(flow_conf) {};
+
+    /* whether the files exist. */
+    bool init() {
+        struct stat file_stat;
+        if (!_task_loader.init(_task_conf) || stat(_scheduler_conf.c_str(), &file_stat) != 0) {
+            return false;
+        }
+        return _flow_conf.empty() || stat(_flow_conf.c_str(), &file_stat) == 0;
+    }
+
+    /* task conf. */
+    std::string get_load_file_name() const {
+        return _task_conf;
+    }
+
+    /* load every part and validate them together. */
+    SnapshotPtr load() {
+        TaskMapPtr task_map = _task_loader.load();
+        if (!task_map) {
+            throw std::runtime_error("load task conf failed : " + _task_conf);
+        }
+        auto scheduler_table = TaskSchedulerManager<UnitTaskCreator>::load_schedulers(_scheduler_conf);
+        if (!scheduler_table) {
+            throw std::runtime_error("load scheduler conf failed : " + _scheduler_conf);
+        }
+        FlowRouterPtr flow_router;
+        if (!_flow_conf.empty()) {
+            FlowLoader flow_loader;
+            flow_loader.init(_flow_conf);
+            flow_router = flow_loader.load();
+        }
+        SnapshotPtr snapshot(new Snapshot(std::move(task_map), std::move(scheduler_table),
+                std::move(flow_router), _version + 1));
+        if (!snapshot->validate()) {
+            throw std::runtime_error("tasks and schedulers do not match : " + _scheduler_conf);
+        }
+        ++_version;
+        INFO_LOG << "snapshot loaded, version : " << _version << std::endl;
+        return snapshot;
+    }
+
+private:
+    /* none copy. */
+    FrameSnapshotLoader(const FrameSnapshotLoader &rhs) = delete;
+    FrameSnapshotLoader &operator=(const FrameSnapshotLoader &rhs) = delete;
+
+    std::string                 _task_conf;
+    std::string                 _scheduler_conf;
+    std::string                 _flow_conf;
+    /* reuses the unchanged tasks of the last load. */
+    TaskLoader<UnitTaskCreator> _task_loader;
+    /* version of the last published snapshot. */
+    uint64_t                    _version{0};
+};
+
+/**
+ * @class FrameSnapshotManager.
+ * publishes FrameSnapshot by one pointer swap, instead of TaskManager and
+ * TaskSchedulerManager reloading on their own.
+ * a change of any file loads all of them, a snapshot failing validation,
+ * such as a new scheduler deployed before its tasks, is rejected and the
+ * current one is kept, the next change retries.
+ * a request pins one snapshot for its whole lifetime.
+ * e.g.:
+ * FrameSnapshotManager<Creator>::instance().init("task.yaml", "scheduler.yaml", "flow.yaml", true);
+ * FrameSnapshotManager<Creator>::instance().schedule("rec_base", &data_map);
+ **/
+template <typename UnitTaskCreator>
+class FrameSnapshotManager {
+public:
+    using Snapshot = FrameSnapshot<UnitTaskCreator>;
+    using SnapshotPtr = std::unique_ptr<Snapshot>;
+    /* pinned snapshot, see read(). */
+    using SnapshotGuard = typename ::inf::utils::DoubleData<SnapshotPtr,
+            FrameSnapshotLoader<UnitTaskCreator>>::ReadGuard;
+
+    /* singleton. */
+    static FrameSnapshotManager& instance() {
+        static FrameSnapshotManager instance;
+        return instance;
+    }
+
+    /**
+    * load the first snapshot.
+    * @param task_conf task.yaml
+    * @param scheduler_conf scheduler.yaml
+    * @param flow_conf flow.yaml, optional
+    * @param is_watch reload when any of the files changes
+    * @return false if the files are missing or the snapshot is invalid
+    */
+    bool init(const std::string &task_conf, const std::string &scheduler_conf,
+            const std::string &flow_conf = "", const bool is_watch = false) {
+        unwatch();
+        remove_reload();
+        try {
+            SnapshotLoaderPtr loader(new SnapshotLoader(task_conf, scheduler_conf, flow_conf));
+            if (!loader->init()) {
+                ERR_LOG << "snapshot conf not exist : " << task_conf << ", " << scheduler_conf
+                        << ", " << flow_conf << std::endl;
+                return false;
+            }
+            _double_buffer_ptr.reset(new SnapshotDoubleBuffer(std::move(loader)));
+            if (_double_buffer_ptr->init() != 0) {
+                ERR_LOG << "snapshot init failed : " << _double_buffer_ptr->get_reload_stats()._last_error
+                        << std::endl;
+                _double_buffer_ptr.reset();
+                return false;
+            }
+        } catch (const std::exception &e) {
+            ERR_LOG << "snapshot init failed : " << e.what() << std::endl;
+            _double_buffer_ptr.reset();
+            return false;
+        }
+        if (is_watch) {
+            _reload_id = ::inf::utils::ReloadExecutor::instance().add([this]() { reload(); });
+            for (auto &file_name : {task_conf, scheduler_conf, flow_conf}) {
+                if (file_name.empty()) {
+                    continue;
+                }
+                int64_t watch_id = ::inf::utils::FileWatcher::instance().watch(file_name,
+                        [this](const std::string &) { request_reload(); });
+                if (watch_id == ::inf::utils::INVALID_WATCH_ID) {
+                    ERR_LOG << "watch failed, reload by hand : " << file_name << std::endl;
+                    continue;
+                }
+                _watch_ids.push_back(watch_id);
+            }
+        }
+        return true;
+    }
+
+    /* reload on the shared ReloadExecutor, returns at once, so a slow load never blocks the watcher. */
+    void request_reload() {
+        ::inf::utils::ReloadExecutor::instance().request(_reload_id);
+    }
+
+    /**
+    * load every file and publish the new snapshot if valid.
+    * it may be called while holding a read(), it only waits when a generation
+    * cap is set on the snapshot buffer and every allowed generation is still pinned.
+    * @return false if rejected, the current snapshot is kept
+    */
+    bool reload() {
+        if (!_double_buffer_ptr) {
+            return false;
+        }
+        if (!_double_buffer_ptr->swap_data()) {
+            _rejected_num.fetch_add(1, std::memory_order_relaxed);
+            ERR_LOG << "snapshot rejected, keep version " << get_version() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+    * pin the current snapshot, lock free, hold it for the whole request.
+    * @return SnapshotGuard, empty if not initialized
+    */
+    SnapshotGuard read() const {
+        if (!_double_buffer_ptr) {
+            return SnapshotGuard();
+        }
+        return _double_buffer_ptr->read();
+    }
+
+    /**
+    * shared pin of the current snapshot, for a request finishing on another thread.
+    * @return snapshot, nullptr if not initialized
+    */
+    std::shared_ptr<const SnapshotPtr> get_shared() const {
+        if (!_double_buffer_ptr) {
+            return nullptr;
+        }
+        return _double_buffer_ptr->get_current();
+    }
+
+    /**
+    * run a scheduler of the current snapshot, tasks and scheduler of the same generation.
+    * @param scheduler_name
+    * @param data
+    * @return true if ok
+    */
+    bool schedule(const std::string &scheduler_name, void *data) const {
+        auto snapshot = read();
+        if (!snapshot || !*snapshot) {
+            ERR_LOG << "snapshot not ready" << std::endl;
+            return false;
+        }
+        auto scheduler = (*snapshot)->get_scheduler(scheduler_name);
+        if (scheduler == nullptr) {
+            ERR_LOG << "not found scheduler : " << scheduler_name << std::endl;
+            return false;
+        }
+        return scheduler->schedule((*snapshot)->get_task_map(), data);
+    }
+
+    /**
+    * route a request by the flows of the current snapshot, then run the scheduler it hits.
+    * @param platform
+    * @param scene
+    * @param guid
+    * @param data
+    * @param route optional, the hit flows of every layer, for logging and reporting
+    * @return false if the scene or the scheduler is not found, or the scheduler failed
+    */
+    bool schedule_flow(const std::string &platform, const std::string &scene, const std::string &guid,
+            void *data, FlowRoute *route = nullptr) const {
+        auto snapshot = read();
+        if (!snapshot || !*snapshot || (*snapshot)->get_flow_router() == nullptr) {
+            ERR_LOG << "flow not ready" << std::endl;
+            return false;
+        }
+        FlowRoute local_route;
+        route = route == nullptr ? &local_route : route;
+        if (!(*snapshot)->get_flow_router()->route(platform, scene, guid, route)) {
+            ERR_LOG << "not found scene : " << platform << "." << scene << std::endl;
+            return false;
+        }
+        auto scheduler = (*snapshot)->get_scheduler(*route->_scheduler_name);
+        if (scheduler == nullptr) {
+            return false;
+        }
+        return scheduler->schedule((*snapshot)->get_task_map(), data);
+    }
+
+    /**
+    * schedule_async on the current snapshot, pinned until done is called.
+    * @param scheduler_name
+    * @param data must stay valid until done is called
+    * @param done called exactly once
+    */
+    void schedule_async(const std::string &scheduler_name, void *data, TaskDone done) const {
+        auto snapshot = get_shared();
+        if (!snapshot || !*snapshot) {
+            ERR_LOG << "snapshot not ready" << std::endl;
+            done(false);
+            return;
+        }
+        auto scheduler = (*snapshot)->get_scheduler(scheduler_name);
+        if (scheduler == nullptr) {
+            ERR_LOG << "not found scheduler : " << scheduler_name << std::endl;
+            done(false);
+            return;
+        }
+        const TaskMap &task_map = (*snapshot)->get_task_map();
+        scheduler->schedule_async(task_map, std::move(snapshot), data, std::move(done));
+    }
+
+    /* version of the current snapshot, 0 if not initialized. */
+    uint64_t get_version() const {
+        auto snapshot = read();
+        return snapshot && *snapshot ? (*snapshot)->get_version() : 0;
+    }
+
+    /* loads rejected by validation or broken files. */
+    int64_t get_rejected_num() const {
+        return _rejected_num.load(std::memory_order_relaxed);
+    }
+
+private:
+    using SnapshotLoader = FrameSnapshotLoader<UnitTaskCreator>;
+    using SnapshotLoaderPtr = std::unique_ptr<SnapshotLoader>;
+    using SnapshotDoubleBuffer = ::inf::utils::DoubleData<SnapshotPtr, SnapshotLoader>;
+
+    /* ctor. */
+    FrameSnapshotManager() = default;
+
+    /* dtor. */
+    ~FrameSnapshotManager() {
+        unwatch();
+        remove_reload();
+    }
+
+    /* none copy. */
+    FrameSnapshotManager(const FrameSnapshotManager &rhs) = delete;
+    FrameSnapshotManager &operator=(const FrameSnapshotManager &rhs) = delete;
+
+    void unwatch() {
+        for (auto watch_id : _watch_ids) {
+            ::inf::utils::FileWatcher::instance().unwatch(watch_id);
+        }
+        _watch_ids.clear();
+    }
+
+    /* when it returns, no reload is running, call after unwatch. */
+    void remove_reload() {
+        if (_reload_id != ::inf::utils::INVALID_RELOAD_ID) {
+            ::inf::utils::ReloadExecutor::instance().remove(_reload_id);
+            _reload_id = ::inf::utils::INVALID_RELOAD_ID;
+        }
+    }
+
+    /* snapshot double buffer. */
+    std::unique_ptr<SnapshotDoubleBuffer>   _double_buffer_ptr;
+
+    /* FileWatcher watch ids of the files. */
+    std::vector<int64_t>                    _watch_ids;
+
+    /* ReloadExecutor id, requested by the watch callbacks. */
+    int64_t                                 _reload_id{::inf::utils::INVALID_RELOAD_ID};
+
+    /* rejected load num. */
+    std::atomic<int64_t>                    _rejected_num{0};
+};
+
+} // end namespace frame
+} // end namespace inf
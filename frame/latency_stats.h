@@ -0,0 +1,383 @@
+#pragma once
+#include "utils/common_log.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
+#include <algorithm>
+#include <stdint.h>
+
+namespace inf {
+namespace frame {
+
+const int64_t INVALID_STAT_ID = -1;
+/* max num of registered stats, such as task aliases and schedulers. */
+const int64_t MAX_LATENCY_STAT_NUM = 4096;
+/* 2^3 sub buckets per power of 2, a percentile is within 12.5% of the real value. */
+const int64_t LATENCY_SUB_BUCKET_BITS = 3;
+const int64_t LATENCY_SUB_BUCKET_NUM = 1 << LATENCY_SUB_BUCKET_BITS;
+/* latency above 2^36 ns (about 68s) goes into the last bucket. */
+const int64_t LATENCY_MAX_EXPONENT = 36;
+const int64_t LATENCY_BUCKET_NUM = (LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 1) *
+        LATENCY_SUB_BUCKET_NUM + LATENCY_SUB_BUCKET_NUM;
+
+/**
+ * @class LatencyHistogram.
+ * log-linear histogram in ns, like HDR histogram with 3 significant bits.
+ * used as the merged snapshot of LatencyStats, a window is the difference
+ * of two snapshots.
+ **/
+class LatencyHistogram {
+public:
+    /* bucket of a latency. */
+    static int64_t get_bucket(const uint64_t cost_ns) {
+        if (cost_ns < static_cast<uint64_t>(LATENCY_SUB_BUCKET_NUM)) {
+            return cost_ns;
+        }
+        int64_t exponent = 63 - __builtin_clzll(cost_ns);
+        if (exponent > LATENCY_MAX_EXPONENT) {
+            return LATENCY_BUCKET_NUM - 1;
+        }
+        int64_t sub_bucket = (cost_ns >> (exponent - LATENCY_SUB_BUCKET_BITS)) & (LATENCY_SUB_BUCKET_NUM - 1);
+        return (exponent - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKET_NUM + sub_bucket;
+    }
+
+    /* highest latency of a bucket. */
+    static uint64_t get_bucket_upper_ns(const int64_t bucket) {
+        if (bucket < LATENCY_SUB_BUCKET_NUM) {
+            return bucket;
+        }
+        int64_t exponent = bucket / LATENCY_SUB_BUCKET_NUM + LATENCY_SUB_BUCKET_BITS - 1;
+        uint64_t sub_bucket = bucket % LATENCY_SUB_BUCKET_NUM;
+        uint64_t unit = 1ULL << (exponent - LATENCY_SUB_BUCKET_BITS);
+        return ((LATENCY_SUB_BUCKET_NUM + sub_bucket + 1) * unit) - 1;
+    }
+
+    /**
+    * latency at the percentile.
+    * @param percentile in [0, 100]
+    * @return upper ns of the bucket, 0 if empty
+    */
+    uint64_t get_percentile_ns(const double percentile) const {
+        //counted from the buckets, counters of a live shard may be one record ahead
+        uint64_t total = 0;
+        for (auto count : _buckets) {
+            total += count;
+        }
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(total * percentile / 100.0 + 0.5));
+        uint64_t count = 0;
+        for (int64_t i = 0; i < LATENCY_BUCKET_NUM; ++i) {
+            count += _buckets[i];
+            if (count >= target) {
+                return get_bucket_upper_ns(i);
+            }
+        }
+        return get_bucket_upper_ns(LATENCY_BUCKET_NUM - 1);
+    }
+
+    /* record num. */
+    uint64_t get_count() const {
+        return _ok_num + _fail_num;
+    }
+
+    /* mean ns. */
+    uint64_t get_mean_ns() const {
+        uint64_t total = get_count();
+        return total == 0 ? 0 : _sum_ns / total;
+    }
+
+    /* this - rhs, for a window. */
+    void subtract(const LatencyHistogram &rhs) {
+        for (int64_t i = 0; i < LATENCY_BUCKET_NUM; ++i) {
+            _buckets[i] -= rhs._buckets[i];
+        }
+        _ok_num -= rhs._ok_num;
+        _fail_num -= rhs._fail_num;
+        _sum_ns -= rhs._sum_ns;
+    }
+
+    std::vector<uint64_t>   _buckets = std::vector<uint64_t>(LATENCY_BUCKET_NUM, 0);
+    uint64_t                _ok_num{0};
+    uint64_t                _fail_num{0};
+    uint64_t                _sum_ns{0};
+};
+
+/**
+ * @class LatencyStats.
+ * latency histograms and ok/fail counters of every task alias and scheduler.
+ * each thread records into its own shard without lock or atomic rmw,
+ * shards are merged when a snapshot is read.
+ * reset() starts a new window, later snapshots only count the records after it.
+ * e.g.:
+ * int64_t stat_id = LatencyStats::instance().register_stat("task.recall");
+ * LatencyStats::instance().record(stat_id, cost_ns, ok);
+ * std::string json = LatencyStats::instance().dump_json();
+ **/
+class LatencyStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /* merged stats of one name. */
+    struct Snapshot {
+        std::string         _name;
+        LatencyHistogram    _histogram;
+    };
+
+    /* singleton, never destroyed, threads may record during static destruction. */
+    static LatencyStats& instance() {
+        static LatencyStats *instance = new LatencyStats();
+        return *instance;
+    }
+
+    /**
+    * id of a stat name, registered at the first call.
+    * @param name such as task.<alias> or scheduler.<name>
+    * @return id, INVALID_STAT_ID if too many stats
+    */
+    int64_t register_stat(const std::string &name) {
+        std::lock_guard<std::mutex> lock(_lock);
+        auto iter = _id_table.find(name);
+        if (iter != _id_table.end()) {
+            return iter->second;
+        }
+        if (static_cast<int64_t>(_names.size()) >= MAX_LATENCY_STAT_NUM) {
+            ERR_LOG << "too many latency stats, drop : " << name << std::endl;
+            return INVALID_STAT_ID;
+        }
+        int64_t stat_id = _names.size();
+        _names.push_back(name);
+        _id_table.emplace(name, stat_id);
+        return stat_id;
+    }
+
+    /**
+    * record one execution on the shard of the calling thread.
+    * @param stat_id from register_stat
+    * @param cost_ns latency
+    * @param ok result of the execution
+    */
+    void record(const int64_t stat_id, const int64_t cost_ns, const bool ok) {
+        if (stat_id < 0 || stat_id >= MAX_LATENCY_STAT_NUM) {
+            return;
+        }
+        Counter *counter = local_shard().get_counter(stat_id);
+        //single writer, plain load + store is enough
+        auto &bucket = counter->_buckets[LatencyHistogram::get_bucket(std::max<int64_t>(cost_ns, 0))];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        auto &result = ok ? counter->_ok_num : counter->_fail_num;
+        result.store(result.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        counter->_sum_ns.store(counter->_sum_ns.load(std::memory_order_relaxed) + cost_ns,
+                std::memory_order_relaxed);
+    }
+
+    /**
+    * merged stats since the last reset, names without records are skipped.
+    * @return snapshots ordered by name
+    */
+    std::vector<Snapshot> get_snapshot() {
+        std::lock_guard<std::mutex> lock(_lock);
+        std::vector<LatencyHistogram> merged = merge();
+        std::vector<Snapshot> snapshots;
+        for (size_t i = 0; i < merged.size(); ++i) {
+            if (i < _baseline.size()) {
+                merged[i].subtract(_baseline[i]);
+            }
+            if (merged[i].get_count() == 0) {
+                continue;
+            }
+            snapshots.push_back(Snapshot{_names[i], std::move(merged[i])});
+        }
+        std::sort(snapshots.begin(), snapshots.end(),
+                [](const Snapshot &lhs, const Snapshot &rhs) { return lhs._name < rhs._name; });
+        return snapshots;
+    }
+
+    /* start a new window, writers are not blocked. */
+    void reset() {
+        std::lock_guard<std::mutex> lock(_lock);
+        _baseline = merge();
+    }
+
+    /* one line per name: count, ok, fail, mean and percentiles in us. */
+    std::string dump_text() {
+        std::ostringstream output;
+        output << std::fixed << std::setprecision(1);
+        for (auto &snapshot : get_snapshot()) {
+            const LatencyHistogram &histogram = snapshot._histogram;
+            output << snapshot._name << " count:" << histogram.get_count()
+                   << " ok:" << histogram._ok_num << " fail:" << histogram._fail_num
+                   << " mean_us:" << histogram.get_mean_ns() / 1000.0
+                   << " p50_us:" << histogram.get_percentile_ns(50) / 1000.0
+                   << " p90_us:" << histogram.get_percentile_ns(90) / 1000.0
+                   << " p99_us:" << histogram.get_percentile_ns(99) / 1000.0
+                   << " p999_us:" << histogram.get_percentile_ns(99.9) / 1000.0 << "\n";
+        }
+        return output.str();
+    }
+
+    /* {"name": {"count":.., "ok":.., "fail":.., "mean_us":.., "p50_us":.., ...}, ...} */
+    std::string dump_json() {
+        std::ostringstream output;
+        output << std::fixed << std::setprecision(1) << "{";
+        bool first = true;
+        for (auto &snapshot : get_snapshot()) {
+            const LatencyHistogram &histogram = snapshot._histogram;
+            output << (first ? "" : ",") << "\"" << snapshot._name << "\":{"
+                   << "\"count\":" << histogram.get_count()
+                   << ",\"ok\":" << histogram._ok_num << ",\"fail\":" << histogram._fail_num
+                   << ",\"mean_us\":" << histogram.get_mean_ns() / 1000.0
+                   << ",\"p50_us\":" << histogram.get_percentile_ns(50) / 1000.0
+                   << ",\"p90_us\":" << histogram.get_percentile_ns(90) / 1000.0
+                   << ",\"p99_us\":" << histogram.get_percentile_ns(99) / 1000.0
+                   << ",\"p999_us\":" << histogram.get_percentile_ns(99.9) / 1000.0 << "}";
+            first = false;
+        }
+        output << "}";
+        return output.str();
+    }
+
+private:
+    /* counters of one stat in one shard, written by the owner thread only. */
+    struct Counter {
+        std::atomic<uint64_t>   _buckets[LATENCY_BUCKET_NUM];
+        std::atomic<uint64_t>   _ok_num{0};
+        std::atomic<uint64_t>   _fail_num{0};
+        std::atomic<uint64_t>   _sum_ns{0};
+
+        Counter() {
+            for (auto &bucket : _buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /* counters of one thread, created when the stat is first recorded. */
+    struct Shard {
+        std::unique_ptr<std::atomic<Counter*>[]>    _counters;
+
+        Shard() : _counters(new std::atomic<Counter*>[MAX_LATENCY_STAT_NUM]) {
+            for (int64_t i = 0; i < MAX_LATENCY_STAT_NUM; ++i) {
+                _counters[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        ~Shard() {
+            for (int64_t i = 0; i < MAX_LATENCY_STAT_NUM; ++i) {
+                delete _counters[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        Counter* get_counter(const int64_t stat_id) {
+            Counter *counter = _counters[stat_id].load(std::memory_order_relaxed);
+            if (counter == nullptr) {
+                counter = new Counter();
+                _counters[stat_id].store(counter, std::memory_order_release);
+            }
+            return counter;
+        }
+    };
+
+    /* hand the shard to the next thread when the owner exits, records are kept. */
+    struct ShardHolder {
+        Shard *_shard{nullptr};
+        ~ShardHolder() {
+            if (_shard != nullptr) {
+                LatencyStats &stats = LatencyStats::instance();
+                std::lock_guard<std::mutex> lock(stats._lock);
+                stats._free_shards.push_back(_shard);
+            }
+        }
+    };
+
+    /* ctor. */
+    LatencyStats() = default;
+
+    /* none copy. */
+    LatencyStats(const LatencyStats &rhs) = delete;
+    LatencyStats &operator=(const LatencyStats &rhs) = delete;
+
+    Shard& local_shard() {
+        thread_local ShardHolder holder;
+        if (holder._shard == nullptr) {
+            std::lock_guard<std::mutex> lock(_lock);
+            if (!_free_shards.empty()) {
+                holder._shard = _free_shards.back();
+                _free_shards.pop_back();
+            } else {
+                _shards.emplace_back(new Shard());
+                holder._shard = _shards.back().get();
+            }
+        }
+        return *holder._shard;
+    }
+
+    /* sum of every shard, under _lock. */
+    std::vector<LatencyHistogram> merge() {
+        std::vector<LatencyHistogram> merged(_names.size());
+        for (auto &shard : _shards) {
+            for (size_t i = 0; i < merged.size(); ++i) {
+                Counter *counter = shard->_counters[i].load(std::memory_order_acquire);
+                if (counter == nullptr) {
+                    continue;
+                }
+                LatencyHistogram &histogram = merged[i];
+                for (int64_t j = 0; j < LATENCY_BUCKET_NUM; ++j) {
+                    histogram._buckets[j] += counter->_buckets[j].load(std::memory_order_relaxed);
+                }
+                histogram._ok_num += counter->_ok_num.load(std::memory_order_relaxed);
+                histogram._fail_num += counter->_fail_num.load(std::memory_order_relaxed);
+                histogram._sum_ns += counter->_sum_ns.load(std::memory_order_relaxed);
+            }
+        }
+        return merged;
+    }
+
+    /* guard names, shards and baseline. */
+    std::mutex                                  _lock;
+
+    /* stat names, indexed by id. */
+    std::vector<std::string>                    _names;
+    std::unordered_map<std::string, int64_t>    _id_table;
+
+    /* every shard ever created, and the ones of exited threads. */
+    std::vector<std::unique_ptr<Shard>>         _shards;
+    std::vector<Shard*>                         _free_shards;
+
+    /* merged counters at the last reset. */
+    std::vector<LatencyHistogram>               _baseline;
+};
+
+/**
+ * @class LatencyRecorder.
+ * record the latency of a scope, e.g. a scheduler run.
+ **/
+class LatencyRecorder {
+public:
+    /* ctor. */
+    explicit LatencyRecorder(const int64_t stat_id)
+        : _stat_id(stat_id), _start(LatencyStats::Clock::now()) {};
+
+    /* record with the result. */
+    bool done(const bool ok) {
+        if (_stat_id != INVALID_STAT_ID) {
+            LatencyStats::instance().record(_stat_id, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    LatencyStats::Clock::now() - _start).count(), ok);
+        }
+        return ok;
+    }
+
+private:
+    int64_t                         _stat_id;
+    LatencyStats::Clock::time_point _start;
+};
+
+} // end namespace frame
+} // end namespace inf
@@ -0,0 +1,752 @@
+#pragma once
+#include "utils/common_log.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace inf {
+namespace utils {
+
+/* "INFMMAP1", first bytes of every snapshot file. */
+const uint64_t MMAP_SNAPSHOT_MAGIC = 0x3150414D4D464E49ULL;
+const uint32_t MMAP_SNAPSHOT_FORMAT_VERSION = 1;
+/* max length of a section name, with the ending '\0'. */
+const int64_t MMAP_SECTION_NAME_SIZE = 48;
+/* sections start on a cache line, any trivially copyable element up to it can be viewed in place. */
+const uint64_t MMAP_SECTION_ALIGN = 64;
+
+/* section types. */
+enum MmapSectionType {
+    MMAP_POD_ARRAY      = 1,    //elem_size * count bytes
+    MMAP_STRING_ARRAY   = 2,    //uint64_t offsets[count + 1], then the chars
+    MMAP_BYTES          = 3,    //one blob
+    MMAP_SORTED_KEYS    = 4,    //strictly increasing uint64_t[count], the keys of a dict
+    MMAP_HASH_INDEX     = 5,    //uint32_t slots[count] of a dict, index + 1 of a key, 0 if empty
+};
+
+/* file layout, every position is an offset from the file start. */
+struct MmapHeader {
+    uint64_t    _magic;
+    uint32_t    _format_version;
+    uint32_t    _section_num;
+    uint64_t    _version;           //data version, set by the builder
+    uint64_t    _total_size;
+    uint64_t    _section_offset;    //MmapSection[_section_num]
+    uint64_t    _checksum;          //of the bytes after the header
+};
+
+struct MmapSection {
+    char        _name[MMAP_SECTION_NAME_SIZE];
+    uint32_t    _type;
+    uint32_t    _elem_size;
+    uint64_t    _count;
+    uint64_t    _offset;
+    uint64_t    _size;
+};
+
+/* 8 bytes per step, catches truncated and corrupted files, not a cryptographic hash. */
+inline uint64_t checksum_bytes(const char *data, const uint64_t size) {
+    const uint64_t prime = 0x9E3779B97F4A7C15ULL;
+    uint64_t hash = size * prime;
+    uint64_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * prime;
+    }
+    return hash ^ (hash >> 32);
+}
+
+/* slot of a dict key, linear probing from here. */
+inline uint64_t hash_mmap_key(uint64_t key) {
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+    return key ^ (key >> 31);
+}
+
+/**
+ * @class MmapSpan.
+ * read only view of a pod array over the mapped pages.
+ **/
+template <typename DataType>
+class MmapSpan {
+public:
+    MmapSpan() = default;
+    MmapSpan(const DataType *data, const uint64_t size) : _data(data), _size(size) {};
+
+    const DataType* data() const {
+        return _data;
+    }
+
+    uint64_t size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+
+    const DataType& operator[](const uint64_t index) const {
+        return _data[index];
+    }
+
+    const DataType* begin() const {
+        return _data;
+    }
+
+    const DataType* end() const {
+        return _data + _size;
+    }
+
+private:
+    const DataType  *_data{nullptr};
+    uint64_t        _size{0};
+};
+
+/**
+ * @class MmapStringArray.
+ * read only view of a string array, each string is a string_view over the mapped pages.
+ **/
+class MmapStringArray {
+public:
+    MmapStringArray() = default;
+    MmapStringArray(const uint64_t *offsets, const char *chars, const uint64_t size)
+        : _offsets(offsets), _chars(chars), _size(size) {};
+
+    std::string_view operator[](const uint64_t index) const {
+        return std::string_view(_chars + _offsets[index], _offsets[index + 1] - _offsets[index]);
+    }
+
+    uint64_t size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+
+private:
+    const uint64_t  *_offsets{nullptr};
+    const char      *_chars{nullptr};
+    uint64_t        _size{0};
+};
+
+/**
+ * @class MmapDict.
+ * uint64 key -> string, sorted keys and their values.
+ * looked up by the hash index, a probe or two, or by binary search if the file has no index.
+ **/
+class MmapDict {
+public:
+    MmapDict() = default;
+    MmapDict(const MmapSpan<uint64_t> &keys, const MmapStringArray &values, const MmapSpan<uint32_t> &slots)
+        : _keys(keys), _values(values), _slots(slots) {};
+
+    /**
+    * value of a key.
+    * @param key
+    * @param value output, points into the mapped pages
+    * @return false if not found
+    */
+    bool find(const uint64_t key, std::string_view *value) const {
+        if (!_slots.empty()) {
+            uint64_t mask = _slots.size() - 1;
+            for (uint64_t i = hash_mmap_key(key) & mask; _slots[i] != 0; i = (i + 1) & mask) {
+                if (_keys[_slots[i] - 1] == key) {
+                    *value = _values[_slots[i] - 1];
+                    return true;
+                }
+            }
+            return false;
+        }
+        const uint64_t *iter = std::lower_bound(_keys.begin(), _keys.end(), key);
+        if (iter == _keys.end() || *iter != key) {
+            return false;
+        }
+        *value = _values[iter - _keys.begin()];
+        return true;
+    }
+
+    uint64_t size() const {
+        return _keys.size();
+    }
+
+    bool empty() const {
+        return _keys.empty();
+    }
+
+private:
+    MmapSpan<uint64_t>  _keys;
+    MmapStringArray     _values;
+    MmapSpan<uint32_t>  _slots;
+};
+
+/**
+ * @class MmapFile.
+ * one read only mapping of a snapshot file, checked once when mapped.
+ * unmapped when the last MmapSnapshot holding it is released.
+ **/
+class MmapFile {
+public:
+    /**
+    * map a file and check the header, the sections and the checksum.
+    * @param file_name
+    * @param error reason if failed
+    * @return mapping, nullptr if failed
+    */
+    static std::shared_ptr<const MmapFile> open(const std::string &file_name, std::string *error) {
+        int fd = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            *error = "open failed : " + std::string(strerror(errno));
+            return nullptr;
+        }
+        struct stat file_stat;
+        void *data = MAP_FAILED;
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size >= static_cast<off_t>(sizeof(MmapHeader))) {
+            data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (data == MAP_FAILED) {
+            *error = "map failed, too small or not readable";
+            return nullptr;
+        }
+        std::shared_ptr<MmapFile> file(new MmapFile(static_cast<const char*>(data), file_stat.st_size));
+        if (!file->check(error)) {
+            return nullptr;
+        }
+        return file;
+    }
+
+    /* dtor. */
+    ~MmapFile() {
+        munmap(const_cast<char*>(_base), _size);
+    }
+
+    const MmapHeader& header() const {
+        return *reinterpret_cast<const MmapHeader*>(_base);
+    }
+
+    /**
+    * section by name and type.
+    * @return section, nullptr if not found
+    */
+    const MmapSection* find_section(const std::string_view &name, const MmapSectionType type) const {
+        const MmapSection *sections = reinterpret_cast<const MmapSection*>(_base + header()._section_offset);
+        for (uint32_t i = 0; i < header()._section_num; ++i) {
+            if (sections[i]._type == type && name == sections[i]._name) {
+                return &sections[i];
+            }
+        }
+        return nullptr;
+    }
+
+    const char* data() const {
+        return _base;
+    }
+
+    uint64_t size() const {
+        return _size;
+    }
+
+private:
+    MmapFile(const char *base, const uint64_t size) : _base(base), _size(size) {};
+
+    /* none copy. */
+    MmapFile(const MmapFile &rhs) = delete;
+    MmapFile &operator=(const MmapFile &rhs) = delete;
+
+    bool in_range(const uint64_t offset, const uint64_t size) const {
+        return offset <= _size && size <= _size - offset;
+    }
+
+    /* every offset a view may follow is checked here, views do no checks. */
+    bool check(std::string *error) const {
+        const MmapHeader &head = header();
+        if (head._magic != MMAP_SNAPSHOT_MAGIC || head._format_version != MMAP_SNAPSHOT_FORMAT_VERSION) {
+            *error = "not a snapshot or unsupported format version";
+            return false;
+        }
+        if (head._total_size != _size) {
+            *error = "size mismatch, truncated file";
+            return false;
+        }
+        if (head._checksum != checksum_bytes(_base + sizeof(MmapHeader), _size - sizeof(MmapHeader))) {
+            *error = "checksum mismatch";
+            return false;
+        }
+        if (head._section_offset % alignof(MmapSection) != 0 || head._section_num > _size / sizeof(MmapSection) ||
+                !in_range(head._section_offset, head._section_num * sizeof(MmapSection))) {
+            *error = "invalid section table";
+            return false;
+        }
+        const MmapSection *sections = reinterpret_cast<const MmapSection*>(_base + head._section_offset);
+        for (uint32_t i = 0; i < head._section_num; ++i) {
+            if (!check_section(sections[i])) {
+                *error = "invalid section : " + std::string(sections[i]._name, strnlen(sections[i]._name,
+                        MMAP_SECTION_NAME_SIZE));
+                return false;
+            }
+        }
+        for (uint32_t i = 0; i < head._section_num; ++i) {
+            if (sections[i]._type == MMAP_HASH_INDEX && !check_hash_index(sections[i])) {
+                *error = "invalid hash index : " + std::string(sections[i]._name);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* slots point into the keys of the same dict, and a probe always ends at an empty slot. */
+    bool check_hash_index(const MmapSection &index) const {
+        const MmapSection *keys = find_section(index._name, MMAP_SORTED_KEYS);
+        if (keys == nullptr || index._count <= keys->_count) {
+            return false;
+        }
+        const uint32_t *slots = reinterpret_cast<const uint32_t*>(_base + index._offset);
+        for (uint64_t i = 0; i < index._count; ++i) {
+            if (slots[i] > keys->_count) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool check_section(const MmapSection &section) const {
+        if (section._name[MMAP_SECTION_NAME_SIZE - 1] != '\0' || section._offset % MMAP_SECTION_ALIGN != 0 ||
+                !in_range(section._offset, section._size)) {
+            return false;
+        }
+        const char *data = _base + section._offset;
+        switch (section._type) {
+        case MMAP_POD_ARRAY:
+            return section._elem_size > 0 && section._count == section._size / section._elem_size &&
+                    section._size % section._elem_size == 0;
+        case MMAP_SORTED_KEYS: {
+            if (section._elem_size != sizeof(uint64_t) || section._size != section._count * sizeof(uint64_t)) {
+                return false;
+            }
+            const uint64_t *keys = reinterpret_cast<const uint64_t*>(data);
+            for (uint64_t i = 1; i < section._count; ++i) {
+                if (keys[i - 1] >= keys[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case MMAP_STRING_ARRAY: {
+            if (section._count >= section._size / sizeof(uint64_t)) {
+                return false;
+            }
+            const uint64_t *offsets = reinterpret_cast<const uint64_t*>(data);
+            uint64_t char_size = section._size - (section._count + 1) * sizeof(uint64_t);
+            if (offsets[0] != 0 || offsets[section._count] > char_size) {
+                return false;
+            }
+            for (uint64_t i = 0; i < section._count; ++i) {
+                if (offsets[i] > offsets[i + 1]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case MMAP_HASH_INDEX:
+            return section._elem_size == sizeof(uint32_t) && section._size == section._count * sizeof(uint32_t) &&
+                    section._count > 0 && (section._count & (section._count - 1)) == 0;
+        case MMAP_BYTES:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    const char  *_base;
+    uint64_t    _size;
+};
+using MmapFilePtr = std::shared_ptr<const MmapFile>;
+
+/**
+ * @class MmapSnapshot.
+ * a validated snapshot file, the BufferType of DoubleData<MmapSnapshot, MmapLoader>.
+ * copying it shares the mapping, views stay valid while any copy is alive.
+ * e.g.:
+ * auto guard = double_data.read();
+ * MmapSpan<float> embeddings = guard->get_array<float>("item_embedding");
+ * std::string_view title;
+ * guard->get_dict("item_title").find(item_id, &title);
+ **/
+class MmapSnapshot {
+public:
+    /* ctor, empty until init. */
+    MmapSnapshot() = default;
+
+    /**
+    * map and check a snapshot file.
+    * @param file_name
+    * @param error reason if failed, can be nullptr
+    * @return false if the file is missing or invalid
+    */
+    bool init(const std::string &file_name, std::string *error = nullptr) {
+        std::string reason;
+        MmapFilePtr file = MmapFile::open(file_name, &reason);
+        if (!file) {
+            ERR_LOG << "invalid mmap snapshot : " << file_name << ", " << reason << std::endl;
+            if (error != nullptr) {
+                *error = reason;
+            }
+            return false;
+        }
+        _file = std::move(file);
+        return true;
+    }
+
+    /**
+    * pod array section.
+    * @param name
+    * @return view, empty if not found or the element size differs
+    */
+    template <typename DataType>
+    MmapSpan<DataType> get_array(const std::string_view &name) const {
+        static_assert(std::is_trivially_copyable<DataType>::value, "DataType must be trivially copyable");
+        static_assert(alignof(DataType) <= MMAP_SECTION_ALIGN, "DataType is over aligned");
+        const MmapSection *section = find_section(name, MMAP_POD_ARRAY);
+        if (section == nullptr || section->_elem_size != sizeof(DataType)) {
+            return MmapSpan<DataType>();
+        }
+        return MmapSpan<DataType>(reinterpret_cast<const DataType*>(_file->data() + section->_offset),
+                section->_count);
+    }
+
+    /* string array section, empty if not found. */
+    MmapStringArray get_strings(const std::string_view &name) const {
+        const MmapSection *section = find_section(name, MMAP_STRING_ARRAY);
+        if (section == nullptr) {
+            return MmapStringArray();
+        }
+        const uint64_t *offsets = reinterpret_cast<const uint64_t*>(_file->data() + section->_offset);
+        return MmapStringArray(offsets, reinterpret_cast<const char*>(offsets + section->_count + 1),
+                section->_count);
+    }
+
+    /* bytes section, empty if not found. */
+    std::string_view get_bytes(const std::string_view &name) const {
+        const MmapSection *section = find_section(name, MMAP_BYTES);
+        if (section == nullptr) {
+            return std::string_view();
+        }
+        return std::string_view(_file->data() + section->_offset, section->_size);
+    }
+
+    /* dict written by MmapSnapshotBuilder::add_dict, empty if not found. */
+    MmapDict get_dict(const std::string &name) const {
+        const MmapSection *keys = find_section(name, MMAP_SORTED_KEYS);
+        MmapStringArray values = get_strings(name);
+        if (keys == nullptr || keys->_count != values.size()) {
+            return MmapDict();
+        }
+        const MmapSection *index = find_section(name, MMAP_HASH_INDEX);
+        MmapSpan<uint32_t> slots;
+        if (index != nullptr) {
+            slots = MmapSpan<uint32_t>(reinterpret_cast<const uint32_t*>(_file->data() + index->_offset),
+                    index->_count);
+        }
+        return MmapDict(MmapSpan<uint64_t>(reinterpret_cast<const uint64_t*>(_file->data() + keys->_offset),
+                keys->_count), values, slots);
+    }
+
+    /* data version written by the builder, 0 if empty. */
+    uint64_t get_version() const {
+        return _file ? _file->header()._version : 0;
+    }
+
+    /* mapped bytes. */
+    uint64_t get_size() const {
+        return _file ? _file->size() : 0;
+    }
+
+    explicit operator bool() const {
+        return static_cast<bool>(_file);
+    }
+
+private:
+    const MmapSection* find_section(const std::string_view &name, const MmapSectionType type) const {
+        return _file ? _file->find_section(name, type) : nullptr;
+    }
+
+    MmapFilePtr _file;
+};
+
+/* mapped bytes, what a retired generation of DoubleData<MmapSnapshot, MmapLoader> holds. */
+inline int64_t get_buffer_bytes(const MmapSnapshot &snapshot) {
+    return snapshot.get_size();
+}
+
+/**
+ * @class MmapSnapshotBuilder.
+ * writes a snapshot file offline, into a temp file renamed over the target,
+ * so a process still mapping the old file keeps reading the old inode.
+ * e.g.:
+ * MmapSnapshotBuilder builder;
+ * builder.add_array("item_embedding", embeddings);
+ * builder.add_dict("item_title", std::move(titles));
+ * builder.write("item.snapshot", version);
+ **/
+class MmapSnapshotBuilder {
+public:
+    /**
+    * add a pod array.
+    * @return false if the name is invalid or used
+    */
+    template <typename DataType>
+    bool add_array(const std::string &name, const std::vector<DataType> &items) {
+        static_assert(std::is_trivially_copyable<DataType>::value, "DataType must be trivially copyable");
+        static_assert(alignof(DataType) <= MMAP_SECTION_ALIGN, "DataType is over aligned");
+        if (!check_name(name, MMAP_POD_ARRAY)) {
+            return false;
+        }
+        std::string payload(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(DataType));
+        _sections.emplace_back(Section{name, MMAP_POD_ARRAY, sizeof(DataType), items.size(), std::move(payload)});
+        return true;
+    }
+
+    /* add a string array, false if the name is invalid or used. */
+    bool add_strings(const std::string &name, const std::vector<std::string> &items) {
+        if (!check_name(name, MMAP_STRING_ARRAY)) {
+            return false;
+        }
+        _sections.emplace_back(Section{name, MMAP_STRING_ARRAY, 1, items.size(), encode_strings(items)});
+        return true;
+    }
+
+    /* add a blob, false if the name is invalid or used. */
+    bool add_bytes(const std::string &name, const std::string &bytes) {
+        if (!check_name(name, MMAP_BYTES)) {
+            return false;
+        }
+        _sections.emplace_back(Section{name, MMAP_BYTES, 1, bytes.size(), bytes});
+        return true;
+    }
+
+    /**
+    * add a uint64 key -> string dict.
+    * @param name
+    * @param items keys must be unique
+    * @return false if the name is invalid or used, a key is duplicated or there are 2^32 keys
+    */
+    bool add_dict(const std::string &name, std::vector<std::pair<uint64_t, std::string>> items) {
+        if (!check_name(name, MMAP_SORTED_KEYS) || !check_name(name, MMAP_STRING_ARRAY)) {
+            return false;
+        }
+        if (items.size() >= UINT32_MAX) {
+            ERR_LOG << "too many dict keys : " << items.size() << ", dict : " << name << std::endl;
+            return false;
+        }
+        std::sort(items.begin(), items.end(), [](const std::pair<uint64_t, std::string> &lhs,
+                const std::pair<uint64_t, std::string> &rhs) { return lhs.first < rhs.first; });
+        std::vector<uint64_t> keys(items.size());
+        std::vector<std::string> values(items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (i > 0 && items[i - 1].first == items[i].first) {
+                ERR_LOG << "duplicated dict key : " << items[i].first << ", dict : " << name << std::endl;
+                return false;
+            }
+            keys[i] = items[i].first;
+            values[i] = std::move(items[i].second);
+        }
+        std::string key_payload(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(uint64_t));
+        _sections.emplace_back(Section{name, MMAP_SORTED_KEYS, sizeof(uint64_t), keys.size(),
+                std::move(key_payload)});
+        _sections.emplace_back(Section{name, MMAP_STRING_ARRAY, 1, values.size(), encode_strings(values)});
+        _sections.emplace_back(Section{name, MMAP_HASH_INDEX, sizeof(uint32_t), 0, std::string()});
+        encode_hash_index(keys, &_sections.back());
+        return true;
+    }
+
+    /**
+    * write every section into file_name.
+    * @param file_name
+    * @param version data version, readable by MmapSnapshot::get_version
+    * @return false if failed, file_name is untouched then
+    */
+    bool write(const std::string &file_name, const uint64_t version) const {
+        std::string content = build(version);
+        std::string tmp_file_name = file_name + ".tmp." + std::to_string(getpid());
+        int fd = ::open(tmp_file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            ERR_LOG << "create snapshot failed : " << tmp_file_name << ", " << strerror(errno) << std::endl;
+            return false;
+        }
+        bool ok = true;
+        for (uint64_t written = 0; ok && written < content.size(); ) {
+            ssize_t size = ::write(fd, content.data() + written, content.size() - written);
+            ok = size > 0 || (size < 0 && errno == EINTR);
+            written += size > 0 ? size : 0;
+        }
+        ok = ok && fsync(fd) == 0;
+        close(fd);
+        if (!ok || rename(tmp_file_name.c_str(), file_name.c_str()) != 0) {
+            ERR_LOG << "write snapshot failed : " << file_name << ", " << strerror(errno) << std::endl;
+            unlink(tmp_file_name.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct Section {
+        std::string     _name;
+        MmapSectionType _type;
+        uint32_t        _elem_size;
+        uint64_t        _count;
+        std::string     _payload;
+    };
+
+    static uint64_t align(const uint64_t size) {
+        return (size + MMAP_SECTION_ALIGN - 1) / MMAP_SECTION_ALIGN * MMAP_SECTION_ALIGN;
+    }
+
+    bool check_name(const std::string &name, const MmapSectionType type) const {
+        if (name.empty() || static_cast<int64_t>(name.size()) >= MMAP_SECTION_NAME_SIZE) {
+            ERR_LOG << "invalid section name : " << name << std::endl;
+            return false;
+        }
+        for (auto &section : _sections) {
+            if (section._name == name && section._type == type) {
+                ERR_LOG << "duplicated section name : " << name << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* load factor <= 0.5, linear probing. */
+    static void encode_hash_index(const std::vector<uint64_t> &keys, Section *section) {
+        uint64_t slot_num = 2;
+        while (slot_num < keys.size() * 2) {
+            slot_num <<= 1;
+        }
+        std::vector<uint32_t> slots(slot_num, 0);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            uint64_t slot = hash_mmap_key(keys[i]) & (slot_num - 1);
+            while (slots[slot] != 0) {
+                slot = (slot + 1) & (slot_num - 1);
+            }
+            slots[slot] = static_cast<uint32_t>(i + 1);
+        }
+        section->_count = slot_num;
+        section->_payload.assign(reinterpret_cast<const char*>(slots.data()), slot_num * sizeof(uint32_t));
+    }
+
+    static std::string encode_strings(const std::vector<std::string> &items) {
+        std::vector<uint64_t> offsets(items.size() + 1, 0);
+        for (size_t i = 0; i < items.size(); ++i) {
+            offsets[i + 1] = offsets[i] + items[i].size();
+        }
+        std::string payload(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+        payload.reserve(payload.size() + offsets.back());
+        for (auto &item : items) {
+            payload.append(item);
+        }
+        return payload;
+    }
+
+    /* header, section table, then the aligned payloads. */
+    std::string build(const uint64_t version) const {
+        uint64_t section_offset = align(sizeof(MmapHeader));
+        uint64_t offset = align(section_offset + sizeof(MmapSection) * _sections.size());
+        std::vector<MmapSection> sections(_sections.size());
+        for (size_t i = 0; i < _sections.size(); ++i) {
+            MmapSection &section = sections[i];
+            memset(&section, 0, sizeof(section));
+            strncpy(section._name, _sections[i]._name.c_str(), MMAP_SECTION_NAME_SIZE - 1);
+            section._type = _sections[i]._type;
+            section._elem_size = _sections[i]._elem_size;
+            section._count = _sections[i]._count;
+            section._offset = offset;
+            section._size = _sections[i]._payload.size();
+            offset = align(offset + section._size);
+        }
+        std::string content(offset, '\0');
+        if (!sections.empty()) {
+            memcpy(&content[section_offset], sections.data(), sizeof(MmapSection) * sections.size());
+        }
+        for (size_t i = 0; i < _sections.size(); ++i) {
+            memcpy(&content[sections[i]._offset], _sections[i]._payload.data(), _sections[i]._payload.size());
+        }
+        MmapHeader header;
+        memset(&header, 0, sizeof(header));
+        header._magic = MMAP_SNAPSHOT_MAGIC;
+        header._format_version = MMAP_SNAPSHOT_FORMAT_VERSION;
+        header._section_num = _sections.size();
+        header._version = version;
+        header._total_size = content.size();
+        header._section_offset = section_offset;
+        header._checksum = checksum_bytes(content.data() + sizeof(MmapHeader), content.size() - sizeof(MmapHeader));
+        memcpy(&content[0], &header, sizeof(header));
+        return content;
+    }
+
+    std::vector<Section> _sections;
+};
+
+/**
+ * @class MmapLoader.
+ * Loader of DoubleData<MmapSnapshot, MmapLoader>, a reload is one mmap and one
+ * validation pass instead of a parse. throws if the file is invalid so the current
+ * snapshot is kept.
+ * replace the file by rename as MmapSnapshotBuilder does, writing it in place would
+ * change the pages under the readers of the current snapshot.
+ **/
+class MmapLoader {
+public:
+    /* ctor. */
+    MmapLoader() = default;
+    virtual ~MmapLoader() = default;
+
+    /* bind the loader to a snapshot file. */
+    bool init(const std::string &file_name) {
+        _file_name = file_name;
+        struct stat file_stat;
+        return !file_name.empty() && stat(file_name.c_str(), &file_stat) == 0;
+    }
+
+    /* snapshot file. */
+    std::string get_load_file_name() const {
+        return _file_name;
+    }
+
+    /* map the latest file. */
+    MmapSnapshot load() {
+        MmapSnapshot snapshot;
+        std::string error;
+        if (!snapshot.init(_file_name, &error)) {
+            throw std::runtime_error("invalid mmap snapshot : " + _file_name + ", " + error);
+        }
+        return snapshot;
+    }
+
+private:
+    MmapLoader(const MmapLoader &rhs) = delete;
+    MmapLoader &operator=(const MmapLoader &rhs) = delete;
+
+    std::string _file_name;
+};
+
+} // end namespace utils
+} // end namespace inf
@@ -0,0 +1,316 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <condition_variable>
+#include <type_traits>
+#include <new>
+#include <stdint.h>
+
+namespace inf {
+namespace frame {
+
+const int64_t CACHE_LINE_SIZE = 64;
+const int64_t DEFAULT_QUEUE_CAPACITY = 1024;
+const int64_t DEFAULT_QUEUE_SPIN_NUM = 128;
+
+/**
+ * @class MpmcQueue.
+ * bounded lock-free multi-producer multi-consumer ring (Vyukov).
+ * every cell carries a sequence number, producers and consumers claim a
+ * position with one CAS and never touch the same cell at the same time.
+ * try_enqueue/try_dequeue never block,
+ * enqueue/dequeue spin a while then park until the queue changes or is closed.
+ * DataType may be move-only, but must be default constructible.
+ * e.g.:
+ * MpmcQueue<TaskPtr> queue(1024);
+ * queue.enqueue(std::move(task));
+ * TaskPtr task;
+ * queue.dequeue(task);
+ **/
+template <typename DataType>
+class MpmcQueue {
+public:
+    /**
+    * ctor.
+    * @param capacity max element num, rounded up to power of 2
+    */
+    explicit MpmcQueue(const int64_t capacity = DEFAULT_QUEUE_CAPACITY) {
+        size_t real_capacity = 2;
+        while (static_cast<int64_t>(real_capacity) < capacity) {
+            real_capacity <<= 1;
+        }
+        _mask = real_capacity - 1;
+        _cells.reset(new Cell[real_capacity]);
+        for (size_t i = 0; i < real_capacity; ++i) {
+            _cells[i]._sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /* dtor, destroy the elements left. */
+    virtual ~MpmcQueue() {
+        DataType data;
+        while (try_dequeue(data)) {
+        }
+    }
+
+    /**
+    * put data into the queue without blocking.
+    * @param data
+    * @return true if ok, false if the queue is full.
+    */
+    bool try_enqueue(const DataType &data) {
+        return emplace(data);
+    }
+
+    /* move version. */
+    bool try_enqueue(DataType &&data) {
+        return emplace(std::move(data));
+    }
+
+    /**
+    * get data from the queue without blocking.
+    * @param data output
+    * @return true if ok, false if the queue is empty.
+    */
+    bool try_dequeue(DataType &data) {
+        Cell *cell = nullptr;
+        size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &_cells[pos & _mask];
+            size_t sequence = cell->_sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        DataType *slot = cell->data();
+        data = std::move(*slot);
+        slot->~DataType();
+        cell->_sequence.store(pos + _mask + 1, std::memory_order_release);
+        notify(_producer_waiting, _not_full_cond);
+        return true;
+    }
+
+    /**
+    * put data into the queue, blocked while the queue is full.
+    * @param data
+    * @return true if ok, false if the queue is closed.
+    */
+    bool enqueue(const DataType &data) {
+        DataType copy(data);
+        return enqueue(std::move(copy));
+    }
+
+    /* move version. */
+    bool enqueue(DataType &&data) {
+        return wait_until(_producer_waiting, _not_full_cond,
+                [this, &data]() { return try_enqueue(std::move(data)); },
+                [this]() { return readable_cell(_enqueue_pos, 0); });
+    }
+
+    /**
+    * get data from the queue, blocked while the queue is empty.
+    * @param data output
+    * @return true if ok, false if the queue is closed and empty.
+    */
+    bool dequeue(DataType &data) {
+        return wait_until(_consumer_waiting, _not_empty_cond,
+                [this, &data]() { return try_dequeue(data); },
+                [this]() { return readable_cell(_dequeue_pos, 1); });
+    }
+
+    /**
+    * put a batch of data without blocking, stop at the first full slot.
+    * @param begin iterator of the first data, elements are moved
+    * @param num data num
+    * @return enqueued num
+    */
+    template <typename Iterator>
+    int64_t try_enqueue_bulk(Iterator begin, const int64_t num) {
+        int64_t count = 0;
+        for (; count < num; ++count, ++begin) {
+            if (!try_enqueue(std::move(*begin))) {
+                break;
+            }
+        }
+        return count;
+    }
+
+    /**
+    * get up to max_num data without blocking.
+    * @param output output iterator, such as std::back_inserter
+    * @param max_num max data num
+    * @return dequeued num
+    */
+    template <typename OutputIterator>
+    int64_t try_dequeue_bulk(OutputIterator output, const int64_t max_num) {
+        int64_t count = 0;
+        DataType data;
+        for (; count < max_num; ++count) {
+            if (!try_dequeue(data)) {
+                break;
+            }
+            *output = std::move(data);
+            ++output;
+        }
+        return count;
+    }
+
+    /**
+    * close the queue, wake up all the blocked threads.
+    * enqueue fails after closed, dequeue drains the data left.
+    */
+    void close() {
+        std::lock_guard<std::mutex> guard(_park_lock);
+        _closed = true;
+        _not_empty_cond.notify_all();
+        _not_full_cond.notify_all();
+    }
+
+    /* whether closed. */
+    bool is_closed() const {
+        return _closed;
+    }
+
+    /* approximate element num. */
+    int64_t size() const {
+        size_t enqueue_pos = _enqueue_pos.load(std::memory_order_relaxed);
+        size_t dequeue_pos = _dequeue_pos.load(std::memory_order_relaxed);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+
+    /* capacity. */
+    int64_t capacity() const {
+        return _mask + 1;
+    }
+
+private:
+    /* ring cell, sequence tells whether the cell is ready for producer or consumer. */
+    struct Cell {
+        std::atomic<size_t>                                                 _sequence;
+        typename std::aligned_storage<sizeof(DataType), alignof(DataType)>::type _storage;
+
+        DataType* data() {
+            return reinterpret_cast<DataType*>(&_storage);
+        }
+    };
+
+    /* claim a cell and construct data in place. */
+    template <typename ValueType>
+    bool emplace(ValueType &&data) {
+        if (_closed) {
+            return false;
+        }
+        Cell *cell = nullptr;
+        size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &_cells[pos & _mask];
+            size_t sequence = cell->_sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        new (cell->data()) DataType(std::forward<ValueType>(data));
+        cell->_sequence.store(pos + 1, std::memory_order_release);
+        notify(_consumer_waiting, _not_empty_cond);
+        return true;
+    }
+
+    /* whether the cell at cursor is ready, offset 0 for producer, 1 for consumer. */
+    bool readable_cell(const std::atomic<size_t> &cursor, const size_t offset) const {
+        size_t pos = cursor.load(std::memory_order_relaxed);
+        return _cells[pos & _mask]._sequence.load(std::memory_order_acquire) == pos + offset;
+    }
+
+    /* wake up one parked thread of the other side. */
+    void notify(std::atomic<int64_t> &waiting, std::condition_variable &cond) {
+        //order the cell publish before reading the waiting num
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> guard(_park_lock);
+            cond.notify_one();
+        }
+    }
+
+    /**
+    * spin then park until op succeeds or the queue is closed.
+    * op runs without the park lock, because it notifies the other side.
+    * ready only peeks the cell, and is checked after counted as waiting,
+    * so a notify can not be missed.
+    */
+    template <typename Operation, typename ReadyCheck>
+    bool wait_until(std::atomic<int64_t> &waiting, std::condition_variable &cond,
+                    Operation op, ReadyCheck ready) {
+        int64_t spin = 0;
+        while (true) {
+            if (op()) {
+                return true;
+            }
+            if (_closed) {
+                return false;
+            }
+            if (++spin < DEFAULT_QUEUE_SPIN_NUM) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_park_lock);
+            waiting.fetch_add(1, std::memory_order_seq_cst);
+            if (!ready() && !_closed) {
+                cond.wait(lock);
+            }
+            waiting.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    /* none copy. */
+    MpmcQueue(const MpmcQueue &rhs) = delete;
+    MpmcQueue &operator=(const MpmcQueue &rhs) = delete;
+
+    /* cells. */
+    std::unique_ptr<Cell[]>                     _cells;
+
+    /* capacity - 1. */
+    size_t                                      _mask;
+
+    /* producer cursor, on its own cache line. */
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _enqueue_pos{0};
+
+    /* consumer cursor, on its own cache line. */
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _dequeue_pos{0};
+
+    /* parked producers and consumers. */
+    alignas(CACHE_LINE_SIZE) std::atomic<int64_t> _producer_waiting{0};
+    std::atomic<int64_t>                        _consumer_waiting{0};
+
+    /* closed flag. */
+    std::atomic<bool>                           _closed{false};
+
+    /* park lock. */
+    std::mutex                                  _park_lock;
+
+    /* consumers wait here. */
+    std::condition_variable                     _not_empty_cond;
+
+    /* producers wait here. */
+    std::condition_variable                     _not_full_cond;
+};
+
+} // end namespace frame
+} // end namespace inf
@@ -0,0 +1,123 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <functional>
+#include <future>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <stdint.h>
+
+namespace inf {
+namespace frame {
+
+/**
+ * @class TaskTimeoutException.
+ * set into the future of a task which is still queued after its deadline.
+ **/
+class TaskTimeoutException : public std::runtime_error {
+public:
+    /* ctor. */
+    explicit TaskTimeoutException(const std::string &message) : std::runtime_error(message) {};
+};
+
+/**
+ * @class TaskRejectedException.
+ * set into the future of a task submitted to a pool not inited or stopped,
+ * or still queued when the pool stopped.
+ **/
+class TaskRejectedException : public std::runtime_error {
+public:
+    /* ctor. */
+    explicit TaskRejectedException(const std::string &message) : std::runtime_error(message) {};
+};
+
+/**
+ * @class PoolTask.
+ * one submitted task of ThreadPool and WorkStealingThreadPool, the callable and
+ * the promise of its future. exactly one of run(), expire() and reject() is called.
+ * e.g.:
+ * std::unique_ptr<PoolTask> task;
+ * auto result = PoolTask::create(100, &task, func, a, b, c);
+ **/
+struct PoolTask {
+    using Clock = std::chrono::steady_clock;
+
+    int64_t                                     _timeout_ms;//task run timeout time
+    std::function<void()>                       _func;      //run, set the result into the future
+    std::function<void(std::exception_ptr)>     _fail;      //set an error into the future
+    Clock::time_point                           _deadline;  //latest start time, max if no timeout
+    uint64_t                                    _sequence;  //FIFO among the same deadline
+
+    explicit PoolTask(const int64_t timeout_ms = 0) : _timeout_ms(timeout_ms), _sequence(0) {
+        _deadline = timeout_ms > 0 ? Clock::now() + std::chrono::milliseconds(timeout_ms) :
+                Clock::time_point::max();
+    };
+
+    /**
+    * create a task.
+    * @param timeout_ms task timeout ms, 0 means never expire
+    * @param task output
+    * @param func and args...
+    * @return std::future<> of the task
+    */
+    template <typename Func, typename ...Args>
+    static auto create(const int64_t timeout_ms, std::unique_ptr<PoolTask> *task, Func&& func, Args&& ...args)
+            -> std::future<decltype(func(args...))> {
+        using ReturnType = decltype(func(args...));
+        auto promise = std::make_shared<std::promise<ReturnType>>();
+        auto callable = std::bind(func, std::forward<Args>(args)...);
+
+        task->reset(new PoolTask(timeout_ms));
+        (*task)->_func = [promise, callable]() mutable {
+            //execute the task, pass the result or exception to the future
+            try {
+                set_promise(*promise, callable);
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        };
+        (*task)->_fail = [promise](std::exception_ptr error) {
+            promise->set_exception(error);
+        };
+        return promise->get_future();
+    }
+
+    /* whether it missed the deadline. */
+    bool is_expired(const Clock::time_point &now) const {
+        return _deadline < now;
+    }
+
+    /* run the callable. */
+    void run() {
+        _func();
+    }
+
+    /* the future throws TaskTimeoutException. */
+    void expire() {
+        _fail(std::make_exception_ptr(TaskTimeoutException(
+                "task expired in queue, timeout_ms : " + std::to_string(_timeout_ms))));
+    }
+
+    /* the future throws TaskRejectedException. */
+    void reject(const std::string &reason) {
+        _fail(std::make_exception_ptr(TaskRejectedException(reason)));
+    }
+
+private:
+    /* set the return value of func into the promise. */
+    template <typename ReturnType, typename Callable>
+    static void set_promise(std::promise<ReturnType> &promise, Callable &callable) {
+        promise.set_value(callable());
+    }
+
+    /* void version. */
+    template <typename Callable>
+    static void set_promise(std::promise<void> &promise, Callable &callable) {
+        callable();
+        promise.set_value();
+    }
+};
+
+} // end namespace frame
+} // end namespace inf
@@ -0,0 +1,319 @@
+#pragma once
+#include "task_data.h"
+#include "arena.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <stdint.h>
+
+namespace inf {
+namespace frame {
+
+const int64_t DEFAULT_POOLED_CONTEXT_NUM = 8;
+
+/**
+ * @class RequestContext.
+ * per request state: the TaskDataMap passed to schedule(), its arena, and
+ * retained data such as candidate lists.
+ * retained data is kept across requests and only clear()'ed, so a vector keeps
+ * its reserved capacity and a hash map keeps its buckets.
+ * e.g.:
+ * const SlotKey<std::vector<Item>> CANDIDATE_KEY("candidate");
+ * auto context = RequestContextPool::instance().acquire();
+ * std::vector<Item> *candidates = context->get_retained(CANDIDATE_KEY);
+ * FrameSnapshotManager<Creator>::instance().schedule("rec_base", &context->get_data_map());
+ **/
+class RequestContext {
+public:
+    /* ctor. */
+    RequestContext() : _data_map(&_arena) {};
+
+    /* dtor. */
+    virtual ~RequestContext() {
+        _data_map.clear();
+        for (auto &retained : _retained_table) {
+            if (retained._data != nullptr) {
+                retained._destroy(retained._data);
+            }
+        }
+    }
+
+    /* data of the request, pass it to FrameSnapshotManager::schedule. */
+    TaskDataMap<>& get_data_map() {
+        return _data_map;
+    }
+
+    /* request arena. */
+    Arena& get_arena() {
+        return _arena;
+    }
+
+    /**
+    * retained data of key, created at the first use and kept by the context.
+    * it is clear()'ed when the context is released, DataType must have clear().
+    * @param key slot key
+    * @return data, nullptr if the key is invalid
+    */
+    template <typename DataType>
+    DataType* get_retained(const SlotKey<DataType> &key) {
+        int64_t index = key.index();
+        if (index < 0) {
+            return nullptr;
+        }
+        if (index >= static_cast<int64_t>(_retained_table.size())) {
+            _retained_table.resize(std::max<int64_t>(index + 1, SlotRegistry::instance().size()));
+        }
+        Retained &retained = _retained_table[index];
+        if (retained._data == nullptr) {
+            retained._data = new DataType();
+            retained._type_id = get_slot_type_id<DataType>();
+            retained._clear = &clear_data<DataType>;
+            retained._destroy = &destroy_data<DataType>;
+            retained._bytes = &RetainedBytes<DataType>::get;
+        }
+#ifndef NDEBUG
+        if (retained._type_id != get_slot_type_id<DataType>()) {
+            ERR_LOG << "retained type mismatch, key : " << SlotRegistry::instance().get_name(index)
+                    << std::endl;
+            return nullptr;
+        }
+#endif
+        return static_cast<DataType*>(retained._data);
+    }
+
+    /**
+    * end of the request. data and arena are released, retained data is cleared.
+    */
+    void clear() {
+        //arena data first, the map may refer to it
+        _data_map.clear();
+        _arena.reset();
+        for (auto &retained : _retained_table) {
+            if (retained._data != nullptr) {
+                retained._clear(retained._data);
+            }
+        }
+    }
+
+    /**
+    * memory kept by the context: arena high-water and retained capacity.
+    * @return bytes
+    */
+    int64_t get_memory_bytes() const {
+        int64_t bytes = std::max(_arena.get_used_bytes(), _arena.get_high_water_bytes());
+        for (auto &retained : _retained_table) {
+            if (retained._data != nullptr) {
+                bytes += retained._bytes(retained._data);
+            }
+        }
+        return bytes;
+    }
+
+private:
+    /* data kept across requests. */
+    struct Retained {
+        void        *_data{nullptr};
+        SlotTypeId  _type_id{nullptr};
+        void        (*_clear)(void*){nullptr};
+        void        (*_destroy)(void*){nullptr};
+        int64_t     (*_bytes)(const void*){nullptr};
+    };
+
+    /* size of plain data. */
+    template <typename DataType, typename = void>
+    struct RetainedBytes {
+        static int64_t get(const void *data) {
+            return sizeof(DataType);
+        }
+    };
+
+    /* size of containers with capacity(), such as vector and string. */
+    template <typename DataType>
+    struct RetainedBytes<DataType, std::void_t<decltype(std::declval<const DataType&>().capacity()),
+            typename DataType::value_type>> {
+        static int64_t get(const void *data) {
+            return sizeof(DataType) + static_cast<const DataType*>(data)->capacity() *
+                    sizeof(typename DataType::value_type);
+        }
+    };
+
+    template <typename DataType>
+    static void clear_data(void *data) {
+        static_cast<DataType*>(data)->clear();
+    }
+
+    template <typename DataType>
+    static void destroy_data(void *data) {
+        delete static_cast<DataType*>(data);
+    }
+
+    /* none copy. */
+    RequestContext(const RequestContext &rhs) = delete;
+    RequestContext &operator=(const RequestContext &rhs) = delete;
+
+    /* request arena, declared before the map using it. */
+    Arena                   _arena;
+
+    /* request data. */
+    TaskDataMap<>           _data_map;
+
+    /* retained data, indexed by SlotKey. */
+    std::vector<Retained>   _retained_table;
+};
+
+/**
+ * @class RequestContextPool.
+ * pre-warmed RequestContext, sharded per thread, no lock on acquire and release.
+ * a context released on another thread goes to the shard of that thread.
+ * e.g.:
+ * auto context = RequestContextPool::instance().acquire();
+ * ...
+ * //back to the pool when context is destroyed
+ **/
+class RequestContextPool {
+public:
+    /* clear and give the context back to the pool. */
+    struct ContextReleaser {
+        void operator()(RequestContext *context) const {
+            RequestContextPool::instance().release(context);
+        }
+    };
+    using RequestContextPtr = std::unique_ptr<RequestContext, ContextReleaser>;
+
+    /* singleton. */
+    static RequestContextPool& instance() {
+        static RequestContextPool instance;
+        return instance;
+    }
+
+    /**
+    * get a context, from the shard of the current thread if any.
+    * @return context, cleared
+    */
+    RequestContextPtr acquire() {
+        Shard &shard = local_shard();
+        shard._acquire_num.fetch_add(1, std::memory_order_relaxed);
+        if (shard._contexts.empty()) {
+            return RequestContextPtr(new RequestContext());
+        }
+        shard._hit_num.fetch_add(1, std::memory_order_relaxed);
+        RequestContext *context = shard._contexts.back().release();
+        shard._contexts.pop_back();
+        shard._pooled_num.store(shard._contexts.size(), std::memory_order_relaxed);
+        return RequestContextPtr(context);
+    }
+
+    /**
+    * max pooled context num of each thread.
+    * @param pooled_num
+    */
+    void set_max_pooled_num(const int64_t pooled_num) {
+        _max_pooled_num = pooled_num;
+    }
+
+    /* acquire num of all threads. */
+    int64_t get_acquire_num() {
+        return sum_shards(&Shard::_acquire_num);
+    }
+
+    /* acquire num served by a pooled context. */
+    int64_t get_hit_num() {
+        return sum_shards(&Shard::_hit_num);
+    }
+
+    /* hit num / acquire num. */
+    double get_hit_rate() {
+        int64_t acquire_num = get_acquire_num();
+        return acquire_num == 0 ? 0.0 : static_cast<double>(get_hit_num()) / acquire_num;
+    }
+
+    /* pooled context num of all threads. */
+    int64_t get_pooled_num() {
+        return sum_shards(&Shard::_pooled_num);
+    }
+
+    /* max memory one context kept, seen at release. */
+    int64_t get_high_water_bytes() const {
+        return _high_water_bytes.load(std::memory_order_relaxed);
+    }
+
+private:
+    /* contexts and counters of one thread, counters are only written by the owner. */
+    struct Shard {
+        std::vector<std::unique_ptr<RequestContext>>    _contexts;
+        std::atomic<int64_t>                            _acquire_num{0};
+        std::atomic<int64_t>                            _hit_num{0};
+        std::atomic<int64_t>                            _pooled_num{0};
+    };
+    using ShardPtr = std::shared_ptr<Shard>;
+
+    /* drop the pooled contexts when the thread exits, counters stay in the pool. */
+    struct ShardHolder {
+        ShardPtr _shard;
+        ~ShardHolder() {
+            if (_shard) {
+                _shard->_contexts.clear();
+                _shard->_pooled_num.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /* ctor. */
+    RequestContextPool() = default;
+    /* none copy. */
+    RequestContextPool(const RequestContextPool &rhs) = delete;
+    RequestContextPool &operator=(const RequestContextPool &rhs) = delete;
+
+    Shard& local_shard() {
+        thread_local ShardHolder holder;
+        if (!holder._shard) {
+            holder._shard = std::make_shared<Shard>();
+            std::lock_guard<std::mutex> lock(_lock);
+            _shards.push_back(holder._shard);
+        }
+        return *holder._shard;
+    }
+
+    void release(RequestContext *context) {
+        int64_t bytes = context->get_memory_bytes();
+        int64_t high_water = _high_water_bytes.load(std::memory_order_relaxed);
+        while (bytes > high_water &&
+                !_high_water_bytes.compare_exchange_weak(high_water, bytes, std::memory_order_relaxed)) {
+        }
+
+        Shard &shard = local_shard();
+        if (static_cast<int64_t>(shard._contexts.size()) >= _max_pooled_num) {
+            delete context;
+            return;
+        }
+        context->clear();
+        shard._contexts.emplace_back(context);
+        shard._pooled_num.store(shard._contexts.size(), std::memory_order_relaxed);
+    }
+
+    int64_t sum_shards(std::atomic<int64_t> Shard::*counter) {
+        std::lock_guard<std::mutex> lock(_lock);
+        int64_t sum = 0;
+        for (auto &shard : _shards) {
+            sum += ((*shard).*counter).load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    /* every shard ever created, for stats. */
+    std::mutex                  _lock;
+    std::vector<ShardPtr>       _shards;
+
+    /* max pooled context num of each thread. */
+    std::atomic<int64_t>        _max_pooled_num{DEFAULT_POOLED_CONTEXT_NUM};
+
+    /* max memory of one context. */
+    std::atomic<int64_t>        _high_water_bytes{0};
+};
+
+} // end namespace frame
+} // end namespace inf
@@ -8,7 +8,11 @@ namespace frame {
 TaskPtr UnitTaskCreator::create(const YAML::Node &conf) const {
     try {
         std::string task_name = conf["task_name"].as<std::string>();
-        TaskPtr new_task = RecTaskFactory::instance().create(task_name);
+        //REGISTER_TASK first, then the creators registered in RecTaskFactory::init
+        TaskPtr new_task = TaskRegistry::instance().create(task_name);
+        if (!new_task) {
+            new_task = RecTaskFactory::instance().create(task_name);
+        }
         if (!new_task) {
             ERR_LOG << "Create Task Failed, task name : " << task_name << std::endl;
             return TaskPtr(nullptr);
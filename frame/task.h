@@ -2,10 +2,21 @@
 #include "utils/common_log.h"
 #include "yaml-cpp/yaml.h"
 #include "double_buffer.h"
+#include "task_graph.h"
+#include "latency_stats.h"
+#include "trace.h"
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <memory>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <future>
 #include <stdint.h>
 
 namespace inf{
@@ -17,6 +28,7 @@ enum TaskType {
     SERIAL_TASK     = 1,
     PARALLEL_TASK   = 2,
     DEFAULT_TASK    = 3,
+    ASYNC_TASK      = 4,
 };
 
 
@@ -60,6 +72,69 @@ public:
     */
     virtual bool run(void *data) const = 0;
 
+    /**
+    * execute the task without blocking, used by TaskScheduler::schedule_async.
+    * done must be called exactly once, from any thread. 
+    * the default runs run() on the calling thread.
+    * @param data the task data.(TaskDataMap*), valid until done is called
+    * @param done completion callback, true if execute ok
+    */
+    virtual void run_async(void *data, TaskDone done) const {
+        done(run(data));
+    }
+
+    /**
+    * run() with its latency recorded as task.<alias>, used by the schedulers and groups.
+    * a span is recorded if the request is traced.
+    * @param data the task data.(TaskDataMap*)
+    * @return bool true: execute ok, false : failed
+    */
+    bool execute(void *data) const {
+        LatencyRecorder recorder(_stat_id);
+        SpanRecorder span(_trace_name);
+        try {
+            return span.done(recorder.done(run(data)));
+        } catch (...) {
+            span.done(recorder.done(false));
+            throw;
+        }
+    }
+
+    /**
+    * run_async() with its latency and span recorded, until done is called.
+    * @param data the task data.(TaskDataMap*), valid until done is called
+    * @param done completion callback, true if execute ok
+    */
+    void execute_async(void *data, TaskDone done) const {
+        if (_stat_id == INVALID_STAT_ID) {
+            run_async(data, std::move(done));
+            return;
+        }
+        LatencyRecorder recorder(_stat_id);
+        SpanRecorder span(_trace_name);
+        run_async(data, [recorder, span, done = std::move(done)](bool ret) mutable {
+            done(span.done(recorder.done(ret)));
+        });
+    }
+
+    /**
+    * bind the task to its alias in task.yaml, TaskLoader calls it before init.
+    * @param task_alias alias name
+    */
+    void set_task_alias(const std::string &task_alias) {
+        _task_alias = task_alias;
+        _stat_id = LatencyStats::instance().register_stat("task." + task_alias);
+        _trace_name = Tracer::instance().intern(task_alias);
+    }
+
+    /**
+    * retrieve task alias
+    * @return task_alias, empty if not loaded by TaskLoader
+    */
+    std::string get_task_alias() const {
+        return _task_alias;
+    }
+
     /**
     * retrieve task name
     * @return  task_name
@@ -86,9 +161,19 @@ private:
     
     /* task type. */
     TaskType    _task_type;
+
+    /* alias name in task.yaml. */
+    std::string _task_alias;
+
+    /* latency stat of the alias. */
+    int64_t     _stat_id{INVALID_STAT_ID};
+
+    /* span name of the alias. */
+    const char  *_trace_name{nullptr};
 };
 
-using TaskPtr = std::unique_ptr<BaseTask>;
+/* shared, an unchanged task lives in the old and the new task map during reload. */
+using TaskPtr = std::shared_ptr<BaseTask>;
 
 /** 
  * @class UnitTask.
@@ -119,14 +204,411 @@ public:
    virtual bool run(void *data) const = 0;
 };
 
+/** 
+ * @class AsyncTask.
+ * @brief task waiting for I/O, such as a remote recall or feature service.
+ * run_async issues the request and returns, the response callback calls done,
+ * no worker is held while the request is outstanding.
+ * e.g.:
+ * void run_async(void *data, TaskDone done) const override {
+ *     _client->call(request, [data, done](const Response &response) {
+ *         ...
+ *         done(response.ok());
+ *     });
+ * }
+ **/
+class AsyncTask : public BaseTask {
+public:
+    /* ctor. */
+    AsyncTask() : BaseTask(ASYNC_TASK) {};
+
+    /**
+    * initializing task by configuration
+    * @param conf, yaml configure node
+    * @return true : if init ok, otherwise false.
+    */
+    virtual bool init(const YAML::Node &conf_info) override {
+        return BaseTask::init(conf_info);
+    }
+
+    /**
+    * execute the task without blocking.
+    * @param data task_data, valid until done is called
+    * @param done call it exactly once when finished
+    */
+    virtual void run_async(void *data, TaskDone done) const override = 0;
+
+    /**
+    * blocking execution for TaskScheduler::schedule, waits for run_async.
+    * @param data task_data
+    * @return true if execute ok, otherwise false.
+    */
+    virtual bool run(void *data) const override {
+        auto result = std::make_shared<std::promise<bool>>();
+        std::future<bool> future = result->get_future();
+        run_async(data, [result](bool ret) {
+            result->set_value(ret);
+        });
+        return future.get();
+    }
+};
+
+/* max plan ids, one for each scheduler name. */
+const int64_t MAX_TASK_PLAN_NUM = 1024;
+const int64_t INVALID_PLAN_ID = -1;
+
+/**
+ * @class TaskPlan.
+ * tasks of a scheduler resolved against one TaskMap generation, immutable once built.
+ **/
+struct TaskPlan {
+    /* version of the scheduler it is built for. */
+    uint64_t                        _version{0};
+    /* tasks in the declared order. */
+    std::vector<const BaseTask*>    _tasks;
+    /* first alias not found in the map, empty if every task is found. */
+    std::string                     _missing;
+};
+
+/**
+ * @class TaskMap.
+ * alias -> task of one loaded generation, with the plans built against it.
+ * a plan is built by the first request after a swap and is read without lookup
+ * until the generation is retired, the plans go with it. a plan replaced by a
+ * newer scheduler is freed once the scheduler it was built for is released.
+ * e.g.:
+ * int64_t plan_id = TaskMap::register_plan("scheduler.rec_base");
+ * uint64_t version = TaskMap::new_plan_version();
+ * const TaskPlan *plan = task_map->get_plan(plan_id, version, aliases);
+ * TaskMap::release_plan(plan_id, version);
+ **/
+class TaskMap : public std::unordered_map<std::string, TaskPtr> {
+public:
+    /* ctor. */
+    TaskMap() : _plans(new std::atomic<const TaskPlan*>[MAX_TASK_PLAN_NUM]) {
+        for (int64_t i = 0; i < MAX_TASK_PLAN_NUM; ++i) {
+            _plans[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    /* dtor, no request reads a retired generation. */
+    ~TaskMap() {
+        for (int64_t i = 0; i < MAX_TASK_PLAN_NUM; ++i) {
+            delete _plans[i].load(std::memory_order_relaxed);
+        }
+        for (auto plan : _replaced_plans) {
+            delete plan;
+        }
+    }
+
+    /**
+    * plan id of a name, the same name gets the same id while it is registered,
+    * an id released by every holder is reused by another name.
+    * @param name scheduler name
+    * @return plan id, INVALID_PLAN_ID if ids run out
+    */
+    static int64_t register_plan(const std::string &name) {
+        PlanRegistry &registry = plan_registry();
+        std::lock_guard<std::mutex> guard(registry._lock);
+        auto iter = registry._ids.find(name);
+        if (iter != registry._ids.end()) {
+            ++registry._holder_nums[iter->second];
+            return iter->second;
+        }
+        int64_t plan_id = INVALID_PLAN_ID;
+        if (!registry._free_ids.empty()) {
+            plan_id = registry._free_ids.back();
+            registry._free_ids.pop_back();
+        } else if (static_cast<int64_t>(registry._names.size()) < MAX_TASK_PLAN_NUM) {
+            plan_id = registry._names.size();
+            registry._names.emplace_back();
+            registry._holder_nums.push_back(0);
+        } else {
+            ERR_LOG << "too many task plans, name : " << name << std::endl;
+            return INVALID_PLAN_ID;
+        }
+        registry._ids.emplace(name, plan_id);
+        registry._names[plan_id] = name;
+        registry._holder_nums[plan_id] = 1;
+        return plan_id;
+    }
+
+    /* a new version for every initialized scheduler, a plan of another version is rebuilt. */
+    static uint64_t new_plan_version() {
+        PlanRegistry &registry = plan_registry();
+        std::lock_guard<std::mutex> guard(registry._lock);
+        uint64_t version = ++registry._version;
+        registry._live_versions.insert(version);
+        return version;
+    }
+
+    /**
+    * release what a retired scheduler registered, when no request runs on it.
+    * @param plan_id from register_plan, ignored if INVALID_PLAN_ID
+    * @param version from new_plan_version, ignored if 0
+    */
+    static void release_plan(const int64_t plan_id, const uint64_t version) {
+        PlanRegistry &registry = plan_registry();
+        std::lock_guard<std::mutex> guard(registry._lock);
+        registry._live_versions.erase(version);
+        if (plan_id < 0 || plan_id >= static_cast<int64_t>(registry._names.size()) ||
+                registry._holder_nums[plan_id] <= 0) {
+            return;
+        }
+        if (--registry._holder_nums[plan_id] == 0) {
+            registry._ids.erase(registry._names[plan_id]);
+            registry._names[plan_id].clear();
+            registry._free_ids.push_back(plan_id);
+        }
+    }
+
+    /**
+    * plan of the aliases in this generation, built at the first call of a version.
+    * @param plan_id from register_plan
+    * @param version from new_plan_version, of the caller's alias list
+    * @param aliases task aliases in order
+    * @return plan, valid while this map is pinned and the version is not released.
+    *         nullptr if the plan id is invalid or a newer version is built,
+    *         such as a request still on a reloaded scheduler, resolve the aliases by find()
+    */
+    const TaskPlan* get_plan(const int64_t plan_id, const uint64_t version,
+            const std::vector<std::string> &aliases) const {
+        if (plan_id < 0 || plan_id >= MAX_TASK_PLAN_NUM) {
+            return nullptr;
+        }
+        //a replaced plan is freed after the readers of the slot are done
+        ::inf::utils::EpochReclaimer &reclaimer = ::inf::utils::EpochReclaimer::instance();
+        auto slot = reclaimer.enter();
+        const TaskPlan *plan = _plans[plan_id].load(std::memory_order_acquire);
+        if (plan != nullptr && plan->_version >= version) {
+            reclaimer.leave(slot);
+            return plan->_version == version ? plan : nullptr;
+        }
+        std::unique_ptr<TaskPlan> new_plan = build_plan(version, aliases);
+        while (!_plans[plan_id].compare_exchange_weak(plan, new_plan.get(),
+                std::memory_order_acq_rel, std::memory_order_acquire)) {
+            //built by another request at the same time, or by a newer scheduler
+            if (plan != nullptr && plan->_version >= version) {
+                reclaimer.leave(slot);
+                return plan->_version == version ? plan : nullptr;
+            }
+        }
+        reclaimer.leave(slot);
+        if (plan != nullptr) {
+            retire_plan(plan);
+        }
+        return new_plan.release();
+    }
+
+    /* bytes of the map, its slots and plans, the tasks are not counted. */
+    int64_t get_bytes() const {
+        int64_t bytes = sizeof(TaskMap) + bucket_count() * sizeof(void*) +
+                MAX_TASK_PLAN_NUM * sizeof(std::atomic<const TaskPlan*>);
+        for (auto &task : *this) {
+            //one node of the hash map, value and the next pointer
+            bytes += sizeof(value_type) + sizeof(void*) + task.first.capacity();
+        }
+        auto plan_bytes = [](const TaskPlan *plan) {
+            return plan == nullptr ? 0 : static_cast<int64_t>(sizeof(TaskPlan) +
+                    plan->_tasks.capacity() * sizeof(const BaseTask*) + plan->_missing.capacity());
+        };
+        ::inf::utils::EpochReclaimer &reclaimer = ::inf::utils::EpochReclaimer::instance();
+        auto slot = reclaimer.enter();
+        for (int64_t i = 0; i < MAX_TASK_PLAN_NUM; ++i) {
+            bytes += plan_bytes(_plans[i].load(std::memory_order_acquire));
+        }
+        reclaimer.leave(slot);
+        std::lock_guard<std::mutex> guard(_plan_lock);
+        for (auto plan : _replaced_plans) {
+            bytes += plan_bytes(plan);
+        }
+        return bytes;
+    }
+
+    /* plans held by this map, the current ones and the replaced ones not released yet. */
+    int64_t get_plan_num() const {
+        int64_t plan_num = 0;
+        for (int64_t i = 0; i < MAX_TASK_PLAN_NUM; ++i) {
+            if (_plans[i].load(std::memory_order_acquire) != nullptr) {
+                ++plan_num;
+            }
+        }
+        std::lock_guard<std::mutex> guard(_plan_lock);
+        return plan_num + _replaced_plans.size();
+    }
+
+private:
+    /* process wide plan ids and live versions. */
+    struct PlanRegistry {
+        std::mutex                                  _lock;
+        std::unordered_map<std::string, int64_t>    _ids;
+        /* plan id -> name and the num of schedulers holding it. */
+        std::vector<std::string>                    _names;
+        std::vector<int64_t>                        _holder_nums;
+        std::vector<int64_t>                        _free_ids;
+        /* versions of the schedulers not released. */
+        std::unordered_set<uint64_t>                _live_versions;
+        uint64_t                                    _version{0};
+    };
+
+    /* never destroyed, schedulers may be released during static destruction. */
+    static PlanRegistry& plan_registry() {
+        static PlanRegistry *registry = new PlanRegistry();
+        return *registry;
+    }
+
+    /* whether a scheduler of the version may still read its plan. */
+    static bool is_live_version(const uint64_t version) {
+        PlanRegistry &registry = plan_registry();
+        std::lock_guard<std::mutex> guard(registry._lock);
+        return registry._live_versions.count(version) != 0;
+    }
+
+    /* resolve the aliases in this map. */
+    std::unique_ptr<TaskPlan> build_plan(const uint64_t version,
+            const std::vector<std::string> &aliases) const {
+        std::unique_ptr<TaskPlan> plan(new TaskPlan());
+        plan->_version = version;
+        plan->_tasks.reserve(aliases.size());
+        for (auto &alias : aliases) {
+            auto iter = find(alias);
+            if (iter == end() || !iter->second) {
+                plan->_missing = alias;
+                plan->_tasks.clear();
+                break;
+            }
+            plan->_tasks.push_back(iter->second.get());
+        }
+        return plan;
+    }
+
+    /**
+    * keep a replaced plan while its scheduler runs, free the released ones
+    * on the BufferRetirer once the readers of the slot are done.
+    */
+    void retire_plan(const TaskPlan *plan) const {
+        std::lock_guard<std::mutex> guard(_plan_lock);
+        _replaced_plans.push_back(plan);
+        auto iter = std::partition(_replaced_plans.begin(), _replaced_plans.end(),
+                [](const TaskPlan *replaced) { return is_live_version(replaced->_version); });
+        for (auto released = iter; released != _replaced_plans.end(); ++released) {
+            const TaskPlan *released_plan = *released;
+            ::inf::utils::BufferRetirer::instance().retire([released_plan]() { delete released_plan; });
+        }
+        _replaced_plans.erase(iter, _replaced_plans.end());
+    }
+
+    /* plan id -> latest plan, owned. */
+    std::unique_ptr<std::atomic<const TaskPlan*>[]>     _plans;
+
+    /* plans replaced by a newer version, owned, a request may still read them. */
+    mutable std::mutex                                  _plan_lock;
+    mutable std::vector<const TaskPlan*>                _replaced_plans;
+};
+using TaskMapPtr = std::unique_ptr<TaskMap>;
+
+/**
+ * bytes of a TaskMap generation for DoubleData, the tasks are not counted,
+ * a reload shares the unchanged ones with the generation it replaces.
+ */
+inline int64_t get_buffer_bytes(const TaskMap &task_map) {
+    return task_map.get_bytes();
+}
+
+/* registered name of the builtin serial group task. */
+const std::string SERIAL_TASK_NAME = "serial_task";
+/* registered name of the builtin parallel group task. */
+const std::string PARALLEL_TASK_NAME = "parallel_task";
+/* default max num of task init() running at the same time while loading. */
+const int64_t DEFAULT_INIT_CONCURRENCY = 4;
+
+/** 
+ * @class CompositeTask.
+ * @brief group of child tasks, children are referred by alias name in task.yaml.
+ * e.g.:
+ * - task_alias_name: multi_recall
+ *   task_name: parallel_task
+ *   sub_tasks: [recall_hot, recall_cf, recall_vec]
+ *   timeout_ms: 30     # optional, parallel_task only, 0 means no deadline
+ *   skip_failure: 0    # optional, 1: keep running other children after one failed
+ * children may be groups as well, but a group can not contain itself.
+ **/
+class CompositeTask : public BaseTask {
+public:
+    /* ctor. */
+    explicit CompositeTask(TaskType task_type) : BaseTask(task_type) {};
+
+    /**
+    * initializing group by configuration, read the child alias names.
+    * @param conf, yaml configure node
+    * @return true : if init ok, otherwise false.
+    */
+    virtual bool init(const YAML::Node &conf_info) override {
+        if (!BaseTask::init(conf_info)) {
+            return false;
+        }
+        try {
+            if (!conf_info["sub_tasks"].IsDefined()) {
+                ERR_LOG << "sub_tasks not define, task : " << get_task_name() << std::endl;
+                return false;
+            }
+            _sub_task_names = conf_info["sub_tasks"].as<std::vector<std::string>>();
+            if (conf_info["skip_failure"].IsDefined()) {
+                _skip_failure = conf_info["skip_failure"].as<int64_t>() == 1;
+            }
+        } catch (const std::exception &e) {
+            ERR_LOG << e.what() << std::endl;
+            return false;
+        }
+
+        return !_sub_task_names.empty();
+    }
+
+    /**
+    * bind children to the instances of the same task map.
+    * TaskLoader calls it after every task of the map is created.
+    * @param task_map the task map this group belongs to
+    * @return true if every child exists.
+    */
+    virtual bool link(const TaskMap &task_map) {
+        _sub_tasks.clear();
+        for (auto &sub_task_name : _sub_task_names) {
+            auto it = task_map.find(sub_task_name);
+            if (it == task_map.end() || !it->second) {
+                ERR_LOG << "sub task not found : " << sub_task_name << ", group : "
+                        << get_task_name() << std::endl;
+                return false;
+            }
+            _sub_tasks.push_back(it->second.get());
+        }
+        return true;
+    }
+
+    /* child alias names. */
+    const std::vector<std::string>& get_sub_task_names() const {
+        return _sub_task_names;
+    }
+
+protected:
+    /* child alias names. */
+    std::vector<std::string>        _sub_task_names;
+
+    /* child instances, valid as long as the task map. */
+    std::vector<const BaseTask*>    _sub_tasks;
+
+    /* keep running after a child failed. */
+    bool                            _skip_failure{false};
+};
+
 /** 
  * @class SerialTask.
  * @brief task be executed in a serial.
+ * children run one by one in the declared order, inside one scheduling slot.
  **/
-class SerialTask : public BaseTask {
+class SerialTask : public CompositeTask {
 public:
     /* ctor. */
-    SerialTask() : BaseTask(SERIAL_TASK) {};
+    SerialTask() : CompositeTask(SERIAL_TASK) {};
     
     /**
     * initializing task by configuration
@@ -135,27 +617,72 @@ public:
     * @note BaseTaskLoader::load will call SerialTask::init for all subclass of UnitTask.
     * so there is no need to init each UnitTask subclass manaunlly.
     */
-    virtual bool init(const YAML::Node &conf_info) {
-        return BaseTask::init(conf_info);
+    virtual bool init(const YAML::Node &conf_info) override {
+        if (!CompositeTask::init(conf_info)) {
+            return false;
+        }
+
+        //chain graph for run_async, a child listed twice gets a unique node name
+        std::string last_node;
+        for (size_t i = 0; i < _sub_task_names.size(); ++i) {
+            std::string node = _sub_task_names[i];
+            if (std::count(_sub_task_names.begin(), _sub_task_names.begin() + i, node) > 0) {
+                node.append("#").append(std::to_string(i));
+            }
+            _sub_task_graph.add_node(node, last_node.empty() ? 
+                    std::vector<std::string>() : std::vector<std::string>{last_node});
+            last_node = node;
+        }
+        return _sub_task_graph.build();
     }
 
 
     /**
-    * execute the task
+    * execute the children in order
     * @param data task_data
     * @return true if execute ok, otherwise false.
     */
-   virtual bool run(void *data) const = 0;
+    virtual bool run(void *data) const override {
+        bool result = true;
+        for (auto sub_task : _sub_tasks) {
+            if (sub_task->execute(data)) {
+                continue;
+            }
+            ERR_LOG << "sub task failed : " << sub_task->get_task_name() << ", group : "
+                    << get_task_name() << std::endl;
+            if (!_skip_failure) {
+                return false;
+            }
+            result = false;
+        }
+        return result;
+    }
+
+    /**
+    * execute the children in order without blocking
+    * @param data task_data
+    * @param done completion callback
+    */
+    virtual void run_async(void *data, TaskDone done) const override {
+        TaskGraphExecutor::execute_async(_sub_task_graph, _sub_tasks, data,
+                _skip_failure, 0, std::move(done));
+    }
+
+private:
+    /* children graph, each child depends on the previous one. */
+    TaskGraph   _sub_task_graph;
 };
 
 /** 
  * @class ParallelTask.
- * @brief task be executed in a serial.
+ * @brief task be executed in parallel.
+ * children fan out on the FrameThreadPool and are joined before the deadline,
+ * children not started before the deadline are skipped.
  **/
-class ParallelTask : public BaseTask {
+class ParallelTask : public CompositeTask {
 public:
     /* ctor. */
-    ParallelTask() : BaseTask(PARALLEL_TASK) {};
+    ParallelTask() : CompositeTask(PARALLEL_TASK) {};
     
     /**
     * initializing task by configuration
@@ -164,25 +691,65 @@ public:
     * @note BaseTaskLoader::load will call ParallelTask::init for all subclass of UnitTask.
     * so there is no need to init each UnitTask subclass manaunlly.
     */
-    virtual bool init(const YAML::Node &conf_info) {
-        return BaseTask::init(conf_info);
+    virtual bool init(const YAML::Node &conf_info) override {
+        if (!CompositeTask::init(conf_info)) {
+            return false;
+        }
+        try {
+            if (conf_info["timeout_ms"].IsDefined()) {
+                _timeout_ms = conf_info["timeout_ms"].as<int64_t>();
+            }
+        } catch (const std::exception &e) {
+            ERR_LOG << e.what() << std::endl;
+            return false;
+        }
+
+        //children have no dependency between each other
+        for (auto &sub_task_name : _sub_task_names) {
+            _sub_task_graph.add_node(sub_task_name, {});
+        }
+        return _sub_task_graph.build();
     }
 
 
     /**
-    * execute the task
+    * execute the children at the same time
     * @param data task_data
     * @return true if execute ok, otherwise false.
     */
-   virtual bool run(void *data) const = 0;
+    virtual bool run(void *data) const override {
+        return TaskGraphExecutor::execute(_sub_task_graph, _sub_tasks, data,
+                _skip_failure, _timeout_ms);
+    }
+
+    /**
+    * execute the children at the same time without blocking
+    * @param data task_data
+    * @param done completion callback
+    */
+    virtual void run_async(void *data, TaskDone done) const override {
+        TaskGraphExecutor::execute_async(_sub_task_graph, _sub_tasks, data,
+                _skip_failure, _timeout_ms, std::move(done));
+    }
+
+private:
+    /* deadline of the group, 0 means no deadline. */
+    int64_t     _timeout_ms{0};
+
+    /* children graph without edges. */
+    TaskGraph   _sub_task_graph;
 };
 
-using TaskMap = std::unordered_map<std::string, TaskPtr>;
-using TaskMapPtr = std::unique_ptr<TaskMap>;
 /** 
  * @class TaskLoader.
  * double buffer task loader,
  * TODO: maybe should be defined as inner class of Manager?
+ * reload is incremental: a unit task whose alias and yaml subtree are the same
+ * as the last loaded one is moved into the new map without create and init,
+ * only the changed or new aliases are created. 
+ * group tasks are always rebuilt, they are cheap and bind to the new children.
+ * a reused task is shared by the old and new maps, run() may be called on 
+ * both generations at the same time.
  **/
 template <typename UnitTaskCreator>
 class TaskLoader {
@@ -217,49 +784,258 @@ public:
             TaskMapPtr task_table(new TaskMap());
             
             YAML::Node conf = YAML::LoadFile(_config_file_name.c_str());
-            for (int64_t i = 0; i < conf.size(); ++i) {
+            //alias -> yaml subtree and instance of this load, replace the cache when all done
+            LoadedTaskTable loaded_table;
+            int64_t reused_num = 0;
+            //created tasks, init after all created
+            std::vector<InitItem> init_items;
+            for (size_t i = 0; i < conf.size(); ++i) {
                 //create by alias name, but registered name is conf["task_name"]
-                std::string task_alias_name = conf["task_alias_name"].as<std::string>();
+                std::string task_alias_name = conf[i]["task_alias_name"].as<std::string>();
                 auto it = task_table->find(task_alias_name);
                 if (it != task_table->end()) {
                     ERR_LOG << "Duplicate task alias name, alias : " << task_alias_name << std::endl;
                     return TaskMapPtr(nullptr);
                 }
                 
+                //unchanged unit task, reuse the live instance
+                std::string task_conf = YAML::Dump(conf[i]);
+                auto loaded = _loaded_table.find(task_alias_name);
+                if (loaded != _loaded_table.end() && loaded->second.first == task_conf) {
+                    loaded_table.emplace(task_alias_name, loaded->second);
+                    task_table->insert(std::make_pair(task_alias_name, loaded->second.second));
+                    ++reused_num;
+                    continue;
+                }
+                
                 // task can be create by conf, creator's proxy mode.
-                TaskPtr task_ptr = task_creator.create(conf[i]);
+                // group tasks are builtin, no need to register.
+                TaskPtr task_ptr = create_builtin(conf[i]);
+                if (!task_ptr) {
+                    task_ptr = task_creator.create(conf[i]);
+                }
                 if (!task_ptr) {
-                    ERR_LOG << "Create Task Failed, alias : << task_alias_name" << std::endl;
+                    ERR_LOG << "Create Task Failed, alias : " << task_alias_name << std::endl;
                     return TaskMapPtr(nullptr);
                 }
 
-                //task init by it's own conf
-                if (!task_ptr->init(conf[i])) {
-                    ERR_LOG << "Initialize Task Failed, alias :  << task_alias_name" << std::endl;
-                    return TaskMapPtr(nullptr); 
+                task_ptr->set_task_alias(task_alias_name);
+                init_items.push_back(InitItem{task_alias_name, task_conf, task_ptr, 0});
+                task_table->insert(std::make_pair(task_alias_name, std::move(task_ptr)));
+            }
+
+            //task init by it's own conf, any failure discards the whole map
+            if (!init_tasks(init_items)) {
+                return TaskMapPtr(nullptr);
+            }
+            for (auto &item : init_items) {
+                if (!is_composite(item._task)) {
+                    loaded_table.emplace(item._alias, std::make_pair(item._conf, item._task));
                 }
+            }
 
-                task_table->insert(std::make_pair(task_alias_name, std::move(task_ptr)));
+            if (!link_composite(*task_table)) {
+                return TaskMapPtr(nullptr);
             }
 
+            //a failed load keeps the cache of the live map
+            _loaded_table.swap(loaded_table);
+            _reused_task_num = reused_num;
+            INFO_LOG << "task loaded : " << task_table->size() << ", reused : " << reused_num
+                    << ", file : " << _config_file_name << std::endl;
             return task_table;
         } catch (const std::exception &e) {
             ERR_LOG << e.what() << std::endl;
             return TaskMapPtr(nullptr);
         } catch (...) {
             ERR_LOG << "Unknown Error" << std::endl;
+            return TaskMapPtr(nullptr);
         }
         
     }
 
+    /**
+    * max num of task init() running at the same time.
+    * @param init_concurrency 1 means init one by one on the loading thread
+    */
+    void set_init_concurrency(const int64_t init_concurrency) {
+        _init_concurrency = std::max<int64_t>(init_concurrency, 1);
+    }
+
+    /**
+    * init cost of the tasks created by the last load, failed or not.
+    * a copy, the next load replaces it on the reload thread.
+    * @return alias -> cost ms
+    */
+    std::unordered_map<std::string, int64_t> get_init_cost_ms() const {
+        std::lock_guard<std::mutex> guard(_init_cost_lock);
+        return _init_cost_ms;
+    }
+
+    /**
+    * num of the tasks reused by the last successful load.
+    * @return reused task num
+    */
+    int64_t get_reused_task_num() const {
+        return _reused_task_num;
+    }
     
 private:
+    /* alias -> (yaml subtree, unit task instance) */
+    using LoadedTaskTable = std::unordered_map<std::string, std::pair<std::string, TaskPtr>>;
+
+    /* task waiting for init. */
+    struct InitItem {
+        std::string     _alias;
+        std::string     _conf;      //yaml subtree
+        TaskPtr         _task;
+        int64_t         _cost_ms;
+    };
+
+    /**
+    * init the tasks on at most _init_concurrency threads, the loading thread is one of them.
+    * every task gets its own yaml node parsed from the subtree, yaml-cpp nodes
+    * are not safe to share between threads.
+    * after one failed, the tasks not started yet are skipped.
+    * @return true if all ok
+    */
+    bool init_tasks(std::vector<InitItem> &init_items) {
+        std::atomic<size_t> next_index{0};
+        std::atomic<bool> failed{false};
+        auto init_worker = [&init_items, &next_index, &failed]() {
+            while (!failed) {
+                size_t index = next_index.fetch_add(1);
+                if (index >= init_items.size()) {
+                    return;
+                }
+                InitItem &item = init_items[index];
+                auto start = std::chrono::steady_clock::now();
+                bool ret = false;
+                try {
+                    ret = item._task->init(YAML::Load(item._conf));
+                } catch (const std::exception &e) {
+                    ERR_LOG << e.what() << ", alias : " << item._alias << std::endl;
+                } catch (...) {
+                    ERR_LOG << "Unknown Error, alias : " << item._alias << std::endl;
+                }
+                item._cost_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+                if (!ret) {
+                    ERR_LOG << "Initialize Task Failed, alias : " << item._alias << std::endl;
+                    failed = true;
+                }
+            }
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        int64_t thread_num = std::min<int64_t>(_init_concurrency, init_items.size());
+        std::vector<std::thread> init_threads;
+        for (int64_t i = 1; i < thread_num; ++i) {
+            init_threads.emplace_back(init_worker);
+        }
+        init_worker();
+        for (auto &init_thread : init_threads) {
+            init_thread.join();
+        }
+
+        std::unordered_map<std::string, int64_t> init_cost_ms;
+        for (auto &item : init_items) {
+            init_cost_ms[item._alias] = item._cost_ms;
+        }
+        {
+        std::lock_guard<std::mutex> guard(_init_cost_lock);
+        _init_cost_ms.swap(init_cost_ms);
+        }
+        auto slowest = std::max_element(init_items.begin(), init_items.end(), 
+                [](const InitItem &lhs, const InitItem &rhs) { return lhs._cost_ms < rhs._cost_ms; });
+        INFO_LOG << "task init : " << init_items.size() << ", concurrency : " << thread_num
+                << ", cost_ms : " << std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start).count()
+                << (slowest == init_items.end() ? std::string() : ", slowest : " + 
+                        slowest->_alias + " " + std::to_string(slowest->_cost_ms) + "ms")
+                << std::endl;
+        return !failed;
+    }
+
+    /* create builtin group task by task_name, nullptr if not a group. */
+    TaskPtr create_builtin(const YAML::Node &conf) const {
+        std::string task_name = conf["task_name"].as<std::string>();
+        if (task_name == SERIAL_TASK_NAME) {
+            return TaskPtr(new SerialTask());
+        }
+        if (task_name == PARALLEL_TASK_NAME) {
+            return TaskPtr(new ParallelTask());
+        }
+        return TaskPtr(nullptr);
+    }
+
+    /* bind group children inside the new map, and reject groups containing themselves. */
+    bool link_composite(const TaskMap &task_table) const {
+        // 0: not visited, 1: visiting, 2: done
+        std::unordered_map<std::string, int> visit_status;
+        std::function<bool(const std::string&)> check_cycle = [&](const std::string &alias) {
+            int &status = visit_status[alias];
+            if (status == 1) {
+                ERR_LOG << "group task contains itself, alias : " << alias << std::endl;
+                return false;
+            }
+            if (status == 2) {
+                return true;
+            }
+            status = 1;
+            auto it = task_table.find(alias);
+            if (it != task_table.end() && is_composite(it->second)) {
+                auto composite = static_cast<const CompositeTask*>(it->second.get());
+                for (auto &sub_task_name : composite->get_sub_task_names()) {
+                    if (!check_cycle(sub_task_name)) {
+                        return false;
+                    }
+                }
+            }
+            visit_status[alias] = 2;
+            return true;
+        };
+
+        for (auto &item : task_table) {
+            if (!is_composite(item.second)) {
+                continue;
+            }
+            if (!static_cast<CompositeTask*>(item.second.get())->link(task_table)) {
+                ERR_LOG << "Link Group Task Failed, alias : " << item.first << std::endl;
+                return false;
+            }
+            if (!check_cycle(item.first)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* whether the task is a group task. */
+    static bool is_composite(const TaskPtr &task) {
+        return task && (task->get_task_type() == SERIAL_TASK ||
+                task->get_task_type() == PARALLEL_TASK);
+    }
+
     /* none copy. */
     TaskLoader(const TaskLoader &rhs) = delete;
     TaskLoader &operator=(const TaskLoader &rhs) = delete;
     
     /* conf filename. */
     std::string _config_file_name {""};
+
+    /* unit tasks of the last successful load, reused by the next one. */
+    LoadedTaskTable _loaded_table;
+
+    /* reused num of the last successful load. */
+    int64_t     _reused_task_num{0};
+
+    /* max init() running at the same time. */
+    int64_t     _init_concurrency{DEFAULT_INIT_CONCURRENCY};
+
+    /* alias -> init cost ms, of the last load. */
+    mutable std::mutex                          _init_cost_lock;
+    std::unordered_map<std::string, int64_t>    _init_cost_ms;
 };
 
 
@@ -271,6 +1047,10 @@ private:
 template <typename UnitTaskCreator>
 class TaskManager {
 public:
+    /* pinned task map, see get_task_map(). */
+    using TaskMapGuard = typename ::inf::utils::DoubleData<TaskMapPtr, 
+            TaskLoader<UnitTaskCreator>>::ReadGuard;
+
     /* singleton. */
     static TaskManager& instance() {
         static TaskManager instance;
@@ -278,13 +1058,21 @@ public:
     }
 
     /* init task manager. */
-    bool init(const std::string &file_path, const std::string &comand) {
+    bool init(const std::string &file_path, const std::string &/*command*/) {
         try {
             TaskLoaderPtr task_loader_ptr = std::make_unique<TaskLoader<UnitTaskCreator>>();
             //bind loader to conf
-            task_loader_ptr->init(file_path);
-            _task_double_buffer_ptr = TaskDoubleBuffer(std::move(task_loader_ptr));
-            _task_double_buffer_ptr->init();
+            if (!task_loader_ptr->init(file_path)) {
+                ERR_LOG << "task conf not exist : " << file_path << std::endl;
+                return false;
+            }
+            task_loader_ptr->set_init_concurrency(_init_concurrency);
+            _task_double_buffer_ptr.reset(new TaskDoubleBuffer(std::move(task_loader_ptr)));
+            if (_task_double_buffer_ptr->init() != 0) {
+                return false;
+            }
+            auto task_map = _task_double_buffer_ptr->get_current();
+            return task_map && *task_map;
         } catch (const std::exception &e) {
             ERR_LOG << e.what() << std::endl;
             return false;
@@ -294,15 +1082,55 @@ public:
         }
     }
 
-    /* get task instance by alias name. */
+    /**
+    * max num of task init() running at the same time while loading, call it before init.
+    * @param init_concurrency
+    */
+    void set_init_concurrency(const int64_t init_concurrency) {
+        _init_concurrency = init_concurrency;
+    }
+
+    /**
+    * pin the current task map, lock free.
+    * tasks found in it stay valid until the guard is destroyed,
+    * hold it for the whole request.
+    * @return TaskMapGuard, empty if not initialized
+    */
+    TaskMapGuard get_task_map() const {
+        if (!_task_double_buffer_ptr) {
+            return TaskMapGuard();
+        }
+        return _task_double_buffer_ptr->read();
+    }
+
+    /**
+    * shared pin of the current task map, for a request finishing on another thread
+    * such as schedule_async. it takes a lock, prefer get_task_map() otherwise.
+    * @return task map, nullptr if not initialized
+    */
+    std::shared_ptr<const TaskMapPtr> get_shared_task_map() const {
+        if (!_task_double_buffer_ptr) {
+            return nullptr;
+        }
+        return _task_double_buffer_ptr->get_current();
+    }
+
+    /**
+    * get task instance by alias name. 
+    * the result is only safe while the caller pins the task map by get_task_map().
+    */
     const TaskPtr& get_task(const std::string& task_alias_name) const {
-        const TaskMapPtr task_map = _task_double_buffer_ptr->get_current();
-        if (!task_map) {
-            ERR_LOG << " _task_double_buffer_ptr->get_current() Failed!" << std::endl;
+        if (!_task_double_buffer_ptr) {
+            ERR_LOG << "TaskManager not initialized" << std::endl;
+            return _invalid_ptr;
+        }
+        TaskMapGuard task_map = _task_double_buffer_ptr->read();
+        if (!task_map || !*task_map) {
+            ERR_LOG << " _task_double_buffer_ptr->read() Failed!" << std::endl;
             return _invalid_ptr;
         }
-        auto it = task_map->find(task_alias_name);
-        if (it == task_map->end()) {
+        auto it = (*task_map)->find(task_alias_name);
+        if (it == (*task_map)->end()) {
             return _invalid_ptr;
         }
 
@@ -323,6 +1151,9 @@ private:
     /* task double buffer ptr. */
     TaskDoubelBufferPtr _task_double_buffer_ptr;
 
+    /* max init() running at the same time. */
+    int64_t _init_concurrency{DEFAULT_INIT_CONCURRENCY};
+
 };
 
 
@@ -1,8 +1,15 @@
 #pragma once
-
+#include "utils/common_log.h"
+#include "arena.h"
 #include <memory>
 #include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <typeinfo>
+#include <utility>
 #include <unordered_map>
+#include <stdint.h>
 
 namespace inf {
 namespace frame {
@@ -58,16 +65,138 @@ private:
 
 
 
+const int64_t INVALID_SLOT_INDEX = -1;
+
+/* unique id of a type, without rtti. */
+using SlotTypeId = const void*;
+
+template <typename DataType>
+SlotTypeId get_slot_type_id() {
+    static const char type_id = 0;
+    return &type_id;
+}
+
+/** 
+ * @class SlotRegistry.
+ * resolves slot key names to dense indexes once, at registration time,
+ * and records the data type of every slot.
+ * registering the same name with the same type returns the same index,
+ * with another type is rejected.
+ **/
+class SlotRegistry {
+public:
+    /* singleton. */
+    static SlotRegistry& instance() {
+        static SlotRegistry instance;
+        return instance;
+    }
+
+    /**
+    * register a slot.
+    * @param name key name
+    * @param type_id data type id
+    * @param type_name data type name, for logging
+    * @return slot index, INVALID_SLOT_INDEX if the name is registered with another type
+    */
+    int64_t register_slot(const std::string &name, SlotTypeId type_id, const std::string &type_name) {
+        std::lock_guard<std::mutex> lock(_lock);
+        auto it = _name_table.find(name);
+        if (it != _name_table.end()) {
+            if (_slot_types[it->second] != type_id) {
+                ERR_LOG << "slot key registered with another type, key : " << name 
+                        << ", type : " << type_name << std::endl;
+                return INVALID_SLOT_INDEX;
+            }
+            return it->second;
+        }
+        int64_t index = _slot_types.size();
+        _slot_types.push_back(type_id);
+        _slot_names.push_back(name);
+        _name_table.insert(std::make_pair(name, index));
+        _size = _slot_types.size();
+        return index;
+    }
+
+    /* registered slot num. */
+    int64_t size() const {
+        return _size.load(std::memory_order_acquire);
+    }
+
+    /* name of the slot, for logging. */
+    std::string get_name(const int64_t index) {
+        std::lock_guard<std::mutex> lock(_lock);
+        return index >= 0 && index < static_cast<int64_t>(_slot_names.size()) ? 
+                _slot_names[index] : "";
+    }
+
+private:
+    /* ctor. */
+    SlotRegistry() = default;
+    /* none copy. */
+    SlotRegistry(const SlotRegistry &rhs) = delete;
+    SlotRegistry &operator=(const SlotRegistry &rhs) = delete;
+
+    std::mutex                                  _lock;
+    std::unordered_map<std::string, int64_t>    _name_table;
+    std::vector<SlotTypeId>                     _slot_types;
+    std::vector<std::string>                    _slot_names;
+    std::atomic<int64_t>                        _size{0};
+};
+
+/** 
+ * @class SlotKey.
+ * typed key of TaskDataMap, resolved to an index when constructed.
+ * define keys as globals, so they are registered before any request:
+ * const SlotKey<UserFeature> USER_FEATURE_REQ_KEY("user_feature_req");
+ * data_map.insert(USER_FEATURE_REQ_KEY, new UserFeature);
+ * UserFeature *feature = data_map.find(USER_FEATURE_REQ_KEY);
+ **/
+template <typename DataType>
+class SlotKey {
+public:
+    /* ctor. */
+    explicit SlotKey(const std::string &name) 
+        : _index(SlotRegistry::instance().register_slot(name, get_slot_type_id<DataType>(), 
+                typeid(DataType).name())) {};
+
+    /* slot index, INVALID_SLOT_INDEX if registration failed. */
+    int64_t index() const {
+        return _index;
+    }
+
+private:
+    int64_t _index;
+};
+
 /** 
  * @class TaskDataMap.
  * store multi task , unorder_map <string, BaseTaskDataPtr>
  * can store any data type, because data will be stored by BaseTaskDataPtr.
  * get the task inherent class pointer.
+ * hot data should use SlotKey instead of string key: slots are a flat array 
+ * indexed by the key, no hashing and no TaskData wrapper.
+ * in debug builds (NDEBUG not defined) the data type is checked on find, 
+ * a mismatch is logged and returns nullptr.
  **/
 template <typename KeyType = std::string>
 class TaskDataMap {
 using DataMap = std::unordered_map<KeyType, BaseTaskDataPtr>;
 public:
+/**
+* ctor.
+* @param arena request arena, data created by emplace() lives in it, 
+* the map must be destroyed before the arena is reset.
+*/
+explicit TaskDataMap(Arena *arena = nullptr) : _arena(arena) {};
+
+/**
+* request arena, business tasks can allocate their request data from it.
+* @return arena, nullptr if not set
+*/
+Arena* get_arena() const {
+    return _arena;
+}
+
 /**
 * insert DataType* into table
 * may be store the request data, feature data, user data, etc. can be found by name.
@@ -103,10 +232,9 @@ DataType* find(const KeyType &key) {
         return nullptr;
     }
     
-    TaskData<DataType> *task_data = 
-        static_cast<TaskData<DataType>*>(it->second.get());
+    TaskData<DataType> *task_data = cast_task_data<DataType>(it->second.get());
     //task_data is TaskData, must return TaskData.get_data() (the raw data pointer)
-    return task_data->get_data();
+    return task_data == nullptr ? nullptr : task_data->get_data();
 }
 
 /**
@@ -121,10 +249,9 @@ const DataType* find(const KeyType &key) const{
         return nullptr;
     }
     
-    TaskData<DataType> *task_data = 
-        static_cast<TaskData<DataType>*>(it->second.get());
+    TaskData<DataType> *task_data = cast_task_data<DataType>(it->second.get());
     //task_data is TaskData, must return TaskData.get_data() (the raw data pointer)
-    return task_data->get_data();
+    return task_data == nullptr ? nullptr : task_data->get_data();
 }
 
 
@@ -145,10 +272,158 @@ bool erase(const KeyType &key) {
     return true;
 }
 
+/**
+* remove all data, keep the bucket array of the string keys and the slot array,
+* so a pooled map does not rebuild them for the next request.
+*/
+void clear() {
+    _data_table.clear();
+    for (auto &slot : _slot_table) {
+        slot._data.reset();
+        slot._type_id = nullptr;
+    }
+}
+
+/**
+* insert DataType* into the slot of key.
+* @param key slot key
+* @param data raw data pointer, owned by the map
+* @return data if inserted, otherwise nullptr and data is deleted.
+*/
+template <typename DataType>
+DataType* insert(const SlotKey<DataType> &key, DataType *data) {
+    int64_t index = key.index();
+    if (index < 0) {
+        delete data;
+        return nullptr;
+    }
+    if (index >= static_cast<int64_t>(_slot_table.size())) {
+        _slot_table.resize(SlotRegistry::instance().size());
+    }
+    Slot &slot = _slot_table[index];
+    if (slot._data) {
+        delete data;
+        return nullptr;
+    }
+    slot._data = SlotDataPtr(data, &delete_slot_data<DataType>);
+    slot._type_id = get_slot_type_id<DataType>();
+    return data;
+}
+
+/**
+* construct DataType in the slot of key, in the arena if set.
+* @param key slot key
+* @param args ctor args
+* @return data if inserted, otherwise nullptr.
+*/
+template <typename DataType, typename ...Args>
+DataType* emplace(const SlotKey<DataType> &key, Args&& ...args) {
+    if (_arena == nullptr) {
+        return insert(key, new DataType(std::forward<Args>(args)...));
+    }
+    int64_t index = key.index();
+    if (index < 0) {
+        return nullptr;
+    }
+    if (index >= static_cast<int64_t>(_slot_table.size())) {
+        _slot_table.resize(SlotRegistry::instance().size());
+    }
+    Slot &slot = _slot_table[index];
+    if (slot._data) {
+        return nullptr;
+    }
+    //the arena runs the destructor at reset
+    DataType *data = _arena->create<DataType>(std::forward<Args>(args)...);
+    slot._data = SlotDataPtr(data, &skip_delete);
+    slot._type_id = get_slot_type_id<DataType>();
+    return data;
+}
+
+/**
+* find the data by slot key, O(1).
+* @param key slot key
+* @return data, nullptr if not exist.
+*/
+template <typename DataType>
+DataType* find(const SlotKey<DataType> &key) {
+    return const_cast<DataType*>(static_cast<const TaskDataMap*>(this)->find(key));
+}
+
+/* const version. */
+template <typename DataType>
+const DataType* find(const SlotKey<DataType> &key) const {
+    int64_t index = key.index();
+    if (index < 0 || index >= static_cast<int64_t>(_slot_table.size())) {
+        return nullptr;
+    }
+    const Slot &slot = _slot_table[index];
+#ifndef NDEBUG
+    if (slot._data && slot._type_id != get_slot_type_id<DataType>()) {
+        ERR_LOG << "slot type mismatch, key : " << SlotRegistry::instance().get_name(index)
+                << ", type : " << typeid(DataType).name() << std::endl;
+        return nullptr;
+    }
+#endif
+    return static_cast<const DataType*>(slot._data.get());
+}
+
+/**
+* erase data by slot key.
+* @param key slot key
+* @return bool true if erase. othrer wise false.
+*/
+template <typename DataType>
+bool erase(const SlotKey<DataType> &key) {
+    int64_t index = key.index();
+    if (index < 0 || index >= static_cast<int64_t>(_slot_table.size()) || 
+            !_slot_table[index]._data) {
+        return false;
+    }
+    _slot_table[index]._data.reset();
+    return true;
+}
+
 
 private: 
+    using SlotDataPtr = std::unique_ptr<void, void(*)(void*)>;
+
+    /* one slot, data and its type. */
+    struct Slot {
+        SlotDataPtr     _data{nullptr, &delete_slot_data<char>};
+        SlotTypeId      _type_id{nullptr};
+    };
+
+    template <typename DataType>
+    static void delete_slot_data(void *data) {
+        delete static_cast<DataType*>(data);
+    }
+
+    /* data owned by the arena. */
+    static void skip_delete(void *) {
+    }
+
+    /* checked in debug builds. */
+    template <typename DataType>
+    static TaskData<DataType>* cast_task_data(BaseTaskData *task_data) {
+#ifndef NDEBUG
+        TaskData<DataType> *typed_data = dynamic_cast<TaskData<DataType>*>(task_data);
+        if (typed_data == nullptr) {
+            ERR_LOG << "task data type mismatch, type : " << typeid(DataType).name() << std::endl;
+        }
+        return typed_data;
+#else
+        return static_cast<TaskData<DataType>*>(task_data);
+#endif
+    }
+
     /* data map <string, BaseTaskDataPtr>. */
     DataMap             _data_table;
+
+    /* slots, indexed by SlotKey. */
+    std::vector<Slot>   _slot_table{static_cast<size_t>(SlotRegistry::instance().size())};
+
+    /* request arena, not owned. */
+    Arena               *_arena;
 };
 
 
@@ -0,0 +1,641 @@
+#pragma once
+#include "utils/common_log.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace inf {
+namespace frame {
+
+const int64_t DEFAULT_TASK_COST = 1;
+
+/* completion callback of an async task or graph, true if executed ok. */
+using TaskDone = std::function<void(bool)>;
+
+/**
+ * @class TaskGraph.
+ * dependency graph of the tasks in one scheduler, built once at load time.
+ * node id is the declared order of the task, edges point from a task to the
+ * tasks depending on it.
+ * e.g.:
+ * TaskGraph graph;
+ * graph.add_node("recall", {});
+ * graph.add_node("expose", {});
+ * graph.add_node("rank", {"recall", "expose"});
+ * graph.build();
+ **/
+class TaskGraph {
+public:
+    struct Node {
+        std::string                 _alias;         //task alias name
+        std::vector<std::string>    _depends_on;    //alias names this task waits for
+        int64_t                     _cost;          //estimated cost, used by critical path
+        int64_t                     _in_degree;     //number of dependencies
+        int64_t                     _rank;          //longest cost path from this node to the end
+        std::vector<int64_t>        _successors;    //nodes depending on this node
+
+        Node() : _cost(DEFAULT_TASK_COST), _in_degree(0), _rank(0) {};
+    };
+
+    /* ctor. */
+    TaskGraph() = default;
+    virtual ~TaskGraph() = default;
+
+    /**
+    * add a task into the graph, dependencies are resolved in build()
+    * @param alias task alias name
+    * @param depends_on alias names of the tasks must be finished before this one
+    * @param cost estimated cost of the task
+    * @return node id
+    */
+    int64_t add_node(const std::string &alias,
+                     const std::vector<std::string> &depends_on,
+                     const int64_t cost = DEFAULT_TASK_COST) {
+        Node node;
+        node._alias = alias;
+        node._depends_on = depends_on;
+        node._cost = cost > 0 ? cost : DEFAULT_TASK_COST;
+        _nodes.push_back(std::move(node));
+        return _nodes.size() - 1;
+    }
+
+    /**
+    * resolve dependencies, check cycles and compute the critical path.
+    * @return true if the graph is a valid DAG, otherwise false.
+    */
+    bool build() {
+        std::unordered_map<std::string, int64_t> index_table;
+        for (int64_t i = 0; i < static_cast<int64_t>(_nodes.size()); ++i) {
+            if (!index_table.insert(std::make_pair(_nodes[i]._alias, i)).second) {
+                ERR_LOG << "Duplicate task alias in graph : " << _nodes[i]._alias << std::endl;
+                return false;
+            }
+        }
+
+        for (int64_t i = 0; i < static_cast<int64_t>(_nodes.size()); ++i) {
+            for (auto &depend : _nodes[i]._depends_on) {
+                auto it = index_table.find(depend);
+                if (it == index_table.end()) {
+                    ERR_LOG << "Task " << _nodes[i]._alias
+                            << " depends on undeclared task : " << depend << std::endl;
+                    return false;
+                }
+                if (it->second == i) {
+                    ERR_LOG << "Task depends on itself : " << depend << std::endl;
+                    return false;
+                }
+                _nodes[it->second]._successors.push_back(i);
+                ++_nodes[i]._in_degree;
+            }
+        }
+
+        //kahn topological sort, detect cycles
+        std::vector<int64_t> in_degree(_nodes.size());
+        std::deque<int64_t> ready;
+        for (int64_t i = 0; i < static_cast<int64_t>(_nodes.size()); ++i) {
+            in_degree[i] = _nodes[i]._in_degree;
+            if (in_degree[i] == 0) {
+                ready.push_back(i);
+                _roots.push_back(i);
+            }
+        }
+        _topo_order.clear();
+        while (!ready.empty()) {
+            int64_t cur = ready.front();
+            ready.pop_front();
+            _topo_order.push_back(cur);
+            for (auto succ : _nodes[cur]._successors) {
+                if (--in_degree[succ] == 0) {
+                    ready.push_back(succ);
+                }
+            }
+        }
+        if (_topo_order.size() != _nodes.size()) {
+            ERR_LOG << "Task dependencies contain a cycle" << std::endl;
+            return false;
+        }
+
+        //rank = cost + max(rank of successors), walk in reverse topological order
+        for (auto it = _topo_order.rbegin(); it != _topo_order.rend(); ++it) {
+            Node &node = _nodes[*it];
+            int64_t max_succ_rank = 0;
+            for (auto succ : node._successors) {
+                max_succ_rank = std::max(max_succ_rank, _nodes[succ]._rank);
+            }
+            node._rank = node._cost + max_succ_rank;
+        }
+
+        //critical path starts from the root with the max rank
+        _critical_path.clear();
+        int64_t cur = -1;
+        for (auto root : _roots) {
+            if (cur < 0 || _nodes[root]._rank > _nodes[cur]._rank) {
+                cur = root;
+            }
+        }
+        while (cur >= 0) {
+            _critical_path.push_back(cur);
+            int64_t next = -1;
+            for (auto succ : _nodes[cur]._successors) {
+                if (next < 0 || _nodes[succ]._rank > _nodes[next]._rank) {
+                    next = succ;
+                }
+            }
+            cur = next;
+        }
+
+        return true;
+    }
+
+    /* node num. */
+    int64_t size() const {
+        return _nodes.size();
+    }
+
+    /* get node by id. */
+    const Node& get_node(const int64_t node_id) const {
+        return _nodes[node_id];
+    }
+
+    /* nodes without dependencies. */
+    const std::vector<int64_t>& get_roots() const {
+        return _roots;
+    }
+
+    /* node ids in topological order. */
+    const std::vector<int64_t>& get_topo_order() const {
+        return _topo_order;
+    }
+
+    /* node ids on the critical path, from the first task to the last. */
+    const std::vector<int64_t>& get_critical_path() const {
+        return _critical_path;
+    }
+
+    /* estimated cost of the critical path. */
+    int64_t get_critical_path_cost() const {
+        return _critical_path.empty() ? 0 : _nodes[_critical_path.front()]._rank;
+    }
+
+private:
+    /* graph nodes. */
+    std::vector<Node>       _nodes;
+
+    /* nodes without dependencies. */
+    std::vector<int64_t>    _roots;
+
+    /* topological order. */
+    std::vector<int64_t>    _topo_order;
+
+    /* critical path. */
+    std::vector<int64_t>    _critical_path;
+};
+
+
+/**
+ * @class TaskGraphExecutor.
+ * run the tasks of a TaskGraph on the FrameThreadPool.
+ * a task is dispatched as soon as all of its dependencies are finished,
+ * ready tasks with the longer remaining path are picked first.
+ * the calling thread takes part in the execution, so a graph never waits for
+ * a pool worker which may be blocked by the caller itself (nested graphs).
+ * ExecutableType must implement bool execute(void *data) const.
+ * execute_async does not block: ExecutableType must implement
+ * void execute_async(void *data, TaskDone done) const, a task waiting for I/O
+ * returns at once and its done callback resumes the successors, so no thread
+ * is held while the I/O is outstanding.
+ **/
+class TaskGraphExecutor {
+public:
+    /**
+    * execute the graph, returns after every started task is finished.
+    * @param graph task graph
+    * @param tasks task instances, indexed by node id
+    * @param data task data, shared by all the tasks
+    * @param skip_failure keep dispatching after a task failed
+    * @param timeout_ms deadline of the whole graph, tasks not started before the
+    *        deadline are skipped, 0 means no deadline.
+    * @return true if every task executed ok.
+    */
+    template <typename ExecutableType>
+    static bool execute(const TaskGraph &graph,
+                        const std::vector<const ExecutableType*> &tasks,
+                        void *data,
+                        const bool skip_failure,
+                        const int64_t timeout_ms = 0) {
+        if (graph.size() != static_cast<int64_t>(tasks.size())) {
+            ERR_LOG << "graph size not match the tasks : " << graph.size()
+                    << " vs " << tasks.size() << std::endl;
+            return false;
+        }
+        if (graph.size() == 0) {
+            return true;
+        }
+
+        auto state = std::make_shared<ExecuteState<ExecutableType>>(graph, tasks, data, skip_failure);
+        {
+            std::unique_lock<std::mutex> lock(state->_lock);
+            for (auto root : graph.get_roots()) {
+                state->push_ready(root);
+            }
+        }
+        dispatch(state, graph.get_roots().size() - 1);
+
+        const auto deadline = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(timeout_ms);
+        std::unique_lock<std::mutex> lock(state->_lock);
+        while (state->_finished_num < graph.size()) {
+            if (state->_stopped && state->_running_num == 0) {
+                break;
+            }
+            if (timeout_ms > 0 && !state->_stopped && std::chrono::steady_clock::now() >= deadline) {
+                ERR_LOG << "task graph timeout, timeout_ms : " << timeout_ms
+                        << ", finished : " << state->_finished_num << "/" << graph.size() << std::endl;
+                state->_stopped = true;
+                state->_ok = false;
+                state->_ready.clear();
+                continue;
+            }
+            //the caller helps to run the ready tasks instead of only waiting
+            if (!state->_stopped && !state->_ready.empty()) {
+                run_ready(state, lock);
+                continue;
+            }
+            if (timeout_ms <= 0 || state->_stopped) {
+                state->_cond.wait(lock);
+            } else {
+                state->_cond.wait_until(lock, deadline);
+            }
+        }
+
+        return state->_ok && state->_finished_num == graph.size();
+    }
+
+    /**
+    * execute the graph without blocking, done is called exactly once, after every
+    * started task is finished, on the thread finishing the last task.
+    * successors of an async task are dispatched to the FrameThreadPool, or run
+    * on the completing thread if the pool is not running.
+    * @param graph task graph, must outlive the execution, see holder
+    * @param tasks task instances, indexed by node id, copied
+    * @param data task data, shared by all the tasks, must outlive the execution
+    * @param skip_failure keep dispatching after a task failed
+    * @param timeout_ms deadline of the whole graph, tasks not started before the
+    *        deadline are skipped, 0 means no deadline.
+    * @param done called with true if every task executed ok
+    * @param holder kept until done is called, pins graph and tasks
+    */
+    template <typename ExecutableType>
+    static void execute_async(const TaskGraph &graph,
+                              const std::vector<const ExecutableType*> &tasks,
+                              void *data,
+                              const bool skip_failure,
+                              const int64_t timeout_ms,
+                              TaskDone done,
+                              std::shared_ptr<const void> holder = nullptr) {
+        if (graph.size() != static_cast<int64_t>(tasks.size())) {
+            ERR_LOG << "graph size not match the tasks : " << graph.size()
+                    << " vs " << tasks.size() << std::endl;
+            done(false);
+            return;
+        }
+        if (graph.size() == 0) {
+            done(true);
+            return;
+        }
+
+        auto state = std::make_shared<AsyncState<ExecutableType>>(graph, tasks, data, skip_failure);
+        state->_done = std::move(done);
+        state->_holder = std::move(holder);
+        if (timeout_ms > 0) {
+            state->_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        }
+        {
+            std::unique_lock<std::mutex> lock(state->_lock);
+            for (auto root : graph.get_roots()) {
+                state->push_ready(root);
+            }
+        }
+        dispatch_async(state, graph.get_roots().size() - 1);
+        drive(state);
+    }
+
+private:
+    /* ready list with the ready time of each task if the request is traced, under _lock. */
+    struct ReadyList {
+        std::vector<int64_t>                    _ready;         //ready but not started
+        uint64_t                                _trace_id;      //trace of the calling thread
+        std::vector<int64_t>                    _ready_ns;
+
+        explicit ReadyList(const int64_t size)
+            : _trace_id(Tracer::local_context()._trace_id),
+              _ready_ns(_trace_id == INVALID_TRACE_ID ? 0 : size) {}
+
+        void push_ready(const int64_t node_id) {
+            _ready.push_back(node_id);
+            if (_trace_id != INVALID_TRACE_ID) {
+                _ready_ns[node_id] = Tracer::now_ns();
+            }
+        }
+
+        /* queue wait of a task about to start. */
+        int64_t get_wait_ns(const int64_t node_id) const {
+            return _trace_id == INVALID_TRACE_ID ? 0 : Tracer::now_ns() - _ready_ns[node_id];
+        }
+    };
+
+    /* running state of one execution, shared with the pool workers. */
+    template <typename ExecutableType>
+    struct ExecuteState : public ReadyList {
+        const TaskGraph                         &_graph;
+        const std::vector<const ExecutableType*>      &_tasks;
+        void                                    *_data;
+        bool                                    _skip_failure;
+        std::mutex                              _lock;
+        std::condition_variable                 _cond;
+        std::vector<int64_t>                    _pending;       //unfinished dependencies
+        int64_t                                 _running_num;
+        int64_t                                 _finished_num;
+        bool                                    _stopped;
+        bool                                    _ok;
+
+        ExecuteState(const TaskGraph &graph, const std::vector<const ExecutableType*> &tasks,
+                     void *data, bool skip_failure)
+            : ReadyList(graph.size()), _graph(graph), _tasks(tasks), _data(data),
+              _skip_failure(skip_failure), _pending(graph.size()), _running_num(0),
+              _finished_num(0), _stopped(false), _ok(true) {
+            for (int64_t i = 0; i < graph.size(); ++i) {
+                _pending[i] = graph.get_node(i)._in_degree;
+            }
+        }
+    };
+
+    /**
+    * pop the ready task with the max rank and run it, lock is held on entry and exit.
+    * graph, tasks and data are only touched while the execution is alive: once the
+    * caller returns, the ready list is empty and late workers exit without running.
+    */
+    template <typename ExecutableType>
+    static void run_ready(const std::shared_ptr<ExecuteState<ExecutableType>> &state,
+                          std::unique_lock<std::mutex> &lock) {
+        auto best = state->_ready.begin();
+        for (auto it = state->_ready.begin(); it != state->_ready.end(); ++it) {
+            if (state->_graph.get_node(*it)._rank > state->_graph.get_node(*best)._rank) {
+                best = it;
+            }
+        }
+        int64_t node_id = *best;
+        state->_ready.erase(best);
+        ++state->_running_num;
+        int64_t wait_ns = state->get_wait_ns(node_id);
+        lock.unlock();
+
+        bool ret = false;
+        const ExecutableType *task = state->_tasks[node_id];
+        try {
+            //the task runs on a pool worker, carry the trace of the request
+            TraceScope trace_scope(state->_trace_id, wait_ns);
+            ret = task != nullptr && task->execute(state->_data);
+        } catch (const std::exception &e) {
+            ERR_LOG << e.what() << "|" << state->_graph.get_node(node_id)._alias << std::endl;
+        } catch (...) {
+            ERR_LOG << "Unknown Exception|" << state->_graph.get_node(node_id)._alias << std::endl;
+        }
+
+        lock.lock();
+        --state->_running_num;
+        ++state->_finished_num;
+        int64_t new_ready_num = 0;
+        if (!ret) {
+            ERR_LOG << "task failed : " << state->_graph.get_node(node_id)._alias << std::endl;
+            state->_ok = state->_ok && state->_skip_failure;
+            if (!state->_skip_failure) {
+                state->_stopped = true;
+                state->_ready.clear();
+            }
+        }
+        if (!state->_stopped) {
+            for (auto succ : state->_graph.get_node(node_id)._successors) {
+                if (--state->_pending[succ] == 0) {
+                    state->push_ready(succ);
+                    ++new_ready_num;
+                }
+            }
+        }
+        state->_cond.notify_all();
+
+        //current thread continues with one of the new ready tasks
+        if (new_ready_num > 1) {
+            lock.unlock();
+            dispatch(state, new_ready_num - 1);
+            lock.lock();
+        }
+    }
+
+    /* worker entry, keep running ready tasks until there is none. */
+    template <typename ExecutableType>
+    static void work(const std::shared_ptr<ExecuteState<ExecutableType>> &state) {
+        std::unique_lock<std::mutex> lock(state->_lock);
+        while (!state->_stopped && !state->_ready.empty()) {
+            run_ready(state, lock);
+        }
+    }
+
+    /* state of execute_async, owned by the tasks in flight. */
+    template <typename ExecutableType>
+    struct AsyncState : public ReadyList {
+        const TaskGraph                             &_graph;
+        std::vector<const ExecutableType*>          _tasks;
+        void                                        *_data;
+        bool                                        _skip_failure;
+        TaskDone                                    _done;
+        std::shared_ptr<const void>                 _holder;
+        std::chrono::steady_clock::time_point       _deadline;      //epoch if no deadline
+        std::mutex                                  _lock;
+        std::vector<int64_t>                        _pending;       //unfinished dependencies
+        int64_t                                     _running_num;
+        int64_t                                     _finished_num;
+        int64_t                                     _driving_num;   //threads in drive()
+        bool                                        _stopped;
+        bool                                        _ok;
+        bool                                        _completed;     //done is called
+
+        AsyncState(const TaskGraph &graph, const std::vector<const ExecutableType*> &tasks,
+                   void *data, bool skip_failure)
+            : ReadyList(graph.size()), _graph(graph), _tasks(tasks), _data(data),
+              _skip_failure(skip_failure), _pending(graph.size()), _running_num(0),
+              _finished_num(0), _driving_num(0),
+              _stopped(false), _ok(true), _completed(false) {
+            for (int64_t i = 0; i < graph.size(); ++i) {
+                _pending[i] = graph.get_node(i)._in_degree;
+            }
+        }
+    };
+
+    /**
+    * start the ready tasks until there is none. a task returns from run_async
+    * as soon as its I/O is issued, so one thread can start many of them.
+    */
+    template <typename ExecutableType>
+    static void drive(const std::shared_ptr<AsyncState<ExecutableType>> &state) {
+        std::unique_lock<std::mutex> lock(state->_lock);
+        ++state->_driving_num;
+        while (!state->_stopped && !state->_ready.empty()) {
+            if (state->_deadline.time_since_epoch().count() > 0 &&
+                    std::chrono::steady_clock::now() >= state->_deadline) {
+                ERR_LOG << "task graph timeout, finished : " << state->_finished_num
+                        << "/" << state->_graph.size() << std::endl;
+                state->_stopped = true;
+                state->_ok = false;
+                state->_ready.clear();
+                break;
+            }
+            auto best = state->_ready.begin();
+            for (auto it = state->_ready.begin(); it != state->_ready.end(); ++it) {
+                if (state->_graph.get_node(*it)._rank > state->_graph.get_node(*best)._rank) {
+                    best = it;
+                }
+            }
+            int64_t node_id = *best;
+            state->_ready.erase(best);
+            ++state->_running_num;
+            int64_t wait_ns = state->get_wait_ns(node_id);
+            lock.unlock();
+
+            const ExecutableType *task = state->_tasks[node_id];
+            if (task == nullptr) {
+                finish_async(state, node_id, false);
+            } else {
+                try {
+                    TraceScope trace_scope(state->_trace_id, wait_ns);
+                    task->execute_async(state->_data, [state, node_id](bool ret) {
+                        finish_async(state, node_id, ret);
+                    });
+                } catch (const std::exception &e) {
+                    //the task gave up before taking the callback
+                    ERR_LOG << e.what() << "|" << state->_graph.get_node(node_id)._alias << std::endl;
+                    finish_async(state, node_id, false);
+                } catch (...) {
+                    ERR_LOG << "Unknown Exception|" << state->_graph.get_node(node_id)._alias << std::endl;
+                    finish_async(state, node_id, false);
+                }
+            }
+            lock.lock();
+        }
+        --state->_driving_num;
+        bool completed = complete(state);
+        lock.unlock();
+        if (completed) {
+            call_done(state);
+        }
+    }
+
+    /* done callback of one task, may run on any thread. */
+    template <typename ExecutableType>
+    static void finish_async(const std::shared_ptr<AsyncState<ExecutableType>> &state,
+                             const int64_t node_id, const bool ret) {
+        std::unique_lock<std::mutex> lock(state->_lock);
+        --state->_running_num;
+        ++state->_finished_num;
+        int64_t new_ready_num = 0;
+        if (!ret) {
+            ERR_LOG << "task failed : " << state->_graph.get_node(node_id)._alias << std::endl;
+            state->_ok = state->_ok && state->_skip_failure;
+            if (!state->_skip_failure) {
+                state->_stopped = true;
+                state->_ready.clear();
+            }
+        }
+        if (!state->_stopped) {
+            for (auto succ : state->_graph.get_node(node_id)._successors) {
+                if (--state->_pending[succ] == 0) {
+                    state->push_ready(succ);
+                    ++new_ready_num;
+                }
+            }
+        }
+        bool completed = complete(state);
+        bool driven = state->_driving_num > 0;
+        lock.unlock();
+        if (completed) {
+            call_done(state);
+            return;
+        }
+        if (new_ready_num == 0) {
+            return;
+        }
+        //never run the successors on an I/O callback thread if the pool can take them
+        if (FrameThreadPool::instance().is_running()) {
+            //a running drive() takes one of them
+            dispatch_async(state, driven ? new_ready_num - 1 : new_ready_num);
+        } else if (!driven) {
+            drive(state);
+        }
+    }
+
+    /* every started task is finished and nothing is left to start, under _lock. */
+    template <typename ExecutableType>
+    static bool complete(const std::shared_ptr<AsyncState<ExecutableType>> &state) {
+        if (state->_completed || state->_running_num > 0 || state->_driving_num > 0) {
+            return false;
+        }
+        if (state->_finished_num < state->_graph.size() && !state->_stopped) {
+            return false;
+        }
+        state->_completed = true;
+        return true;
+    }
+
+    /* call done once, release the holder after it. */
+    template <typename ExecutableType>
+    static void call_done(const std::shared_ptr<AsyncState<ExecutableType>> &state) {
+        TaskDone done = std::move(state->_done);
+        bool ok = state->_ok && state->_finished_num == state->_graph.size();
+        done(ok);
+        state->_holder.reset();
+    }
+
+    /* wake up worker_num pool workers to start ready tasks. */
+    template <typename ExecutableType>
+    static void dispatch_async(const std::shared_ptr<AsyncState<ExecutableType>> &state,
+                               const int64_t worker_num) {
+        ThreadPool &thread_pool = FrameThreadPool::instance();
+        if (!thread_pool.is_running()) {
+            return;
+        }
+        for (int64_t i = 0; i < worker_num; ++i) {
+            thread_pool.submit([state]() {
+                drive(state);
+            });
+        }
+    }
+
+    /* wake up worker_num pool workers to run ready tasks. */
+    template <typename ExecutableType>
+    static void dispatch(const std::shared_ptr<ExecuteState<ExecutableType>> &state,
+                         const int64_t worker_num) {
+        ThreadPool &thread_pool = FrameThreadPool::instance();
+        if (!thread_pool.is_running()) {
+            return;
+        }
+        for (int64_t i = 0; i < worker_num; ++i) {
+            thread_pool.submit([state]() {
+                work(state);
+            });
+        }
+    }
+};
+
+} // end namespace frame
+} // end namespace inf
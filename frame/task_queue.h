@@ -1,4 +1,5 @@
 #pragma once
+#include "mpmc_queue.h"
 #include <iostream>
 #include <string>
 #include <thread>
@@ -12,23 +13,24 @@
 
 namespace inf {
 namespace frame { 
+/** 
+ * @class TaskQueue.
+ * bounded task queue backed by the lock-free MpmcQueue.
+ * enqueue blocks while full, get_task blocks while empty.
+ **/
 template <typename TaskType>
 class TaskQueue {
 public:
+    /* ctor. */
+    explicit TaskQueue(const int64_t capacity = DEFAULT_QUEUE_CAPACITY) : _task_queue(capacity) {};
+
     int enqueue(const TaskType &task) {
-        std::unique_lock<std::mutex> lock(_lock);
-        _task_queue.push(task);
-        _cond.notify_one();
-        return 0;
+        return _task_queue.enqueue(task) ? 0 : -1;
     }
 
     TaskType get_task() {
-        std::unique_lock<std::mutex> lock(_lock);
-        if (_task_queue.empty()) {
-            _cond.wait(lock);
-        }
-        auto result = _task_queue.front();
-        _task_queue.pop();
+        TaskType result;
+        _task_queue.dequeue(result);
         return result;
     }
 
@@ -54,16 +56,14 @@ void run_task() {
 
     bool is_running = false;
 private:
-    std::queue<TaskType> _task_queue;
-    std::mutex           _lock;
-    std::condition_variable _cond;
+    MpmcQueue<TaskType>  _task_queue;
 
 };
 
 class Task{
 public:
     int val;
-    Task(const int x) : val(x) {};
+    Task(const int x = 0) : val(x) {};
     int run() {
         std::cout << val << std::endl;
         return 0;
@@ -4,6 +4,8 @@ namespace inf {
 namespace frame {
 
 bool RecTaskFactory::init() {
+    //prefer REGISTER_TASK(user_feature_task, FeatureTask) at global namespace of a .cpp,
+    //it is resolved before this table and checked for duplicates before main.
     //register task creator name here
     // const std::string USER_FEATURE_TASK = "user_feature_task";
     // const std::string COMMON_RECALL_TASK = "common_recall_task";
@@ -1,10 +1,12 @@
 #pragma once
 #include "strategy_creator.h"
 #include "task.h"
+#include "task_registry.h"
 namespace inf {
 namespace frame {
 /** 
  * @class RecTaskFactory.
+ * creators registered at runtime by init(), prefer REGISTER_TASK in task_registry.h.
  **/
 class RecTaskFactory : public Factory<BaseTaskCreator, BaseTask> {
 public:
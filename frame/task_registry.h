@@ -0,0 +1,289 @@
+#pragma once
+#include "task.h"
+#include "utils/common_log.h"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdlib>
+#include <algorithm>
+#include <stdint.h>
+
+namespace inf {
+namespace frame {
+
+/* seeds tried for one bucket before growing the table. */
+const uint64_t TASK_REGISTRY_SEED_TRY_NUM = 4096;
+
+/* creates a registered task, a plain function instead of a virtual creator. */
+using TaskCreateFunc = TaskPtr (*)();
+
+/* fnv-1a of a task name, evaluated at compile time for REGISTER_TASK. */
+constexpr uint64_t hash_task_name(const char *name, const size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(name[i])) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+constexpr size_t get_task_name_size(const char *name) {
+    size_t size = 0;
+    while (name[size] != '\0') {
+        ++size;
+    }
+    return size;
+}
+
+template <typename TaskType>
+TaskPtr create_registered_task() {
+    return TaskPtr(new TaskType);
+}
+
+/* one REGISTER_TASK, built at compile time. */
+struct TaskRegistration {
+    const char      *_name;
+    size_t          _size;
+    uint64_t        _hash;
+    TaskCreateFunc  _create;
+
+    constexpr TaskRegistration(const char *name, TaskCreateFunc create) :
+            _name(name), _size(get_task_name_size(name)),
+            _hash(hash_task_name(name, get_task_name_size(name))), _create(create) {}
+};
+
+/**
+ * @class TaskRegistry.
+ * task_name -> creator, filled by REGISTER_TASK during static init.
+ * the first create() freezes it into an immutable perfect hashed table:
+ * a lookup is one hash of the name, one seed, one slot and one name compare, no lock,
+ * and the task is created by a plain function call.
+ * registering after the table is frozen fails.
+ * e.g.:
+ * //in a .cpp, at global namespace
+ * REGISTER_TASK(user_feature_task, FeatureTask);
+ * TaskPtr task = TaskRegistry::instance().create("user_feature_task");
+ **/
+class TaskRegistry {
+public:
+    /* ctor. */
+    TaskRegistry() = default;
+
+    /* singleton, filled by REGISTER_TASK. */
+    static TaskRegistry& instance() {
+        static TaskRegistry instance;
+        return instance;
+    }
+
+    /**
+    * register a creator.
+    * @param registration
+    * @return false if the name is registered, or the table is frozen
+    */
+    bool add(const TaskRegistration &registration) {
+        std::lock_guard<std::mutex> lock(_lock);
+        if (_frozen.load(std::memory_order_relaxed)) {
+            ERR_LOG << "task registry is frozen, task name : " << registration._name << std::endl;
+            return false;
+        }
+        for (auto &entry : _entries) {
+            if (entry._hash != registration._hash) {
+                continue;
+            }
+            if (entry._size == registration._size &&
+                    std::char_traits<char>::compare(entry._name, registration._name, entry._size) == 0) {
+                ERR_LOG << "Duplicated task name : " << registration._name << std::endl;
+            } else {
+                ERR_LOG << "task name hash collision : " << registration._name
+                        << ", " << entry._name << std::endl;
+            }
+            return false;
+        }
+        _entries.push_back(registration);
+        return true;
+    }
+
+    /**
+    * build the lookup table, no registration after it.
+    * called by the first lookup, call it earlier to keep the cost out of a request.
+    */
+    void freeze() {
+        if (_frozen.load(std::memory_order_acquire)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_lock);
+        if (_frozen.load(std::memory_order_relaxed)) {
+            return;
+        }
+        build();
+        _frozen.store(true, std::memory_order_release);
+    }
+
+    /**
+    * create a task by the registered name.
+    * @param task_name
+    * @return task, nullptr if not registered
+    */
+    TaskPtr create(const std::string &task_name) {
+        const TaskRegistration *entry = find(task_name);
+        if (entry == nullptr) {
+            return TaskPtr(nullptr);
+        }
+        return entry->_create();
+    }
+
+    /**
+    * registered entry of a name.
+    * @param task_name
+    * @return entry, nullptr if not registered
+    */
+    const TaskRegistration* find(const std::string &task_name) {
+        freeze();
+        uint64_t hash = hash_task_name(task_name.data(), task_name.size());
+        int32_t index = _slots[get_slot(hash)];
+        if (index < 0) {
+            return nullptr;
+        }
+        const TaskRegistration &entry = _entries[index];
+        if (entry._hash != hash || entry._size != task_name.size() ||
+                task_name.compare(0, entry._size, entry._name, entry._size) != 0) {
+            return nullptr;
+        }
+        return &entry;
+    }
+
+    /* registered num. */
+    int64_t size() {
+        std::lock_guard<std::mutex> lock(_lock);
+        return _entries.size();
+    }
+
+    /* slot num of the frozen table. */
+    int64_t get_slot_num() {
+        freeze();
+        return _slots.size();
+    }
+
+private:
+    /* none copy. */
+    TaskRegistry(const TaskRegistry &rhs) = delete;
+    TaskRegistry &operator=(const TaskRegistry &rhs) = delete;
+
+    /* slot of a hash: the bucket picks a seed, the seed picks the slot. */
+    size_t get_slot(const uint64_t hash) const {
+        uint64_t seed = _seeds[hash & _bucket_mask];
+        return static_cast<size_t>(mix_hash(hash, seed) & _slot_mask);
+    }
+
+    static uint64_t mix_hash(uint64_t hash, const uint64_t seed) {
+        hash ^= seed * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 31;
+        hash *= 0xBF58476D1CE4E5B9ULL;
+        return hash ^ (hash >> 29);
+    }
+
+    /**
+    * hash and displace: names are grouped into buckets, the largest bucket is placed first,
+    * each bucket tries seeds until its names land on free slots.
+    * about 4 names per bucket and 2 slots per name, grow the table if a bucket can not be placed.
+    */
+    void build() {
+        size_t bucket_num = 1;
+        while (bucket_num * 4 < _entries.size()) {
+            bucket_num <<= 1;
+        }
+        size_t slot_num = 2;
+        while (slot_num < _entries.size() * 2) {
+            slot_num <<= 1;
+        }
+        _bucket_mask = bucket_num - 1;
+        std::vector<std::vector<int32_t>> buckets(bucket_num);
+        for (size_t i = 0; i < _entries.size(); ++i) {
+            buckets[_entries[i]._hash & _bucket_mask].push_back(static_cast<int32_t>(i));
+        }
+        std::vector<size_t> order(bucket_num);
+        for (size_t i = 0; i < bucket_num; ++i) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&buckets](const size_t lhs, const size_t rhs) {
+            return buckets[lhs].size() > buckets[rhs].size();
+        });
+        //hashes are distinct, every bucket can be placed once the table is large enough
+        for (;; slot_num <<= 1) {
+            _slot_mask = slot_num - 1;
+            _slots.assign(slot_num, -1);
+            _seeds.assign(bucket_num, 0);
+            bool placed = true;
+            for (size_t bucket : order) {
+                if (!place_bucket(bucket, buckets[bucket])) {
+                    placed = false;
+                    break;
+                }
+            }
+            if (placed) {
+                return;
+            }
+        }
+    }
+
+    bool place_bucket(const size_t bucket, const std::vector<int32_t> &indexes) {
+        std::vector<size_t> slots(indexes.size());
+        for (uint64_t seed = 0; seed < TASK_REGISTRY_SEED_TRY_NUM; ++seed) {
+            bool free = true;
+            for (size_t i = 0; i < indexes.size() && free; ++i) {
+                slots[i] = mix_hash(_entries[indexes[i]]._hash, seed) & _slot_mask;
+                free = _slots[slots[i]] < 0 &&
+                        std::find(slots.begin(), slots.begin() + i, slots[i]) == slots.begin() + i;
+            }
+            if (!free) {
+                continue;
+            }
+            for (size_t i = 0; i < indexes.size(); ++i) {
+                _slots[slots[i]] = indexes[i];
+            }
+            _seeds[bucket] = seed;
+            return true;
+        }
+        return false;
+    }
+
+    /* registration, written before frozen. */
+    std::mutex                      _lock;
+    std::vector<TaskRegistration>   _entries;
+
+    /* lookup table, read only after frozen. */
+    std::atomic<bool>               _frozen{false};
+    std::vector<uint64_t>           _seeds;
+    std::vector<int32_t>            _slots;
+    uint64_t                        _bucket_mask{0};
+    uint64_t                        _slot_mask{0};
+};
+
+/**
+ * @class TaskRegistrar.
+ * adds a registration during static init, a duplicated name aborts the process before main.
+ **/
+class TaskRegistrar {
+public:
+    explicit TaskRegistrar(const TaskRegistration &registration) {
+        if (!TaskRegistry::instance().add(registration)) {
+            FATAL_LOG << "register task failed, task name : " << registration._name << std::endl;
+            std::abort();
+        }
+    }
+};
+
+} // end namespace frame
+} // end namespace inf
+
+/**
+ * register TaskType as task_name Name, Name is an identifier and is used as the string.
+ * use it in a .cpp at global namespace: the same name registered twice fails to compile
+ * in one file and fails to link across files, other duplicates abort at static init.
+ */
+#define REGISTER_TASK(Name, TaskType) \
+    extern const int inf_registered_task_##Name; \
+    const int inf_registered_task_##Name = 0; \
+    static constexpr ::inf::frame::TaskRegistration inf_task_registration_##Name( \
+            #Name, &::inf::frame::create_registered_task<TaskType>); \
+    static const ::inf::frame::TaskRegistrar inf_task_registrar_##Name(inf_task_registration_##Name)
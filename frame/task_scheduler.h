@@ -1,16 +1,49 @@
+#pragma once
 #include "task.h"
+#include "task_graph.h"
 
 namespace inf {
 namespace frame {
 
 const int64_t SKIP_FAILURE_FLAG = 1;
+/* run tasks one by one in the declared order. */
+const std::string SERIAL_EXECUTE_MODE = "serial";
+/* run tasks by the dependency graph built from depends_on. */
+const std::string DAG_EXECUTE_MODE = "dag";
+
 /** 
  * @class TaskScheduler.
- * schedule the task by sequence
+ * schedule the task by sequence, or by dependencies in dag mode
+ * e.g. scheduler.yaml:
+ * - scheduler_name: rec_for_video_base
+ *   skip_failure: 0
+ *   execute_mode: dag          # optional, serial by default
+ *   tasks:
+ *       - task_alias_name: recall_task_base
+ *       - task_alias_name: expose_task_base
+ *       - task_alias_name: user_feature_task_base
+ *       - task_alias_name: rank_task_base
+ *         depends_on: [recall_task_base, expose_task_base, user_feature_task_base]
+ *         cost: 10             # optional, estimated cost used by critical path
+ * in dag mode, tasks run concurrently on the FrameThreadPool as soon as their
+ * dependencies are finished, so tasks without dependency between each other
+ * must not modify the same data.
+ * schedule_async runs the same tasks without blocking, an AsyncTask holds no
+ * thread while waiting for I/O, its successors are resumed by its callback.
+ * aliases are resolved once per TaskMap generation into a TaskPlan kept in the map,
+ * a request pins the map and reads the plan without lookup.
  **/
 template <typename UnitTaskCreator>
 class TaskScheduler {
 public:
+    /* ctor. */
+    TaskScheduler() = default;
+
+    /* dtor, the last request on this scheduler is done, its plans can be freed. */
+    ~TaskScheduler() {
+        TaskMap::release_plan(_plan_id, _plan_version);
+    }
+
     /**
     * initialize the scheduler.
     * @param conf conf of the scheduler
@@ -23,6 +56,13 @@ public:
                 return false;
             }
             _scheduler_name = conf["scheduler_name"].as<std::string>();
+            _stat_id = LatencyStats::instance().register_stat("scheduler." + _scheduler_name);
+            _trace_name = Tracer::instance().intern("scheduler." + _scheduler_name);
+            _plan_id = TaskMap::register_plan(_scheduler_name);
+            if (_plan_id == INVALID_PLAN_ID) {
+                return false;
+            }
+            _plan_version = TaskMap::new_plan_version();
         
             //whether skip
             if (!conf["skip_failure"].IsDefined()) {
@@ -31,13 +71,60 @@ public:
             }
             _skip_failure = conf["skip_failure"].as<int64_t>();
 
+            //execute mode
+            if (conf["execute_mode"].IsDefined()) {
+                _execute_mode = conf["execute_mode"].as<std::string>();
+            }
+            if (_execute_mode != SERIAL_EXECUTE_MODE && _execute_mode != DAG_EXECUTE_MODE) {
+                ERR_LOG << "unknown execute_mode : " << _execute_mode << std::endl;
+                return false;
+            }
+
             //load task
-            YAML::Node &task_config = conf["tasks"];
+            const YAML::Node &task_config = conf["tasks"];
 
             _tasks.reserve(task_config.size());
 
-            for (auto &task : task_config) {
-                _task.push_back(task["task_alias_name"]).as<std::string>();
+            for (const auto &task : task_config) {
+                std::string task_alias_name = task["task_alias_name"].as<std::string>();
+                std::vector<std::string> depends_on;
+                if (task["depends_on"].IsDefined()) {
+                    depends_on = task["depends_on"].as<std::vector<std::string>>();
+                }
+                int64_t cost = DEFAULT_TASK_COST;
+                if (task["cost"].IsDefined()) {
+                    cost = task["cost"].as<int64_t>();
+                }
+                _tasks.push_back(task_alias_name);
+                _task_graph->add_node(task_alias_name, depends_on, cost);
+            }
+
+            //build the dag and critical path once at load time
+            if (!_task_graph->build()) {
+                ERR_LOG << "invalid task dependencies, scheduler : " << _scheduler_name << std::endl;
+                return false;
+            }
+            if (_execute_mode == SERIAL_EXECUTE_MODE) {
+                //schedule_async runs serial mode as a chain
+                auto chain_graph = std::make_shared<TaskGraph>();
+                for (size_t i = 0; i < _tasks.size(); ++i) {
+                    chain_graph->add_node(_tasks[i], i == 0 ? 
+                            std::vector<std::string>() : std::vector<std::string>{_tasks[i - 1]});
+                }
+                if (!chain_graph->build()) {
+                    return false;
+                }
+                _async_graph = chain_graph;
+            } else {
+                _async_graph = _task_graph;
+            }
+            if (_execute_mode == DAG_EXECUTE_MODE) {
+                std::string critical_path;
+                for (auto node_id : _task_graph->get_critical_path()) {
+                    critical_path.append(_task_graph->get_node(node_id)._alias).append(" ");
+                }
+                INFO_LOG << "scheduler : " << _scheduler_name << ", critical path : " << critical_path
+                         << ", cost : " << _task_graph->get_critical_path_cost() << std::endl;
             }
         } catch (const std::exception &e) {
             ERR_LOG << e.what() << std::endl;
@@ -54,11 +141,139 @@ public:
 
 
     /**
-    * execute the task. by tasks
+    * execute the task. by tasks, the latency is recorded as scheduler.<name>
+    * a sampled request, or one already traced by the caller, records its spans.
+    * deprecated: the task map and this scheduler come from two singletons reloaded
+    * apart, use FrameSnapshotManager::schedule for one consistent generation.
     * @param data
     * @return true if ok, otherwise false.
     */
+   [[deprecated("use FrameSnapshotManager::schedule")]]
    bool schedule(void *data) const {
+       //pin the task map, the tasks stay alive during this schedule even if reloaded
+       auto task_map = TaskManager<UnitTaskCreator>::instance().get_task_map();
+       if (!task_map || !*task_map) {
+           ERR_LOG << "task map not ready" << std::endl;
+           return false;
+       }
+       return schedule(**task_map, data);
+   }
+
+    /**
+    * execute the tasks found in a task map pinned by the caller, such as a FrameSnapshot.
+    * @param task_map must stay pinned until return
+    * @param data
+    * @return true if ok, otherwise false.
+    */
+   bool schedule(const TaskMap &task_map, void *data) const {
+       TraceScope trace_scope(start_trace(), 0);
+       LatencyRecorder recorder(_stat_id);
+       SpanRecorder span(_trace_name);
+       try {
+           return span.done(recorder.done(run_tasks(task_map, data)));
+       } catch (...) {
+           span.done(recorder.done(false));
+           throw;
+       }
+   }
+
+    /**
+    * execute the tasks without blocking, returns once the tasks without pending
+    * I/O are done, done is called when every task is finished.
+    * the tasks are pinned until done is called, even if reloaded.
+    * @param data task data, must stay valid until done is called
+    * @param done called exactly once, true if ok, maybe on the calling thread
+    * deprecated for the same reason as schedule(data), use FrameSnapshotManager::schedule_async.
+    */
+    [[deprecated("use FrameSnapshotManager::schedule_async")]]
+    void schedule_async(void *data, TaskDone done) const {
+        //a ReadGuard can not leave the calling thread, take a shared pin instead
+        auto task_map = TaskManager<UnitTaskCreator>::instance().get_shared_task_map();
+        if (!task_map || !*task_map) {
+            ERR_LOG << "task map not ready" << std::endl;
+            done(false);
+            return;
+        }
+        schedule_async(**task_map, task_map, data, std::move(done));
+    }
+
+    /**
+    * schedule_async on a task map pinned by the caller, such as a FrameSnapshot.
+    * @param task_map tasks to run
+    * @param pin keeps task_map alive, held until done is called
+    * @param data task data, must stay valid until done is called
+    * @param done called exactly once, true if ok, maybe on the calling thread
+    */
+    void schedule_async(const TaskMap &task_map, std::shared_ptr<const void> pin, 
+            void *data, TaskDone done) const {
+        if (data == nullptr) {
+            ERR_LOG << "data is nullptr\n";
+            done(false);
+            return;
+        }
+
+        std::vector<const BaseTask*> local_executors;
+        auto task_executors = resolve_tasks(task_map, &local_executors);
+        if (task_executors == nullptr) {
+            done(false);
+            return;
+        }
+
+        //the scheduler may be reloaded before done, pin the graph with the tasks
+        auto holder = std::make_shared<std::pair<std::shared_ptr<const void>, 
+                std::shared_ptr<const TaskGraph>>>(std::move(pin), _async_graph);
+        TraceScope trace_scope(start_trace(), 0);
+        LatencyRecorder recorder(_stat_id);
+        SpanRecorder span(_trace_name);
+        TaskGraphExecutor::execute_async(*_async_graph, *task_executors, data,
+                _skip_failure == SKIP_FAILURE_FLAG, 0, 
+                [recorder, span, done = std::move(done)](bool ok) mutable {
+                    done(span.done(recorder.done(ok)));
+                },
+                std::move(holder));
+    }
+
+    /**
+    * build the plan of this scheduler in a task map before any request.
+    * @param task_map
+    * @return false if a task of the scheduler is not in the map
+    */
+    bool prepare(const TaskMap &task_map) const {
+        const TaskPlan *plan = task_map.get_plan(_plan_id, _plan_version, _tasks);
+        if (plan == nullptr || !plan->_missing.empty()) {
+            ERR_LOG << "scheduler : " << _scheduler_name << ", not found task name : "
+                    << (plan == nullptr ? "" : plan->_missing) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+   /* get scheduler name. */
+   std::string get_scheduler_name() const {
+       return _scheduler_name;
+   }
+
+   /* get execute mode. */
+   std::string get_execute_mode() const {
+       return _execute_mode;
+   }
+
+   /* get task dependency graph. */
+   const TaskGraph& get_task_graph() const {
+       return *_task_graph;
+   }
+
+
+
+private:
+    /* trace of the caller, or a new one if sampled. */
+    static uint64_t start_trace() {
+        uint64_t trace_id = Tracer::local_context()._trace_id;
+        return trace_id != INVALID_TRACE_ID ? trace_id : Tracer::instance().sample();
+    }
+
+    /* execute the tasks of one request. */
+   bool run_tasks(const TaskMap &task_map, void *data) const {
        if (data == nullptr) {
            ERR_LOG << "data is nullptr\n";
            return false;
@@ -68,43 +283,73 @@ public:
            ERR_LOG << "no task to execute" << _scheduler_name << std::endl;
        }
 
-       //prepare task instance before task execute
-       std::vector<Task*> task_executors;
-       for (auto &task : _tasks) {
-           const TaskPtr &task_ptr = TaskManager<UnitTaskCreator>::instance().get_task(task);
-           if (task_ptr.empty()) {
-               ERR_LOG << "not found task name : " task << std::endl;
-               return false;
-           } 
-           task_executors.push_back(task_ptr.get());
-        }
+       //task instances of this map generation, resolved once by the first request
+       std::vector<const BaseTask*> local_executors;
+       auto task_executors = resolve_tasks(task_map, &local_executors);
+       if (task_executors == nullptr) {
+           return false;
+       }
 
+        if (_execute_mode == DAG_EXECUTE_MODE) {
+            return TaskGraphExecutor::execute(*_task_graph, *task_executors, data,
+                    _skip_failure == SKIP_FAILURE_FLAG);
+        }
 
         // scheduler the task
-        for (auto &task_instance : task_executors) {
+        bool result = true;
+        for (auto &task_instance : *task_executors) {
             if (task_instance == nullptr) {
                 return false;
             }
             
-            auto ret = task_instance->run(data);
+            auto ret = task_instance->execute(data);
+            if (ret) {
+                continue;
+            }
             // skip failure task if flag is open, otherwise not execute next task.
-            if (_skip_failure != SKIP_FAILURA_FLAG) {
-                ERR_LOG << "skip failure " << task->get_task_name() << std::endl;
+            if (_skip_failure != SKIP_FAILURE_FLAG) {
+                ERR_LOG << "task failed " << task_instance->get_task_name() << std::endl;
                 return false;
             }
+            ERR_LOG << "skip failure " << task_instance->get_task_name() << std::endl;
+            result = false;
         }
         
-        return true;
-   }
-
-   /* get scheduler name. */
-   std::string get_scheduler_name() const {
-       return _scheduler_name;
+        return result;
    }
 
+    /**
+    * tasks of the scheduler in a pinned map, from the plan of the map.
+    * @param task_map pinned map
+    * @param local_tasks filled by lookups if the map has no plan for this scheduler
+    * @return tasks in declared order, nullptr if a task is not found
+    */
+    const std::vector<const BaseTask*>* resolve_tasks(const TaskMap &task_map,
+            std::vector<const BaseTask*> *local_tasks) const {
+        const TaskPlan *plan = task_map.get_plan(_plan_id, _plan_version, _tasks);
+        if (plan != nullptr) {
+            if (!plan->_missing.empty()) {
+                ERR_LOG << "not found task name : " << plan->_missing << std::endl;
+                return nullptr;
+            }
+            return &plan->_tasks;
+        }
+        local_tasks->reserve(_tasks.size());
+        for (auto &task : _tasks) {
+            auto iter = task_map.find(task);
+            if (iter == task_map.end() || !iter->second) {
+                ERR_LOG << "not found task name : " << task << std::endl;
+                return nullptr;
+            }
+            local_tasks->push_back(iter->second.get());
+        }
+        return local_tasks;
+    }
 
+    /* none copy, the plan id is released once. */
+    TaskScheduler(const TaskScheduler &rhs) = delete;
+    TaskScheduler &operator=(const TaskScheduler &rhs) = delete;
 
-private:
     /* scheduler name. */
     std::string             _scheduler_name{""};
     
@@ -113,6 +358,25 @@ private:
     
     /* skip failure flag. */
     int64_t                 _skip_failure{0};
+
+    /* execute mode, serial or dag. */
+    std::string             _execute_mode{SERIAL_EXECUTE_MODE};
+
+    /* task dependency graph, built at load time. */
+    std::shared_ptr<TaskGraph>  _task_graph{std::make_shared<TaskGraph>()};
+
+    /* graph of schedule_async, the chain of tasks in serial mode. */
+    std::shared_ptr<const TaskGraph> _async_graph;
+
+    /* latency stat of the scheduler. */
+    int64_t                 _stat_id{INVALID_STAT_ID};
+
+    /* span name of the scheduler. */
+    const char              *_trace_name{nullptr};
+
+    /* plan slot in every TaskMap, and the version of _tasks. */
+    int64_t                 _plan_id{INVALID_PLAN_ID};
+    uint64_t                _plan_version{0};
 };
 
 
@@ -125,14 +389,21 @@ public:
     }
  
     /*load conf*/
-    bool init(const std::string &conf_path, const std::string &command) {
+    bool init(const std::string &conf_path, const std::string &/*command*/) {
         try {
             SchedulerLoaderPtr scheduler_loader(new SchedulerLoader(conf_path));
+            if (!scheduler_loader->init(conf_path)) {
+                ERR_LOG << "scheduler conf not exist : " << conf_path << std::endl;
+                return false;
+            }
             _scheduler_double_buffer_ptr = SchedulerDoubleBufferPtr(
                     new SchedulerDoubleBuffer(std::move(scheduler_loader)));
         
-            return _scheduler_double_buffer_ptr->init(
-                    util::DoubleBufferConfigureManager::instance().get_configure_node(command));
+            if (_scheduler_double_buffer_ptr->init() != 0) {
+                return false;
+            }
+            auto task_scheduler_table = _scheduler_double_buffer_ptr->get_current();
+            return task_scheduler_table && *task_scheduler_table;
         } catch (const std::exception &e) {
             ERR_LOG << e.what() << "|" << conf_path << std::endl;
             return false;
@@ -142,30 +413,82 @@ public:
         }
     }
 
-    /*get scheduler by name from double buffer. */
-    const TaskScheduler<UnitTaskCreator>* get_scheduler(
-            const std::string &schedule_name) const {
-        const HashTaskSchedulerPtrPtr &task_scheduler_table = 
-                _scheduler_double_buffer_ptr->get_buffer();
-        if (!task_scheduler_table) {
-            ERR_LOG << "_scheduler_double_buffer_ptr.get_buffer() failed.\n";
+    /* scheduler which keeps its generation of the scheduler table alive. */
+    typedef std::shared_ptr<const TaskScheduler<UnitTaskCreator> > ConstTaskSchedulerPtr;
+
+    /**
+    * get scheduler by name from double buffer.
+    * the result shares ownership of the table it was found in, so a reload only
+    * retires that table once every holder is released, hold it per request,
+    * not forever, or the old table and its schedulers are never freed.
+    * @param schedule_name
+    * @return scheduler, nullptr if not found
+    */
+    ConstTaskSchedulerPtr get_scheduler(const std::string &schedule_name) const {
+        if (!_scheduler_double_buffer_ptr) {
+            ERR_LOG << "TaskSchedulerManager not initialized.\n";
+            return nullptr;
+        }
+        auto task_scheduler_table = _scheduler_double_buffer_ptr->get_current();
+        if (!task_scheduler_table || !*task_scheduler_table) {
+            ERR_LOG << "_scheduler_double_buffer_ptr.get_current() failed.\n";
             return nullptr;
         }
 
         typename HashTaskSchedulerPtr::const_iterator iter = 
-                task_scheduler_table->find(schedule_name);
-        if (iter == task_scheduler_table->end()) {
+                (*task_scheduler_table)->find(schedule_name);
+        if (iter == (*task_scheduler_table)->end()) {
             return nullptr;
         }
 
-        return iter->second.get();
+        return ConstTaskSchedulerPtr(task_scheduler_table, iter->second.get());
     }
 
-private:
     typedef std::unique_ptr<TaskScheduler<UnitTaskCreator> >  TaskSchedulerPtr;
     typedef std::unordered_map<std::string, TaskSchedulerPtr> HashTaskSchedulerPtr;
     typedef std::unique_ptr<HashTaskSchedulerPtr>             HashTaskSchedulerPtrPtr;
 
+    /**
+    * load and init every scheduler of a conf file.
+    * @param scheduler_conf
+    * @return name -> scheduler, nullptr if any scheduler failed
+    */
+    static HashTaskSchedulerPtrPtr load_schedulers(const std::string &scheduler_conf) {
+        try {
+            HashTaskSchedulerPtrPtr task_scheduler_table(new HashTaskSchedulerPtr());
+
+            YAML::Node conf = YAML::LoadFile(scheduler_conf.c_str());
+            for (uint32_t i = 0; i < conf.size(); ++i) {
+                TaskSchedulerPtr new_task_schedule_ptr(new TaskScheduler<UnitTaskCreator>());
+                if (!new_task_schedule_ptr->init(conf[i])) {
+                    ERR_LOG << "Failed to init TaskScheduler : " << i << std::endl;
+                    return nullptr;
+                }
+
+                if (task_scheduler_table->find(
+                        new_task_schedule_ptr->get_scheduler_name()) != task_scheduler_table->end()) {
+                    ERR_LOG << "Exist duplicated schedule_name : " << 
+                            new_task_schedule_ptr->get_scheduler_name() << std::endl;
+                    return nullptr;
+                }
+                
+                task_scheduler_table->insert(
+                        std::make_pair(new_task_schedule_ptr->get_scheduler_name(), 
+                        std::move(new_task_schedule_ptr)));
+            }
+
+            return task_scheduler_table;
+        } catch (const std::exception &e) {
+            ERR_LOG << e.what() << std::endl;
+            return nullptr;
+        } catch (...) {
+            ERR_LOG << "unknown exception." << std::endl;
+            return nullptr;
+        }
+    }
+
+private:
+
     /* ctor */
     TaskSchedulerManager() {}
     
@@ -183,39 +506,27 @@ private:
         /* Destructor*/
         ~SchedulerLoader() {}
 
+        /* init function, check the conf file. */
+        bool init(const std::string &file_name) {
+            if (file_name.empty()) {
+                return false;
+            }
+            _scheduler_conf = file_name;
+            struct stat file_stat;
+            if (stat(file_name.c_str(), &file_stat) != 0) {
+                return false;
+            }
+            return true;
+        }
+
+        /* config file name. */
+        std::string get_load_file_name() const {
+            return _scheduler_conf;
+        }
+
         /* Scheduler table load */
         HashTaskSchedulerPtrPtr load() const {
-            try {
-                HashTaskSchedulerPtrPtr task_scheduler_table(new HashTaskSchedulerPtr());
-
-                YAML::Node conf = YAML::LoadFile(_scheduler_conf.c_str());
-                for (uint32_t i = 0; i < conf.size(); ++i) {
-                    TaskSchedulerPtr new_task_schedule_ptr(new TaskScheduler<UnitTaskCreator>());
-                    if (!new_task_schedule_ptr->init(conf[i])) {
-                        ERR_LOG << "Failed to init TaskScheduler : " << i << std::endl;
-                        return nullptr;
-                    }
-
-                    if (task_scheduler_table->find(
-                            new_task_schedule_ptr->get_name()) != task_scheduler_table->end()) {
-                        ERR_LOG << "Exist duplicated schedule_name : " << 
-                                new_task_schedule_ptr->get_name() << std::endl;
-                        return nullptr;
-                    }
-                    
-                    task_scheduler_table->insert(
-                            std::make_pair(new_task_schedule_ptr->get_name(), 
-                            std::move(new_task_schedule_ptr)));
-                }
-
-                return task_scheduler_table;
-            } catch (const std::exception &e) {
-                ERR_LOG << e.what() << std::endl;
-                return nullptr;
-            } catch (...) {
-                ERR_LOG << "unknown exception." << std::endl;
-                return nullptr;
-            }
+            return TaskSchedulerManager::load_schedulers(_scheduler_conf);
         }
     
     private:
@@ -231,8 +542,8 @@ private:
     typedef std::unique_ptr<SchedulerLoader> SchedulerLoaderPtr;
 
     /* Double buffer unique_ptr define */
-    typedef inf::util::DoubleBuffer<HashTaskSchedulerPtr, SchedulerLoader> SchedulerDoubleBuffer;
-    typedef inf::std::unique_ptr<SchedulerDoubleBuffer>                    SchedulerDoubleBufferPtr;
+    typedef ::inf::utils::DoubleData<HashTaskSchedulerPtrPtr, SchedulerLoader> SchedulerDoubleBuffer;
+    typedef std::unique_ptr<SchedulerDoubleBuffer>                             SchedulerDoubleBufferPtr;
 
     /*scheduler double buffer structure */
     SchedulerDoubleBufferPtr _scheduler_double_buffer_ptr;
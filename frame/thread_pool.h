@@ -1,4 +1,5 @@
 #pragma once
+#include "pool_task.h"
 #include <string>
 #include <vector>
 #include <memory>
@@ -9,11 +10,17 @@
 #include <condition_variable>
 #include <unistd.h>
 #include <queue>
+#include <deque>
+#include <thread>
 #include <future>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
 
 namespace inf {
 namespace frame {
 const int64_t DEFAULT_THREAD_NUM = 5;
+
 /** 
  * @class ThreadPool.
  * note:
@@ -33,22 +40,26 @@ const int64_t DEFAULT_THREAD_NUM = 5;
  * 
  * 
  * //stop
+ *
+ * deadline:
+ * a task with timeout_ms > 0 must be started within timeout_ms after submitted,
+ * otherwise it is dropped and its future throws TaskTimeoutException at its deadline,
+ * by a reaper thread even if every worker is busy.
+ * queued tasks are executed earliest deadline first, tasks without timeout are a
+ * lower tier run in submit order when no task with a deadline is queued.
  **/
 class ThreadPool {
 protected:
-    struct FuncTask {
-        int64_t                 _timeout_ms;//task run timeout time
-        std::function<void()>   _func;      //func
-        
-        FuncTask(const int timeout_ms = 0) : _timeout_ms(timeout_ms) {};
-    };
+    using Clock = PoolTask::Clock;
 public:
 
-    using FuncPtr = std::shared_ptr<FuncTask>;
+    using FuncPtr = std::shared_ptr<PoolTask>;
     using ThreadPtr = std::unique_ptr<std::thread>;
     /* ctor. */
     ThreadPool() = default;
-    virtual ~ThreadPool() = default;
+    virtual ~ThreadPool() {
+        stop();
+    }
 
     /**
     * init the trhead pool
@@ -57,7 +68,11 @@ public:
     */
     int init(const int thread_num = DEFAULT_THREAD_NUM) {
         std::unique_lock<std::mutex> lock(_lock);
+        if (_is_running) {
+            return -1;
+        }
         _thread_num = thread_num;
+        _thread_pool.clear();
        
         for (int64_t i = 0; i < _thread_num; ++i) {
             ThreadPtr thread_ptr(new std::thread());
@@ -81,21 +96,21 @@ public:
     template <typename Func, typename ...Args>
     auto submit(int64_t timeout_ms, Func&& func, Args&& ...args) -> std::future<decltype(func(args...))>
     {   
-        using ReturnType = decltype(func(args...));
-        auto task = std::make_shared<std::packaged_task<ReturnType()>>
-                        (std::bind(func, std::forward<Args>(args)...));
-
-        auto f_ptr = std::make_shared<FuncTask>(timeout_ms);
-        f_ptr->_func = [task]{
-            //execute the packaged task
-            (*task)();
-        };
+        std::unique_ptr<PoolTask> task;
+        auto result = PoolTask::create(timeout_ms, &task, std::forward<Func>(func), std::forward<Args>(args)...);
+        FuncPtr f_ptr(std::move(task));
 
         std::unique_lock<std::mutex> lock(_lock);
-        _task_queue.push(f_ptr);
+        f_ptr->_sequence = _sequence++;
+        if (timeout_ms > 0) {
+            _task_queue.push(f_ptr);
+            _reap_cond.notify_one();
+        } else {
+            _untimed_queue.push_back(f_ptr);
+        }
         _cond.notify_one();
 
-        return task->get_future();
+        return result;
     }
 
     /**
@@ -105,13 +120,13 @@ public:
     * e.g.:
     * auto result = submit(func, a, b, c);
     * result.get() will blocking untill the task has been executed.
+    * the default timeout (set_default_timeout_ms) is used.
     * @param func and args...
-    * @param timeout_ms task timeout ms
     * @return std::future<>
     */
     template <typename Func, typename ...Args>
     auto submit(Func&& func, Args&& ...args) -> std::future<decltype(func(args...))> {
-        return submit(0, func, args...);
+        return submit(_timeout_ms_default.load(), func, args...);
     }
 
 
@@ -121,33 +136,72 @@ public:
     * @return FuncPtr
     */
    FuncPtr get_task() {
+       std::vector<FuncPtr> expired_tasks;
+       FuncPtr task_ptr;
+       {
        std::unique_lock<std::mutex> lock(_lock);
-       if (_task_queue.empty()) {
-           _cond.wait(lock);
+       _cond.wait(lock, [this]() {
+           return !_task_queue.empty() || !_untimed_queue.empty() || !_is_running;
+       });
+
+       //drop the tasks which missed their deadline, then the earliest deadline first
+       pop_expired(&expired_tasks);
+       if (!_task_queue.empty()) {
+           task_ptr = _task_queue.top();
+           _task_queue.pop();
+       } else if (!_untimed_queue.empty()) {
+           task_ptr = std::move(_untimed_queue.front());
+           _untimed_queue.pop_front();
+       }
        }
 
-       auto task_ptr = std::move(_task_queue.front());
-       _task_queue.pop();
+       expire(expired_tasks);
        
+       //nullptr if woken up by stop() or every task expired
        return task_ptr;
    }
 
+    /**
+    * reaper thread, fails the queued tasks at their deadline, even if every worker is busy.
+    */
+   void reap() {
+       std::vector<FuncPtr> expired_tasks;
+       std::unique_lock<std::mutex> lock(_lock);
+       while (_is_running) {
+           if (_task_queue.empty()) {
+               _reap_cond.wait(lock);
+           } else {
+               //a copy, the task may be taken and freed by a worker during the wait
+               Clock::time_point deadline = _task_queue.top()->_deadline;
+               _reap_cond.wait_until(lock, deadline);
+           }
+           pop_expired(&expired_tasks);
+           if (!expired_tasks.empty()) {
+               lock.unlock();
+               expire(expired_tasks);
+               expired_tasks.clear();
+               lock.lock();
+           }
+       }
+   }
+
     /**
     * run the thread pool, thread call here to get task from the queue. 
     */
    void run() {
        while(_is_running) {
-           ++_task_num;
            auto task = get_task();
-           if (task != nullptr) {
-                task->_func();
+           if (task == nullptr) {
+               continue;
            }
+           ++_task_num;
+           task->run();
            --_task_num;
            
-           //time out 
-           //    if (task->_timeout_ms != 0 && )
-           if (_task_num == 0 && _task_queue.empty()) {
-               _cond.notify_all();
+           //time out, finished but after the deadline
+           ++_completed_task_num;
+           if (Clock::now() > task->_deadline) {
+               ++_late_task_num;
            }
        }
    }
@@ -162,6 +216,7 @@ public:
         for (auto& ths : _thread_pool) {
             *ths = std::thread(&::inf::frame::ThreadPool::run, this);
         }
+        _reaper.reset(new std::thread(&::inf::frame::ThreadPool::reap, this));
         return 0;
     }
 
@@ -174,6 +229,7 @@ public:
        std::unique_lock<std::mutex> lock(_lock);
        _is_running = false;
        _cond.notify_all();
+       _reap_cond.notify_all();
        }
 
        for (auto &ths : _thread_pool) {
@@ -181,6 +237,9 @@ public:
                ths->join();
            }
        }
+       if (_reaper && _reaper->joinable()) {
+           _reaper->join();
+       }
        return 0;
    }
 
@@ -190,7 +249,7 @@ public:
     */
    int64_t get_queued_task_num() {
        std::unique_lock<std::mutex> lock(_lock);
-       return _task_queue.size();
+       return _task_queue.size() + _untimed_queue.size();
    }
 
     /**
@@ -201,6 +260,46 @@ public:
        return _task_num;
    }
 
+    /**
+    * whether the pool has been started and not stopped yet.
+    * @return true if workers are running
+    */
+   bool is_running() const {
+       return _is_running;
+   }
+
+    /**
+    * timeout of the tasks submitted without timeout_ms, 0 means never expire.
+    * @param timeout_ms
+    */
+   void set_default_timeout_ms(const int64_t timeout_ms) {
+       _timeout_ms_default = timeout_ms;
+   }
+
+    /**
+    * get num of the tasks dropped because their deadline passed in queue.
+    * @return expired task num
+    */
+   int64_t get_expired_task_num() const {
+       return _expired_task_num;
+   }
+
+    /**
+    * get num of the executed tasks.
+    * @return completed task num
+    */
+   int64_t get_completed_task_num() const {
+       return _completed_task_num;
+   }
+
+    /**
+    * get num of the tasks finished after their deadline.
+    * @return late task num
+    */
+   int64_t get_late_task_num() const {
+       return _late_task_num;
+   }
+
 
 
 
@@ -214,10 +313,49 @@ private:
     std::vector<ThreadPtr>                  _thread_pool;
 
     /* thread num. */
-    int                                     _thread_num;
+    int                                     _thread_num{0};
+
+    /* EDF order, the earliest deadline on the top. */
+    struct DeadlineCompare {
+        bool operator()(const FuncPtr &lhs, const FuncPtr &rhs) const {
+            if (lhs->_deadline != rhs->_deadline) {
+                return lhs->_deadline > rhs->_deadline;
+            }
+            return lhs->_sequence > rhs->_sequence;
+        }
+    };
+
+    /* move the tasks past their deadline out of the queue, under _lock. */
+    void pop_expired(std::vector<FuncPtr> *expired_tasks) {
+        Clock::time_point now = Clock::now();
+        while (!_task_queue.empty() && _task_queue.top()->is_expired(now)) {
+            expired_tasks->push_back(_task_queue.top());
+            _task_queue.pop();
+        }
+    }
+
+    /* fail the futures, outside the lock since it wakes up the waiters. */
+    void expire(const std::vector<FuncPtr> &expired_tasks) {
+        for (auto &expired_task : expired_tasks) {
+            ++_expired_task_num;
+            expired_task->expire();
+        }
+    }
+
+    /* tasks with a deadline. */
+    std::priority_queue<FuncPtr, std::vector<FuncPtr>, DeadlineCompare> _task_queue;
+
+    /* tasks without timeout, run only when no task with a deadline is queued. */
+    std::deque<FuncPtr>                     _untimed_queue;
 
-    /* task queue. */
-    std::queue<FuncPtr>                     _task_queue;
+    /* reaper thread. */
+    ThreadPtr                               _reaper;
+
+    /* wakes up the reaper when an earlier deadline is queued or stopped. */
+    std::condition_variable                 _reap_cond;
+
+    /* submit sequence. */
+    uint64_t                                _sequence{0};
 
     /* mutex lock. */
     std::mutex                              _lock;
@@ -232,7 +370,16 @@ private:
     std::atomic<bool>                       _is_running{false};
 
     /* timeout ms. */
-    int64_t                                 _timeout_ms_default{0};
+    std::atomic<int64_t>                    _timeout_ms_default{0};
+
+    /* tasks dropped in queue. */
+    std::atomic<int64_t>                    _expired_task_num{0};
+
+    /* tasks executed. */
+    std::atomic<int64_t>                    _completed_task_num{0};
+
+    /* tasks finished after deadline. */
+    std::atomic<int64_t>                    _late_task_num{0};
 
 };
 
@@ -240,5 +387,22 @@ private:
 
 
 
+/** 
+ * @class FrameThreadPool.
+ * process wide thread pool shared by dag schedulers and composite tasks.
+ * init and start it once while the server initializing:
+ * FrameThreadPool::instance().init(thread_num);
+ * FrameThreadPool::instance().start();
+ * if the pool is never started, fan-out work is executed by the calling thread.
+ **/
+class FrameThreadPool {
+public:
+    /* singleton. */
+    static ThreadPool& instance() {
+        static ThreadPool thread_pool;
+        return thread_pool;
+    }
+};
+
 } // end namespace frame
 } // end namespace inf
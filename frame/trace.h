@@ -0,0 +1,363 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <unordered_set>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+
+namespace inf {
+namespace frame {
+
+/* span num kept by each thread, the oldest are overwritten. */
+const int64_t TRACE_RING_SIZE = 4096;
+const uint64_t INVALID_TRACE_ID = 0;
+
+/* one task execution of a traced request. */
+struct TraceSpan {
+    uint64_t    _trace_id{INVALID_TRACE_ID};
+    const char  *_name{nullptr};
+    int64_t     _start_ns{0};
+    int64_t     _end_ns{0};
+    int64_t     _wait_ns{0};        //from ready to start, 0 if not queued
+    int64_t     _thread_id{0};
+    bool        _ok{false};
+};
+
+/**
+ * @class Tracer.
+ * sampled request tracing. a traced request records a span for every task it
+ * executes into the ring of the executing thread, lock free, the rings are
+ * read when dumped as chrome trace-event json (chrome://tracing, Perfetto).
+ * sampling is off by default.
+ * e.g.:
+ * Tracer::instance().set_sample_rate(1000);     //one of 1000 requests
+ * FrameSnapshotManager<Creator>::instance().schedule("rec_base", data);
+ * uint64_t trace_id = Tracer::instance().get_last_trace_id();
+ * std::string json = Tracer::instance().dump_chrome_trace(trace_id);
+ **/
+class Tracer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /* singleton, never destroyed, threads may trace during static destruction. */
+    static Tracer& instance() {
+        static Tracer *instance = new Tracer();
+        return *instance;
+    }
+
+    /**
+    * trace one of every sample_rate requests.
+    * @param sample_rate 0 means off, 1 traces every request
+    */
+    void set_sample_rate(const int64_t sample_rate) {
+        _sample_rate.store(std::max<int64_t>(sample_rate, 0), std::memory_order_relaxed);
+    }
+
+    /**
+    * start a request, sampled by the rate.
+    * @return trace id, INVALID_TRACE_ID if not sampled
+    */
+    uint64_t sample() {
+        int64_t sample_rate = _sample_rate.load(std::memory_order_relaxed);
+        if (sample_rate <= 0) {
+            return INVALID_TRACE_ID;
+        }
+        thread_local int64_t request_num = 0;
+        if (++request_num % sample_rate != 0) {
+            return INVALID_TRACE_ID;
+        }
+        return new_trace_id();
+    }
+
+    /* a new trace id, to force tracing a request. */
+    uint64_t new_trace_id() {
+        uint64_t trace_id = _trace_id.fetch_add(1, std::memory_order_relaxed) + 1;
+        _last_trace_id.store(trace_id, std::memory_order_relaxed);
+        return trace_id;
+    }
+
+    /* the latest trace id. */
+    uint64_t get_last_trace_id() const {
+        return _last_trace_id.load(std::memory_order_relaxed);
+    }
+
+    /**
+    * stable name for spans, spans outlive the tasks which are reloaded.
+    * @param name
+    * @return interned c string, never freed
+    */
+    const char* intern(const std::string &name) {
+        std::lock_guard<std::mutex> lock(_lock);
+        return _names.insert(name).first->c_str();
+    }
+
+    /**
+    * append a span to the ring of the calling thread.
+    * @param span
+    */
+    void record(const TraceSpan &span) {
+        local_ring().push(span);
+    }
+
+    /**
+    * spans still in the rings.
+    * @param trace_id INVALID_TRACE_ID for every trace
+    * @return spans ordered by start time
+    */
+    std::vector<TraceSpan> get_spans(const uint64_t trace_id = INVALID_TRACE_ID) {
+        std::vector<TraceSpan> spans;
+        {
+        std::lock_guard<std::mutex> lock(_lock);
+        for (auto &ring : _rings) {
+            ring->collect(trace_id, &spans);
+        }
+        }
+        std::sort(spans.begin(), spans.end(), [](const TraceSpan &lhs, const TraceSpan &rhs) {
+            return lhs._start_ns < rhs._start_ns;
+        });
+        return spans;
+    }
+
+    /**
+    * spans in chrome trace-event json, complete events in us.
+    * @param trace_id INVALID_TRACE_ID for every trace
+    * @return json
+    */
+    std::string dump_chrome_trace(const uint64_t trace_id = INVALID_TRACE_ID) {
+        std::ostringstream output;
+        output << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+        bool first = true;
+        for (auto &span : get_spans(trace_id)) {
+            output << (first ? "" : ",") << "{\"name\":\"" << span._name
+                   << "\",\"cat\":\"task\",\"ph\":\"X\",\"pid\":" << getpid()
+                   << ",\"tid\":" << span._thread_id
+                   << ",\"ts\":" << span._start_ns / 1000.0
+                   << ",\"dur\":" << (span._end_ns - span._start_ns) / 1000.0
+                   << ",\"args\":{\"trace_id\":" << span._trace_id
+                   << ",\"ok\":" << (span._ok ? "true" : "false")
+                   << ",\"wait_us\":" << span._wait_ns / 1000.0 << "}}";
+            first = false;
+        }
+        output << "],\"displayTimeUnit\":\"ms\"}";
+        return output.str();
+    }
+
+    /* ns on the steady clock, the time base of the spans. */
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now().time_since_epoch()).count();
+    }
+
+    /* kernel thread id, as shown by top and perf. */
+    static int64_t get_thread_id() {
+        thread_local int64_t thread_id = syscall(SYS_gettid);
+        return thread_id;
+    }
+
+    /* trace id and queue wait of the task the calling thread is about to execute. */
+    struct Context {
+        uint64_t    _trace_id{INVALID_TRACE_ID};
+        int64_t     _wait_ns{0};
+    };
+
+    /* context of the calling thread. */
+    static Context& local_context() {
+        thread_local Context context;
+        return context;
+    }
+
+private:
+    /**
+    * spans of one thread, single writer.
+    * each slot is a seqlock: odd while written, readers skip torn slots.
+    */
+    class Ring {
+    public:
+        Ring() : _slots(new Slot[TRACE_RING_SIZE]) {};
+
+        void push(const TraceSpan &span) {
+            uint64_t index = _head.load(std::memory_order_relaxed);
+            Slot &slot = _slots[index % TRACE_RING_SIZE];
+            uint64_t seq = slot._seq.load(std::memory_order_relaxed);
+            slot._seq.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot._trace_id.store(span._trace_id, std::memory_order_relaxed);
+            slot._name.store(span._name, std::memory_order_relaxed);
+            slot._start_ns.store(span._start_ns, std::memory_order_relaxed);
+            slot._end_ns.store(span._end_ns, std::memory_order_relaxed);
+            slot._wait_ns.store(span._wait_ns, std::memory_order_relaxed);
+            slot._thread_id.store(span._thread_id, std::memory_order_relaxed);
+            slot._ok.store(span._ok, std::memory_order_relaxed);
+            slot._seq.store(seq + 2, std::memory_order_release);
+            _head.store(index + 1, std::memory_order_release);
+        }
+
+        void collect(const uint64_t trace_id, std::vector<TraceSpan> *spans) const {
+            uint64_t head = _head.load(std::memory_order_acquire);
+            uint64_t begin = head > static_cast<uint64_t>(TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+            for (uint64_t index = begin; index < head; ++index) {
+                const Slot &slot = _slots[index % TRACE_RING_SIZE];
+                uint64_t seq = slot._seq.load(std::memory_order_acquire);
+                if (seq % 2 != 0) {
+                    continue;
+                }
+                TraceSpan span;
+                span._trace_id = slot._trace_id.load(std::memory_order_relaxed);
+                span._name = slot._name.load(std::memory_order_relaxed);
+                span._start_ns = slot._start_ns.load(std::memory_order_relaxed);
+                span._end_ns = slot._end_ns.load(std::memory_order_relaxed);
+                span._wait_ns = slot._wait_ns.load(std::memory_order_relaxed);
+                span._thread_id = slot._thread_id.load(std::memory_order_relaxed);
+                span._ok = slot._ok.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot._seq.load(std::memory_order_relaxed) != seq || span._name == nullptr) {
+                    continue;
+                }
+                if (trace_id == INVALID_TRACE_ID || span._trace_id == trace_id) {
+                    spans->push_back(span);
+                }
+            }
+        }
+
+    private:
+        struct Slot {
+            std::atomic<uint64_t>       _seq{0};
+            std::atomic<uint64_t>       _trace_id{INVALID_TRACE_ID};
+            std::atomic<const char*>    _name{nullptr};
+            std::atomic<int64_t>        _start_ns{0};
+            std::atomic<int64_t>        _end_ns{0};
+            std::atomic<int64_t>        _wait_ns{0};
+            std::atomic<int64_t>        _thread_id{0};
+            std::atomic<bool>           _ok{false};
+        };
+
+        std::unique_ptr<Slot[]>     _slots;
+        std::atomic<uint64_t>       _head{0};
+    };
+
+    /* hand the ring to the next thread when the owner exits, spans are kept. */
+    struct RingHolder {
+        Ring *_ring{nullptr};
+        ~RingHolder() {
+            if (_ring != nullptr) {
+                Tracer &tracer = Tracer::instance();
+                std::lock_guard<std::mutex> lock(tracer._lock);
+                tracer._free_rings.push_back(_ring);
+            }
+        }
+    };
+
+    /* ctor. */
+    Tracer() = default;
+
+    /* none copy. */
+    Tracer(const Tracer &rhs) = delete;
+    Tracer &operator=(const Tracer &rhs) = delete;
+
+    Ring& local_ring() {
+        thread_local RingHolder holder;
+        if (holder._ring == nullptr) {
+            std::lock_guard<std::mutex> lock(_lock);
+            if (!_free_rings.empty()) {
+                holder._ring = _free_rings.back();
+                _free_rings.pop_back();
+            } else {
+                _rings.emplace_back(new Ring());
+                holder._ring = _rings.back().get();
+            }
+        }
+        return *holder._ring;
+    }
+
+    /* guard rings and names. */
+    std::mutex                          _lock;
+
+    /* every ring ever created, and the ones of exited threads. */
+    std::vector<std::unique_ptr<Ring>>  _rings;
+    std::vector<Ring*>                  _free_rings;
+
+    /* interned span names. */
+    std::unordered_set<std::string>     _names;
+
+    /* one of sample_rate requests is traced. */
+    std::atomic<int64_t>                _sample_rate{0};
+
+    /* last trace id. */
+    std::atomic<uint64_t>               _trace_id{INVALID_TRACE_ID};
+    std::atomic<uint64_t>               _last_trace_id{INVALID_TRACE_ID};
+};
+
+/**
+ * @class TraceScope.
+ * set the trace context of the calling thread for a scope, restore it after,
+ * used where a request moves to another thread.
+ **/
+class TraceScope {
+public:
+    /* ctor. */
+    TraceScope(const uint64_t trace_id, const int64_t wait_ns)
+        : _saved(Tracer::local_context()) {
+        Tracer::Context &context = Tracer::local_context();
+        context._trace_id = trace_id;
+        context._wait_ns = wait_ns;
+    }
+
+    /* dtor. */
+    ~TraceScope() {
+        Tracer::local_context() = _saved;
+    }
+
+private:
+    /* none copy. */
+    TraceScope(const TraceScope &rhs) = delete;
+    TraceScope &operator=(const TraceScope &rhs) = delete;
+
+    Tracer::Context _saved;
+};
+
+/**
+ * @class SpanRecorder.
+ * record a span of the traced request running on the calling thread,
+ * nothing but a thread local read if the request is not traced.
+ * an async span is done on the callback thread, it keeps the starting thread id.
+ **/
+class SpanRecorder {
+public:
+    /* ctor. */
+    explicit SpanRecorder(const char *name) {
+        const Tracer::Context &context = Tracer::local_context();
+        if (context._trace_id == INVALID_TRACE_ID || name == nullptr) {
+            return;
+        }
+        _span._trace_id = context._trace_id;
+        _span._name = name;
+        _span._wait_ns = context._wait_ns;
+        _span._thread_id = Tracer::get_thread_id();
+        _span._start_ns = Tracer::now_ns();
+    }
+
+    /* record with the result. */
+    bool done(const bool ok) {
+        if (_span._trace_id != INVALID_TRACE_ID) {
+            _span._end_ns = Tracer::now_ns();
+            _span._ok = ok;
+            Tracer::instance().record(_span);
+            _span._trace_id = INVALID_TRACE_ID;
+        }
+        return ok;
+    }
+
+private:
+    TraceSpan   _span;
+};
+
+} // end namespace frame
+} // end namespace inf
@@ -0,0 +1,508 @@
+#pragma once
+#include "thread_pool.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <stdint.h>
+
+namespace inf {
+namespace frame {
+
+const int64_t DEFAULT_STEALING_QUEUE_CAPACITY = 256;
+const int64_t DEFAULT_STEAL_SPIN_NUM = 64;
+
+/**
+ * @class WorkStealingQueue.
+ * lock-free Chase-Lev deque, one owner and many thieves.
+ * the owner pushes and pops at the bottom (LIFO, cache friendly),
+ * thieves steal from the top (FIFO).
+ * DataType must be trivially copyable, usually a raw pointer.
+ * the ring grows when full, retired rings are kept until the queue is destroyed
+ * because a thief may still be reading them.
+ **/
+template <typename DataType>
+class WorkStealingQueue {
+public:
+    /* ctor. */
+    explicit WorkStealingQueue(const int64_t capacity = DEFAULT_STEALING_QUEUE_CAPACITY) {
+        int64_t real_capacity = 1;
+        while (real_capacity < capacity) {
+            real_capacity <<= 1;
+        }
+        _rings.emplace_back(new Ring(real_capacity));
+        _ring.store(_rings.back().get(), std::memory_order_relaxed);
+    }
+
+    /* dtor. */
+    virtual ~WorkStealingQueue() = default;
+
+    /**
+    * push data at the bottom, owner only.
+    * @param data
+    */
+    void push(DataType data) {
+        int64_t bottom = _bottom.load(std::memory_order_relaxed);
+        int64_t top = _top.load(std::memory_order_acquire);
+        Ring *ring = _ring.load(std::memory_order_relaxed);
+        if (bottom - top > ring->_capacity - 1) {
+            ring = grow(ring, bottom, top);
+        }
+        ring->put(bottom, data);
+        //publish the slot to thieves
+        _bottom.store(bottom + 1, std::memory_order_release);
+    }
+
+    /**
+    * pop data from the bottom, owner only.
+    * @param data output
+    * @return true if got one
+    */
+    bool pop(DataType &data) {
+        int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+        Ring *ring = _ring.load(std::memory_order_relaxed);
+        _bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = _top.load(std::memory_order_relaxed);
+
+        if (top > bottom) {
+            //empty
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+        data = ring->get(bottom);
+        if (top == bottom) {
+            //the last one, race with thieves
+            bool won = _top.compare_exchange_strong(top, top + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed);
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    /**
+    * steal data from the top, any thread.
+    * @param data output
+    * @return true if got one
+    */
+    bool steal(DataType &data) {
+        int64_t top = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = _bottom.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return false;
+        }
+        Ring *ring = _ring.load(std::memory_order_acquire);
+        data = ring->get(top);
+        return _top.compare_exchange_strong(top, top + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    /* approximate size. */
+    int64_t size() const {
+        int64_t bottom = _bottom.load(std::memory_order_relaxed);
+        int64_t top = _top.load(std::memory_order_relaxed);
+        return bottom > top ? bottom - top : 0;
+    }
+
+private:
+    /* power of 2 sized ring. */
+    struct Ring {
+        int64_t                                 _capacity;
+        int64_t                                 _mask;
+        std::unique_ptr<std::atomic<DataType>[]> _buffer;
+
+        explicit Ring(const int64_t capacity)
+            : _capacity(capacity), _mask(capacity - 1),
+              _buffer(new std::atomic<DataType>[capacity]) {};
+
+        void put(const int64_t index, DataType data) {
+            _buffer[index & _mask].store(data, std::memory_order_relaxed);
+        }
+
+        DataType get(const int64_t index) const {
+            return _buffer[index & _mask].load(std::memory_order_relaxed);
+        }
+    };
+
+    /* double the ring, owner only. */
+    Ring* grow(Ring *ring, const int64_t bottom, const int64_t top) {
+        std::unique_ptr<Ring> new_ring(new Ring(ring->_capacity * 2));
+        for (int64_t i = top; i < bottom; ++i) {
+            new_ring->put(i, ring->get(i));
+        }
+        Ring *result = new_ring.get();
+        _rings.push_back(std::move(new_ring));
+        _ring.store(result, std::memory_order_release);
+        return result;
+    }
+
+    /* none copy. */
+    WorkStealingQueue(const WorkStealingQueue &rhs) = delete;
+    WorkStealingQueue &operator=(const WorkStealingQueue &rhs) = delete;
+
+    /* steal end, on its own cache line. */
+    alignas(64) std::atomic<int64_t>    _top{0};
+
+    /* owner end. */
+    alignas(64) std::atomic<int64_t>    _bottom{0};
+
+    /* current ring. */
+    std::atomic<Ring*>                  _ring{nullptr};
+
+    /* all the rings ever used, owner only. */
+    std::vector<std::unique_ptr<Ring>>  _rings;
+};
+
+
+/**
+ * @class WorkStealingThreadPool.
+ * thread pool with one lock-free deque per worker, same usage as ThreadPool:
+ * WorkStealingThreadPool thread_pool;
+ * thread_pool.init(16);
+ * thread_pool.start();
+ * auto result = thread_pool.submit(100, func, a, b, c);
+ * thread_pool.stop();
+ *
+ * a task submitted from a worker goes to the worker's own deque, so fan-out
+ * children stay on the core that produced their input.
+ * a task submitted from outside goes to one worker's inbox in round robin.
+ * idle workers steal from the others before parking.
+ * a task with timeout_ms > 0 must be started within timeout_ms after submitted,
+ * otherwise it is dropped when popped or stolen and its future throws
+ * TaskTimeoutException, as ThreadPool does. tasks are not reordered by deadline.
+ * a task submitted before init or after stop, or still queued when stopped,
+ * is not run and its future throws TaskRejectedException.
+ **/
+class WorkStealingThreadPool {
+protected:
+    using Clock = PoolTask::Clock;
+    using TaskPtr = std::unique_ptr<PoolTask>;
+
+public:
+    using ThreadPtr = std::unique_ptr<std::thread>;
+
+    /* ctor. */
+    WorkStealingThreadPool() = default;
+    virtual ~WorkStealingThreadPool() {
+        stop();
+    }
+
+    /**
+    * init the thread pool
+    * @param thread_num
+    * @return 0 if ok. otherwise failed
+    */
+    int init(const int thread_num = DEFAULT_THREAD_NUM) {
+        if (_is_running || thread_num <= 0) {
+            return -1;
+        }
+        _workers.clear();
+        for (int64_t i = 0; i < thread_num; ++i) {
+            _workers.emplace_back(new Worker());
+        }
+        return 0;
+    }
+
+    /**
+    * submit task, see ThreadPool::submit.
+    * @param timeout_ms task timeout ms, 0 means never expire
+    * @param func and args...
+    * @return std::future<>, throws TaskTimeoutException if not started within timeout_ms,
+    *         TaskRejectedException if the pool is not inited or stopped
+    */
+    template <typename Func, typename ...Args>
+    auto submit(int64_t timeout_ms, Func&& func, Args&& ...args) -> std::future<decltype(func(args...))>
+    {
+        TaskPtr task;
+        auto result = PoolTask::create(timeout_ms, &task, std::forward<Func>(func), std::forward<Args>(args)...);
+        //stop() drains the queues only after every submit in flight is done
+        _submitting_num.fetch_add(1, std::memory_order_seq_cst);
+        if (_workers.empty() || _is_stopped.load(std::memory_order_seq_cst)) {
+            _submitting_num.fetch_sub(1, std::memory_order_seq_cst);
+            task->reject(_workers.empty() ? "thread pool not inited" : "thread pool stopped");
+            return result;
+        }
+        push(std::move(task));
+        _submitting_num.fetch_sub(1, std::memory_order_seq_cst);
+        return result;
+    }
+
+    /**
+    * submit task, the default timeout (set_default_timeout_ms) is used.
+    * @param func and args...
+    * @return std::future<>
+    */
+    template <typename Func, typename ...Args>
+    auto submit(Func&& func, Args&& ...args) -> std::future<decltype(func(args...))> {
+        return submit(_timeout_ms_default.load(), std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    /**
+    * timeout of the tasks submitted without timeout_ms, 0 means never expire.
+    * @param timeout_ms
+    */
+    void set_default_timeout_ms(const int64_t timeout_ms) {
+        _timeout_ms_default = timeout_ms;
+    }
+
+    /**
+    * start the workers
+    * @return 0 if ok , otherwise failed
+    */
+    int start() {
+        if (_is_running || _workers.empty()) {
+            return -1;
+        }
+        _is_stopped = false;
+        _is_running = true;
+        for (int64_t i = 0; i < static_cast<int64_t>(_workers.size()); ++i) {
+            _workers[i]->_thread.reset(new std::thread(&WorkStealingThreadPool::run, this, i));
+        }
+        return 0;
+    }
+
+    /**
+    * stop the workers, tasks left in the queues are rejected, so are the later submits.
+    * @return 0 if ok, otherwise failed.
+    */
+    int stop() {
+        _is_stopped.store(true, std::memory_order_seq_cst);
+        {
+        std::unique_lock<std::mutex> lock(_park_lock);
+        _is_running = false;
+        _park_cond.notify_all();
+        }
+
+        for (auto &worker : _workers) {
+            if (worker->_thread && worker->_thread->joinable()) {
+                worker->_thread->join();
+            }
+        }
+        while (_submitting_num.load(std::memory_order_seq_cst) > 0) {
+            std::this_thread::yield();
+        }
+        //fail the tasks never run
+        for (auto &worker : _workers) {
+            PoolTask *raw_task = nullptr;
+            while (worker->_local_queue.pop(raw_task)) {
+                TaskPtr(raw_task)->reject("thread pool stopped");
+            }
+            std::deque<TaskPtr> inbox;
+            {
+            std::lock_guard<std::mutex> guard(worker->_inbox_lock);
+            inbox.swap(worker->_inbox);
+            }
+            for (auto &inbox_task : inbox) {
+                inbox_task->reject("thread pool stopped");
+            }
+        }
+        _pending_num = 0;
+        return 0;
+    }
+
+    /**
+    * get queued task num.
+    * @return task num
+    */
+    int64_t get_queued_task_num() const {
+        return _pending_num;
+    }
+
+    /**
+    * get running task num.
+    * @return running task num
+    */
+    int64_t get_running_task_num() const {
+        return _task_num;
+    }
+
+    /**
+    * whether the pool has been started and not stopped yet.
+    * @return true if workers are running
+    */
+    bool is_running() const {
+        return _is_running;
+    }
+
+    /**
+    * get stolen task num since started.
+    * @return stolen task num
+    */
+    int64_t get_stolen_task_num() const {
+        return _stolen_num;
+    }
+
+    /**
+    * get num of the tasks dropped because their deadline passed in queue.
+    * @return expired task num
+    */
+    int64_t get_expired_task_num() const {
+        return _expired_num;
+    }
+
+private:
+    /* per worker queues. */
+    struct Worker {
+        WorkStealingQueue<PoolTask*>    _local_queue;   //pushed by the worker itself, owns the tasks
+        std::mutex                      _inbox_lock;    //guard inbox
+        std::deque<TaskPtr>             _inbox;         //pushed by other threads
+        ThreadPtr                       _thread;
+    };
+    using WorkerPtr = std::unique_ptr<Worker>;
+
+    /* put the task into the local deque or an inbox, wake up one parked worker. */
+    void push(TaskPtr task) {
+        //count first, so a parked worker never misses a visible task
+        _pending_num.fetch_add(1, std::memory_order_seq_cst);
+        if (_current_pool == this) {
+            //the deque holds raw pointers, taken back into a TaskPtr when popped or stolen
+            _workers[_current_index]->_local_queue.push(task.release());
+        } else {
+            int64_t index = _next_worker.fetch_add(1, std::memory_order_relaxed) % _workers.size();
+            Worker &worker = *_workers[index];
+            std::lock_guard<std::mutex> guard(worker._inbox_lock);
+            worker._inbox.push_back(std::move(task));
+        }
+
+        if (_parked_num.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> guard(_park_lock);
+            _park_cond.notify_one();
+        }
+    }
+
+    /* find a task: local deque, own inbox, then steal from others. */
+    TaskPtr get_task(const int64_t index) {
+        PoolTask *raw_task = nullptr;
+        TaskPtr task;
+        Worker &self = *_workers[index];
+        if (self._local_queue.pop(raw_task)) {
+            return TaskPtr(raw_task);
+        }
+        if (pop_inbox(self, task)) {
+            return task;
+        }
+        const int64_t worker_num = _workers.size();
+        for (int64_t i = 1; i < worker_num; ++i) {
+            Worker &victim = *_workers[(index + i) % worker_num];
+            if (victim._local_queue.steal(raw_task)) {
+                task.reset(raw_task);
+            }
+            if (task || pop_inbox(victim, task)) {
+                _stolen_num.fetch_add(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    /* pop from the inbox of a worker. */
+    static bool pop_inbox(Worker &worker, TaskPtr &task) {
+        std::lock_guard<std::mutex> guard(worker._inbox_lock);
+        if (worker._inbox.empty()) {
+            return false;
+        }
+        task = std::move(worker._inbox.front());
+        worker._inbox.pop_front();
+        return true;
+    }
+
+    /* worker loop. */
+    void run(const int64_t index) {
+        _current_pool = this;
+        _current_index = index;
+        int64_t spin = 0;
+        while (_is_running) {
+            TaskPtr task = get_task(index);
+            if (task) {
+                _pending_num.fetch_sub(1, std::memory_order_relaxed);
+                if (task->is_expired(Clock::now())) {
+                    ++_expired_num;
+                    task->expire();
+                } else {
+                    ++_task_num;
+                    task->run();
+                    --_task_num;
+                }
+                spin = 0;
+                continue;
+            }
+            if (++spin < DEFAULT_STEAL_SPIN_NUM) {
+                std::this_thread::yield();
+                continue;
+            }
+            //park until something is pushed
+            std::unique_lock<std::mutex> lock(_park_lock);
+            _parked_num.fetch_add(1, std::memory_order_seq_cst);
+            _park_cond.wait(lock, [this]() {
+                return _pending_num.load(std::memory_order_seq_cst) > 0 || !_is_running;
+            });
+            _parked_num.fetch_sub(1, std::memory_order_seq_cst);
+            spin = 0;
+        }
+        _current_pool = nullptr;
+    }
+
+    /* none copy. */
+    WorkStealingThreadPool(const WorkStealingThreadPool &lhs) = delete;
+    WorkStealingThreadPool &operator=(const WorkStealingThreadPool &lhs) = delete;
+
+    /* the pool the current thread works for. */
+    static thread_local WorkStealingThreadPool *_current_pool;
+
+    /* the worker index of the current thread. */
+    static thread_local int64_t                 _current_index;
+
+    /* workers. */
+    std::vector<WorkerPtr>                      _workers;
+
+    /* round robin cursor for outside submitters. */
+    std::atomic<uint64_t>                       _next_worker{0};
+
+    /* queued task num. */
+    std::atomic<int64_t>                        _pending_num{0};
+
+    /* parked worker num. */
+    std::atomic<int64_t>                        _parked_num{0};
+
+    /* running task num. */
+    std::atomic<int64_t>                        _task_num{0};
+
+    /* stolen task num. */
+    std::atomic<int64_t>                        _stolen_num{0};
+
+    /* expired task num. */
+    std::atomic<int64_t>                        _expired_num{0};
+
+    /* running status. */
+    std::atomic<bool>                           _is_running{false};
+
+    /* set by stop, submits are rejected until started again. */
+    std::atomic<bool>                           _is_stopped{false};
+
+    /* submits in flight, stop waits for them before draining the queues. */
+    std::atomic<int64_t>                        _submitting_num{0};
+
+    /* timeout ms of submit without timeout_ms. */
+    std::atomic<int64_t>                        _timeout_ms_default{0};
+
+    /* park lock. */
+    std::mutex                                  _park_lock;
+
+    /* park cond. */
+    std::condition_variable                     _park_cond;
+};
+
+inline thread_local WorkStealingThreadPool *WorkStealingThreadPool::_current_pool = nullptr;
+inline thread_local int64_t WorkStealingThreadPool::_current_index = 0;
+
+} // end namespace frame
+} // end namespace inf
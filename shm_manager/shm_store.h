@@ -0,0 +1,681 @@
+#pragma once
+#include "utils/common_log.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace inf {
+namespace shm {
+
+/* "INFSHM01", first bytes of every segment. */
+const uint64_t SHM_STORE_MAGIC = 0x31304D4853464E49ULL;
+const uint32_t SHM_STORE_FORMAT_VERSION = 1;
+/* max length of a table name, with the ending '\0'. */
+const int64_t SHM_TABLE_NAME_SIZE = 48;
+/* values are aligned, so fixed size records such as float vectors can be cast in place. */
+const uint64_t SHM_VALUE_ALIGN = 8;
+const uint64_t INVALID_SHM_VERSION = 0;
+
+/* table types. */
+enum ShmTableType {
+    SHM_HASH_TABLE  = 1,
+    SHM_ARRAY_TABLE = 2,
+};
+
+/* layout of a segment, every position is an offset from the segment start. */
+struct ShmHeader {
+    uint64_t    _magic;
+    uint32_t    _format_version;
+    uint32_t    _table_num;
+    uint64_t    _total_size;
+    uint64_t    _version;
+    uint64_t    _table_offset;      //ShmTableEntry[_table_num]
+};
+
+struct ShmTableEntry {
+    char        _name[SHM_TABLE_NAME_SIZE];
+    uint32_t    _type;
+    uint32_t    _reserved;
+    uint64_t    _slot_num;          //power of 2, hash table only
+    uint64_t    _slot_offset;       //ShmSlot[_slot_num], hash table only
+    uint64_t    _value_num;
+    uint64_t    _value_offset;      //ShmValueRef[_value_num]
+};
+
+/* open addressing slot, value_index + 1, 0 if empty. */
+struct ShmSlot {
+    uint64_t    _key;
+    uint64_t    _value_index;
+};
+
+struct ShmValueRef {
+    uint64_t    _offset;
+    uint64_t    _size;
+};
+
+/* control segment of a store, the only mutable bytes, points to the live data segment. */
+struct ShmControl {
+    uint64_t                _magic;
+    std::atomic<uint64_t>   _version;
+};
+
+/* value in the segment, valid while the segment is pinned. */
+struct ShmValue {
+    const char  *_data{nullptr};
+    uint64_t    _size{0};
+
+    explicit operator bool() const {
+        return _data != nullptr;
+    }
+};
+
+/* slot of a key, shared by the builder and the readers. */
+inline uint64_t hash_shm_key(uint64_t key) {
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+    return key ^ (key >> 31);
+}
+
+/* posix shm names, the control segment and the data segment of each version. */
+inline std::string get_control_name(const std::string &store_name) {
+    return "/" + store_name;
+}
+
+inline std::string get_segment_name(const std::string &store_name, const uint64_t version) {
+    return "/" + store_name + "." + std::to_string(version);
+}
+
+/**
+ * @class ShmHashView.
+ * read only uint64 key -> bytes table in a segment, no allocation and no lock.
+ **/
+class ShmHashView {
+public:
+    ShmHashView() = default;
+    ShmHashView(const char *base, const ShmTableEntry *entry) : _base(base), _entry(entry) {};
+
+    /**
+    * value of a key.
+    * @param key
+    * @return value, empty if not found
+    */
+    ShmValue find(const uint64_t key) const {
+        if (_entry == nullptr) {
+            return ShmValue();
+        }
+        const ShmSlot *slots = reinterpret_cast<const ShmSlot*>(_base + _entry->_slot_offset);
+        uint64_t mask = _entry->_slot_num - 1;
+        for (uint64_t i = hash_shm_key(key) & mask; ; i = (i + 1) & mask) {
+            const ShmSlot &slot = slots[i];
+            if (slot._value_index == 0) {
+                return ShmValue();
+            }
+            if (slot._key == key) {
+                const ShmValueRef &ref = reinterpret_cast<const ShmValueRef*>(
+                        _base + _entry->_value_offset)[slot._value_index - 1];
+                return ShmValue{_base + ref._offset, ref._size};
+            }
+        }
+    }
+
+    /* key num. */
+    uint64_t size() const {
+        return _entry == nullptr ? 0 : _entry->_value_num;
+    }
+
+    explicit operator bool() const {
+        return _entry != nullptr;
+    }
+
+private:
+    const char              *_base{nullptr};
+    const ShmTableEntry     *_entry{nullptr};
+};
+
+/**
+ * @class ShmArrayView.
+ * read only index -> bytes array in a segment.
+ **/
+class ShmArrayView {
+public:
+    ShmArrayView() = default;
+    ShmArrayView(const char *base, const ShmTableEntry *entry) : _base(base), _entry(entry) {};
+
+    /**
+    * value at index.
+    * @param index
+    * @return value, empty if out of range
+    */
+    ShmValue get(const uint64_t index) const {
+        if (_entry == nullptr || index >= _entry->_value_num) {
+            return ShmValue();
+        }
+        const ShmValueRef &ref = reinterpret_cast<const ShmValueRef*>(_base + _entry->_value_offset)[index];
+        return ShmValue{_base + ref._offset, ref._size};
+    }
+
+    uint64_t size() const {
+        return _entry == nullptr ? 0 : _entry->_value_num;
+    }
+
+    explicit operator bool() const {
+        return _entry != nullptr;
+    }
+
+private:
+    const char              *_base{nullptr};
+    const ShmTableEntry     *_entry{nullptr};
+};
+
+/**
+ * @class ShmSegment.
+ * one read only mapping of a data segment, shared by every process mapping it.
+ * unmapped when the last holder releases it.
+ **/
+class ShmSegment {
+public:
+    /**
+    * map a published version read only and check its layout.
+    * @param store_name
+    * @param version
+    * @return segment, nullptr if missing or corrupted
+    */
+    static std::shared_ptr<const ShmSegment> open(const std::string &store_name, const uint64_t version) {
+        int fd = shm_open(get_segment_name(store_name, version).c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat segment_stat;
+        void *data = MAP_FAILED;
+        if (fstat(fd, &segment_stat) == 0 && segment_stat.st_size >= static_cast<off_t>(sizeof(ShmHeader))) {
+            data = mmap(nullptr, segment_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (data == MAP_FAILED) {
+            ERR_LOG << "map shm segment failed : " << get_segment_name(store_name, version) << std::endl;
+            return nullptr;
+        }
+        std::shared_ptr<ShmSegment> segment(new ShmSegment(static_cast<const char*>(data), segment_stat.st_size));
+        if (!segment->check(version)) {
+            ERR_LOG << "corrupted shm segment : " << get_segment_name(store_name, version) << std::endl;
+            return nullptr;
+        }
+        return segment;
+    }
+
+    /* dtor. */
+    ~ShmSegment() {
+        munmap(const_cast<char*>(_base), _size);
+    }
+
+    /**
+    * hash table by name.
+    * @param table_name
+    * @return view, empty if not found or not a hash table
+    */
+    ShmHashView get_hash_table(const std::string &table_name) const {
+        const ShmTableEntry *entry = find_table(table_name, SHM_HASH_TABLE);
+        return entry == nullptr ? ShmHashView() : ShmHashView(_base, entry);
+    }
+
+    /**
+    * array by name.
+    * @param table_name
+    * @return view, empty if not found or not an array
+    */
+    ShmArrayView get_array(const std::string &table_name) const {
+        const ShmTableEntry *entry = find_table(table_name, SHM_ARRAY_TABLE);
+        return entry == nullptr ? ShmArrayView() : ShmArrayView(_base, entry);
+    }
+
+    uint64_t get_version() const {
+        return header()._version;
+    }
+
+    /* mapped bytes. */
+    uint64_t get_size() const {
+        return _size;
+    }
+
+    /* start of the mapping. */
+    const char* data() const {
+        return _base;
+    }
+
+private:
+    ShmSegment(const char *base, const uint64_t size) : _base(base), _size(size) {};
+
+    /* none copy. */
+    ShmSegment(const ShmSegment &rhs) = delete;
+    ShmSegment &operator=(const ShmSegment &rhs) = delete;
+
+    const ShmHeader& header() const {
+        return *reinterpret_cast<const ShmHeader*>(_base);
+    }
+
+    const ShmTableEntry* tables() const {
+        return reinterpret_cast<const ShmTableEntry*>(_base + header()._table_offset);
+    }
+
+    const ShmTableEntry* find_table(const std::string &table_name, const ShmTableType type) const {
+        for (uint32_t i = 0; i < header()._table_num; ++i) {
+            const ShmTableEntry &entry = tables()[i];
+            if (entry._type == type && table_name == entry._name) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    bool in_range(const uint64_t offset, const uint64_t num, const uint64_t item_size) const {
+        return offset <= _size && num <= (_size - offset) / item_size;
+    }
+
+    /* a broken segment must not crash the readers, every offset is checked once. */
+    bool check(const uint64_t version) const {
+        const ShmHeader &head = header();
+        if (head._magic != SHM_STORE_MAGIC || head._format_version != SHM_STORE_FORMAT_VERSION ||
+                head._total_size != _size || head._version != version ||
+                !in_range(head._table_offset, head._table_num, sizeof(ShmTableEntry))) {
+            return false;
+        }
+        for (uint32_t i = 0; i < head._table_num; ++i) {
+            const ShmTableEntry &entry = tables()[i];
+            if (entry._name[SHM_TABLE_NAME_SIZE - 1] != '\0' ||
+                    !in_range(entry._value_offset, entry._value_num, sizeof(ShmValueRef))) {
+                return false;
+            }
+            if (entry._type == SHM_HASH_TABLE && (entry._slot_num == 0 ||
+                    (entry._slot_num & (entry._slot_num - 1)) != 0 || entry._slot_num <= entry._value_num ||
+                    !in_range(entry._slot_offset, entry._slot_num, sizeof(ShmSlot)))) {
+                return false;
+            }
+            const ShmValueRef *refs = reinterpret_cast<const ShmValueRef*>(_base + entry._value_offset);
+            for (uint64_t j = 0; j < entry._value_num; ++j) {
+                if (!in_range(refs[j]._offset, refs[j]._size, 1)) {
+                    return false;
+                }
+            }
+            if (entry._type == SHM_HASH_TABLE) {
+                const ShmSlot *slots = reinterpret_cast<const ShmSlot*>(_base + entry._slot_offset);
+                for (uint64_t j = 0; j < entry._slot_num; ++j) {
+                    if (slots[j]._value_index > entry._value_num) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    const char  *_base;
+    uint64_t    _size;
+};
+using ShmSegmentPtr = std::shared_ptr<const ShmSegment>;
+
+/**
+ * @class ShmStoreBuilder.
+ * writes tables into a new data segment, then flips the version in the control segment.
+ * readers see either the old or the new version, never a half written one.
+ * the replaced segment is unlinked, it stays mapped by its readers until they refresh.
+ * e.g.:
+ * ShmStoreBuilder builder;
+ * builder.add_hash_table("item_feature", std::move(features));
+ * builder.add_array("item_embedding", std::move(embeddings));
+ * uint64_t version = builder.publish("item_dict");
+ **/
+class ShmStoreBuilder {
+public:
+    using HashItems = std::vector<std::pair<uint64_t, std::string>>;
+    using ArrayItems = std::vector<std::string>;
+
+    /**
+    * add a uint64 key -> bytes table.
+    * @param table_name
+    * @param items keys must be unique
+    * @return false if the name is invalid or used
+    */
+    bool add_hash_table(const std::string &table_name, HashItems items) {
+        if (!check_name(table_name)) {
+            return false;
+        }
+        _tables.emplace_back(Table{table_name, SHM_HASH_TABLE, std::move(items), ArrayItems()});
+        return true;
+    }
+
+    /**
+    * add an index -> bytes array.
+    * @param table_name
+    * @param items
+    * @return false if the name is invalid or used
+    */
+    bool add_array(const std::string &table_name, ArrayItems items) {
+        if (!check_name(table_name)) {
+            return false;
+        }
+        _tables.emplace_back(Table{table_name, SHM_ARRAY_TABLE, HashItems(), std::move(items)});
+        return true;
+    }
+
+    /**
+    * write the tables into a new segment and make it the live version.
+    * only one builder of a store may publish at a time.
+    * @param store_name posix shm name without '/'
+    * @return new version, INVALID_SHM_VERSION if failed
+    */
+    uint64_t publish(const std::string &store_name) {
+        ShmControl *control = open_control(store_name);
+        if (control == nullptr) {
+            return INVALID_SHM_VERSION;
+        }
+        uint64_t old_version = control->_version.load(std::memory_order_acquire);
+        uint64_t version = old_version + 1;
+        bool ok = write_segment(store_name, version);
+        if (ok) {
+            //the flip, readers map the new segment from now on
+            control->_version.store(version, std::memory_order_release);
+            if (old_version != INVALID_SHM_VERSION) {
+                shm_unlink(get_segment_name(store_name, old_version).c_str());
+            }
+        }
+        munmap(control, sizeof(ShmControl));
+        return ok ? version : INVALID_SHM_VERSION;
+    }
+
+    /**
+    * remove a store, mapped segments stay valid until unmapped.
+    * @param store_name
+    */
+    static void unlink(const std::string &store_name) {
+        int fd = shm_open(get_control_name(store_name).c_str(), O_RDONLY, 0);
+        if (fd >= 0) {
+            void *data = mmap(nullptr, sizeof(ShmControl), PROT_READ, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED) {
+                uint64_t version = static_cast<ShmControl*>(data)->_version.load(std::memory_order_acquire);
+                shm_unlink(get_segment_name(store_name, version).c_str());
+                munmap(data, sizeof(ShmControl));
+            }
+            close(fd);
+        }
+        shm_unlink(get_control_name(store_name).c_str());
+    }
+
+private:
+    struct Table {
+        std::string     _name;
+        ShmTableType    _type;
+        HashItems       _hash_items;
+        ArrayItems      _array_items;
+    };
+
+    static uint64_t align(const uint64_t size) {
+        return (size + SHM_VALUE_ALIGN - 1) / SHM_VALUE_ALIGN * SHM_VALUE_ALIGN;
+    }
+
+    bool check_name(const std::string &table_name) const {
+        if (table_name.empty() || static_cast<int64_t>(table_name.size()) >= SHM_TABLE_NAME_SIZE) {
+            ERR_LOG << "invalid shm table name : " << table_name << std::endl;
+            return false;
+        }
+        for (auto &table : _tables) {
+            if (table._name == table_name) {
+                ERR_LOG << "duplicated shm table name : " << table_name << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static uint64_t get_slot_num(const uint64_t key_num) {
+        uint64_t slot_num = 2;
+        while (slot_num < key_num * 2) {
+            slot_num <<= 1;
+        }
+        return slot_num;
+    }
+
+    /* create the control segment at the first publish. */
+    static ShmControl* open_control(const std::string &store_name) {
+        int fd = shm_open(get_control_name(store_name).c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0 || ftruncate(fd, sizeof(ShmControl)) != 0) {
+            ERR_LOG << "open shm control failed : " << store_name << ", " << strerror(errno) << std::endl;
+            if (fd >= 0) {
+                close(fd);
+            }
+            return nullptr;
+        }
+        void *data = mmap(nullptr, sizeof(ShmControl), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            return nullptr;
+        }
+        //a new control segment is zero filled, version 0 means nothing published
+        ShmControl *control = static_cast<ShmControl*>(data);
+        control->_magic = SHM_STORE_MAGIC;
+        return control;
+    }
+
+    /* size every part, then write them in place. */
+    bool write_segment(const std::string &store_name, const uint64_t version) {
+        uint64_t offset = align(sizeof(ShmHeader));
+        uint64_t table_offset = offset;
+        offset += align(sizeof(ShmTableEntry) * _tables.size());
+        std::vector<ShmTableEntry> entries(_tables.size());
+        for (size_t i = 0; i < _tables.size(); ++i) {
+            Table &table = _tables[i];
+            ShmTableEntry &entry = entries[i];
+            memset(&entry, 0, sizeof(entry));
+            strncpy(entry._name, table._name.c_str(), SHM_TABLE_NAME_SIZE - 1);
+            entry._type = table._type;
+            entry._value_num = table._type == SHM_HASH_TABLE ? table._hash_items.size() : table._array_items.size();
+            if (table._type == SHM_HASH_TABLE) {
+                entry._slot_num = get_slot_num(entry._value_num);
+                entry._slot_offset = offset;
+                offset += align(sizeof(ShmSlot) * entry._slot_num);
+            }
+            entry._value_offset = offset;
+            offset += align(sizeof(ShmValueRef) * entry._value_num);
+            for (uint64_t j = 0; j < entry._value_num; ++j) {
+                offset += align(get_value(table, j).size());
+            }
+        }
+        uint64_t total_size = offset;
+
+        std::string segment_name = get_segment_name(store_name, version);
+        shm_unlink(segment_name.c_str());
+        int fd = shm_open(segment_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0 || ftruncate(fd, total_size) != 0) {
+            ERR_LOG << "create shm segment failed : " << segment_name << ", " << strerror(errno) << std::endl;
+            if (fd >= 0) {
+                close(fd);
+                shm_unlink(segment_name.c_str());
+            }
+            return false;
+        }
+        void *data = mmap(nullptr, total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            shm_unlink(segment_name.c_str());
+            return false;
+        }
+        char *base = static_cast<char*>(data);
+        ShmHeader *header = reinterpret_cast<ShmHeader*>(base);
+        header->_magic = SHM_STORE_MAGIC;
+        header->_format_version = SHM_STORE_FORMAT_VERSION;
+        header->_table_num = _tables.size();
+        header->_total_size = total_size;
+        header->_version = version;
+        header->_table_offset = table_offset;
+        if (!entries.empty()) {
+            memcpy(base + table_offset, entries.data(), sizeof(ShmTableEntry) * entries.size());
+        }
+
+        bool ok = true;
+        for (size_t i = 0; i < _tables.size() && ok; ++i) {
+            ok = write_table(_tables[i], entries[i], base);
+        }
+        munmap(data, total_size);
+        if (!ok) {
+            shm_unlink(segment_name.c_str());
+        }
+        return ok;
+    }
+
+    static const std::string& get_value(const Table &table, const uint64_t index) {
+        return table._type == SHM_HASH_TABLE ? table._hash_items[index].second : table._array_items[index];
+    }
+
+    /* values follow the refs of the table, slots point to the refs. */
+    static bool write_table(const Table &table, const ShmTableEntry &entry, char *base) {
+        ShmValueRef *refs = reinterpret_cast<ShmValueRef*>(base + entry._value_offset);
+        uint64_t offset = entry._value_offset + align(sizeof(ShmValueRef) * entry._value_num);
+        for (uint64_t i = 0; i < entry._value_num; ++i) {
+            const std::string &value = get_value(table, i);
+            refs[i]._offset = offset;
+            refs[i]._size = value.size();
+            memcpy(base + offset, value.data(), value.size());
+            offset += align(value.size());
+        }
+        if (table._type != SHM_HASH_TABLE) {
+            return true;
+        }
+        //the segment is zero filled, every slot starts empty
+        ShmSlot *slots = reinterpret_cast<ShmSlot*>(base + entry._slot_offset);
+        uint64_t mask = entry._slot_num - 1;
+        for (uint64_t i = 0; i < entry._value_num; ++i) {
+            uint64_t key = table._hash_items[i].first;
+            uint64_t slot = hash_shm_key(key) & mask;
+            while (slots[slot]._value_index != 0) {
+                if (slots[slot]._key == key) {
+                    ERR_LOG << "duplicated shm key : " << key << ", table : " << table._name << std::endl;
+                    return false;
+                }
+                slot = (slot + 1) & mask;
+            }
+            slots[slot]._key = key;
+            slots[slot]._value_index = i + 1;
+        }
+        return true;
+    }
+
+    std::vector<Table> _tables;
+};
+
+/**
+ * @class ShmStore.
+ * reader of a store, every process maps the same read only pages.
+ * refresh() remaps when the builder has flipped the version, a segment pinned by
+ * get_segment() stays mapped until released, so a request reads one version.
+ * e.g.:
+ * ShmStore store;
+ * store.open("item_dict");
+ * ShmSegmentPtr segment = store.get_segment();
+ * ShmValue feature = segment->get_hash_table("item_feature").find(item_id);
+ **/
+class ShmStore {
+public:
+    /* ctor. */
+    ShmStore() = default;
+
+    /* dtor. */
+    ~ShmStore() {
+        if (_control != nullptr) {
+            munmap(const_cast<ShmControl*>(_control), sizeof(ShmControl));
+        }
+    }
+
+    /**
+    * attach to a store and map the live version.
+    * @param store_name
+    * @return false if nothing is published
+    */
+    bool open(const std::string &store_name) {
+        std::lock_guard<std::mutex> lock(_lock);
+        if (_control != nullptr) {
+            return false;
+        }
+        int fd = shm_open(get_control_name(store_name).c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            ERR_LOG << "shm store not exist : " << store_name << std::endl;
+            return false;
+        }
+        void *data = mmap(nullptr, sizeof(ShmControl), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        _control = static_cast<const ShmControl*>(data);
+        _store_name = store_name;
+        return refresh_locked() && _segment != nullptr;
+    }
+
+    /**
+    * map the live version if it changed, cheap when it did not.
+    * @return false if the new version can not be mapped, the current one is kept
+    */
+    bool refresh() {
+        if (_control == nullptr) {
+            return false;
+        }
+        if (_control->_version.load(std::memory_order_acquire) == _version.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(_lock);
+        return refresh_locked();
+    }
+
+    /* pinned live segment, nullptr if not opened. */
+    ShmSegmentPtr get_segment() const {
+        return std::atomic_load(&_segment);
+    }
+
+    /* mapped version. */
+    uint64_t get_version() const {
+        return _version.load(std::memory_order_relaxed);
+    }
+
+private:
+    /* none copy. */
+    ShmStore(const ShmStore &rhs) = delete;
+    ShmStore &operator=(const ShmStore &rhs) = delete;
+
+    bool refresh_locked() {
+        //the segment of a version read here may be unlinked by a newer publish, read again
+        for (int retry = 0; retry < 3; ++retry) {
+            uint64_t version = _control->_version.load(std::memory_order_acquire);
+            if (version == _version.load(std::memory_order_relaxed)) {
+                return true;
+            }
+            if (version == INVALID_SHM_VERSION) {
+                return false;
+            }
+            ShmSegmentPtr segment = ShmSegment::open(_store_name, version);
+            if (segment) {
+                std::atomic_store(&_segment, segment);
+                _version.store(version, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        ERR_LOG << "map shm store failed, keep version " << get_version() << " : " << _store_name << std::endl;
+        return false;
+    }
+
+    std::mutex              _lock;
+    std::string             _store_name;
+    const ShmControl        *_control{nullptr};
+    ShmSegmentPtr           _segment;
+    std::atomic<uint64_t>   _version{INVALID_SHM_VERSION};
+};
+
+} // end namespace shm
+} // end namespace inf
@@ -0,0 +1,105 @@
+#include "frame/arena.h"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * benchmark a request building candidate items with new/delete vs a pooled Arena.
+ * every worker runs REQUEST_NUM requests, each creates ITEM_NUM_PER_REQUEST items
+ * and frees them all at the end, the per request latency is recorded.
+ */
+const int64_t REQUEST_NUM = 2000;
+const int64_t ITEM_NUM_PER_REQUEST = 2000;
+
+using Clock = std::chrono::steady_clock;
+
+/* candidate item of a request. */
+struct Item {
+    int64_t     item_id;
+    double      score;
+    std::string reason;
+
+    Item(const int64_t id, const double s) : item_id(id), score(s) {}
+};
+
+struct BenchResult {
+    double  requests;
+    int64_t p50_ns;
+    int64_t p99_ns;
+};
+
+int64_t heap_request() {
+    std::vector<std::unique_ptr<Item>> items;
+    items.reserve(ITEM_NUM_PER_REQUEST);
+    for (int64_t i = 0; i < ITEM_NUM_PER_REQUEST; ++i) {
+        items.emplace_back(new Item(i, i * 0.5));
+    }
+    return items.back()->item_id;
+}
+
+int64_t arena_request() {
+    auto arena = ::inf::frame::ArenaPool::acquire();
+    ::inf::frame::ArenaAllocator<Item*> allocator(arena.get());
+    std::vector<Item*, ::inf::frame::ArenaAllocator<Item*>> items(allocator);
+    items.reserve(ITEM_NUM_PER_REQUEST);
+    for (int64_t i = 0; i < ITEM_NUM_PER_REQUEST; ++i) {
+        items.push_back(arena->create<Item>(i, i * 0.5));
+    }
+    return items.back()->item_id;
+}
+
+template <typename RequestFunc>
+BenchResult bench(const int thread_num, RequestFunc request) {
+    std::vector<std::vector<int64_t>> latencies(thread_num);
+    std::atomic<int64_t> checksum{0};
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int i = 0; i < thread_num; ++i) {
+        threads.emplace_back([&, i]() {
+            auto &latency = latencies[i];
+            latency.reserve(REQUEST_NUM);
+            int64_t sum = 0;
+            for (int64_t j = 0; j < REQUEST_NUM; ++j) {
+                auto request_start = Clock::now();
+                sum += request();
+                latency.push_back((Clock::now() - request_start).count());
+            }
+            checksum += sum;
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double cost_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<int64_t> all;
+    for (auto &latency : latencies) {
+        all.insert(all.end(), latency.begin(), latency.end());
+    }
+    std::sort(all.begin(), all.end());
+    BenchResult result;
+    result.requests = REQUEST_NUM * thread_num / cost_s;
+    result.p50_ns = all[all.size() / 2];
+    result.p99_ns = all[all.size() * 99 / 100];
+    return result;
+}
+
+int main() {
+    printf("%-8s %-8s %14s %12s %12s\n", "threads", "alloc", "requests/s", "p50(ns)", "p99(ns)");
+    for (int thread_num = 1; thread_num <= 16; thread_num *= 4) {
+        BenchResult heap_result = bench(thread_num, heap_request);
+        BenchResult arena_result = bench(thread_num, arena_request);
+        printf("%-8d %-8s %14.0f %12ld %12ld\n", thread_num, "heap",
+                heap_result.requests, heap_result.p50_ns, heap_result.p99_ns);
+        printf("%-8d %-8s %14.0f %12ld %12ld\n", thread_num, "arena",
+                arena_result.requests, arena_result.p50_ns, arena_result.p99_ns);
+    }
+    return 0;
+}
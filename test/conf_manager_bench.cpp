@@ -0,0 +1,55 @@
+#include "frame/conf_manager.h"
+#include "yaml-cpp/yaml.h"
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * benchmark reading 3 fields of a conf on the request path, LOOKUP_NUM times on one thread:
+ * YAML::Node lookups with as<T>() vs a ConfHandle read of the compiled struct.
+ */
+const int64_t LOOKUP_NUM = 1000000;
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchConf {
+    int64_t     top_k{0};
+    double      threshold{0};
+    std::string model_name;
+
+    static void declare(::inf::utils::ConfSchema<BenchConf> &schema) {
+        schema.field("top_k", &BenchConf::top_k).required();
+        schema.field("threshold", &BenchConf::threshold);
+        schema.field("model_name", &BenchConf::model_name);
+    }
+};
+
+int main() {
+    const std::string file_name = "./conf_manager_bench.yaml";
+    std::ofstream(file_name, std::ios::trunc) << "top_k: 100\nthreshold: 0.5\nmodel_name: dnn\n";
+    YAML::Node node = YAML::LoadFile(file_name);
+    auto handle = ::inf::utils::ConfManager::get_instance().add<BenchConf>("bench", file_name, false);
+
+    int64_t yaml_sum = 0;
+    Clock::time_point begin = Clock::now();
+    for (int64_t i = 0; i < LOOKUP_NUM; ++i) {
+        yaml_sum += node["top_k"].as<int64_t>() + static_cast<int64_t>(node["threshold"].as<double>()) +
+                node["model_name"].as<std::string>().size();
+    }
+    double yaml_ns = std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / LOOKUP_NUM;
+
+    int64_t handle_sum = 0;
+    begin = Clock::now();
+    for (int64_t i = 0; i < LOOKUP_NUM; ++i) {
+        auto conf = handle.read();
+        handle_sum += conf->top_k + static_cast<int64_t>(conf->threshold) + conf->model_name.size();
+    }
+    double handle_ns = std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / LOOKUP_NUM;
+
+    printf("3 fields per request: yaml %.1f ns, conf handle %.1f ns, checksum %ld/%ld\n",
+            yaml_ns, handle_ns, static_cast<long>(yaml_sum), static_cast<long>(handle_sum));
+    std::remove(file_name.c_str());
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include "frame/double_buffer.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * benchmark the lock free DoubleData::read vs DoubleData::get_current (mutex + shared_ptr copy).
+ * every reader looks up one key per read, like TaskManager::get_task does per task,
+ * while a writer reloads the buffer every 10ms.
+ */
+const int64_t LOOKUP_NUM_PER_THREAD = 200000;
+const int64_t KEY_NUM = 128;
+const int64_t SWAP_INTERVAL_MS = 10;
+
+using Clock = std::chrono::steady_clock;
+using KeyMap = std::unordered_map<std::string, int64_t>;
+using KeyMapPtr = std::unique_ptr<KeyMap>;
+
+/* loader of the benchmark buffer. */
+class KeyMapLoader {
+public:
+    bool init(const std::string &file_name) {
+        return true;
+    }
+
+    std::string get_load_file_name() const {
+        return "";
+    }
+
+    KeyMapPtr load() {
+        KeyMapPtr key_map(new KeyMap);
+        for (int64_t i = 0; i < KEY_NUM; ++i) {
+            key_map->emplace("task_" + std::to_string(i), i);
+        }
+        return key_map;
+    }
+};
+
+using KeyMapBuffer = ::inf::utils::DoubleData<KeyMapPtr, KeyMapLoader>;
+
+struct BenchResult {
+    double  ops;
+    int64_t swap_num;
+};
+
+template <typename LookupFunc>
+BenchResult bench(KeyMapBuffer &buffer, const int thread_num, LookupFunc lookup) {
+    std::vector<std::string> keys;
+    for (int64_t i = 0; i < KEY_NUM; ++i) {
+        keys.push_back("task_" + std::to_string(i));
+    }
+    std::atomic<bool> stop{false};
+    std::atomic<int64_t> checksum{0};
+    int64_t swap_num = 0;
+    std::thread writer([&]() {
+        while (!stop) {
+            buffer.swap_data();
+            ++swap_num;
+            std::this_thread::sleep_for(std::chrono::milliseconds(SWAP_INTERVAL_MS));
+        }
+    });
+
+    std::vector<std::thread> readers;
+    auto start = Clock::now();
+    for (int i = 0; i < thread_num; ++i) {
+        readers.emplace_back([&, i]() {
+            int64_t sum = 0;
+            for (int64_t j = 0; j < LOOKUP_NUM_PER_THREAD; ++j) {
+                sum += lookup(buffer, keys[(i + j) % KEY_NUM]);
+            }
+            checksum += sum;
+        });
+    }
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    double cost_s = std::chrono::duration<double>(Clock::now() - start).count();
+    stop = true;
+    writer.join();
+
+    BenchResult result;
+    result.ops = LOOKUP_NUM_PER_THREAD * thread_num / cost_s;
+    result.swap_num = swap_num;
+    return result;
+}
+
+int main() {
+    KeyMapBuffer buffer(std::unique_ptr<KeyMapLoader>(new KeyMapLoader));
+    buffer.init();
+
+    auto locked_lookup = [](KeyMapBuffer &buffer, const std::string &key) -> int64_t {
+        auto key_map = buffer.get_current();
+        return (*key_map)->find(key)->second;
+    };
+    auto lock_free_lookup = [](KeyMapBuffer &buffer, const std::string &key) -> int64_t {
+        auto key_map = buffer.read();
+        return (*key_map)->find(key)->second;
+    };
+
+    printf("%-8s %-12s %14s %8s\n", "readers", "read path", "lookups/s", "swaps");
+    for (int thread_num = 1; thread_num <= 64; thread_num *= 4) {
+        BenchResult locked_result = bench(buffer, thread_num, locked_lookup);
+        BenchResult lock_free_result = bench(buffer, thread_num, lock_free_lookup);
+        printf("%-8d %-12s %14.0f %8ld\n", thread_num, "get_current",
+                locked_result.ops, locked_result.swap_num);
+        printf("%-8d %-12s %14.0f %8ld\n", thread_num, "read",
+                lock_free_result.ops, lock_free_result.swap_num);
+    }
+    return 0;
+}
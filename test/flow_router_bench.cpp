@@ -0,0 +1,79 @@
+#include "frame/flow_router.h"
+#include "yaml-cpp/yaml.h"
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * benchmark FlowRouter::route: a scene with LAYER_NUM layers, each layer has
+ * FLOW_NUM_PER_LAYER exclusive experiments and a white list of WHITE_LIST_SIZE guids.
+ * GUID_NUM distinct guids are routed ROUND_NUM times on one thread.
+ */
+const int64_t LAYER_NUM = 8;
+const int64_t FLOW_NUM_PER_LAYER = 50;
+const int64_t WHITE_LIST_SIZE = 1000;
+const int64_t GUID_NUM = 100000;
+const int64_t ROUND_NUM = 20;
+
+using Clock = std::chrono::steady_clock;
+
+YAML::Node build_conf() {
+    YAML::Node scene;
+    scene["scene_name"] = "feed";
+    scene["scheduler_name"] = "base";
+    int64_t bucket_num = ::inf::frame::FLOW_BUCKET_NUM / FLOW_NUM_PER_LAYER;
+    for (int64_t i = 0; i < LAYER_NUM; ++i) {
+        YAML::Node layer;
+        layer["layer_name"] = "layer_" + std::to_string(i);
+        layer["divider_type"] = i == 0 ? ::inf::frame::TAIL_DIVIDER : ::inf::frame::RANDOM_DIVIDER;
+        for (int64_t j = 0; j < FLOW_NUM_PER_LAYER; ++j) {
+            YAML::Node flow;
+            flow["flow_id"] = i * 1000 + j;
+            flow["scheduler_name"] = "exp_" + std::to_string(i * 1000 + j);
+            flow["buckets"].push_back(j * bucket_num);
+            flow["buckets"].push_back((j + 1) * bucket_num);
+            for (int64_t k = j; k < WHITE_LIST_SIZE; k += FLOW_NUM_PER_LAYER) {
+                flow["white_list"].push_back("white_" + std::to_string(i) + "_" + std::to_string(k));
+            }
+            layer["flows"].push_back(flow);
+        }
+        scene["layers"].push_back(layer);
+    }
+    YAML::Node platform;
+    platform["platform"] = "rec";
+    platform["scenes"].push_back(scene);
+    YAML::Node conf;
+    conf.push_back(platform);
+    return conf;
+}
+
+int main() {
+    ::inf::frame::FlowRouter router;
+    if (!router.init(build_conf())) {
+        printf("init failed\n");
+        return 1;
+    }
+    std::vector<std::string> guids;
+    for (int64_t i = 0; i < GUID_NUM; ++i) {
+        guids.push_back("guid_" + std::to_string(i * 7919));
+    }
+    const std::string platform = "rec";
+    const std::string scene = "feed";
+
+    ::inf::frame::FlowRoute route;
+    int64_t checksum = 0;
+    auto start = Clock::now();
+    for (int64_t round = 0; round < ROUND_NUM; ++round) {
+        for (auto &guid : guids) {
+            router.route(platform, scene, guid, &route);
+            checksum += route._flow_ids[LAYER_NUM - 1];
+        }
+    }
+    double cost_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    printf("%-8s %-8s %12s %12s\n", "layers", "flows", "ns/route", "checksum");
+    printf("%-8ld %-8ld %12.1f %12ld\n", LAYER_NUM, LAYER_NUM * FLOW_NUM_PER_LAYER,
+            cost_ns / (GUID_NUM * ROUND_NUM), checksum);
+    return 0;
+}
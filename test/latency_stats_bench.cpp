@@ -0,0 +1,51 @@
+#include "frame/latency_stats.h"
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * benchmark the cost of timing one task: two steady_clock reads plus
+ * LatencyStats::record, every thread records RECORD_NUM times over STAT_NUM aliases.
+ * ns/record is the latency seen by one thread, it grows once threads exceed the cores.
+ */
+const int64_t RECORD_NUM = 2000000;
+const int64_t STAT_NUM = 64;
+
+using Clock = std::chrono::steady_clock;
+
+double bench(const int thread_num, const std::vector<int64_t> &stat_ids) {
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int i = 0; i < thread_num; ++i) {
+        threads.emplace_back([&stat_ids, i]() {
+            for (int64_t j = 0; j < RECORD_NUM; ++j) {
+                ::inf::frame::LatencyRecorder recorder(stat_ids[(i + j) % STAT_NUM]);
+                recorder.done(true);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double cost_s = std::chrono::duration<double>(Clock::now() - start).count();
+    return RECORD_NUM * thread_num / cost_s;
+}
+
+int main() {
+    std::vector<int64_t> stat_ids;
+    for (int64_t i = 0; i < STAT_NUM; ++i) {
+        stat_ids.push_back(::inf::frame::LatencyStats::instance().register_stat(
+                "task.bench_" + std::to_string(i)));
+    }
+
+    printf("%-8s %16s %16s\n", "threads", "records/s", "ns/record");
+    for (int thread_num = 1; thread_num <= 16; thread_num *= 4) {
+        double records = bench(thread_num, stat_ids);
+        printf("%-8d %16.0f %16.1f\n", thread_num, records, 1e9 * thread_num / records);
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "frame/mmap_snapshot.h"
+#include "yaml-cpp/yaml.h"
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * benchmark a reload of a KEY_NUM entries uint64 -> string dictionary:
+ * parsing it from yaml into an unordered_map vs mapping and validating an mmap snapshot,
+ * then LOOKUP_NUM lookups on each.
+ */
+const int64_t KEY_NUM = 200000;
+const int64_t LOOKUP_NUM = 2000000;
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(const Clock::time_point &begin) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+}
+
+int main() {
+    const std::string yaml_file = "./mmap_snapshot_bench.yaml";
+    const std::string snapshot_file = "./mmap_snapshot_bench.bin";
+    std::vector<std::pair<uint64_t, std::string>> items;
+    {
+        std::ofstream output(yaml_file, std::ios::trunc);
+        for (int64_t i = 0; i < KEY_NUM; ++i) {
+            items.emplace_back(i * 7919, "value_of_item_" + std::to_string(i));
+            output << items.back().first << ": " << items.back().second << "\n";
+        }
+    }
+    ::inf::utils::MmapSnapshotBuilder builder;
+    builder.add_dict("dict", items);
+    builder.write(snapshot_file, 1);
+
+    Clock::time_point begin = Clock::now();
+    std::unordered_map<uint64_t, std::string> yaml_dict;
+    for (auto iter : YAML::LoadFile(yaml_file)) {
+        yaml_dict.emplace(iter.first.as<uint64_t>(), iter.second.as<std::string>());
+    }
+    double yaml_ms = elapsed_ms(begin);
+
+    begin = Clock::now();
+    ::inf::utils::MmapLoader loader;
+    loader.init(snapshot_file);
+    ::inf::utils::MmapSnapshot snapshot = loader.load();
+    ::inf::utils::MmapDict dict = snapshot.get_dict("dict");
+    double mmap_ms = elapsed_ms(begin);
+
+    size_t yaml_size = 0;
+    begin = Clock::now();
+    for (int64_t i = 0; i < LOOKUP_NUM; ++i) {
+        auto iter = yaml_dict.find((i * 31 % KEY_NUM) * 7919);
+        yaml_size += iter == yaml_dict.end() ? 0 : iter->second.size();
+    }
+    double yaml_lookup_ns = elapsed_ms(begin) * 1e6 / LOOKUP_NUM;
+
+    size_t mmap_size = 0;
+    begin = Clock::now();
+    for (int64_t i = 0; i < LOOKUP_NUM; ++i) {
+        std::string_view value;
+        mmap_size += dict.find((i * 31 % KEY_NUM) * 7919, &value) ? value.size() : 0;
+    }
+    double mmap_lookup_ns = elapsed_ms(begin) * 1e6 / LOOKUP_NUM;
+
+    printf("reload %ld keys: yaml parse %.1f ms, mmap + validate %.1f ms (%lu bytes)\n",
+            static_cast<long>(KEY_NUM), yaml_ms, mmap_ms, static_cast<unsigned long>(snapshot.get_size()));
+    printf("lookup: unordered_map %.1f ns, mmap dict %.1f ns, checksum %lu/%lu\n",
+            yaml_lookup_ns, mmap_lookup_ns, static_cast<unsigned long>(yaml_size),
+            static_cast<unsigned long>(mmap_size));
+    std::remove(yaml_file.c_str());
+    std::remove(snapshot_file.c_str());
+    return 0;
+}
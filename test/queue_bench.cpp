@@ -0,0 +1,110 @@
+#include "frame/blocking_queue.h"
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * benchmark the lock-free BlockingQueue vs a std::queue + mutex + condvar queue
+ * (the previous BlockingQueue/TaskQueue design).
+ * every item carries its enqueue time, consumers record the handoff latency.
+ */
+const int64_t ITEM_NUM_PER_PRODUCER = 200000;
+const int64_t QUEUE_CAPACITY = 4096;
+
+using Clock = std::chrono::steady_clock;
+
+/* previous design, kept here as baseline. */
+template <typename DataType>
+class MutexQueue {
+public:
+    int enqueue(DataType &&data) {
+        std::unique_lock<std::mutex> lock(_lock);
+        _task_queue.push(std::move(data));
+        _cond.notify_one();
+        return 0;
+    }
+
+    DataType get_data() {
+        std::unique_lock<std::mutex> lock(_lock);
+        _cond.wait(lock, [this]() { return !_task_queue.empty(); });
+        DataType result = std::move(_task_queue.front());
+        _task_queue.pop();
+        return result;
+    }
+
+private:
+    std::queue<DataType>        _task_queue;
+    std::mutex                  _lock;
+    std::condition_variable     _cond;
+};
+
+struct BenchResult {
+    double  ops;
+    int64_t p50_ns;
+    int64_t p99_ns;
+};
+
+template <typename QueueType>
+BenchResult bench(QueueType &queue, const int producer_num, const int consumer_num) {
+    const int64_t total = ITEM_NUM_PER_PRODUCER * producer_num;
+    std::atomic<int64_t> consumed{0};
+    std::vector<std::vector<int64_t>> latencies(consumer_num);
+    std::vector<std::thread> threads;
+
+    auto start = Clock::now();
+    for (int i = 0; i < consumer_num; ++i) {
+        threads.emplace_back([&, i]() {
+            auto &latency = latencies[i];
+            latency.reserve(total / consumer_num + 1);
+            while (consumed.fetch_add(1) < total) {
+                int64_t stamp = queue.get_data();
+                latency.push_back(Clock::now().time_since_epoch().count() - stamp);
+            }
+        });
+    }
+    for (int i = 0; i < producer_num; ++i) {
+        threads.emplace_back([&]() {
+            for (int64_t j = 0; j < ITEM_NUM_PER_PRODUCER; ++j) {
+                queue.enqueue(static_cast<int64_t>(Clock::now().time_since_epoch().count()));
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double cost_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<int64_t> all;
+    for (auto &latency : latencies) {
+        all.insert(all.end(), latency.begin(), latency.end());
+    }
+    std::sort(all.begin(), all.end());
+    BenchResult result;
+    result.ops = total / cost_s;
+    result.p50_ns = all[all.size() / 2];
+    result.p99_ns = all[all.size() * 99 / 100];
+    return result;
+}
+
+int main() {
+    printf("%-10s %-10s %14s %12s %12s\n", "prod/cons", "queue", "ops/s", "p50(ns)", "p99(ns)");
+    for (int thread_num = 1; thread_num <= 8; thread_num *= 2) {
+        MutexQueue<int64_t> mutex_queue;
+        BenchResult mutex_result = bench(mutex_queue, thread_num, thread_num);
+        ::inf::frame::BlockingQueue<int64_t> mpmc_queue(QUEUE_CAPACITY);
+        BenchResult mpmc_result = bench(mpmc_queue, thread_num, thread_num);
+        printf("%4d/%-5d %-10s %14.0f %12ld %12ld\n", thread_num, thread_num, "mutex",
+                mutex_result.ops, mutex_result.p50_ns, mutex_result.p99_ns);
+        printf("%4d/%-5d %-10s %14.0f %12ld %12ld\n", thread_num, thread_num, "mpmc",
+                mpmc_result.ops, mpmc_result.p50_ns, mpmc_result.p99_ns);
+    }
+    return 0;
+}
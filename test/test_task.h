@@ -1,5 +1,14 @@
 #pragma once
 #include "../frame/task.h"
+#include "../frame/task_registry.h"
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <map>
+#include <functional>
+#include <condition_variable>
+#include <stdexcept>
 
 /* task used for unittask. */
 class RecallTask : public ::inf::frame::UnitTask {
@@ -38,3 +47,227 @@ public:
         
 };
 
+
+/* data shared by the tasks scheduled in unittest, records the finish order. */
+struct TraceData {
+    std::mutex                  lock;
+    std::vector<std::string>    trace;
+
+    void append(const std::string &alias) {
+        std::lock_guard<std::mutex> guard(lock);
+        trace.push_back(alias);
+    }
+
+    int64_t index_of(const std::string &alias) {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < trace.size(); ++i) {
+            if (trace[i] == alias) {
+                return i;
+            }
+        }
+        return -1;
+    }
+};
+
+/* task used for unittest. sleep sleep_ms then record its alias into TraceData. */
+class SleepTask : public ::inf::frame::UnitTask {
+public:
+    virtual bool run(void *data) const{
+        std::this_thread::sleep_for(std::chrono::milliseconds(_sleep_ms));
+        static_cast<TraceData*>(data)->append(_alias);
+        return !_fail;
+    }
+
+    virtual bool init(const YAML::Node &conf_info) {
+        if (!::inf::frame::UnitTask::init(conf_info)) {
+            return false;
+        }
+        _alias = conf_info["task_alias_name"].as<std::string>();
+        if (conf_info["sleep_ms"].IsDefined()) {
+            _sleep_ms = conf_info["sleep_ms"].as<int64_t>();
+        }
+        if (conf_info["fail"].IsDefined()) {
+            _fail = conf_info["fail"].as<bool>();
+        }
+        if (conf_info["init_sleep_ms"].IsDefined()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(
+                    conf_info["init_sleep_ms"].as<int64_t>()));
+        }
+        return !conf_info["init_fail"].IsDefined() || !conf_info["init_fail"].as<bool>();
+    }
+
+private:
+    std::string _alias;
+    int64_t     _sleep_ms{0};
+    bool        _fail{false};
+};
+
+/* simulated I/O for unittest, one thread calls back each request after its delay. */
+class IoTimer {
+public:
+    static IoTimer& instance() {
+        static IoTimer *instance = new IoTimer();
+        return *instance;
+    }
+
+    void call_after(const int64_t delay_ms, std::function<void()> callback) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _timers.emplace(std::chrono::steady_clock::now() + std::chrono::milliseconds(delay_ms),
+                std::move(callback));
+        _cond.notify_one();
+    }
+
+private:
+    IoTimer() {
+        std::thread([this]() { run(); }).detach();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> guard(_lock);
+        while (true) {
+            if (_timers.empty()) {
+                _cond.wait(guard);
+                continue;
+            }
+            auto first = _timers.begin();
+            if (first->first > std::chrono::steady_clock::now()) {
+                _cond.wait_until(guard, first->first);
+                continue;
+            }
+            std::function<void()> callback = std::move(first->second);
+            _timers.erase(first);
+            guard.unlock();
+            callback();
+            guard.lock();
+        }
+    }
+
+    std::mutex                                                              _lock;
+    std::condition_variable                                                 _cond;
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> _timers;
+};
+
+/* async task used for unittest. waits io_ms on the IoTimer without a thread, then records its alias. */
+class AsyncSleepTask : public ::inf::frame::AsyncTask {
+public:
+    virtual void run_async(void *data, ::inf::frame::TaskDone done) const {
+        std::string alias = _alias;
+        bool fail = _fail;
+        IoTimer::instance().call_after(_io_ms, [data, done, alias, fail]() {
+            static_cast<TraceData*>(data)->append(alias);
+            done(!fail);
+        });
+    }
+
+    virtual bool init(const YAML::Node &conf_info) {
+        if (!::inf::frame::AsyncTask::init(conf_info)) {
+            return false;
+        }
+        _alias = conf_info["task_alias_name"].as<std::string>();
+        if (conf_info["io_ms"].IsDefined()) {
+            _io_ms = conf_info["io_ms"].as<int64_t>();
+        }
+        if (conf_info["fail"].IsDefined()) {
+            _fail = conf_info["fail"].as<bool>();
+        }
+        return true;
+    }
+
+private:
+    std::string _alias;
+    int64_t     _io_ms{0};
+    bool        _fail{false};
+};
+
+REGISTER_TASK(sleep_task, SleepTask);
+REGISTER_TASK(async_sleep_task, AsyncSleepTask);
+
+/* creator used for unittest, create test tasks by task_name. */
+class TestTaskCreator {
+public:
+    ::inf::frame::TaskPtr create(const YAML::Node &conf) const {
+        return ::inf::frame::TaskRegistry::instance().create(conf["task_name"].as<std::string>());
+    }
+};
+
+/* buffer used for unittest, counts the living generations. */
+struct Generation {
+    static std::atomic<int64_t> live_num;
+    int64_t version{0};
+
+    explicit Generation(const int64_t v = 0) : version(v) {
+        ++live_num;
+    }
+
+    ~Generation() {
+        version = -1;
+        --live_num;
+    }
+};
+std::atomic<int64_t> Generation::live_num{0};
+
+/* bytes of a Generation held by DoubleData, found by ADL. */
+inline int64_t get_buffer_bytes(const Generation &) {
+    return sizeof(Generation);
+}
+
+/* loader used for unittest, every load returns a newer generation. */
+class GenerationLoader {
+public:
+    bool init(const std::string &file_name) {
+        return true;
+    }
+
+    std::string get_load_file_name() const {
+        return "";
+    }
+
+    std::unique_ptr<Generation> load() {
+        return std::unique_ptr<Generation>(new Generation(++_version));
+    }
+
+private:
+    int64_t _version{0};
+};
+
+/* loader used for unittest, scripted to block, fail or return nullptr. */
+class ScriptedLoader {
+public:
+    enum LoadMode {
+        LOAD_OK     = 0,
+        LOAD_NULL   = 1,
+        LOAD_THROW  = 2,
+    };
+
+    bool init(const std::string &file_name) {
+        _file_name = file_name;
+        return true;
+    }
+
+    std::string get_load_file_name() const {
+        return _file_name;
+    }
+
+    std::shared_ptr<Generation> load() {
+        _loading = true;
+        while (_blocked) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        _loading = false;
+        if (_mode == LOAD_THROW) {
+            throw std::runtime_error("scripted failure");
+        }
+        if (_mode == LOAD_NULL) {
+            return nullptr;
+        }
+        return std::make_shared<Generation>(++_version);
+    }
+
+    std::atomic<int>    _mode{LOAD_OK};
+    std::atomic<bool>   _blocked{false};
+    std::atomic<bool>   _loading{false};
+
+private:
+    std::string         _file_name;
+    int64_t             _version{0};
+};
@@ -0,0 +1,94 @@
+#include "frame/thread_pool.h"
+#include "frame/work_stealing_thread_pool.h"
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * benchmark ThreadPool vs WorkStealingThreadPool.
+ * submit : one outside thread submits tiny tasks.
+ * fanout : each root task submits children from inside the pool, like a
+ *          request fanning out recall sub-tasks.
+ */
+const int64_t SUBMIT_TASK_NUM = 200000;
+const int64_t FANOUT_ROOT_NUM = 5000;
+const int64_t FANOUT_CHILD_NUM = 32;
+
+/* wait until counter reaches target. */
+void wait_done(const std::atomic<int64_t> &counter, const int64_t target) {
+    while (counter.load(std::memory_order_acquire) < target) {
+        std::this_thread::yield();
+    }
+}
+
+/* tiny cpu work. */
+int64_t spin_work(const int64_t seed) {
+    int64_t value = seed;
+    for (int64_t i = 0; i < 64; ++i) {
+        value = value * 6364136223846793005LL + 1442695040888963407LL;
+    }
+    return value;
+}
+
+template <typename PoolType>
+double bench_submit(const int thread_num) {
+    PoolType thread_pool;
+    thread_pool.init(thread_num);
+    thread_pool.start();
+    std::atomic<int64_t> done{0};
+    std::atomic<int64_t> sink{0};
+
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < SUBMIT_TASK_NUM; ++i) {
+        thread_pool.submit([&done, &sink, i]() {
+            sink.fetch_add(spin_work(i) & 1, std::memory_order_relaxed);
+            done.fetch_add(1, std::memory_order_release);
+        });
+    }
+    wait_done(done, SUBMIT_TASK_NUM);
+    double cost_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    thread_pool.stop();
+    return SUBMIT_TASK_NUM / cost_s;
+}
+
+template <typename PoolType>
+double bench_fanout(const int thread_num) {
+    PoolType thread_pool;
+    thread_pool.init(thread_num);
+    thread_pool.start();
+    std::atomic<int64_t> done{0};
+    std::atomic<int64_t> sink{0};
+
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < FANOUT_ROOT_NUM; ++i) {
+        thread_pool.submit([&thread_pool, &done, &sink, i]() {
+            for (int64_t j = 0; j < FANOUT_CHILD_NUM; ++j) {
+                thread_pool.submit([&done, &sink, i, j]() {
+                    sink.fetch_add(spin_work(i + j) & 1, std::memory_order_relaxed);
+                    done.fetch_add(1, std::memory_order_release);
+                });
+            }
+        });
+    }
+    wait_done(done, FANOUT_ROOT_NUM * FANOUT_CHILD_NUM);
+    double cost_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    thread_pool.stop();
+    return FANOUT_ROOT_NUM * FANOUT_CHILD_NUM / cost_s;
+}
+
+int main() {
+    printf("%-8s %-12s %16s %16s\n", "threads", "scenario", "ThreadPool", "WorkStealing");
+    for (int thread_num = 1; thread_num <= 64; thread_num *= 2) {
+        printf("%-8d %-12s %14.0f/s %14.0f/s\n", thread_num, "submit",
+                bench_submit<::inf::frame::ThreadPool>(thread_num),
+                bench_submit<::inf::frame::WorkStealingThreadPool>(thread_num));
+        printf("%-8d %-12s %14.0f/s %14.0f/s\n", thread_num, "fanout",
+                bench_fanout<::inf::frame::ThreadPool>(thread_num),
+                bench_fanout<::inf::frame::WorkStealingThreadPool>(thread_num));
+    }
+    return 0;
+}
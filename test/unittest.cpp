@@ -2,11 +2,26 @@
 #include "yaml-cpp/yaml.h"
 #include "frame/task_data.h"
 #include "frame/task.h"
+#include "frame/task_scheduler.h"
+#include "frame/frame_snapshot.h"
+#include "frame/work_stealing_thread_pool.h"
+#include "frame/blocking_queue.h"
+#include "frame/request_context.h"
+#include "shm_manager/shm_store.h"
+#include "frame/mmap_snapshot.h"
+#include "frame/conf_manager.h"
 #include "test_task.h"
 #include <string>
 #include <iostream>
 #include <memory>
 #include <cstdint>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <functional>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
 
 /**
  * @class FrameTest
@@ -91,6 +106,119 @@ TEST_F(TestFrame, test_TaskDataMap)  {
 
 }
 
+/* slot keys, registered before main. */
+const ::inf::frame::SlotKey<int> TEST_NUMBER_SLOT_KEY("test_number");
+const ::inf::frame::SlotKey<std::string> TEST_USER_SLOT_KEY("test_user");
+const ::inf::frame::SlotKey<std::string> TEST_USER_SLOT_KEY_AGAIN("test_user");
+const ::inf::frame::SlotKey<double> TEST_CONFLICT_SLOT_KEY("test_user");
+
+TEST_F(TestFrame, test_TaskDataSlot) {
+    ASSERT_NE(::inf::frame::INVALID_SLOT_INDEX, TEST_NUMBER_SLOT_KEY.index());
+    ASSERT_EQ(TEST_USER_SLOT_KEY.index(), TEST_USER_SLOT_KEY_AGAIN.index());
+    ASSERT_EQ(::inf::frame::INVALID_SLOT_INDEX, TEST_CONFLICT_SLOT_KEY.index());
+
+    ::inf::frame::TaskDataMap<> data_map;
+    ASSERT_EQ(nullptr, data_map.find(TEST_NUMBER_SLOT_KEY));
+    int *number = data_map.insert(TEST_NUMBER_SLOT_KEY, new int(100));
+    ASSERT_EQ(100, *number);
+    ASSERT_EQ(number, data_map.find(TEST_NUMBER_SLOT_KEY));
+    ASSERT_EQ(nullptr, data_map.insert(TEST_NUMBER_SLOT_KEY, new int(200)));
+    data_map.insert(TEST_USER_SLOT_KEY, new std::string("user"));
+    ASSERT_EQ("user", *data_map.find(TEST_USER_SLOT_KEY_AGAIN));
+    ASSERT_EQ(nullptr, data_map.insert(TEST_CONFLICT_SLOT_KEY, new double(1.0)));
+    ASSERT_TRUE(data_map.erase(TEST_NUMBER_SLOT_KEY));
+    ASSERT_FALSE(data_map.erase(TEST_NUMBER_SLOT_KEY));
+
+    // string key with a wrong type is rejected in debug build
+    std::string key = "number";
+    data_map.insert<int>(key, new int(1));
+#ifndef NDEBUG
+    ASSERT_EQ(nullptr, data_map.find<std::string>(key));
+#endif
+    ASSERT_EQ(1, *data_map.find<int>(key));
+}
+
+TEST_F(TestFrame, test_Arena) {
+    // destructors run at reset, in reverse order
+    std::vector<int> destroyed;
+    struct Tracked {
+        std::vector<int> *destroyed;
+        int id;
+        ~Tracked() { destroyed->push_back(id); }
+    };
+    ::inf::frame::Arena arena;
+    arena.create<Tracked>(Tracked{&destroyed, 1});
+    destroyed.clear();
+    arena.create<Tracked>(Tracked{&destroyed, 2});
+    destroyed.clear();
+    ::inf::frame::ArenaAllocator<int64_t> allocator(&arena);
+    std::vector<int64_t, ::inf::frame::ArenaAllocator<int64_t>> items(allocator);
+    for (int64_t i = 0; i < 10000; ++i) {
+        items.push_back(i);
+    }
+    ASSERT_GT(arena.get_block_num(), 1);
+    auto *aligned = arena.allocate(64, 64);
+    ASSERT_EQ(0, reinterpret_cast<uintptr_t>(aligned) % 64);
+    int64_t used_bytes = arena.get_used_bytes();
+    arena.reset();
+    ASSERT_EQ(std::vector<int>({2, 1}), destroyed);
+
+    // the next round fits in one block of the high-water size
+    ASSERT_EQ(used_bytes, arena.get_high_water_bytes());
+    ASSERT_EQ(0, arena.get_block_num());
+    arena.allocate(used_bytes - 64);
+    ASSERT_EQ(1, arena.get_block_num());
+
+    // per thread pool, and TaskDataMap data lives in the arena
+    {
+    auto request_arena = ::inf::frame::ArenaPool::acquire();
+    ::inf::frame::TaskDataMap<> data_map(request_arena.get());
+    std::string *user = data_map.emplace(TEST_USER_SLOT_KEY, "user");
+    ASSERT_EQ("user", *data_map.find(TEST_USER_SLOT_KEY));
+    ASSERT_EQ(nullptr, data_map.emplace(TEST_USER_SLOT_KEY, "again"));
+    ASSERT_GT(request_arena->get_used_bytes(), 0);
+    ASSERT_EQ(user, data_map.find(TEST_USER_SLOT_KEY));
+    }
+    ASSERT_EQ(1, ::inf::frame::ArenaPool::get_pooled_num());
+    auto reused_arena = ::inf::frame::ArenaPool::acquire();
+    ASSERT_EQ(0, ::inf::frame::ArenaPool::get_pooled_num());
+    ASSERT_EQ(0, reused_arena->get_used_bytes());
+}
+
+TEST_F(TestFrame, test_RequestContextPool) {
+    static const ::inf::frame::SlotKey<std::vector<int64_t>> candidate_key("test_candidate");
+    auto &pool = ::inf::frame::RequestContextPool::instance();
+    int64_t acquire_num = pool.get_acquire_num();
+    int64_t hit_num = pool.get_hit_num();
+
+    ::inf::frame::RequestContext *first_context = nullptr;
+    {
+    auto context = pool.acquire();
+    first_context = context.get();
+    auto &data_map = context->get_data_map();
+    data_map.emplace(TEST_USER_SLOT_KEY, "user");
+    std::string key = "number";
+    data_map.insert<int>(key, new int(1));
+    auto candidates = context->get_retained(candidate_key);
+    candidates->reserve(1000);
+    candidates->push_back(1);
+    }
+
+    // the same context comes back cleared, the capacity is kept
+    auto context = pool.acquire();
+    ASSERT_EQ(first_context, context.get());
+    ASSERT_EQ(nullptr, context->get_data_map().find(TEST_USER_SLOT_KEY));
+    ASSERT_EQ(nullptr, context->get_data_map().find<int>("number"));
+    auto candidates = context->get_retained(candidate_key);
+    ASSERT_TRUE(candidates->empty());
+    ASSERT_GE(candidates->capacity(), 1000);
+
+    ASSERT_EQ(acquire_num + 2, pool.get_acquire_num());
+    ASSERT_EQ(hit_num + 1, pool.get_hit_num());
+    ASSERT_GT(pool.get_hit_rate(), 0.0);
+    ASSERT_GE(pool.get_high_water_bytes(), 1000 * sizeof(int64_t));
+}
+
 TEST_F(TestFrame, test_Task) {
     const std::string task_conf = "../conf/task.yaml";
     auto conf = YAML::LoadFile(task_conf.c_str());
@@ -122,6 +250,1411 @@ TEST_F(TestFrame, test_Task) {
 
 
 
+TEST_F(TestFrame, test_TaskGraph) {
+    ::inf::frame::TaskGraph graph;
+    graph.add_node("recall", {});
+    graph.add_node("expose", {}, 5);
+    graph.add_node("rank", {"recall", "expose"});
+    graph.add_node("rerank", {"rank"});
+    ASSERT_TRUE(graph.build());
+    ASSERT_EQ(2, graph.get_roots().size());
+    ASSERT_EQ(7, graph.get_critical_path_cost());
+
+    // expose -> rank -> rerank is the heaviest path
+    std::vector<std::string> critical_path;
+    for (auto node_id : graph.get_critical_path()) {
+        critical_path.push_back(graph.get_node(node_id)._alias);
+    }
+    ASSERT_EQ(std::vector<std::string>({"expose", "rank", "rerank"}), critical_path);
+
+    // cycle
+    ::inf::frame::TaskGraph cycle_graph;
+    cycle_graph.add_node("a", {"b"});
+    cycle_graph.add_node("b", {"a"});
+    ASSERT_FALSE(cycle_graph.build());
+
+    // undeclared dependency
+    ::inf::frame::TaskGraph missing_graph;
+    missing_graph.add_node("a", {"not_exist"});
+    ASSERT_FALSE(missing_graph.build());
+}
+
+TEST_F(TestFrame, test_DagScheduler) {
+    using SchedulerManager = ::inf::frame::TaskSchedulerManager<TestTaskCreator>;
+    using TaskManager = ::inf::frame::TaskManager<TestTaskCreator>;
+    auto &snapshot_manager = ::inf::frame::FrameSnapshotManager<TestTaskCreator>::instance();
+    ASSERT_TRUE(snapshot_manager.init("../conf/task_list.yaml", "../conf/scheduler.yaml"));
+    ::inf::frame::FrameThreadPool::instance().init(4);
+    ::inf::frame::FrameThreadPool::instance().start();
+
+    // independent recalls run at the same time, dependencies are kept
+    TraceData dag_data;
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(snapshot_manager.schedule("dag_base", &dag_data));
+    auto cost_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    ASSERT_EQ(5, dag_data.trace.size());
+    ASSERT_LT(cost_ms, 100);
+    ASSERT_GT(dag_data.index_of("rank"), dag_data.index_of("recall_a"));
+    ASSERT_GT(dag_data.index_of("rank"), dag_data.index_of("recall_b"));
+    ASSERT_GT(dag_data.index_of("rank"), dag_data.index_of("user_feature"));
+    ASSERT_EQ(4, dag_data.index_of("rerank"));
+
+    // serial scheduler keeps the declared order
+    TraceData serial_data;
+    ASSERT_TRUE(snapshot_manager.schedule("serial_base", &serial_data));
+    ASSERT_EQ(std::vector<std::string>({"recall_a", "recall_b", "rank"}), serial_data.trace);
+
+    // downstream tasks are not executed after a failure
+    TraceData failure_data;
+    ASSERT_FALSE(snapshot_manager.schedule("dag_failure", &failure_data));
+    ASSERT_EQ(-1, failure_data.index_of("rank"));
+
+    // a held scheduler of TaskSchedulerManager keeps its table alive across reloads
+    ASSERT_TRUE(TaskManager::instance().init("../conf/task_list.yaml", ""));
+    ASSERT_TRUE(SchedulerManager::instance().init("../conf/scheduler.yaml", ""));
+    auto serial_scheduler = SchedulerManager::instance().get_scheduler("serial_base");
+    ASSERT_NE(nullptr, serial_scheduler);
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_TRUE(SchedulerManager::instance().init("../conf/scheduler.yaml", ""));
+    }
+    for (int i = 0; i < 100 && ::inf::utils::BufferRetirer::instance().get_pending_num() > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    TraceData held_data;
+    auto task_map = TaskManager::instance().get_task_map();
+    ASSERT_TRUE(serial_scheduler->schedule(**task_map, &held_data));
+    ASSERT_EQ(std::vector<std::string>({"recall_a", "recall_b", "rank"}), held_data.trace);
+
+    ::inf::frame::FrameThreadPool::instance().stop();
+}
+
+TEST_F(TestFrame, test_TaskPlan) {
+    using SchedulerManager = ::inf::frame::TaskSchedulerManager<TestTaskCreator>;
+    using TaskManager = ::inf::frame::TaskManager<TestTaskCreator>;
+    using ::inf::frame::TaskMap;
+    ASSERT_TRUE(TaskManager::instance().init("../conf/task_list.yaml", ""));
+    ASSERT_TRUE(SchedulerManager::instance().init("../conf/scheduler.yaml", ""));
+
+    // the plan is built by the first request of a generation and reused
+    auto serial_scheduler = SchedulerManager::instance().get_scheduler("serial_base");
+    ASSERT_NE(nullptr, serial_scheduler);
+    for (int i = 0; i < 3; ++i) {
+        TraceData data;
+        auto task_map = TaskManager::instance().get_task_map();
+        ASSERT_TRUE(serial_scheduler->schedule(**task_map, &data));
+        ASSERT_EQ(std::vector<std::string>({"recall_a", "recall_b", "rank"}), data.trace);
+    }
+    {
+        auto task_map = TaskManager::instance().get_task_map();
+        ASSERT_EQ(1, (*task_map)->get_plan_num());
+    }
+
+    // a new generation gets its own plan
+    ASSERT_TRUE(TaskManager::instance().init("../conf/task_list.yaml", ""));
+    TraceData reload_data;
+    {
+        auto task_map = TaskManager::instance().get_task_map();
+        ASSERT_TRUE(serial_scheduler->schedule(**task_map, &reload_data));
+        ASSERT_EQ(3, reload_data.trace.size());
+        ASSERT_EQ(1, (*task_map)->get_plan_num());
+    }
+
+    // a newer version replaces the plan, an older one gets no plan
+    TaskMap task_map;
+    task_map.emplace("a", std::make_shared<RecallTask>());
+    task_map.emplace("b", std::make_shared<RecallTask>());
+    int64_t plan_id = TaskMap::register_plan("test_plan");
+    ASSERT_EQ(plan_id, TaskMap::register_plan("test_plan"));
+    uint64_t old_version = TaskMap::new_plan_version();
+    uint64_t new_version = TaskMap::new_plan_version();
+    auto plan = task_map.get_plan(plan_id, old_version, {"b", "a"});
+    ASSERT_NE(nullptr, plan);
+    ASSERT_EQ(task_map["b"].get(), plan->_tasks[0]);
+    ASSERT_EQ(plan, task_map.get_plan(plan_id, old_version, {"b", "a"}));
+    auto new_plan = task_map.get_plan(plan_id, new_version, {"a", "c"});
+    ASSERT_NE(nullptr, new_plan);
+    ASSERT_TRUE(new_plan->_tasks.empty());
+    ASSERT_EQ("c", new_plan->_missing);
+    ASSERT_EQ(nullptr, task_map.get_plan(plan_id, old_version, {"b", "a"}));
+    ASSERT_EQ(2, task_map.get_plan_num());
+
+    // a replaced plan is freed once its scheduler is released
+    TaskMap::release_plan(plan_id, old_version);
+    uint64_t newest_version = TaskMap::new_plan_version();
+    ASSERT_NE(nullptr, task_map.get_plan(plan_id, newest_version, {"a", "b"}));
+    ASSERT_EQ(2, task_map.get_plan_num());
+    TaskMap::release_plan(plan_id, new_version);
+    TaskMap::release_plan(plan_id, newest_version);
+
+    // the id of a released name is reused
+    ASSERT_EQ(plan_id, TaskMap::register_plan("another_plan"));
+    TaskMap::release_plan(plan_id, 0);
+
+    // released names never run out of ids
+    for (int i = 0; i < 2 * ::inf::frame::MAX_TASK_PLAN_NUM; ++i) {
+        int64_t temp_id = TaskMap::register_plan("temp_plan_" + std::to_string(i));
+        ASSERT_NE(::inf::frame::INVALID_PLAN_ID, temp_id);
+        TaskMap::release_plan(temp_id, 0);
+    }
+}
+
+TEST_F(TestFrame, test_FrameSnapshot) {
+    using SnapshotManager = ::inf::frame::FrameSnapshotManager<TestTaskCreator>;
+    const std::string task_file = "./snapshot_task_test.yaml";
+    const std::string scheduler_file = "./snapshot_scheduler_test.yaml";
+    auto write_file = [](const std::string &file_name, const std::string &content) {
+        std::ofstream output(file_name, std::ios::trunc);
+        output << content;
+    };
+    const std::string task_conf = "- task_alias_name: recall\n  task_name: sleep_task\n"
+            "- task_alias_name: rank\n  task_name: sleep_task\n";
+    const std::string scheduler_conf = "- scheduler_name: rec\n  skip_failure: 0\n  tasks:\n"
+            "      - task_alias_name: recall\n      - task_alias_name: rank\n";
+    write_file(task_file, task_conf);
+    write_file(scheduler_file, scheduler_conf);
+
+    auto &manager = SnapshotManager::instance();
+    ASSERT_TRUE(manager.init(task_file, scheduler_file));
+    ASSERT_EQ(1, manager.get_version());
+    TraceData data;
+    ASSERT_TRUE(manager.schedule("rec", &data));
+    ASSERT_EQ(std::vector<std::string>({"recall", "rank"}), data.trace);
+    ASSERT_FALSE(manager.schedule("not_exist", &data));
+
+    // the scheduler is deployed before its task, rejected as a whole
+    auto pinned = manager.get_shared();
+    int64_t rejected_num = manager.get_rejected_num();
+    write_file(scheduler_file, scheduler_conf + "      - task_alias_name: rerank\n");
+    ASSERT_FALSE(manager.reload());
+    ASSERT_EQ(rejected_num + 1, manager.get_rejected_num());
+    ASSERT_EQ(1, manager.get_version());
+    TraceData kept_data;
+    ASSERT_TRUE(manager.schedule("rec", &kept_data));
+    ASSERT_EQ(2, kept_data.trace.size());
+
+    // the task arrives, both are published together
+    write_file(task_file, task_conf + "- task_alias_name: rerank\n  task_name: sleep_task\n");
+    ASSERT_TRUE(manager.reload());
+    ASSERT_EQ(2, manager.get_version());
+    TraceData new_data;
+    ASSERT_TRUE(manager.schedule("rec", &new_data));
+    ASSERT_EQ(std::vector<std::string>({"recall", "rank", "rerank"}), new_data.trace);
+    {
+        auto snapshot = manager.read();
+        ASSERT_EQ(1, (*snapshot)->get_task_map().get_plan_num());
+    }
+
+    // a pinned request keeps its generation
+    ASSERT_EQ(1, (*pinned)->get_version());
+    TraceData pinned_data;
+    ASSERT_TRUE((*pinned)->get_scheduler("rec")->schedule((*pinned)->get_task_map(), &pinned_data));
+    ASSERT_EQ(2, pinned_data.trace.size());
+
+    // async requests pin the snapshot until done
+    std::promise<bool> result;
+    TraceData async_data;
+    manager.schedule_async("rec", &async_data, [&result](bool ok) { result.set_value(ok); });
+    ASSERT_TRUE(result.get_future().get());
+    ASSERT_EQ(3, async_data.trace.size());
+
+    // watched files are reloaded on the reloader thread, not on the watcher
+    ASSERT_TRUE(manager.init(task_file, scheduler_file, "", true));
+    ASSERT_EQ(1, manager.get_version());
+    write_file(task_file, task_conf + "- task_alias_name: rerank\n  task_name: sleep_task\n"
+            "- task_alias_name: extra\n  task_name: sleep_task\n");
+    for (int i = 0; i < 200 && manager.get_version() != 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(2, manager.get_version());
+    ASSERT_TRUE(manager.init(task_file, scheduler_file));
+    std::remove(task_file.c_str());
+    std::remove(scheduler_file.c_str());
+}
+
+TEST_F(TestFrame, test_FlowRouter) {
+    using ::inf::frame::FlowRouter;
+    using ::inf::frame::FlowRoute;
+    FlowRouter router;
+    ASSERT_TRUE(router.init(YAML::LoadFile("../conf/flow.yaml")));
+    FlowRoute route;
+    ASSERT_FALSE(router.route("rec_for_video", "not_exist", "guid", &route));
+
+    // white lists first, the first layer with a scheduler decides
+    ASSERT_TRUE(router.route("rec_for_video", "feed", "vip_guid", &route));
+    ASSERT_EQ(4, route._layer_num);
+    ASSERT_EQ(301, route._flow_ids[0]);
+    ASSERT_EQ("group_base", *route._scheduler_name);
+    ASSERT_TRUE(router.route("rec_for_video", "feed", "white_guid", &route));
+    ASSERT_EQ(::inf::frame::INVALID_FLOW_ID, route._flow_ids[0]);
+    ASSERT_EQ(101, route._flow_ids[1]);
+    ASSERT_EQ("dag_base", *route._scheduler_name);
+
+    // tail layer by the last digits
+    ASSERT_TRUE(router.route("rec_for_video", "feed", "user_1237", &route));
+    ASSERT_EQ(201, route._flow_ids[2]);
+    ASSERT_TRUE(router.route("rec_for_video", "feed", "user_3", &route));
+    ASSERT_EQ(202, route._flow_ids[2]);
+    ASSERT_TRUE(router.route("rec_for_video", "detail", "user_3", &route));
+    ASSERT_EQ(0, route._layer_num);
+    ASSERT_EQ("serial_base", *route._scheduler_name);
+
+    // random layers split by their own seeds, so they are orthogonal
+    const int64_t request_num = 100000;
+    int64_t exp_num = 0;
+    int64_t other_num = 0;
+    int64_t both_num = 0;
+    for (int64_t i = 0; i < request_num; ++i) {
+        ASSERT_TRUE(router.route("rec_for_video", "feed", "guid_" + std::to_string(i) + "x", &route));
+        bool exp = route._flow_ids[1] == 101;
+        bool other = route._flow_ids[3] == 401;
+        exp_num += exp;
+        other_num += other;
+        both_num += exp && other;
+        if (exp) {
+            ASSERT_EQ("dag_base", *route._scheduler_name);
+        }
+    }
+    ASSERT_NEAR(0.2, static_cast<double>(exp_num) / request_num, 0.01);
+    ASSERT_NEAR(0.5, static_cast<double>(other_num) / request_num, 0.01);
+    ASSERT_NEAR(0.1, static_cast<double>(both_num) / request_num, 0.01);
+
+    // flows of one layer are exclusive
+    FlowRouter overlap_router;
+    ASSERT_FALSE(overlap_router.init(YAML::Load("- platform: p\n  scenes:\n    - scene_name: s\n"
+            "      scheduler_name: a\n      layers:\n        - layer_name: l\n          flows:\n"
+            "            - {flow_id: 1, buckets: [0, 10]}\n            - {flow_id: 2, buckets: [5, 20]}\n")));
+
+    // routed inside one snapshot, a flow with a missing scheduler is rejected
+    using SnapshotManager = ::inf::frame::FrameSnapshotManager<TestTaskCreator>;
+    auto &manager = SnapshotManager::instance();
+    ASSERT_TRUE(manager.init("../conf/task_list.yaml", "../conf/scheduler.yaml", "../conf/flow.yaml"));
+    TraceData data;
+    ASSERT_TRUE(manager.schedule_flow("rec_for_video", "detail", "user_3", &data, &route));
+    ASSERT_EQ(std::vector<std::string>({"recall_a", "recall_b", "rank"}), data.trace);
+    const std::string flow_file = "./flow_missing_test.yaml";
+    {
+        std::ofstream output(flow_file, std::ios::trunc);
+        output << "- platform: p\n  scenes:\n    - scene_name: s\n      scheduler_name: not_exist\n";
+    }
+    ASSERT_FALSE(manager.init("../conf/task_list.yaml", "../conf/scheduler.yaml", flow_file));
+    std::remove(flow_file.c_str());
+}
+
+TEST_F(TestFrame, test_ShmStore) {
+    using namespace ::inf::shm;
+    const std::string store_name = "inf_shm_store_test_" + std::to_string(getpid());
+    ShmStoreBuilder::unlink(store_name);
+    ShmStore not_exist;
+    ASSERT_FALSE(not_exist.open(store_name));
+
+    // build and publish the first version
+    ShmStoreBuilder::HashItems features;
+    for (uint64_t key = 0; key < 1000; ++key) {
+        features.emplace_back(key * 7919, "feature_" + std::to_string(key));
+    }
+    ShmStoreBuilder builder;
+    ASSERT_TRUE(builder.add_hash_table("item_feature", features));
+    ASSERT_FALSE(builder.add_hash_table("item_feature", features));
+    ASSERT_TRUE(builder.add_array("item_embedding", {std::string("\x01\x02", 2), "", "abc"}));
+    ASSERT_EQ(1u, builder.publish(store_name));
+
+    ShmStore store;
+    ASSERT_TRUE(store.open(store_name));
+    ASSERT_EQ(1u, store.get_version());
+    ShmSegmentPtr segment = store.get_segment();
+    ShmHashView table = segment->get_hash_table("item_feature");
+    ASSERT_EQ(1000u, table.size());
+    for (uint64_t key = 0; key < 1000; ++key) {
+        ShmValue value = table.find(key * 7919);
+        ASSERT_TRUE(value);
+        ASSERT_EQ("feature_" + std::to_string(key), std::string(value._data, value._size));
+        ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(value._data) % SHM_VALUE_ALIGN);
+    }
+    ASSERT_FALSE(table.find(1));
+    ASSERT_FALSE(segment->get_array("item_feature"));
+    ShmArrayView array = segment->get_array("item_embedding");
+    ASSERT_EQ(3u, array.size());
+    ASSERT_EQ(std::string("\x01\x02", 2), std::string(array.get(0)._data, array.get(0)._size));
+    ASSERT_EQ(0u, array.get(1)._size);
+    ASSERT_FALSE(array.get(3));
+
+    // another reader maps the same pages
+    ShmStore other_store;
+    ASSERT_TRUE(other_store.open(store_name));
+    ShmValue other_value = other_store.get_segment()->get_hash_table("item_feature").find(7919);
+    ASSERT_EQ("feature_1", std::string(other_value._data, other_value._size));
+
+    // duplicated keys are rejected and the live version is kept
+    ShmStoreBuilder bad_builder;
+    ASSERT_TRUE(bad_builder.add_hash_table("item_feature", {{1, "a"}, {1, "b"}}));
+    ASSERT_EQ(INVALID_SHM_VERSION, bad_builder.publish(store_name));
+    ASSERT_TRUE(store.refresh());
+    ASSERT_EQ(1u, store.get_version());
+
+    // the flip, a pinned old segment stays readable after it is unlinked
+    ShmStoreBuilder new_builder;
+    ASSERT_TRUE(new_builder.add_hash_table("item_feature", {{7919, "new_feature"}}));
+    ASSERT_EQ(2u, new_builder.publish(store_name));
+    ASSERT_TRUE(store.refresh());
+    ASSERT_EQ(2u, store.get_version());
+    ShmValue new_value = store.get_segment()->get_hash_table("item_feature").find(7919);
+    ASSERT_EQ("new_feature", std::string(new_value._data, new_value._size));
+    ASSERT_FALSE(store.get_segment()->get_array("item_embedding"));
+    ASSERT_EQ("feature_1", std::string(table.find(7919)._data, table.find(7919)._size));
+    ASSERT_EQ(1u, other_store.get_version());
+    ASSERT_TRUE(other_store.refresh());
+    ASSERT_EQ(2u, other_store.get_version());
+
+    ShmStoreBuilder::unlink(store_name);
+    ASSERT_TRUE(store.get_segment()->get_hash_table("item_feature").find(7919));
+}
+
+TEST_F(TestFrame, test_MmapSnapshot) {
+    using namespace ::inf::utils;
+    const std::string file_name = "./mmap_snapshot_test.bin";
+    struct Embedding {
+        float   _values[4];
+    };
+    std::vector<std::pair<uint64_t, std::string>> titles;
+    for (uint64_t key = 1000; key > 0; --key) {
+        titles.emplace_back(key * 31, "title_" + std::to_string(key));
+    }
+    MmapSnapshotBuilder builder;
+    ASSERT_TRUE(builder.add_dict("item_title", titles));
+    ASSERT_TRUE(builder.add_array("item_embedding", std::vector<Embedding>{{{1, 2, 3, 4}}, {{5, 6, 7, 8}}}));
+    ASSERT_FALSE(builder.add_array("item_embedding", std::vector<int64_t>{1}));
+    ASSERT_TRUE(builder.add_strings("tags", {"a", "", "ccc"}));
+    ASSERT_TRUE(builder.add_bytes("model", std::string("\0\1\2", 3)));
+    ASSERT_TRUE(builder.write(file_name, 1));
+
+    std::unique_ptr<MmapLoader> loader(new MmapLoader);
+    ASSERT_TRUE(loader->init(file_name));
+    DoubleData<MmapSnapshot, MmapLoader> buffer(std::move(loader));
+    ASSERT_EQ(0, buffer.init());
+    {
+    auto guard = buffer.read();
+    ASSERT_EQ(1u, guard->get_version());
+    MmapDict dict = guard->get_dict("item_title");
+    ASSERT_EQ(1000u, dict.size());
+    std::string_view title;
+    ASSERT_TRUE(dict.find(31 * 7, &title));
+    ASSERT_EQ("title_7", title);
+    ASSERT_FALSE(dict.find(30, &title));
+    MmapSpan<Embedding> embeddings = guard->get_array<Embedding>("item_embedding");
+    ASSERT_EQ(2u, embeddings.size());
+    ASSERT_EQ(7.0f, embeddings[1]._values[2]);
+    ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(embeddings.data()) % MMAP_SECTION_ALIGN);
+    ASSERT_TRUE(guard->get_array<double>("item_embedding").empty());
+    MmapStringArray tags = guard->get_strings("tags");
+    ASSERT_EQ(3u, tags.size());
+    ASSERT_EQ("", tags[1]);
+    ASSERT_EQ("ccc", tags[2]);
+    ASSERT_EQ(std::string("\0\1\2", 3), guard->get_bytes("model"));
+    ASSERT_TRUE(guard->get_bytes("not_exist").empty());
+    }
+
+    // a copy keeps the mapping of its version after the file is replaced
+    MmapSnapshot old_snapshot = *buffer.get_current();
+    MmapSnapshotBuilder new_builder;
+    ASSERT_TRUE(new_builder.add_dict("item_title", {{31, "new_title"}}));
+    ASSERT_TRUE(new_builder.write(file_name, 2));
+    buffer.reload();
+    std::string_view title;
+    ASSERT_TRUE(buffer.read()->get_dict("item_title").find(31, &title));
+    ASSERT_EQ("new_title", title);
+    ASSERT_TRUE(old_snapshot.get_dict("item_title").find(31, &title));
+    ASSERT_EQ("title_1", title);
+
+    // corrupted and truncated files are rejected, the current snapshot is kept
+    std::string content;
+    {
+        std::ifstream input(file_name, std::ios::binary);
+        content.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+    // replaced by rename, writing in place would change the pages of the live mapping
+    auto write_content = [&file_name](const std::string &data) {
+        {
+            std::ofstream output(file_name + ".tmp", std::ios::binary | std::ios::trunc);
+            output << data;
+        }
+        std::rename((file_name + ".tmp").c_str(), file_name.c_str());
+    };
+    std::string corrupted = content;
+    corrupted[corrupted.size() - 70] ^= 1;
+    write_content(corrupted);
+    buffer.reload();
+    ASSERT_EQ(2u, buffer.read()->get_version());
+    write_content(content.substr(0, content.size() / 2));
+    buffer.reload();
+    ASSERT_EQ(2u, buffer.read()->get_version());
+    MmapSnapshot invalid_snapshot;
+    ASSERT_FALSE(invalid_snapshot.init(file_name));
+    ASSERT_FALSE(invalid_snapshot);
+    ASSERT_TRUE(invalid_snapshot.get_dict("item_title").empty());
+    std::remove(file_name.c_str());
+}
+
+TEST_F(TestFrame, test_CompositeTask) {
+    auto &snapshot_manager = ::inf::frame::FrameSnapshotManager<TestTaskCreator>::instance();
+    ASSERT_TRUE(snapshot_manager.init("../conf/task_list.yaml", "../conf/scheduler.yaml"));
+    ASSERT_TRUE(::inf::frame::TaskManager<TestTaskCreator>::instance().init("../conf/task_list.yaml", ""));
+    ::inf::frame::FrameThreadPool::instance().init(4);
+    ::inf::frame::FrameThreadPool::instance().start();
+
+    // nested group: parallel recalls inside a serial group
+    TraceData group_data;
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(snapshot_manager.schedule("group_base", &group_data));
+    auto cost_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    ASSERT_LT(cost_ms, 100);
+    ASSERT_EQ(5, group_data.trace.size());
+    ASSERT_EQ(3, group_data.index_of("rank"));
+    ASSERT_EQ(4, group_data.index_of("rerank"));
+
+    // deadline of the parallel group, without workers the caller runs recall_a
+    // and recall_b is skipped after the deadline
+    ::inf::frame::FrameThreadPool::instance().stop();
+    const auto &timeout_task = ::inf::frame::TaskManager<TestTaskCreator>::instance().get_task("recall_timeout");
+    ASSERT_TRUE(timeout_task);
+    TraceData timeout_data;
+    ASSERT_FALSE(timeout_task->run(&timeout_data));
+    ASSERT_EQ(1, timeout_data.trace.size());
+
+    // group contains itself
+    ::inf::frame::TaskLoader<TestTaskCreator> cycle_loader;
+    ASSERT_TRUE(cycle_loader.init("../conf/task_cycle.yaml"));
+    ASSERT_EQ(nullptr, cycle_loader.load());
+}
+
+TEST_F(TestFrame, test_AsyncScheduler) {
+    auto &snapshot_manager = ::inf::frame::FrameSnapshotManager<TestTaskCreator>::instance();
+    ASSERT_TRUE(snapshot_manager.init("../conf/task_async.yaml", "../conf/scheduler_async.yaml"));
+    ::inf::frame::FrameThreadPool::instance().init(2);
+    ::inf::frame::FrameThreadPool::instance().start();
+
+    std::mutex lock;
+    std::condition_variable cond;
+    int64_t done_num = 0;
+    int64_t ok_num = 0;
+    auto on_done = [&](bool ok) {
+        std::lock_guard<std::mutex> guard(lock);
+        ++done_num;
+        ok_num += ok ? 1 : 0;
+        cond.notify_all();
+    };
+    auto wait_done = [&](const int64_t num) {
+        std::unique_lock<std::mutex> guard(lock);
+        return cond.wait_for(guard, std::chrono::seconds(5), [&]() { return done_num >= num; });
+    };
+
+    // 2 workers serve 200 requests waiting for I/O at the same time
+    const int64_t request_num = 200;
+    std::vector<TraceData> dag_data(request_num);
+    auto start = std::chrono::steady_clock::now();
+    for (auto &data : dag_data) {
+        snapshot_manager.schedule_async("async_dag", &data, on_done);
+    }
+    ASSERT_TRUE(wait_done(request_num));
+    auto cost_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    ASSERT_LT(cost_ms, 1000);
+    ASSERT_EQ(request_num, ok_num);
+    for (auto &data : dag_data) {
+        ASSERT_EQ(3, data.trace.size());
+        ASSERT_EQ(2, data.index_of("rank"));
+    }
+
+    // serial mode and groups keep the declared order
+    done_num = ok_num = 0;
+    TraceData serial_data;
+    snapshot_manager.schedule_async("async_serial", &serial_data, on_done);
+    TraceData group_data;
+    snapshot_manager.schedule_async("async_group", &group_data, on_done);
+    ASSERT_TRUE(wait_done(2));
+    ASSERT_EQ(2, ok_num);
+    ASSERT_EQ(std::vector<std::string>({"remote_a", "rank", "remote_b"}), serial_data.trace);
+    ASSERT_EQ(3, group_data.trace.size());
+    ASSERT_EQ(2, group_data.index_of("rank"));
+
+    // downstream tasks are not resumed after an async failure
+    done_num = ok_num = 0;
+    TraceData failure_data;
+    snapshot_manager.schedule_async("async_failure", &failure_data, on_done);
+    ASSERT_TRUE(wait_done(1));
+    ASSERT_EQ(0, ok_num);
+    ASSERT_EQ(-1, failure_data.index_of("rank"));
+
+    // blocking schedule still works, and without workers the I/O thread resumes the request
+    ::inf::frame::FrameThreadPool::instance().stop();
+    TraceData sync_data;
+    ASSERT_TRUE(snapshot_manager.schedule("async_dag", &sync_data));
+    ASSERT_EQ(2, sync_data.index_of("rank"));
+    done_num = ok_num = 0;
+    TraceData inline_data;
+    snapshot_manager.schedule_async("async_dag", &inline_data, on_done);
+    ASSERT_TRUE(wait_done(1));
+    ASSERT_EQ(1, ok_num);
+    ASSERT_EQ(2, inline_data.index_of("rank"));
+}
+
+TEST_F(TestFrame, test_IncrementalTaskReload) {
+    const std::string file_name = "./task_reload_test.yaml";
+    std::string task_conf;
+    {
+    std::ifstream input("../conf/task_list.yaml");
+    task_conf.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+    auto write_file = [&file_name](const std::string &content) {
+        std::ofstream output(file_name, std::ios::trunc);
+        output << content;
+    };
+    write_file(task_conf);
+
+    ::inf::frame::TaskLoader<TestTaskCreator> loader;
+    ASSERT_TRUE(loader.init(file_name));
+    auto first = loader.load();
+    ASSERT_TRUE(first);
+    ASSERT_EQ(0, loader.get_reused_task_num());
+
+    // nothing changed, every unit task is reused, groups are rebuilt
+    auto second = loader.load();
+    ASSERT_TRUE(second);
+    ASSERT_EQ(6, loader.get_reused_task_num());
+    ASSERT_EQ(first->at("recall_a").get(), second->at("recall_a").get());
+    ASSERT_NE(first->at("rank_group").get(), second->at("rank_group").get());
+
+    // only the changed alias is created again
+    std::string changed_conf = task_conf;
+    changed_conf.replace(changed_conf.find("sleep_ms: 10"), 12, "sleep_ms: 11");
+    write_file(changed_conf);
+    auto third = loader.load();
+    ASSERT_TRUE(third);
+    ASSERT_EQ(5, loader.get_reused_task_num());
+    ASSERT_NE(second->at("user_feature").get(), third->at("user_feature").get());
+    ASSERT_EQ(second->at("rank").get(), third->at("rank").get());
+
+    // a failed load keeps the cache of the live map
+    write_file(changed_conf + "\n- task_alias_name: unknown\n  task_name: not_registered\n");
+    ASSERT_EQ(nullptr, loader.load());
+    write_file(changed_conf);
+    auto fourth = loader.load();
+    ASSERT_TRUE(fourth);
+    ASSERT_EQ(6, loader.get_reused_task_num());
+    ASSERT_EQ(third->at("user_feature").get(), fourth->at("user_feature").get());
+
+    // the rebuilt group runs the shared children
+    ::inf::frame::FrameThreadPool::instance().stop();
+    TraceData trace_data;
+    ASSERT_TRUE(fourth->at("rank_group")->run(&trace_data));
+    ASSERT_EQ(5, trace_data.trace.size());
+    remove(file_name.c_str());
+}
+
+TEST_F(TestFrame, test_ParallelTaskInit) {
+    // 4 slow init run at the same time
+    ::inf::frame::TaskLoader<TestTaskCreator> loader;
+    ASSERT_TRUE(loader.init("../conf/task_init.yaml"));
+    loader.set_init_concurrency(4);
+    auto start = std::chrono::steady_clock::now();
+    auto task_map = loader.load();
+    auto cost_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    ASSERT_TRUE(task_map);
+    ASSERT_EQ(5, task_map->size());
+    ASSERT_LT(cost_ms, 300);
+    ASSERT_EQ(5, loader.get_init_cost_ms().size());
+    ASSERT_GE(loader.get_init_cost_ms().at("dict_a"), 100);
+    // the copy is kept across the next load
+    auto init_cost_ms = loader.get_init_cost_ms();
+    ASSERT_TRUE(loader.load());
+    ASSERT_GE(init_cost_ms.at("dict_a"), 100);
+
+    // one failure discards the whole map
+    ::inf::frame::TaskLoader<TestTaskCreator> fail_loader;
+    ASSERT_TRUE(fail_loader.init("../conf/task_init_fail.yaml"));
+    fail_loader.set_init_concurrency(2);
+    ASSERT_EQ(nullptr, fail_loader.load());
+}
+
+TEST_F(TestFrame, test_LatencyStats) {
+    using ::inf::frame::LatencyHistogram;
+    using ::inf::frame::LatencyStats;
+    // every latency is inside its bucket, and the bucket is within 1/8
+    for (uint64_t cost_ns : {0ULL, 7ULL, 8ULL, 100ULL, 1023ULL, 1024ULL, 123456789ULL}) {
+        int64_t bucket = LatencyHistogram::get_bucket(cost_ns);
+        ASSERT_LE(cost_ns, LatencyHistogram::get_bucket_upper_ns(bucket));
+        ASSERT_LE(LatencyHistogram::get_bucket_upper_ns(bucket), cost_ns + cost_ns / 8);
+    }
+
+    // records of many threads are merged
+    LatencyStats &stats = LatencyStats::instance();
+    int64_t stat_id = stats.register_stat("test.latency");
+    ASSERT_EQ(stat_id, stats.register_stat("test.latency"));
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&stats, stat_id]() {
+            for (int64_t j = 1; j <= 1000; ++j) {
+                stats.record(stat_id, j * 1000, j % 100 != 0);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    stats.reset();
+    for (int64_t j = 1; j <= 1000; ++j) {
+        stats.record(stat_id, j * 1000, j % 100 != 0);
+    }
+    bool found = false;
+    for (auto &snapshot : stats.get_snapshot()) {
+        if (snapshot._name != "test.latency") {
+            continue;
+        }
+        found = true;
+        // only the window after reset
+        ASSERT_EQ(1000, snapshot._histogram.get_count());
+        ASSERT_EQ(10, snapshot._histogram._fail_num);
+        ASSERT_NEAR(500000, snapshot._histogram.get_percentile_ns(50), 500000 / 8);
+        ASSERT_NEAR(990000, snapshot._histogram.get_percentile_ns(99), 990000 / 8);
+    }
+    ASSERT_TRUE(found);
+
+    // tasks and schedulers record by themselves
+    auto &snapshot_manager = ::inf::frame::FrameSnapshotManager<TestTaskCreator>::instance();
+    ASSERT_TRUE(snapshot_manager.init("../conf/task_list.yaml", "../conf/scheduler.yaml"));
+    stats.reset();
+    TraceData data;
+    ASSERT_TRUE(snapshot_manager.schedule("serial_base", &data));
+    std::string json = stats.dump_json();
+    ASSERT_NE(std::string::npos, json.find("\"scheduler.serial_base\":{\"count\":1,\"ok\":1"));
+    ASSERT_NE(std::string::npos, json.find("\"task.recall_a\":{\"count\":1,"));
+    ASSERT_EQ(std::string::npos, json.find("test.latency"));
+    ASSERT_NE(std::string::npos, stats.dump_text().find("task.rank count:1 ok:1 fail:0"));
+}
+
+TEST_F(TestFrame, test_Trace) {
+    using ::inf::frame::Tracer;
+    auto &snapshot_manager = ::inf::frame::FrameSnapshotManager<TestTaskCreator>::instance();
+    ASSERT_TRUE(snapshot_manager.init("../conf/task_list.yaml", "../conf/scheduler.yaml"));
+    ::inf::frame::FrameThreadPool::instance().init(4);
+    ::inf::frame::FrameThreadPool::instance().start();
+
+    // every request is sampled, spans of the pool workers carry the trace
+    Tracer::instance().set_sample_rate(1);
+    TraceData data;
+    ASSERT_TRUE(snapshot_manager.schedule("dag_base", &data));
+    uint64_t trace_id = Tracer::instance().get_last_trace_id();
+    ASSERT_NE(::inf::frame::INVALID_TRACE_ID, trace_id);
+    auto spans = Tracer::instance().get_spans(trace_id);
+    ASSERT_EQ(6, spans.size());
+    std::unordered_map<std::string, ::inf::frame::TraceSpan> span_table;
+    for (auto &span : spans) {
+        span_table[span._name] = span;
+        ASSERT_TRUE(span._ok);
+        ASSERT_LE(span._start_ns, span._end_ns);
+        ASSERT_GE(span._wait_ns, 0);
+    }
+    ASSERT_EQ(1, span_table.count("scheduler.dag_base"));
+    ASSERT_GE(span_table["rank"]._start_ns, span_table["recall_a"]._end_ns);
+    ASSERT_GE(span_table["rerank"]._start_ns, span_table["rank"]._end_ns);
+    ASSERT_LE(span_table["scheduler.dag_base"]._start_ns, span_table["recall_a"]._start_ns);
+    std::string json = Tracer::instance().dump_chrome_trace(trace_id);
+    ASSERT_EQ(0, json.find("{\"traceEvents\":[{\"name\":"));
+    ASSERT_NE(std::string::npos, json.find("\"name\":\"rerank\",\"cat\":\"task\",\"ph\":\"X\""));
+
+    // sampling off, a request traced by the caller is still recorded
+    Tracer::instance().set_sample_rate(0);
+    ASSERT_TRUE(snapshot_manager.schedule("dag_base", &data));
+    ASSERT_EQ(trace_id, Tracer::instance().get_last_trace_id());
+    uint64_t forced_id = Tracer::instance().new_trace_id();
+    {
+        ::inf::frame::TraceScope trace_scope(forced_id, 0);
+        ASSERT_TRUE(snapshot_manager.schedule("dag_base", &data));
+    }
+    ASSERT_EQ(6, Tracer::instance().get_spans(forced_id).size());
+
+    ::inf::frame::FrameThreadPool::instance().stop();
+}
+
+TEST_F(TestFrame, test_Logger) {
+    using ::inf::utils::Logger;
+    Logger &logger = Logger::instance();
+    std::mutex lock;
+    std::string output;
+    std::atomic<bool> block_sink{false};
+    std::atomic<bool> in_sink{false};
+    // the stdout sink is back before the captured locals are gone
+    struct SinkGuard {
+        std::atomic<bool> &_block_sink;
+        ~SinkGuard() {
+            _block_sink = false;
+            Logger::instance().set_rate_limit(::inf::utils::DEFAULT_LOG_RATE_LIMIT);
+            Logger::instance().flush();
+            Logger::instance().set_sink(&Logger::write_stdout);
+        }
+    } sink_guard{block_sink};
+    logger.flush();
+    logger.set_sink([&](const char *data, size_t size) {
+        in_sink = true;
+        while (block_sink) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        output.append(data, size);
+    });
+
+    // lines keep the old format, std::endl does not add an empty line
+    ERR_LOG << "error " << 42 << std::endl;
+    INFO_LOG << "info\n";
+    logger.set_level(::inf::utils::LOG_LEVEL_INFO);
+    DEBUG_LOG << "debug skipped" << std::endl;
+    logger.set_level(::inf::utils::LOG_LEVEL_DEBUG);
+    logger.flush();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ASSERT_NE(std::string::npos, output.find(":TestBody|PRIVATE_LOG_ERR__|error 42\n"));
+        ASSERT_NE(std::string::npos, output.find("PRIVATE_LOG_INFO_|info\n"));
+        ASSERT_EQ(std::string::npos, output.find("\n\n"));
+        ASSERT_EQ(std::string::npos, output.find("debug skipped"));
+    }
+
+    // one call site is limited per second, start at a fresh window
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    std::this_thread::sleep_for(std::chrono::seconds(1) -
+            (now - std::chrono::duration_cast<std::chrono::seconds>(now)));
+    logger.set_rate_limit(5);
+    int64_t suppressed_num = logger.get_suppressed_num();
+    for (int i = 0; i < 20; ++i) {
+        ERR_LOG << "storm " << i << std::endl;
+    }
+    ASSERT_EQ(15, logger.get_suppressed_num() - suppressed_num);
+    logger.set_rate_limit(0);
+
+    // a full ring drops instead of blocking while the sink is stuck
+    logger.flush();
+    block_sink = true;
+    in_sink = false;
+    INFO_LOG << "wake the flusher" << std::endl;
+    while (!in_sink) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    int64_t dropped_num = logger.get_dropped_num();
+    for (int64_t i = 0; i < ::inf::utils::LOG_RING_SIZE * 2; ++i) {
+        INFO_LOG << "flood " << i << std::endl;
+    }
+    ASSERT_GE(logger.get_dropped_num() - dropped_num, ::inf::utils::LOG_RING_SIZE);
+    block_sink = false;
+
+    // a thread_local destroyed after the ring of its thread writes through
+    struct LateLogger {
+        ~LateLogger() {
+            INFO_LOG << "late line" << std::endl;
+        }
+    };
+    std::thread([]() {
+        thread_local LateLogger late_logger;
+        (void)late_logger;
+        INFO_LOG << "early line" << std::endl;
+    }).join();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ASSERT_NE(std::string::npos, output.find("late line\n"));
+        ASSERT_LT(output.find("early line\n"), output.find("late line\n"));
+    }
+
+    logger.flush();
+    std::lock_guard<std::mutex> guard(lock);
+    ASSERT_NE(std::string::npos, output.find("storm 4\n"));
+    ASSERT_EQ(std::string::npos, output.find("storm 5\n"));
+}
+
+TEST_F(TestFrame, test_TaskRegistry) {
+    using ::inf::frame::TaskRegistry;
+    using ::inf::frame::TaskRegistration;
+    // tasks of test_task.h are registered before main
+    auto &registry = TaskRegistry::instance();
+    ASSERT_GE(registry.size(), 2);
+    ASSERT_TRUE(std::dynamic_pointer_cast<SleepTask>(registry.create("sleep_task")) != nullptr);
+    ASSERT_TRUE(std::dynamic_pointer_cast<AsyncSleepTask>(registry.create("async_sleep_task")) != nullptr);
+    ASSERT_TRUE(registry.create("sleep_tas") == nullptr);
+    ASSERT_TRUE(registry.create("sleep_task_") == nullptr);
+    ASSERT_TRUE(registry.create("") == nullptr);
+
+    // hash computed at compile time
+    constexpr TaskRegistration registration("sleep_task", &::inf::frame::create_registered_task<SleepTask>);
+    static_assert(registration._size == 10, "name size");
+    static_assert(registration._hash == ::inf::frame::hash_task_name("sleep_task", 10), "name hash");
+
+    // every name gets its own slot, duplicates and late registration are refused
+    TaskRegistry local_registry;
+    std::vector<std::string> names;
+    for (int i = 0; i < 500; ++i) {
+        names.push_back("task_" + std::to_string(i));
+    }
+    for (auto &name : names) {
+        ASSERT_TRUE(local_registry.add(TaskRegistration(name.c_str(),
+                &::inf::frame::create_registered_task<SleepTask>)));
+    }
+    ASSERT_FALSE(local_registry.add(TaskRegistration("task_7", &::inf::frame::create_registered_task<RecallTask>)));
+    for (auto &name : names) {
+        ASSERT_TRUE(local_registry.find(name) != nullptr);
+        ASSERT_EQ(name, local_registry.find(name)->_name);
+    }
+    ASSERT_TRUE(local_registry.find("task_500") == nullptr);
+    ASSERT_LE(local_registry.get_slot_num(), 500 * 8);
+    ASSERT_FALSE(local_registry.add(TaskRegistration("task_late", &::inf::frame::create_registered_task<SleepTask>)));
+    ASSERT_EQ(500, local_registry.size());
+}
+
+TEST_F(TestFrame, test_WorkStealingThreadPool) {
+    ::inf::frame::WorkStealingQueue<int64_t> queue(2);
+    for (int64_t i = 0; i < 10; ++i) {
+        queue.push(i);
+    }
+    int64_t value = 0;
+    ASSERT_TRUE(queue.steal(value));
+    ASSERT_EQ(0, value);
+    ASSERT_TRUE(queue.pop(value));
+    ASSERT_EQ(9, value);
+    ASSERT_EQ(8, queue.size());
+
+    ::inf::frame::WorkStealingThreadPool thread_pool;
+    ASSERT_EQ(0, thread_pool.init(4));
+    ASSERT_EQ(0, thread_pool.start());
+
+    // submit from outside
+    auto result = thread_pool.submit(0, [](int a, int b) { return a + b; }, 1, 2);
+    ASSERT_EQ(3, result.get());
+
+    // submit from inside a worker goes to the local deque, others steal it
+    std::atomic<int64_t> counter{0};
+    auto fanout = thread_pool.submit([&thread_pool, &counter]() {
+        std::vector<std::future<void>> children;
+        for (int64_t i = 0; i < 1000; ++i) {
+            children.push_back(thread_pool.submit([&counter]() {
+                ++counter;
+            }));
+        }
+        return children;
+    });
+    for (auto &child : fanout.get()) {
+        child.wait();
+    }
+    ASSERT_EQ(1000, counter);
+
+    // a task still queued after its timeout expires instead of running
+    ::inf::frame::WorkStealingThreadPool single_pool;
+    ASSERT_EQ(0, single_pool.init(1));
+    ASSERT_EQ(0, single_pool.start());
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    auto blocker = single_pool.submit([released]() { released.wait(); });
+    auto expired = single_pool.submit(10, []() { return 1; });
+    auto kept = single_pool.submit(0, []() { return 2; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    release.set_value();
+    blocker.get();
+    ASSERT_THROW(expired.get(), ::inf::frame::TaskTimeoutException);
+    ASSERT_EQ(2, kept.get());
+    ASSERT_EQ(1, single_pool.get_expired_task_num());
+
+    // tasks queued at stop, and submitted before init or after stop, are rejected
+    std::promise<void> release_again;
+    std::shared_future<void> released_again = release_again.get_future().share();
+    std::atomic<bool> started{false};
+    auto running = single_pool.submit([released_again, &started]() {
+        started = true;
+        released_again.wait();
+    });
+    auto queued = single_pool.submit([]() { return 3; });
+    while (!started) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::thread stopper([&single_pool]() { single_pool.stop(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    release_again.set_value();
+    stopper.join();
+    running.get();
+    ASSERT_THROW(queued.get(), ::inf::frame::TaskRejectedException);
+    ASSERT_THROW(single_pool.submit([]() { return 4; }).get(), ::inf::frame::TaskRejectedException);
+    ::inf::frame::WorkStealingThreadPool empty_pool;
+    ASSERT_THROW(empty_pool.submit([]() { return 5; }).get(), ::inf::frame::TaskRejectedException);
+    ASSERT_EQ(0, thread_pool.stop());
+}
+
+TEST_F(TestFrame, test_ThreadPoolDeadline) {
+    ::inf::frame::ThreadPool thread_pool;
+    ASSERT_EQ(0, thread_pool.init(1));
+    ASSERT_EQ(0, thread_pool.start());
+
+    // keep the only worker busy
+    auto blocker = thread_pool.submit([]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    // queued longer than its timeout
+    auto expired = thread_pool.submit(10, []() { return 1; });
+    // earliest deadline first
+    std::vector<int> order;
+    std::mutex order_lock;
+    auto later = thread_pool.submit(1000, [&]() {
+        std::lock_guard<std::mutex> guard(order_lock);
+        order.push_back(2);
+    });
+    auto sooner = thread_pool.submit(500, [&]() {
+        std::lock_guard<std::mutex> guard(order_lock);
+        order.push_back(1);
+    });
+
+    blocker.get();
+    ASSERT_THROW(expired.get(), ::inf::frame::TaskTimeoutException);
+    later.get();
+    sooner.get();
+    ASSERT_EQ(std::vector<int>({1, 2}), order);
+
+    // expired at its deadline while the worker is still busy, tasks with a deadline
+    // run before the untimed ones submitted earlier
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<bool> busy_started{false};
+    auto busy = thread_pool.submit(0, [released, &busy_started]() {
+        busy_started = true;
+        released.wait();
+    });
+    while (!busy_started) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto reaped = thread_pool.submit(10, []() { return 1; });
+    ASSERT_EQ(std::future_status::ready, reaped.wait_for(std::chrono::milliseconds(1000)));
+    ASSERT_THROW(reaped.get(), ::inf::frame::TaskTimeoutException);
+    order.clear();
+    auto untimed = thread_pool.submit(0, [&]() {
+        std::lock_guard<std::mutex> guard(order_lock);
+        order.push_back(2);
+    });
+    auto timed = thread_pool.submit(1000, [&]() {
+        std::lock_guard<std::mutex> guard(order_lock);
+        order.push_back(1);
+    });
+    release.set_value();
+    busy.get();
+    untimed.get();
+    timed.get();
+    ASSERT_EQ(std::vector<int>({1, 2}), order);
+
+    // exception of the task is passed to the future
+    auto failed = thread_pool.submit([]() -> int { throw std::logic_error("failed"); });
+    ASSERT_THROW(failed.get(), std::logic_error);
+    ASSERT_EQ(0, thread_pool.stop());
+
+    // counters are final after the workers joined
+    ASSERT_EQ(2, thread_pool.get_expired_task_num());
+    ASSERT_EQ(7, thread_pool.get_completed_task_num());
+    ASSERT_EQ(0, thread_pool.get_late_task_num());
+}
+
+TEST_F(TestFrame, test_MpmcQueue) {
+    // bounded, move-only
+    ::inf::frame::MpmcQueue<std::unique_ptr<int>> queue(4);
+    ASSERT_EQ(4, queue.capacity());
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(queue.try_enqueue(std::unique_ptr<int>(new int(i))));
+    }
+    ASSERT_FALSE(queue.try_enqueue(std::unique_ptr<int>(new int(4))));
+    std::unique_ptr<int> value;
+    ASSERT_TRUE(queue.try_dequeue(value));
+    ASSERT_EQ(0, *value);
+
+    // batch
+    std::vector<std::unique_ptr<int>> batch;
+    ASSERT_EQ(3, queue.try_dequeue_bulk(std::back_inserter(batch), 10));
+    ASSERT_EQ(3, *batch.back());
+    ASSERT_EQ(3, queue.try_enqueue_bulk(batch.begin(), batch.size()));
+    ASSERT_EQ(3, queue.size());
+
+    // back-pressure, producers block while full
+    ::inf::frame::BlockingQueue<int64_t> blocking_queue(8);
+    const int64_t total = 10000;
+    std::atomic<int64_t> sum{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 2; ++i) {
+        threads.emplace_back([&blocking_queue]() {
+            for (int64_t j = 1; j <= total; ++j) {
+                blocking_queue.enqueue(j);
+            }
+        });
+        threads.emplace_back([&blocking_queue, &sum]() {
+            for (int64_t j = 1; j <= total; ++j) {
+                sum += blocking_queue.get_data();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(total * (total + 1), sum);
+    ASSERT_EQ(0, blocking_queue.size());
+
+    // close wakes up the blocked consumer
+    std::thread consumer([&blocking_queue]() {
+        int64_t data = 0;
+        ASSERT_FALSE(blocking_queue.try_get_data(data));
+        blocking_queue.get_data();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    blocking_queue.close();
+    consumer.join();
+    ASSERT_EQ(-1, blocking_queue.enqueue(1));
+}
+
+TEST_F(TestFrame, test_DoubleDataRead) {
+    using GenerationBuffer = ::inf::utils::DoubleData<std::unique_ptr<Generation>, GenerationLoader>;
+    GenerationBuffer buffer(std::unique_ptr<GenerationLoader>(new GenerationLoader));
+    ASSERT_FALSE(buffer.read());
+    ASSERT_EQ(0, buffer.init());
+    ASSERT_EQ(1, (*buffer.read())->version);
+
+    auto wait_retired = [&buffer]() {
+        for (int i = 0; i < 500 && buffer.get_generation_stats()._retired_num > 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        return buffer.get_generation_stats()._retired_num == 0;
+    };
+
+    // a pinned generation is not released until the reader is done, swap does not wait for it
+    ASSERT_TRUE(buffer.swap_data());
+    {
+    auto guard = buffer.read();
+    ASSERT_EQ(2, (*guard)->version);
+    ASSERT_TRUE(buffer.swap_data());
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(2, (*guard)->version);
+    ASSERT_EQ(1, buffer.get_generation_stats()._retired_num);
+    ASSERT_EQ(static_cast<int64_t>(sizeof(Generation)), buffer.get_generation_stats()._retired_bytes);
+    // a buffer type without an overload is not counted, yaml and task maps are
+    ASSERT_EQ(::inf::utils::UNKNOWN_BUFFER_BYTES, ::inf::utils::get_buffer_bytes(std::vector<int>(1024)));
+    ASSERT_LT(::inf::utils::get_buffer_bytes(YAML::Load("a")),
+            ::inf::utils::get_buffer_bytes(YAML::Load("{a: [b, c], d: e}")));
+    ::inf::frame::TaskMap task_map;
+    int64_t empty_bytes = get_buffer_bytes(task_map);
+    task_map.emplace("recall", std::make_shared<RecallTask>());
+    ASSERT_LT(empty_bytes, get_buffer_bytes(task_map));
+    // nested read on the same thread
+    ASSERT_EQ(3, (*buffer.read())->version);
+    }
+    // destroyed in the background once drained, only the current one is alive
+    ASSERT_TRUE(wait_retired());
+    ASSERT_EQ(1, Generation::live_num);
+    ASSERT_EQ(2, buffer.get_generation_stats()._destroyed_num);
+
+    // a shared_ptr holder keeps its generation, the cap fails a swap instead of piling up
+    buffer.set_max_generation_num(2, 20);
+    {
+    auto holder = buffer.get_current();
+    ASSERT_TRUE(buffer.swap_data());
+    ASSERT_FALSE(buffer.swap_data());
+    ASSERT_EQ(2, Generation::live_num);
+    ASSERT_EQ(3, (*holder)->version);
+    }
+    ASSERT_TRUE(wait_retired());
+    ASSERT_TRUE(buffer.swap_data());
+    ASSERT_EQ(5, (*buffer.read())->version);
+    buffer.set_max_generation_num(0);
+
+    // readers never see a released generation while swapping
+    std::atomic<bool> stop{false};
+    std::atomic<int64_t> bad_read{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&]() {
+            int64_t last_version = 0;
+            while (!stop) {
+                auto guard = buffer.read();
+                int64_t version = (*guard)->version;
+                if (version < last_version) {
+                    ++bad_read;
+                }
+                last_version = version;
+            }
+        });
+    }
+    for (int i = 0; i < 50; ++i) {
+        ASSERT_TRUE(buffer.swap_data());
+    }
+    stop = true;
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQ(0, bad_read);
+    ASSERT_EQ(55, (*buffer.read())->version);
+    ASSERT_TRUE(wait_retired());
+    ASSERT_EQ(1, Generation::live_num);
+}
+
+TEST_F(TestFrame, test_DoubleDataReload) {
+    using GenerationBuffer = ::inf::utils::DoubleData<std::shared_ptr<Generation>, ScriptedLoader>;
+    const std::string file_name = "./double_data_reload_test.yaml";
+    std::ofstream(file_name, std::ios::trunc) << "version: 1\n";
+    ScriptedLoader *loader = new ScriptedLoader;
+    loader->init(file_name);
+    loader->_mode = ScriptedLoader::LOAD_NULL;
+    GenerationBuffer buffer(std::unique_ptr<ScriptedLoader>(loader), 3, true);
+    ASSERT_EQ(-1, buffer.init());
+    ASSERT_FALSE(buffer.read());
+    loader->_mode = ScriptedLoader::LOAD_OK;
+    ASSERT_EQ(0, buffer.init());
+    ASSERT_EQ(1, (*buffer.read())->version);
+
+    // readers are not blocked by a slow load
+    loader->_blocked = true;
+    std::thread writer([&buffer]() { buffer.swap_data(); });
+    while (!loader->_loading) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(1, (*buffer.read())->version);
+    ASSERT_EQ(1, (*buffer.get_current())->version);
+    loader->_blocked = false;
+    writer.join();
+    ASSERT_EQ(2, (*buffer.get_current())->version);
+
+    // null and thrown loads keep the last known good buffer
+    loader->_mode = ScriptedLoader::LOAD_NULL;
+    ASSERT_FALSE(buffer.swap_data());
+    ASSERT_EQ(2, (*buffer.read())->version);
+    loader->_mode = ScriptedLoader::LOAD_THROW;
+    ASSERT_FALSE(buffer.swap_data());
+    ASSERT_EQ(2, (*buffer.read())->version);
+    ::inf::utils::ReloadStats stats = buffer.get_reload_stats();
+    ASSERT_EQ(2, stats._success_num);
+    ASSERT_EQ(3, stats._failure_num);
+    ASSERT_EQ("scripted failure", stats._last_error);
+    ASSERT_GE(stats._last_failure_time, stats._last_success_time);
+
+    // a file change or request_reload loads on the background thread
+    loader->_mode = ScriptedLoader::LOAD_OK;
+    auto wait_version = [&buffer](const int64_t version) {
+        for (int i = 0; i < 500 && (*buffer.get_current())->version != version; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return (*buffer.get_current())->version == version;
+    };
+    std::ofstream(file_name, std::ios::trunc) << "version: 2\n";
+    ASSERT_TRUE(wait_version(3));
+    buffer.request_reload();
+    ASSERT_TRUE(wait_version(4));
+    ASSERT_EQ(4, buffer.get_reload_stats()._success_num);
+
+    // the file is watched before the first load, a change during it is reloaded
+    ScriptedLoader *init_loader = new ScriptedLoader;
+    init_loader->init(file_name);
+    init_loader->_blocked = true;
+    GenerationBuffer init_buffer(std::unique_ptr<ScriptedLoader>(init_loader), 3, true);
+    std::thread initer([&init_buffer]() { ASSERT_EQ(0, init_buffer.init()); });
+    while (!init_loader->_loading) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::ofstream(file_name, std::ios::trunc) << "version: 3\n";
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    init_loader->_blocked = false;
+    initer.join();
+    for (int i = 0; i < 500 && (*init_buffer.get_current())->version != 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(2, (*init_buffer.get_current())->version);
+    std::remove(file_name.c_str());
+}
+
+/* typed conf used by test_ConfManager. */
+struct RecallConf {
+    std::string name;
+    int64_t     quota{100};
+
+    static void declare(::inf::utils::ConfSchema<RecallConf> &schema) {
+        schema.field("name", &RecallConf::name).required();
+        schema.field("quota", &RecallConf::quota).range(1, 10000);
+    }
+};
+
+struct RankConf {
+    int64_t                     top_k{0};
+    double                      threshold{0};
+    bool                        enable{false};
+    std::vector<std::string>    features;
+    RecallConf                  recall;
+
+    static void declare(::inf::utils::ConfSchema<RankConf> &schema) {
+        schema.field("top_k", &RankConf::top_k).required().range(1, 1000);
+        schema.field("threshold", &RankConf::threshold).default_value(0.5);
+        schema.field("enable", &RankConf::enable);
+        schema.field("features", &RankConf::features).check(
+                [](const std::vector<std::string> &features) { return !features.empty(); }, "empty");
+        schema.field("recall", &RankConf::recall).required();
+        schema.check([](const RankConf &conf, std::string *error) {
+            if (conf.recall.quota < conf.top_k) {
+                *error = "recall quota less than top_k";
+                return false;
+            }
+            return true;
+        });
+    }
+};
+
+TEST_F(TestFrame, test_ConfManager) {
+    using namespace ::inf::utils;
+    const std::string file_name = "./conf_manager_test.yaml";
+    auto write_conf = [&file_name](const std::string &content) {
+        {
+            std::ofstream output(file_name + ".tmp", std::ios::trunc);
+            output << content;
+        }
+        std::rename((file_name + ".tmp").c_str(), file_name.c_str());
+    };
+    write_conf("top_k: 50\nenable: true\nfeatures: [age, city]\nrecall: {name: hot, quota: 500}\n");
+    auto &manager = ConfManager::get_instance();
+    ConfHandle<RankConf> handle = manager.add<RankConf>("rank", file_name, false);
+    ASSERT_TRUE(handle);
+    {
+    auto conf = handle.read();
+    ASSERT_EQ(50, conf->top_k);
+    ASSERT_EQ(0.5, conf->threshold);
+    ASSERT_TRUE(conf->enable);
+    ASSERT_EQ(std::vector<std::string>({"age", "city"}), conf->features);
+    ASSERT_EQ("hot", conf->recall.name);
+    ASSERT_EQ(500, conf->recall.quota);
+    }
+
+    // looked up by name and type once, the handle is used per request
+    ASSERT_TRUE(manager.get<RankConf>("rank"));
+    ASSERT_FALSE(manager.get<RecallConf>("rank"));
+    ASSERT_FALSE(manager.get<RankConf>("not_exist"));
+    ASSERT_FALSE(manager.add<RankConf>("rank", file_name, false));
+    ASSERT_FALSE(manager.add<RankConf>("rank_missing", "./not_exist.yaml", false));
+    // a used name is rejected before its file is looked at, whatever the type
+    ASSERT_FALSE(manager.add<RecallConf>("rank", "./not_exist.yaml", true));
+    ASSERT_TRUE(manager.get<RankConf>("rank"));
+    ASSERT_TRUE(manager.add<RankConf>("rank_missing", file_name, false));
+
+    // invalid files are rejected, the last valid conf stays live
+    std::vector<std::pair<std::string, std::string>> invalid_confs = {
+        {"enable: true\nrecall: {name: hot}\n", "missing field : top_k"},
+        {"top_k: abc\nrecall: {name: hot}\n", "field top_k : invalid value"},
+        {"top_k: 5000\nrecall: {name: hot}\n", "field top_k : out of range"},
+        {"top_k: 50\nrecall: {name: hot}\nfeatures: []\n", "field features : empty"},
+        {"top_k: 50\nrecall: {quota: 500}\n", "field recall : missing field : name"},
+        {"top_k: 50\nrecall: {name: hot}\ntopk: 10\n", "unknown field : topk"},
+        {"top_k: 200\nrecall: {name: hot, quota: 100}\n", "recall quota less than top_k"},
+        {"- top_k\n", "not a map"},
+    };
+    for (auto &invalid_conf : invalid_confs) {
+        write_conf(invalid_conf.first);
+        ASSERT_FALSE(manager.reload("rank"));
+        ASSERT_EQ(50, handle.read()->top_k);
+        ASSERT_NE(std::string::npos, manager.get_reload_stats("rank")._last_error.find(invalid_conf.second))
+                << manager.get_reload_stats("rank")._last_error;
+    }
+    ASSERT_EQ(static_cast<int64_t>(invalid_confs.size()), manager.get_reload_stats("rank")._failure_num);
+
+    write_conf("top_k: 20\nthreshold: 0.8\nrecall: {name: new_hot}\n");
+    std::shared_ptr<const RankConf> old_conf = handle.get();
+    ASSERT_TRUE(manager.reload("rank"));
+    ASSERT_EQ(20, handle.read()->top_k);
+    ASSERT_EQ(0.8, handle.read()->threshold);
+    ASSERT_EQ(100, handle.read()->recall.quota);
+    ASSERT_FALSE(handle.read()->enable);
+    ASSERT_EQ(50, old_conf->top_k);
+    std::remove(file_name.c_str());
+}
+
+TEST_F(TestFrame, test_FileWatcher) {
+    auto write_file = [](const std::string &file_name, const std::string &content) {
+        std::ofstream output(file_name, std::ios::trunc);
+        output << content;
+    };
+    auto wait_for = [](const std::function<bool()> &cond) {
+        for (int i = 0; i < 200 && !cond(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return cond();
+    };
+    const std::string file_name = "./file_watcher_test.yaml";
+    write_file(file_name, "version: 1\n");
+
+    auto &watcher = ::inf::utils::FileWatcher::instance();
+    watcher.set_debounce_ms(100);
+    std::atomic<int64_t> changed{0};
+    int64_t watch_id = watcher.watch(file_name, [&changed](const std::string &name) { ++changed; });
+    ASSERT_NE(::inf::utils::INVALID_WATCH_ID, watch_id);
+
+    // touched but unchanged
+    int64_t unchanged_num = watcher.get_unchanged_num();
+    write_file(file_name, "version: 1\n");
+    ASSERT_TRUE(wait_for([&]() { return watcher.get_unchanged_num() > unchanged_num; }));
+    ASSERT_EQ(0, changed);
+
+    // a burst of writes is one reload
+    for (int i = 2; i <= 10; ++i) {
+        write_file(file_name, "version: " + std::to_string(i) + "\n");
+    }
+    ASSERT_TRUE(wait_for([&]() { return changed == 1; }));
+
+    // rename into place
+    write_file(file_name + ".tmp", "version: 11\n");
+    ASSERT_EQ(0, rename((file_name + ".tmp").c_str(), file_name.c_str()));
+    ASSERT_TRUE(wait_for([&]() { return changed == 2; }));
+
+    // above max_hash_size a file is compared by stat, not read
+    watcher.set_max_hash_size(0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    write_file(file_name, "version: 11\n");
+    ASSERT_TRUE(wait_for([&]() { return changed == 3; }));
+    watcher.set_max_hash_size(::inf::utils::DEFAULT_MAX_HASH_SIZE);
+
+    // no callback after unwatch
+    ASSERT_TRUE(watcher.unwatch(watch_id));
+    ASSERT_FALSE(watcher.unwatch(watch_id));
+    write_file(file_name, "version: 12\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    ASSERT_EQ(3, changed);
+
+    // a symlink swap of the dir it points through, as a kubernetes configmap deploys
+    const std::string link_dir = "./file_watcher_link_test";
+    mkdir(link_dir.c_str(), 0755);
+    mkdir((link_dir + "/v1").c_str(), 0755);
+    mkdir((link_dir + "/v2").c_str(), 0755);
+    write_file(link_dir + "/v1/conf.yaml", "version: 1\n");
+    write_file(link_dir + "/v2/conf.yaml", "version: 2\n");
+    ASSERT_EQ(0, symlink("v1", (link_dir + "/..data").c_str()));
+    ASSERT_EQ(0, symlink("..data/conf.yaml", (link_dir + "/conf.yaml").c_str()));
+    std::atomic<int64_t> link_changed{0};
+    int64_t link_watch_id = watcher.watch(link_dir + "/conf.yaml",
+            [&link_changed](const std::string &name) { ++link_changed; });
+    ASSERT_NE(::inf::utils::INVALID_WATCH_ID, link_watch_id);
+    ASSERT_EQ(0, symlink("v2", (link_dir + "/..data_tmp").c_str()));
+    ASSERT_EQ(0, rename((link_dir + "/..data_tmp").c_str(), (link_dir + "/..data").c_str()));
+    ASSERT_TRUE(wait_for([&]() { return link_changed == 1; }));
+    ASSERT_TRUE(watcher.unwatch(link_watch_id));
+    for (auto &name : {"/conf.yaml", "/..data", "/v1/conf.yaml", "/v2/conf.yaml", "/v1", "/v2", ""}) {
+        remove((link_dir + name).c_str());
+    }
+
+    // DoubleData reloads by the shared watcher
+    std::unique_ptr<::inf::utils::YamlLoader> loader(new ::inf::utils::YamlLoader);
+    ASSERT_TRUE(loader->init(file_name));
+    ::inf::utils::DoubleData<YAML::Node, ::inf::utils::YamlLoader> buffer(std::move(loader), 3, true);
+    ASSERT_EQ(0, buffer.init());
+    ASSERT_EQ(12, (*buffer.read())["version"].as<int>());
+    write_file(file_name, "version: 13\n");
+    ASSERT_TRUE(wait_for([&]() { return (*buffer.read())["version"].as<int>() == 13; }));
+    // a broken file keeps the current data
+    write_file(file_name, "version: [13\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    ASSERT_EQ(13, (*buffer.read())["version"].as<int>());
+    remove(file_name.c_str());
+}
+
 // TEST_F(TestDict,  test_parser_manager) {
 //    std::shared_ptr<gcs::parser::MessageParserManager> msg_manager_ptr = std::make_shared<gcs::parser::MessageParserManager>();
 //    /* test none-exist key. */
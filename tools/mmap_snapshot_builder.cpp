@@ -0,0 +1,88 @@
+#include "frame/mmap_snapshot.h"
+#include <fstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * offline builder of mmap snapshots, run it where the dictionaries are produced
+ * and ship the output file, the serving side only maps it.
+ * usage: mmap_snapshot_builder <output> <version> <type>:<name>=<input> ...
+ *   dict:<name>=<input>      lines of "uint64_key\tvalue" -> MmapSnapshot::get_dict(name)
+ *   strings:<name>=<input>   one string per line          -> MmapSnapshot::get_strings(name)
+ *   bytes:<name>=<input>     the whole file               -> MmapSnapshot::get_bytes(name)
+ * e.g.:
+ * mmap_snapshot_builder item.snapshot 20240101 dict:item_title=item_title.tsv
+ */
+
+bool add_input(::inf::utils::MmapSnapshotBuilder *builder, const std::string &arg) {
+    size_t colon = arg.find(':');
+    size_t equal = arg.find('=');
+    if (colon == std::string::npos || equal == std::string::npos || equal < colon) {
+        fprintf(stderr, "invalid input : %s\n", arg.c_str());
+        return false;
+    }
+    std::string type = arg.substr(0, colon);
+    std::string name = arg.substr(colon + 1, equal - colon - 1);
+    std::string file_name = arg.substr(equal + 1);
+    std::ifstream input(file_name, std::ios::binary);
+    if (!input) {
+        fprintf(stderr, "open input failed : %s\n", file_name.c_str());
+        return false;
+    }
+    if (type == "bytes") {
+        std::string bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        return builder->add_bytes(name, bytes);
+    }
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(input, line); ) {
+        lines.emplace_back(std::move(line));
+    }
+    if (type == "strings") {
+        return builder->add_strings(name, lines);
+    }
+    if (type != "dict") {
+        fprintf(stderr, "unknown input type : %s\n", type.c_str());
+        return false;
+    }
+    std::vector<std::pair<uint64_t, std::string>> items;
+    items.reserve(lines.size());
+    for (size_t i = 0; i < lines.size(); ++i) {
+        size_t tab = lines[i].find('\t');
+        char *end = nullptr;
+        uint64_t key = strtoull(lines[i].c_str(), &end, 10);
+        if (tab == std::string::npos || tab == 0 || end != lines[i].c_str() + tab) {
+            fprintf(stderr, "invalid dict line %zu of %s\n", i + 1, file_name.c_str());
+            return false;
+        }
+        items.emplace_back(key, lines[i].substr(tab + 1));
+    }
+    return builder->add_dict(name, std::move(items));
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s <output> <version> <dict|strings|bytes>:<name>=<input> ...\n", argv[0]);
+        return 1;
+    }
+    ::inf::utils::MmapSnapshotBuilder builder;
+    for (int i = 3; i < argc; ++i) {
+        if (!add_input(&builder, argv[i])) {
+            return 1;
+        }
+    }
+    if (!builder.write(argv[1], strtoull(argv[2], nullptr, 10))) {
+        return 1;
+    }
+    // check the output the same way the serving side does
+    ::inf::utils::MmapSnapshot snapshot;
+    if (!snapshot.init(argv[1])) {
+        return 1;
+    }
+    printf("%s : version %lu, %lu bytes\n", argv[1], static_cast<unsigned long>(snapshot.get_version()),
+            static_cast<unsigned long>(snapshot.get_size()));
+    return 0;
+}
@@ -1,14 +1,28 @@
 #pragma once
+#include "logger.h"
 #include <string>
 #include <vector>
 #include <iostream>
 
+/* lines below this level are compiled out, 0: debug, 1: info, 2: err, 3: fatal. */
+#ifndef INF_LOG_COMPILE_LEVEL
+#define INF_LOG_COMPILE_LEVEL 0
+#endif
+
+/* one statement, filtered by level before any formatting, limited per call site. */
+#define INF_LOG(level, tag) \
+    !((level) >= INF_LOG_COMPILE_LEVEL && ::inf::utils::Logger::is_enabled(level)) ? (void)0 : \
+    ::inf::utils::LogVoidify() & ::inf::utils::LogLine(level, __FILE__, __LINE__, __FUNCTION__, tag, \
+            []() -> ::inf::utils::LogRateLimiter& { \
+                static ::inf::utils::LogRateLimiter limiter; \
+                return limiter; \
+            }())
+
 //change to your own logger
 #define USER_PRIVATE_LOG
 #ifdef USER_PRIVATE_LOG
-#define ERR_LOG     std::cout << __FILE__ <<  ":" << __LINE__ << ":" << __FUNCTION__ << "|" << "PRIVATE_LOG_ERR__|"
-#define DEBUG_LOG   std::cout << __FILE__ <<  ":" << __LINE__ << ":" << __FUNCTION__ << "|" << "PRIVATE_LOG_DEBUG|"
-#define INFO_LOG    std::cout << __FILE__ <<  ":" << __LINE__ << ":" << __FUNCTION__ << "|" << "PRIVATE_LOG_INFO_|"
-#define FATAL_LOG   std::cout << __FILE__ <<  ":" << __LINE__ << ":" << __FUNCTION__ << "|" << "PRIVATE_LOG_FATAL|"
+#define ERR_LOG     INF_LOG(::inf::utils::LOG_LEVEL_ERR, "PRIVATE_LOG_ERR__|")
+#define DEBUG_LOG   INF_LOG(::inf::utils::LOG_LEVEL_DEBUG, "PRIVATE_LOG_DEBUG|")
+#define INFO_LOG    INF_LOG(::inf::utils::LOG_LEVEL_INFO, "PRIVATE_LOG_INFO_|")
+#define FATAL_LOG   INF_LOG(::inf::utils::LOG_LEVEL_FATAL, "PRIVATE_LOG_FATAL|")
 #endif
-
@@ -0,0 +1,426 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <sstream>
+#include <functional>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+
+namespace inf {
+namespace utils {
+
+/* log levels. */
+enum LogLevel {
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO  = 1,
+    LOG_LEVEL_ERR   = 2,
+    LOG_LEVEL_FATAL = 3,
+};
+
+/* lines kept by each thread until flushed. */
+const int64_t LOG_RING_SIZE = 1024;
+/* flusher wakes up at least every LOG_FLUSH_INTERVAL_MS. */
+const int64_t LOG_FLUSH_INTERVAL_MS = 10;
+/* lines per second of one call site, 0 means no limit. */
+const int64_t DEFAULT_LOG_RATE_LIMIT = 1000;
+
+/**
+ * @class Logger.
+ * asynchronous logger behind ERR_LOG/INFO_LOG/DEBUG_LOG/FATAL_LOG.
+ * a line is formatted on the calling thread and pushed into the lock free ring
+ * of that thread, a background thread writes the rings out in batches.
+ * when a ring is full the line is dropped by default, instead of blocking the request.
+ * FATAL lines are flushed before the macro returns, so are the lines of a thread
+ * whose ring is already closed, such as from a thread_local destructor.
+ * e.g.:
+ * Logger::instance().set_level(LOG_LEVEL_INFO);
+ * Logger::instance().set_rate_limit(100);
+ * ERR_LOG << "reload failed : " << file_name << std::endl;
+ **/
+class Logger {
+public:
+    using LogSink = std::function<void(const char *data, size_t size)>;
+
+    /* singleton, never destroyed, threads may log during static destruction. */
+    static Logger& instance() {
+        static Logger *instance = new Logger();
+        return *instance;
+    }
+
+    /* whether a level is logged, the only cost of a filtered line. */
+    static bool is_enabled(const LogLevel level) {
+        return level >= instance()._level.load(std::memory_order_relaxed);
+    }
+
+    /**
+    * runtime level, lines below it are skipped before formatting.
+    * @param level
+    */
+    void set_level(const LogLevel level) {
+        _level.store(level, std::memory_order_relaxed);
+    }
+
+    /**
+    * max lines per second of each call site, the rest are counted as suppressed.
+    * @param rate_limit 0 means no limit
+    */
+    void set_rate_limit(const int64_t rate_limit) {
+        _rate_limit.store(std::max<int64_t>(rate_limit, 0), std::memory_order_relaxed);
+    }
+
+    int64_t get_rate_limit() const {
+        return _rate_limit.load(std::memory_order_relaxed);
+    }
+
+    /**
+    * when the ring of a thread is full, drop the line or wait for the flusher.
+    * @param drop_when_full
+    */
+    void set_drop_when_full(const bool drop_when_full) {
+        _drop_when_full.store(drop_when_full, std::memory_order_relaxed);
+    }
+
+    /**
+    * where the lines go, stdout by default.
+    * @param sink called on the flusher thread with a batch of lines
+    */
+    void set_sink(LogSink sink) {
+        std::lock_guard<std::mutex> lock(_flush_lock);
+        _sink = std::move(sink);
+    }
+
+    /**
+    * push a formatted line into the ring of the calling thread.
+    * @param level
+    * @param line ends with '\n'
+    */
+    void append(const LogLevel level, std::string &&line) {
+        Ring *ring = local_ring();
+        if (ring == nullptr) {
+            //the thread is exiting and its ring is closed, write through after the queued lines
+            std::lock_guard<std::mutex> lock(_flush_lock);
+            drain();
+            if (_sink) {
+                _sink(line.data(), line.size());
+            }
+            return;
+        }
+        if (!ring->push(std::move(line))) {
+            bool pushed = false;
+            if (!_drop_when_full.load(std::memory_order_relaxed)) {
+                while (!(pushed = ring->push(std::move(line)))) {
+                    _flush_cond.notify_one();
+                    std::this_thread::yield();
+                }
+            }
+            if (!pushed) {
+                _dropped_num.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (level >= LOG_LEVEL_FATAL) {
+            flush();
+        }
+    }
+
+    /* write every queued line out, returns when done. */
+    void flush() {
+        std::lock_guard<std::mutex> lock(_flush_lock);
+        drain();
+    }
+
+    /* lines dropped because a ring was full. */
+    int64_t get_dropped_num() const {
+        return _dropped_num.load(std::memory_order_relaxed);
+    }
+
+    /* lines skipped by the rate limit. */
+    int64_t get_suppressed_num() const {
+        return _suppressed_num.load(std::memory_order_relaxed);
+    }
+
+    void add_suppressed() {
+        _suppressed_num.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /* the default sink. */
+    static void write_stdout(const char *data, size_t size) {
+        fwrite(data, 1, size, stdout);
+        fflush(stdout);
+    }
+
+private:
+    /* lines of one thread, single producer, consumed under _flush_lock. */
+    class Ring {
+    public:
+        Ring() : _lines(LOG_RING_SIZE) {};
+
+        bool push(std::string &&line) {
+            uint64_t tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _head.load(std::memory_order_acquire) >= static_cast<uint64_t>(LOG_RING_SIZE)) {
+                return false;
+            }
+            _lines[tail % LOG_RING_SIZE] = std::move(line);
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /* append every line to output. */
+        void pop_all(std::string *output) {
+            uint64_t head = _head.load(std::memory_order_relaxed);
+            uint64_t tail = _tail.load(std::memory_order_acquire);
+            for (uint64_t index = head; index < tail; ++index) {
+                std::string &line = _lines[index % LOG_RING_SIZE];
+                output->append(line);
+                line.clear();
+            }
+            _head.store(tail, std::memory_order_release);
+        }
+
+        /* the owner thread exited. */
+        std::atomic<bool>           _closed{false};
+
+    private:
+        std::vector<std::string>    _lines;
+        std::atomic<uint64_t>       _head{0};
+        std::atomic<uint64_t>       _tail{0};
+    };
+    using RingPtr = std::shared_ptr<Ring>;
+
+    /* close the ring when the thread exits, the flusher drains and drops it. */
+    struct RingHolder {
+        RingPtr _ring;
+        ~RingHolder() {
+            is_ring_closed() = true;
+            if (_ring) {
+                _ring->_closed.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    /**
+    * set when the RingHolder of the calling thread is destroyed. a trivial thread_local
+    * is never destroyed, so a later thread_local destructor may still read it.
+    */
+    static bool& is_ring_closed() {
+        thread_local bool closed = false;
+        return closed;
+    }
+
+    /* ctor. */
+    Logger() : _sink(&Logger::write_stdout) {
+        std::thread([this]() { run(); }).detach();
+        std::atexit([]() { Logger::instance().flush(); });
+    }
+
+    /* none copy. */
+    Logger(const Logger &rhs) = delete;
+    Logger &operator=(const Logger &rhs) = delete;
+
+    /* ring of the calling thread, nullptr once it is closed by the thread exit. */
+    Ring* local_ring() {
+        if (is_ring_closed()) {
+            return nullptr;
+        }
+        thread_local RingHolder holder;
+        if (!holder._ring) {
+            holder._ring = std::make_shared<Ring>();
+            std::lock_guard<std::mutex> lock(_ring_lock);
+            _rings.push_back(holder._ring);
+        }
+        return holder._ring.get();
+    }
+
+    /* flusher thread. */
+    void run() {
+        std::unique_lock<std::mutex> lock(_flush_lock);
+        while (true) {
+            _flush_cond.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+            drain();
+        }
+    }
+
+    /* write out every ring in one batch, under _flush_lock. */
+    void drain() {
+        _batch.clear();
+        {
+        std::lock_guard<std::mutex> lock(_ring_lock);
+        //a ring closed before it is drained has nothing left, drop it
+        _rings.erase(std::remove_if(_rings.begin(), _rings.end(), [this](const RingPtr &ring) {
+            bool closed = ring->_closed.load(std::memory_order_acquire);
+            ring->pop_all(&_batch);
+            return closed;
+        }), _rings.end());
+        }
+        if (!_batch.empty() && _sink) {
+            _sink(_batch.data(), _batch.size());
+        }
+    }
+
+    /* runtime level. */
+    std::atomic<int>            _level{LOG_LEVEL_DEBUG};
+
+    /* lines per second of each call site. */
+    std::atomic<int64_t>        _rate_limit{DEFAULT_LOG_RATE_LIMIT};
+
+    /* drop or wait when a ring is full. */
+    std::atomic<bool>           _drop_when_full{true};
+
+    /* rings of every living thread. */
+    std::mutex                  _ring_lock;
+    std::vector<RingPtr>        _rings;
+
+    /* one consumer at a time. */
+    std::mutex                  _flush_lock;
+    std::condition_variable     _flush_cond;
+    std::string                 _batch;
+    LogSink                     _sink;
+
+    /* counters. */
+    std::atomic<int64_t>        _dropped_num{0};
+    std::atomic<int64_t>        _suppressed_num{0};
+};
+
+/**
+ * @class LogRateLimiter.
+ * per call site limit, one static instance for each log statement.
+ **/
+class LogRateLimiter {
+public:
+    /**
+    * whether the site may log now.
+    * @return suppressed num since the last allowed line, -1 if not allowed
+    */
+    int64_t allow() {
+        int64_t rate_limit = Logger::instance().get_rate_limit();
+        if (rate_limit <= 0) {
+            return _suppressed_num.exchange(0, std::memory_order_relaxed);
+        }
+        int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t window = _second.load(std::memory_order_relaxed);
+        if (window != second && _second.compare_exchange_strong(window, second,
+                std::memory_order_relaxed)) {
+            _count.store(0, std::memory_order_relaxed);
+        }
+        if (_count.fetch_add(1, std::memory_order_relaxed) < rate_limit) {
+            return _suppressed_num.exchange(0, std::memory_order_relaxed);
+        }
+        _suppressed_num.fetch_add(1, std::memory_order_relaxed);
+        Logger::instance().add_suppressed();
+        return -1;
+    }
+
+private:
+    std::atomic<int64_t> _second{0};
+    std::atomic<int64_t> _count{0};
+    std::atomic<int64_t> _suppressed_num{0};
+};
+
+/**
+ * @class LogLine.
+ * one log statement, formatted into a thread local stream,
+ * handed to the Logger when the statement ends.
+ **/
+class LogLine {
+public:
+    /* ctor. */
+    LogLine(const LogLevel level, const char *file, const int line, const char *function,
+            const char *tag, LogRateLimiter &limiter) : _level(level) {
+        int64_t suppressed_num = limiter.allow();
+        if (suppressed_num < 0) {
+            return;
+        }
+        _stream = &local_stream();
+        *_stream << file << ":" << line << ":" << function << "|" << tag;
+        if (suppressed_num > 0) {
+            *_stream << "(suppressed " << suppressed_num << ")|";
+        }
+    }
+
+    /* dtor, the statement ends. */
+    ~LogLine() {
+        if (_stream == nullptr) {
+            return;
+        }
+        std::string line = _stream->str();
+        _stream->str(std::string());
+        _stream->clear();
+        local_depth() -= 1;
+        if (line.empty() || line.back() != '\n') {
+            line.push_back('\n');
+        }
+        Logger::instance().append(_level, std::move(line));
+    }
+
+    template <typename DataType>
+    LogLine& operator<<(const DataType &data) {
+        if (_stream != nullptr) {
+            *_stream << data;
+        }
+        return *this;
+    }
+
+    /* std::endl and friends, the line ends with the statement. */
+    LogLine& operator<<(std::ostream& (*manipulator)(std::ostream&)) {
+        if (_stream != nullptr && manipulator != static_cast<std::ostream& (*)(std::ostream&)>(std::endl)) {
+            *_stream << manipulator;
+        }
+        return *this;
+    }
+
+private:
+    /* none copy. */
+    LogLine(const LogLine &rhs) = delete;
+    LogLine &operator=(const LogLine &rhs) = delete;
+
+    /* reused stream of the thread, marks it closed when destroyed by the thread exit. */
+    struct StreamHolder {
+        std::ostringstream _stream;
+        ~StreamHolder() {
+            is_stream_closed() = true;
+        }
+    };
+
+    /**
+    * reused stream of the thread, a line logged while formatting another, or from
+    * a thread_local destructor after the stream is gone, gets its own.
+    */
+    std::ostringstream& local_stream() {
+        if (local_depth()++ == 0 && !is_stream_closed()) {
+            thread_local StreamHolder holder;
+            return holder._stream;
+        }
+        _nested_stream.reset(new std::ostringstream());
+        return *_nested_stream;
+    }
+
+    static bool& is_stream_closed() {
+        thread_local bool closed = false;
+        return closed;
+    }
+
+    static int& local_depth() {
+        thread_local int depth = 0;
+        return depth;
+    }
+
+    LogLevel                            _level;
+    std::ostringstream                  *_stream{nullptr};
+    std::unique_ptr<std::ostringstream> _nested_stream;
+};
+
+/* turns the LogLine expression into void for the ?: in the log macros. */
+struct LogVoidify {
+    void operator&(const LogLine &) {}
+};
+
+} // end namespace utils
+} // end namespace inf